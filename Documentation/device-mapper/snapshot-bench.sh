@@ -0,0 +1,95 @@
+#!/bin/sh
+#
+# snapshot-bench.sh: origin write throughput with 0, 1, 4 and 16 snapshots
+#
+#	snapshot-bench.sh <origin-dev> <cow-dev> [megabytes] [chunk-sectors]
+#
+# Each run sets up a snapshot-origin on <origin-dev> with that many
+# persistent snapshots, their COW areas being equal slices of <cow-dev>,
+# writes <megabytes> (default 256) sequentially through the origin and
+# reports MB/s, including the sync.  With snapshots every chunk written
+# is copied out first, to all of them at once.
+#
+# EVERYTHING ON BOTH DEVICES IS DESTROYED.  Needs dmsetup, blockdev,
+# dd and awk; run as root.
+
+set -e
+
+ORIGIN=$1
+COW=$2
+MB=${3:-256}
+CHUNK=${4:-16}
+NAME=snapbench
+
+if [ ! -b "$ORIGIN" ] || [ ! -b "$COW" ]; then
+	echo "usage: $0 <origin-dev> <cow-dev> [megabytes] [chunk-sectors]" >&2
+	exit 1
+fi
+
+ORIGIN_SIZE=`blockdev --getsize $ORIGIN`
+COW_SIZE=`blockdev --getsize $COW`
+
+if [ `expr $MB \* 2048` -gt $ORIGIN_SIZE ]; then
+	echo "$ORIGIN is smaller than $MB MB" >&2
+	exit 1
+fi
+
+teardown()
+{
+	dmsetup remove $NAME-origin 2>/dev/null || true
+	i=0
+	while [ $i -lt 16 ]; do
+		dmsetup remove $NAME-snap$i 2>/dev/null || true
+		dmsetup remove $NAME-cow$i 2>/dev/null || true
+		i=`expr $i + 1`
+	done
+}
+
+now()
+{
+	date +%s.%N
+}
+
+run()
+{
+	nr=$1
+	teardown
+
+	if [ $nr -gt 0 ]; then
+		slice=`expr $COW_SIZE / $nr`
+		# every chunk of the write needs one, plus metadata
+		if [ `expr $slice / 2048` -le `expr $MB + $MB / 8` ]; then
+			echo "$COW is too small for $nr snapshots of $MB MB" >&2
+			exit 1
+		fi
+	fi
+
+	i=0
+	while [ $i -lt $nr ]; do
+		echo "0 $slice linear $COW `expr $i \* $slice`" | \
+			dmsetup create $NAME-cow$i
+		# a zeroed header makes a new persistent store
+		dd if=/dev/zero of=/dev/mapper/$NAME-cow$i bs=4096 count=1 \
+			2>/dev/null
+		echo "0 $ORIGIN_SIZE snapshot $ORIGIN /dev/mapper/$NAME-cow$i P $CHUNK" | \
+			dmsetup create $NAME-snap$i
+		i=`expr $i + 1`
+	done
+	echo "0 $ORIGIN_SIZE snapshot-origin $ORIGIN" | dmsetup create $NAME-origin
+
+	sync
+	start=`now`
+	dd if=/dev/zero of=/dev/mapper/$NAME-origin bs=1M count=$MB 2>/dev/null
+	sync
+	end=`now`
+
+	echo "$nr $start $end" | awk -v mb=$MB \
+		'{ printf "%2d snapshots: %8.1f MB/s\n", $1, mb / ($3 - $2) }'
+}
+
+trap teardown EXIT
+
+echo "$MB MB through the origin, $CHUNK sector chunks"
+for nr in 0 1 4 16; do
+	run $nr
+done
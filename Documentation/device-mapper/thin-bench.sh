@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# thin-bench.sh: thin device write throughput with 0, 1, 4 and 16 snapshots
+#
+#	thin-bench.sh <metadata-dev> <data-dev> [megabytes] [block-sectors]
+#
+# Each run sets up a fresh pool and a thin origin, fills <megabytes>
+# (default 256) of the origin, takes that many thin snapshots of it,
+# then rewrites the same range through the origin and reports MB/s,
+# including the sync.  With snapshots every block rewritten is
+# shared, so it is copied before it is written; the copy is the same
+# whatever the number of snapshots.  The snapshot-bench.sh figures for
+# the snapshot target are the ones to compare with.
+#
+# EVERYTHING ON BOTH DEVICES IS DESTROYED.  Needs dmsetup, blockdev,
+# dd and awk; run as root.
+
+set -e
+
+META=$1
+DATA=$2
+MB=${3:-256}
+BLOCK=${4:-128}
+NAME=thinbench
+
+if [ ! -b "$META" ] || [ ! -b "$DATA" ]; then
+	echo "usage: $0 <metadata-dev> <data-dev> [megabytes] [block-sectors]" >&2
+	exit 1
+fi
+
+DATA_SIZE=`blockdev --getsize $DATA`
+SIZE=`expr $MB \* 2048`
+
+# the fill, plus one copy of every block for the rewrite
+if [ `expr $SIZE \* 2` -gt $DATA_SIZE ]; then
+	echo "$DATA is smaller than `expr $MB \* 2` MB" >&2
+	exit 1
+fi
+
+teardown()
+{
+	i=0
+	while [ $i -lt 16 ]; do
+		dmsetup remove $NAME-snap$i 2>/dev/null || true
+		i=`expr $i + 1`
+	done
+	dmsetup remove $NAME-origin 2>/dev/null || true
+	dmsetup remove $NAME-pool 2>/dev/null || true
+}
+
+now()
+{
+	date +%s.%N
+}
+
+run()
+{
+	nr=$1
+	teardown
+
+	# a zeroed header makes a new pool
+	dd if=/dev/zero of=$META bs=4096 count=1 2>/dev/null
+	echo "0 $DATA_SIZE thin-pool $META $DATA $BLOCK" | \
+		dmsetup create $NAME-pool
+	echo "0 $SIZE thin $META 0" | dmsetup create $NAME-origin
+	dd if=/dev/zero of=/dev/mapper/$NAME-origin bs=1M count=$MB 2>/dev/null
+	sync
+
+	dmsetup suspend $NAME-origin
+	i=0
+	while [ $i -lt $nr ]; do
+		echo "0 $SIZE thin $META `expr $i + 1` 0" | \
+			dmsetup create $NAME-snap$i
+		i=`expr $i + 1`
+	done
+	dmsetup resume $NAME-origin
+
+	start=`now`
+	dd if=/dev/zero of=/dev/mapper/$NAME-origin bs=1M count=$MB 2>/dev/null
+	sync
+	end=`now`
+
+	echo "$nr $start $end" | awk -v mb=$MB \
+		'{ printf "%2d snapshots: %8.1f MB/s\n", $1, mb / ($3 - $2) }'
+}
+
+trap teardown EXIT
+
+echo "$MB MB rewritten through a thin origin, $BLOCK sector blocks"
+for nr in 0 1 4 16; do
+	run $nr
+done
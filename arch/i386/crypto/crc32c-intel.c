@@ -0,0 +1,99 @@
+/*
+ * Cryptographic API.
+ *
+ * CRC32C (Castagnoli) with the crc32 instruction of SSE4.2.
+ *
+ * The instruction does the whole CRC step for 1, 4 or (on x86_64) 8
+ * bytes of data, with the same bit order as __crc32c_le().  It is
+ * not an SSE instruction in the sense of using the xmm registers,
+ * so there is no FPU state to save.  The module only loads on CPUs
+ * which have it; crypto/crc32c.c is the generic version.
+ *
+ * This file also builds the x86_64 module.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+#include <linux/init.h>
+#include <linux/module.h>
+#include <asm/cpufeature.h>
+#include <asm/processor.h>
+#include <asm/msr.h>
+#include <crypto/crc32c.h>
+
+/*
+ * The assembler may not know the instruction yet: crc32b %cl,%esi and
+ * crc32l %ecx,%esi (crc32q %rcx,%rsi with the REX prefix).
+ */
+#define CRC32B_CL_ESI	".byte 0xf2, 0x0f, 0x38, 0xf0, 0xf1"
+#ifdef CONFIG_X86_64
+#define CRC32W_CX_SI	".byte 0xf2, 0x48, 0x0f, 0x38, 0xf1, 0xf1"
+
+/* x86_64 does not keep the CPUID 1 %ecx feature flags */
+#define cpu_has_xmm4_2	(cpuid_ecx(1) & (1 << 20))
+#else
+#define CRC32W_CX_SI	".byte 0xf2, 0x0f, 0x38, 0xf1, 0xf1"
+#endif
+
+static u32 crc32c_intel_le_hw_byte(u32 crc, const u8 *data, unsigned int len)
+{
+	while (len--) {
+		__asm__ __volatile__(CRC32B_CL_ESI
+				     : "=S" (crc)
+				     : "0" (crc), "c" (*data));
+		data++;
+	}
+
+	return crc;
+}
+
+/* a word at a time, unsigned long being the word of the crc32 used */
+static u32 crc32c_intel_le_hw(u32 crc, const u8 *data, unsigned int len)
+{
+	const unsigned long *p = (const unsigned long *)data;
+	unsigned int words = len / sizeof(unsigned long);
+
+	while (words--) {
+		__asm__ __volatile__(CRC32W_CX_SI
+				     : "=S" (crc)
+				     : "0" (crc), "c" (*p));
+		p++;
+	}
+
+	return crc32c_intel_le_hw_byte(crc, (const u8 *)p,
+				       len % sizeof(unsigned long));
+}
+
+static void chksum_update(void *ctx, const u8 *data, unsigned int length)
+{
+	struct chksum_ctx *mctx = ctx;
+
+	mctx->crc = crc32c_intel_le_hw(mctx->crc, data, length);
+}
+
+static struct crypto_alg alg =
+	CRC32C_ALG(alg, "crc32c-intel", 200, chksum_update);
+
+static int __init init(void)
+{
+	if (!cpu_has_xmm4_2)
+		return -ENODEV;
+
+	return crypto_register_alg(&alg);
+}
+
+static void __exit fini(void)
+{
+	crypto_unregister_alg(&alg);
+}
+
+module_init(init);
+module_exit(fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("CRC32c (Castagnoli), SSE4.2 crc32 instruction");
+MODULE_ALIAS("crc32c");
+MODULE_ALIAS("crc32c-intel");
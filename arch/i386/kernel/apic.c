@@ -26,6 +26,7 @@
 #include <linux/mc146818rtc.h>
 #include <linux/kernel_stat.h>
 #include <linux/sysdev.h>
+#include <linux/hrtimer.h>
 
 #include <asm/atomic.h>
 #include <asm/smp.h>
@@ -35,6 +36,7 @@
 #include <asm/desc.h>
 #include <asm/arch_hooks.h>
 #include <asm/hpet.h>
+#include <asm/div64.h>
 
 #include <mach_apic.h>
 
@@ -67,6 +69,10 @@ static DEFINE_PER_CPU(int, prof_multiplier) = 1;
 static DEFINE_PER_CPU(int, prof_old_multiplier) = 1;
 static DEFINE_PER_CPU(int, prof_counter) = 1;
 
+/* Is the APIC timer of this cpu in one-shot mode, driving hrtimers? */
+static DEFINE_PER_CPU(int, lapic_oneshot);
+static int lapic_oneshot_enabled;
+
 static int enabled_via_apicbase;
 
 void enable_NMI_through_LVT0 (void * dummy)
@@ -851,6 +857,55 @@ void __setup_APIC_LVTT(unsigned int clocks)
 	apic_write_around(APIC_TMICT, clocks/APIC_DIVISOR);
 }
 
+static unsigned int calibration_result;
+
+/*
+ * One-shot mode: calibration_result is the number of bus clocks per
+ * tick, which gives us the conversion from nanoseconds.
+ */
+static void lapic_next_event(unsigned long delta_ns)
+{
+	u64 clocks = (u64)delta_ns * calibration_result;
+
+	do_div(clocks, TICK_NSEC * APIC_DIVISOR);
+	if (!clocks)
+		clocks = 1;
+
+	apic_write_around(APIC_LVTT,
+			SET_APIC_TIMER_BASE(APIC_TIMER_BASE_DIV) |
+			LOCAL_TIMER_VECTOR);
+	apic_write_around(APIC_TMICT, (unsigned long)clocks);
+}
+
+static struct clock_event_device lapic_clockevent = {
+	.name		= "lapic",
+	.min_delta_ns	= 1000,
+	.set_next_event	= lapic_next_event,
+};
+
+/*
+ * Switch this cpu's APIC timer from periodic to one-shot mode and
+ * let it drive the hrtimers.  Called with irqs off, after the periodic
+ * timer has been set up, so we stay periodic if hrtimers say no.
+ */
+static void setup_APIC_oneshot(void)
+{
+	if (!lapic_clockevent.max_delta_ns) {
+		/* The initial count register is 32 bits */
+		u64 max = (u64)0x7fffffff * APIC_DIVISOR * TICK_NSEC;
+
+		do_div(max, calibration_result);
+		if (max > NSEC_PER_SEC)
+			max = NSEC_PER_SEC;
+		lapic_clockevent.max_delta_ns = (unsigned long)max;
+	}
+
+	if (hrtimer_register_event(&lapic_clockevent))
+		return;
+	__get_cpu_var(lapic_oneshot) = 1;
+	lapic_oneshot_enabled = 1;
+}
+
 static void setup_APIC_timer(unsigned int clocks)
 {
 	unsigned long flags;
@@ -944,8 +999,6 @@ int __init calibrate_APIC_clock(void)
 	return result;
 }
 
-static unsigned int calibration_result;
-
 void __init setup_boot_APIC_clock(void)
 {
 	printk("Using local APIC timer interrupts.\n");
@@ -958,6 +1011,7 @@ void __init setup_boot_APIC_clock(void)
 	 * Now set up the timer for real.
 	 */
 	setup_APIC_timer(calibration_result);
+	setup_APIC_oneshot();
 
 	local_irq_enable();
 }
@@ -966,6 +1020,7 @@ void __init setup_secondary_APIC_clock(void)
 {
 	local_irq_disable(); /* FIXME: Do we need this? --RR */
 	setup_APIC_timer(calibration_result);
+	setup_APIC_oneshot();
 	local_irq_enable();
 }
 
@@ -1005,6 +1060,10 @@ int setup_profiling_timer(unsigned int multiplier)
 	if ( (!multiplier) || (calibration_result/multiplier < 500))
 		return -EINVAL;
 
+	/* The one-shot APIC timer ticks at HZ, no matter what. */
+	if (lapic_oneshot_enabled && multiplier != 1)
+		return -EINVAL;
+
 	/* 
 	 * Set the new multiplier for each CPU. CPUs don't start using the
 	 * new values until the next timer interrupt in which they do process
@@ -1046,7 +1105,8 @@ inline void smp_local_timer_interrupt(struct pt_regs * regs)
 		 */
 		per_cpu(prof_counter, cpu) = per_cpu(prof_multiplier, cpu);
 		if (per_cpu(prof_counter, cpu) !=
-					per_cpu(prof_old_multiplier, cpu)) {
+					per_cpu(prof_old_multiplier, cpu) &&
+				!per_cpu(lapic_oneshot, cpu)) {
 			__setup_APIC_LVTT(
 					calibration_result/
 					per_cpu(prof_counter, cpu));
@@ -1083,6 +1143,7 @@ inline void smp_local_timer_interrupt(struct pt_regs * regs)
 void smp_apic_timer_interrupt(struct pt_regs regs)
 {
 	int cpu = smp_processor_id();
+	int ticks = 1;
 
 	/*
 	 * the NMI deadlock-detector uses this.
@@ -1100,7 +1161,15 @@ void smp_apic_timer_interrupt(struct pt_regs regs)
 	 * interrupt lock, which is the WrongThing (tm) to do.
 	 */
 	irq_enter();
-	smp_local_timer_interrupt(&regs);
+	/*
+	 * In one-shot mode the local tick is only due every so many
+	 * hrtimer events, and more than one may have come due when the
+	 * event was late; account each of them, as jiffies are.
+	 */
+	if (per_cpu(lapic_oneshot, cpu))
+		ticks = hrtimer_interrupt();
+	while (ticks-- > 0)
+		smp_local_timer_interrupt(&regs);
 	irq_exit();
 }
 
@@ -37,6 +37,7 @@
 #include <linux/module.h>
 #include <linux/kallsyms.h>
 #include <linux/ptrace.h>
+#include <linux/hrtimer.h>
 
 #include <asm/uaccess.h>
 #include <asm/pgtable.h>
@@ -149,8 +150,10 @@ void cpu_idle (void)
 				idle = default_idle;
 
 			irq_stat[smp_processor_id()].idle_timestamp = jiffies;
+			hrtimer_stop_tick();
 			idle();
 		}
+		hrtimer_restart_tick();
 		schedule();
 	}
 }
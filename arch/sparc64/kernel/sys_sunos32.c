@@ -694,6 +694,7 @@ static int sunos_nfs_mount(char *dir_name, int linux_flags, void *data)
 	linux_nfs_mount.wsize    = get_default (sunos_mount.wsize, 8192);
 	linux_nfs_mount.timeo    = get_default (sunos_mount.timeo, 10);
 	linux_nfs_mount.retrans  = sunos_mount.retrans;
+	linux_nfs_mount.nconnect = 0;
 	
 	linux_nfs_mount.acregmin = sunos_mount.acregmin;
 	linux_nfs_mount.acregmax = sunos_mount.acregmax;
@@ -0,0 +1,61 @@
+/* 
+ * Cryptographic API.
+ *
+ * AES Cipher Algorithm, x86_64 assembler version.
+ *
+ * The key schedule and lookup tables are those of crypto/aes.c; the
+ * block functions are in aes-x86_64-asm.S and use the tables directly.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/types.h>
+#include <linux/crypto.h>
+#include <crypto/aes.h>
+
+/* called through cia_encrypt/cia_decrypt: the arguments are in registers */
+void aes_enc_blk(void *ctx, u8 *dst, const u8 *src);
+void aes_dec_blk(void *ctx, u8 *dst, const u8 *src);
+
+static struct crypto_alg aes_alg = {
+	.cra_name		=	"aes",
+	.cra_driver_name	=	"aes-x86_64",
+	.cra_priority		=	200,
+	.cra_flags		=	CRYPTO_ALG_TYPE_CIPHER,
+	.cra_blocksize		=	AES_BLOCK_SIZE,
+	.cra_ctxsize		=	sizeof(struct aes_ctx),
+	.cra_module		=	THIS_MODULE,
+	.cra_list		=	LIST_HEAD_INIT(aes_alg.cra_list),
+	.cra_u			=	{
+		.cipher = {
+			.cia_min_keysize	=	AES_MIN_KEY_SIZE,
+			.cia_max_keysize	=	AES_MAX_KEY_SIZE,
+			.cia_setkey		=	crypto_aes_set_key,
+			.cia_encrypt		=	aes_enc_blk,
+			.cia_decrypt		=	aes_dec_blk
+		}
+	}
+};
+
+static int __init aes_init(void)
+{
+	return crypto_register_alg(&aes_alg);
+}
+
+static void __exit aes_fini(void)
+{
+	crypto_unregister_alg(&aes_alg);
+}
+
+module_init(aes_init);
+module_exit(aes_fini);
+
+MODULE_DESCRIPTION("Rijndael (AES) Cipher Algorithm, x86_64 asm optimized");
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_ALIAS("aes");
+MODULE_ALIAS("aes-x86_64");
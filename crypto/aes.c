@@ -58,11 +58,7 @@
 #include <linux/errno.h>
 #include <linux/crypto.h>
 #include <asm/byteorder.h>
-
-#define AES_MIN_KEY_SIZE	16
-#define AES_MAX_KEY_SIZE	32
-
-#define AES_BLOCK_SIZE		16
+#include <crypto/aes.h>
 
 static inline 
 u32 generic_rotr32 (const u32 x, const unsigned bits)
@@ -93,12 +89,6 @@ byte(const u32 x, const unsigned n)
 #define u32_in(x) le32_to_cpu(*(const u32 *)(x))
 #define u32_out(to, from) (*(u32 *)(to) = cpu_to_le32(from))
 
-struct aes_ctx {
-	int key_length;
-	u32 E[60];
-	u32 D[60];
-};
-
 #define E_KEY ctx->E
 #define D_KEY ctx->D
 
@@ -107,11 +97,18 @@ static u8 log_tab[256];
 static u8 sbx_tab[256];
 static u8 isb_tab[256];
 static u32 rco_tab[10];
-static u32 ft_tab[4][256];
-static u32 it_tab[4][256];
 
-static u32 fl_tab[4][256];
-static u32 il_tab[4][256];
+/* also used by the assembler versions, see <crypto/aes.h> */
+u32 crypto_ft_tab[4][256];
+u32 crypto_it_tab[4][256];
+
+u32 crypto_fl_tab[4][256];
+u32 crypto_il_tab[4][256];
+
+EXPORT_SYMBOL_GPL(crypto_ft_tab);
+EXPORT_SYMBOL_GPL(crypto_it_tab);
+EXPORT_SYMBOL_GPL(crypto_fl_tab);
+EXPORT_SYMBOL_GPL(crypto_il_tab);
 
 static inline u8
 f_mult (u8 a, u8 b)
@@ -124,34 +121,34 @@ f_mult (u8 a, u8 b)
 #define ff_mult(a,b)    (a && b ? f_mult(a, b) : 0)
 
 #define f_rn(bo, bi, n, k)					\
-    bo[n] =  ft_tab[0][byte(bi[n],0)] ^				\
-             ft_tab[1][byte(bi[(n + 1) & 3],1)] ^		\
-             ft_tab[2][byte(bi[(n + 2) & 3],2)] ^		\
-             ft_tab[3][byte(bi[(n + 3) & 3],3)] ^ *(k + n)
+    bo[n] =  crypto_ft_tab[0][byte(bi[n],0)] ^			\
+             crypto_ft_tab[1][byte(bi[(n + 1) & 3],1)] ^	\
+             crypto_ft_tab[2][byte(bi[(n + 2) & 3],2)] ^	\
+             crypto_ft_tab[3][byte(bi[(n + 3) & 3],3)] ^ *(k + n)
 
 #define i_rn(bo, bi, n, k)					\
-    bo[n] =  it_tab[0][byte(bi[n],0)] ^				\
-             it_tab[1][byte(bi[(n + 3) & 3],1)] ^		\
-             it_tab[2][byte(bi[(n + 2) & 3],2)] ^		\
-             it_tab[3][byte(bi[(n + 1) & 3],3)] ^ *(k + n)
+    bo[n] =  crypto_it_tab[0][byte(bi[n],0)] ^			\
+             crypto_it_tab[1][byte(bi[(n + 3) & 3],1)] ^	\
+             crypto_it_tab[2][byte(bi[(n + 2) & 3],2)] ^	\
+             crypto_it_tab[3][byte(bi[(n + 1) & 3],3)] ^ *(k + n)
 
 #define ls_box(x)				\
-    ( fl_tab[0][byte(x, 0)] ^			\
-      fl_tab[1][byte(x, 1)] ^			\
-      fl_tab[2][byte(x, 2)] ^			\
-      fl_tab[3][byte(x, 3)] )
+    ( crypto_fl_tab[0][byte(x, 0)] ^		\
+      crypto_fl_tab[1][byte(x, 1)] ^		\
+      crypto_fl_tab[2][byte(x, 2)] ^		\
+      crypto_fl_tab[3][byte(x, 3)] )
 
 #define f_rl(bo, bi, n, k)					\
-    bo[n] =  fl_tab[0][byte(bi[n],0)] ^				\
-             fl_tab[1][byte(bi[(n + 1) & 3],1)] ^		\
-             fl_tab[2][byte(bi[(n + 2) & 3],2)] ^		\
-             fl_tab[3][byte(bi[(n + 3) & 3],3)] ^ *(k + n)
+    bo[n] =  crypto_fl_tab[0][byte(bi[n],0)] ^			\
+             crypto_fl_tab[1][byte(bi[(n + 1) & 3],1)] ^	\
+             crypto_fl_tab[2][byte(bi[(n + 2) & 3],2)] ^	\
+             crypto_fl_tab[3][byte(bi[(n + 3) & 3],3)] ^ *(k + n)
 
 #define i_rl(bo, bi, n, k)					\
-    bo[n] =  il_tab[0][byte(bi[n],0)] ^				\
-             il_tab[1][byte(bi[(n + 3) & 3],1)] ^		\
-             il_tab[2][byte(bi[(n + 2) & 3],2)] ^		\
-             il_tab[3][byte(bi[(n + 1) & 3],3)] ^ *(k + n)
+    bo[n] =  crypto_il_tab[0][byte(bi[n],0)] ^			\
+             crypto_il_tab[1][byte(bi[(n + 3) & 3],1)] ^	\
+             crypto_il_tab[2][byte(bi[(n + 2) & 3],2)] ^	\
+             crypto_il_tab[3][byte(bi[(n + 1) & 3],3)] ^ *(k + n)
 
 static void
 gen_tabs (void)
@@ -190,37 +187,37 @@ gen_tabs (void)
 		p = sbx_tab[i];
 
 		t = p;
-		fl_tab[0][i] = t;
-		fl_tab[1][i] = rotl (t, 8);
-		fl_tab[2][i] = rotl (t, 16);
-		fl_tab[3][i] = rotl (t, 24);
+		crypto_fl_tab[0][i] = t;
+		crypto_fl_tab[1][i] = rotl (t, 8);
+		crypto_fl_tab[2][i] = rotl (t, 16);
+		crypto_fl_tab[3][i] = rotl (t, 24);
 
 		t = ((u32) ff_mult (2, p)) |
 		    ((u32) p << 8) |
 		    ((u32) p << 16) | ((u32) ff_mult (3, p) << 24);
 
-		ft_tab[0][i] = t;
-		ft_tab[1][i] = rotl (t, 8);
-		ft_tab[2][i] = rotl (t, 16);
-		ft_tab[3][i] = rotl (t, 24);
+		crypto_ft_tab[0][i] = t;
+		crypto_ft_tab[1][i] = rotl (t, 8);
+		crypto_ft_tab[2][i] = rotl (t, 16);
+		crypto_ft_tab[3][i] = rotl (t, 24);
 
 		p = isb_tab[i];
 
 		t = p;
-		il_tab[0][i] = t;
-		il_tab[1][i] = rotl (t, 8);
-		il_tab[2][i] = rotl (t, 16);
-		il_tab[3][i] = rotl (t, 24);
+		crypto_il_tab[0][i] = t;
+		crypto_il_tab[1][i] = rotl (t, 8);
+		crypto_il_tab[2][i] = rotl (t, 16);
+		crypto_il_tab[3][i] = rotl (t, 24);
 
 		t = ((u32) ff_mult (14, p)) |
 		    ((u32) ff_mult (9, p) << 8) |
 		    ((u32) ff_mult (13, p) << 16) |
 		    ((u32) ff_mult (11, p) << 24);
 
-		it_tab[0][i] = t;
-		it_tab[1][i] = rotl (t, 8);
-		it_tab[2][i] = rotl (t, 16);
-		it_tab[3][i] = rotl (t, 24);
+		crypto_it_tab[0][i] = t;
+		crypto_it_tab[1][i] = rotl (t, 8);
+		crypto_it_tab[2][i] = rotl (t, 16);
+		crypto_it_tab[3][i] = rotl (t, 24);
 	}
 }
 
@@ -269,8 +266,8 @@ gen_tabs (void)
     t ^= E_KEY[8 * i + 7]; E_KEY[8 * i + 15] = t;   \
 }
 
-static int
-aes_set_key(void *ctx_arg, const u8 *in_key, unsigned int key_len, u32 *flags)
+int crypto_aes_set_key(void *ctx_arg, const u8 *in_key, unsigned int key_len,
+		       u32 *flags)
 {
 	struct aes_ctx *ctx = ctx_arg;
 	u32 i, t, u, v, w;
@@ -323,6 +320,8 @@ aes_set_key(void *ctx_arg, const u8 *in_key, unsigned int key_len, u32 *flags)
 	return 0;
 }
 
+EXPORT_SYMBOL_GPL(crypto_aes_set_key);
+
 /* encrypt a block of text */
 
 #define f_nround(bo, bi, k) \
@@ -433,6 +432,8 @@ static void aes_decrypt(void *ctx_arg, u8 *out, const u8 *in)
 
 static struct crypto_alg aes_alg = {
 	.cra_name		=	"aes",
+	.cra_driver_name	=	"aes-generic",
+	.cra_priority		=	100,
 	.cra_flags		=	CRYPTO_ALG_TYPE_CIPHER,
 	.cra_blocksize		=	AES_BLOCK_SIZE,
 	.cra_ctxsize		=	sizeof(struct aes_ctx),
@@ -442,7 +443,7 @@ static struct crypto_alg aes_alg = {
 		.cipher = {
 			.cia_min_keysize	=	AES_MIN_KEY_SIZE,
 			.cia_max_keysize	=	AES_MAX_KEY_SIZE,
-			.cia_setkey	   	= 	aes_set_key,
+			.cia_setkey	   	= 	crypto_aes_set_key,
 			.cia_encrypt	 	=	aes_encrypt,
 			.cia_decrypt	  	=	aes_decrypt
 		}
@@ -460,9 +461,14 @@ static void __exit aes_fini(void)
 	crypto_unregister_alg(&aes_alg);
 }
 
-module_init(aes_init);
+/*
+ * The assembler versions use the tables too, and come earlier in the
+ * link order when built in.
+ */
+subsys_initcall(aes_init);
 module_exit(aes_fini);
 
 MODULE_DESCRIPTION("Rijndael (AES) Cipher Algorithm");
 MODULE_LICENSE("Dual BSD/GPL");
 
+MODULE_ALIAS("aes-generic");
@@ -36,6 +36,7 @@ static inline void crypto_alg_put(struct crypto_alg *alg)
 struct crypto_alg *crypto_alg_lookup(const char *name)
 {
 	struct crypto_alg *q, *alg = NULL;
+	int best = -1;
 
 	if (!name)
 		return NULL;
@@ -43,11 +44,23 @@ struct crypto_alg *crypto_alg_lookup(const char *name)
 	down_read(&crypto_alg_sem);
 	
 	list_for_each_entry(q, &crypto_alg_list, cra_list) {
-		if (!(strcmp(q->cra_name, name))) {
-			if (crypto_alg_get(q))
-				alg = q;
+		int exact, fuzzy;
+
+		exact = !strcmp(q->cra_driver_name, name);
+		fuzzy = !strcmp(q->cra_name, name);
+		if (!exact && !(fuzzy && q->cra_priority > best))
+			continue;
+
+		if (!crypto_alg_get(q))
+			continue;
+
+		best = q->cra_priority;
+		if (alg)
+			crypto_alg_put(alg);
+		alg = q;
+
+		if (exact)
 			break;
-		}
 	}
 	
 	up_read(&crypto_alg_sem);
@@ -133,6 +146,7 @@ struct crypto_tfm *crypto_alloc_tfm(const char *name, u32 flags)
 	memset(tfm, 0, sizeof(*tfm) + alg->cra_ctxsize);
 	
 	tfm->__crt_alg = alg;
+	crypto_init_queue(tfm);
 	
 	if (crypto_init_flags(tfm, flags))
 		goto out_free_tfm;
@@ -155,6 +169,7 @@ out:
 
 void crypto_free_tfm(struct crypto_tfm *tfm)
 {
+	crypto_exit_queue(tfm);
 	crypto_exit_ops(tfm);
 	crypto_alg_put(tfm->__crt_alg);
 	kfree(tfm);
@@ -165,10 +180,15 @@ int crypto_register_alg(struct crypto_alg *alg)
 	int ret = 0;
 	struct crypto_alg *q;
 	
+	if (!alg->cra_driver_name[0])
+		memcpy((char *)alg->cra_driver_name, alg->cra_name,
+		       CRYPTO_MAX_ALG_NAME);
+
 	down_write(&crypto_alg_sem);
 	
 	list_for_each_entry(q, &crypto_alg_list, cra_list) {
-		if (!(strcmp(q->cra_name, alg->cra_name))) {
+		if (q == alg ||
+		    !strcmp(q->cra_driver_name, alg->cra_driver_name)) {
 			ret = -EEXIST;
 			goto out;
 		}
@@ -217,7 +237,7 @@ static int __init init_crypto(void)
 {
 	printk(KERN_INFO "Initializing Cryptographic API\n");
 	crypto_init_proc();
-	return 0;
+	return crypto_init_async();
 }
 
 __initcall(init_crypto);
@@ -0,0 +1,141 @@
+/*
+ * Cryptographic API.
+ *
+ * Asynchronous requests.
+ *
+ * Each transform has a queue of requests and a work item on an
+ * unbound workqueue.  Submitting a request to an idle transform
+ * queues its work; the work then takes everything queued on the
+ * transform in one go and runs it in order, so a busy transform
+ * costs one wakeup and one lock round trip per batch rather than per
+ * request.  Unbound workers are not tied to the submitting CPU, so
+ * the transforms of different flows are worked on in parallel.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+#include <linux/init.h>
+#include <linux/crypto.h>
+#include <linux/errno.h>
+#include <linux/workqueue.h>
+#include "internal.h"
+
+static struct workqueue_struct *crypto_wq;
+
+static int crypto_run_request(struct crypto_request *req)
+{
+	struct crypto_tfm *tfm = req->tfm;
+
+	switch (req->op) {
+	case CRYPTO_REQ_ENCRYPT:
+		if (req->iv)
+			return crypto_cipher_encrypt_iv(tfm, req->dst, req->src,
+			                                req->nbytes, req->iv);
+		return crypto_cipher_encrypt(tfm, req->dst, req->src,
+		                             req->nbytes);
+
+	case CRYPTO_REQ_DECRYPT:
+		if (req->iv)
+			return crypto_cipher_decrypt_iv(tfm, req->dst, req->src,
+			                                req->nbytes, req->iv);
+		return crypto_cipher_decrypt(tfm, req->dst, req->src,
+		                             req->nbytes);
+	}
+
+	return -EINVAL;
+}
+
+static void crypto_queue_work(void *data)
+{
+	struct crypto_tfm *tfm = data;
+	struct crypto_queue *q = &tfm->crt_queue;
+	struct crypto_request *req;
+	LIST_HEAD(batch);
+
+	spin_lock_irq(&q->lock);
+	while (!list_empty(&q->list)) {
+		list_splice(&q->list, &batch);
+		INIT_LIST_HEAD(&q->list);
+		q->qlen = 0;
+		spin_unlock_irq(&q->lock);
+
+		while (!list_empty(&batch)) {
+			req = list_entry(batch.next, struct crypto_request,
+			                 list);
+			list_del(&req->list);
+			req->complete(req, crypto_run_request(req));
+		}
+
+		spin_lock_irq(&q->lock);
+	}
+	q->busy = 0;
+	spin_unlock_irq(&q->lock);
+}
+
+int crypto_submit_request(struct crypto_request *req)
+{
+	struct crypto_queue *q = &req->tfm->crt_queue;
+	unsigned long flags;
+	int ret = 0;
+
+	/* crypto_init_async() failed: no workers to run it */
+	if (unlikely(!crypto_wq))
+		return -ENOMEM;
+
+	spin_lock_irqsave(&q->lock, flags);
+
+	if (q->qlen >= CRYPTO_MAX_QLEN) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	list_add_tail(&req->list, &q->list);
+	q->qlen++;
+
+	if (!q->busy) {
+		q->busy = 1;
+		queue_work(crypto_wq, &q->work);
+	}
+out:
+	spin_unlock_irqrestore(&q->lock, flags);
+	return ret;
+}
+
+void crypto_init_queue(struct crypto_tfm *tfm)
+{
+	struct crypto_queue *q = &tfm->crt_queue;
+
+	spin_lock_init(&q->lock);
+	INIT_LIST_HEAD(&q->list);
+	q->qlen = 0;
+	q->busy = 0;
+	INIT_WORK(&q->work, crypto_queue_work, tfm);
+}
+
+/*
+ * Wait for the requests still queued on a transform that is going
+ * away.  Transforms that were never used asynchronously don't sleep.
+ */
+void crypto_exit_queue(struct crypto_tfm *tfm)
+{
+	struct crypto_queue *q = &tfm->crt_queue;
+	int busy;
+
+	spin_lock_irq(&q->lock);
+	busy = q->busy;
+	spin_unlock_irq(&q->lock);
+
+	if (busy)
+		flush_workqueue(crypto_wq);
+}
+
+int __init crypto_init_async(void)
+{
+	crypto_wq = create_unbound_workqueue("crypto");
+	return crypto_wq ? 0 : -ENOMEM;
+}
+
+EXPORT_SYMBOL_GPL(crypto_submit_request);
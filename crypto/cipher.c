@@ -23,8 +23,8 @@
 #include "internal.h"
 
 typedef void (cryptfn_t)(void *, u8 *, const u8 *);
-typedef void (procfn_t)(struct crypto_tfm *, u8 *,
-                        u8*, cryptfn_t, int enc, void *);
+typedef void (procfn_t)(struct crypto_tfm *, u8 *dst, const u8 *src,
+                        unsigned int nbytes, int enc, void *info);
 
 struct scatter_walk {
 	struct scatterlist	*sg;
@@ -159,21 +159,30 @@ static int copy_chunks(void *buf, struct scatter_walk *walk,
 	return 0;
 }
 
+/* Does the request lie within the first page of this scatterlist entry? */
+static inline int sg_fits_page(struct scatterlist *sg, unsigned int nbytes)
+{
+	return nbytes <= sg->length &&
+	       (sg->offset & (PAGE_CACHE_SIZE - 1)) + nbytes <= PAGE_CACHE_SIZE;
+}
+
 /* 
- * Generic encrypt/decrypt wrapper for ciphers, handles operations across
- * multiple page boundaries by using temporary blocks.  In user context,
- * the kernel is given a chance to schedule us once per block.
+ * Generic encrypt/decrypt wrapper for ciphers.  Whole blocks that lie
+ * in the current page of both the source and the destination are
+ * handed to the mode function in one run, straight from the mapped
+ * pages; only a block straddling a page boundary goes through the
+ * temporary blocks.  In user context, the kernel is given a chance to
+ * schedule us once per run.
  */
 static int crypt(struct crypto_tfm *tfm,
 		 struct scatterlist *dst,
 		 struct scatterlist *src,
-                 unsigned int nbytes, cryptfn_t crfn,
-                 procfn_t prfn, int enc, void *info)
+                 unsigned int nbytes, procfn_t prfn, int enc, void *info)
 {
 	struct scatter_walk walk_in, walk_out;
 	const unsigned int bsize = crypto_tfm_alg_blocksize(tfm);
-	u8 tmp_src[nbytes > src->length ? bsize : 0];
-	u8 tmp_dst[nbytes > dst->length ? bsize : 0];
+	u8 tmp_src[bsize];
+	u8 tmp_dst[bsize];
 
 	if (!nbytes)
 		return 0;
@@ -183,26 +192,71 @@ static int crypt(struct crypto_tfm *tfm,
 		return -EINVAL;
 	}
 
+	/*
+	 * Small requests mostly lie within one page on both sides: do
+	 * them in one call, without setting up the walks.
+	 */
+	if (sg_fits_page(src, nbytes) && sg_fits_page(dst, nbytes)) {
+		u8 *src_p, *dst_p;
+
+		src_p = crypto_kmap(src->page, 0) + src->offset;
+		dst_p = src_p;
+		if (dst->page != src->page || dst->offset != src->offset)
+			dst_p = crypto_kmap(dst->page, 1) + dst->offset;
+
+		prfn(tfm, dst_p, src_p, nbytes, enc, info);
+
+		if (dst_p != src_p)
+			crypto_kunmap(dst_p, 1);
+		crypto_kunmap(src_p, 0);
+		flush_dcache_page(dst->page);
+		return 0;
+	}
+
 	scatterwalk_start(&walk_in, src);
 	scatterwalk_start(&walk_out, dst);
 
 	for(;;) {
 		u8 *src_p, *dst_p;
+		unsigned int n;
 
 		scatterwalk_map(&walk_in, 0);
 		scatterwalk_map(&walk_out, 1);
-		src_p = which_buf(&walk_in, bsize, tmp_src);
-		dst_p = which_buf(&walk_out, bsize, tmp_dst);
 
-		nbytes -= bsize;
-
-		copy_chunks(src_p, &walk_in, bsize, 0);
+		n = min(walk_in.len_this_page, walk_out.len_this_page);
+		n = min(n, nbytes);
+		n -= n % bsize;
+
+		if (n) {
+			src_p = walk_in.data;
+			dst_p = walk_out.data;
+
+			/*
+			 * In place: use one mapping for both, so the mode
+			 * functions see src == dst even where the two
+			 * kmaps of a highmem page differ.
+			 */
+			if (walk_in.page == walk_out.page &&
+			    walk_in.offset == walk_out.offset)
+				dst_p = src_p;
+
+			prfn(tfm, dst_p, src_p, n, enc, info);
+
+			copy_chunks(src_p, &walk_in, n, 0);
+			copy_chunks(walk_out.data, &walk_out, n, 1);
+		} else {
+			n = bsize;
+			src_p = which_buf(&walk_in, bsize, tmp_src);
+			dst_p = which_buf(&walk_out, bsize, tmp_dst);
+
+			copy_chunks(src_p, &walk_in, bsize, 0);
+			prfn(tfm, dst_p, src_p, bsize, enc, info);
+			copy_chunks(dst_p, &walk_out, bsize, 1);
+		}
 
-		prfn(tfm, dst_p, src_p, crfn, enc, info);
+		nbytes -= n;
 
 		scatter_done(&walk_in, 0, nbytes);
-
-		copy_chunks(dst_p, &walk_out, bsize, 1);
 		scatter_done(&walk_out, 1, nbytes);
 
 		if (!nbytes)
@@ -212,36 +266,84 @@ static int crypt(struct crypto_tfm *tfm,
 	}
 }
 
-static void cbc_process(struct crypto_tfm *tfm,
-                        u8 *dst, u8 *src, cryptfn_t fn, int enc, void *info)
+/*
+ * The mode functions below get nbytes, a multiple of the block size,
+ * of contiguous data, and call the block function once per block.
+ */
+static void cbc_encrypt_blocks(struct crypto_tfm *tfm, cryptfn_t fn,
+                               u8 *dst, const u8 *src,
+                               unsigned int nbytes, u8 *iv)
 {
+	const unsigned int bsize = crypto_tfm_alg_blocksize(tfm);
+	void *ctx = crypto_tfm_ctx(tfm);
+
+	do {
+		tfm->crt_u.cipher.cit_xor_block(iv, src);
+		fn(ctx, dst, iv);
+		memcpy(iv, dst, bsize);
+
+		src += bsize;
+		dst += bsize;
+	} while (nbytes -= bsize);
+}
+
+/*
+ * Each block needs the ciphertext before it: work backwards, so that
+ * it is still there when decrypting in place.
+ */
+static void cbc_decrypt_blocks(struct crypto_tfm *tfm, cryptfn_t fn,
+                               u8 *dst, const u8 *src,
+                               unsigned int nbytes, u8 *iv)
+{
+	const unsigned int bsize = crypto_tfm_alg_blocksize(tfm);
+	void *ctx = crypto_tfm_ctx(tfm);
+	u8 next_iv[bsize];
+
+	src += nbytes - bsize;
+	dst += nbytes - bsize;
+	memcpy(next_iv, src, bsize);
+
+	while (nbytes -= bsize) {
+		fn(ctx, dst, src);
+		tfm->crt_u.cipher.cit_xor_block(dst, src - bsize);
+		src -= bsize;
+		dst -= bsize;
+	}
+
+	fn(ctx, dst, src);
+	tfm->crt_u.cipher.cit_xor_block(dst, iv);
+	memcpy(iv, next_iv, bsize);
+}
+
+static void cbc_process(struct crypto_tfm *tfm, u8 *dst, const u8 *src,
+                        unsigned int nbytes, int enc, void *info)
+{
+	struct cipher_alg *cia = &tfm->__crt_alg->cra_cipher;
 	u8 *iv = info;
 	
 	/* Null encryption */
 	if (!iv)
 		return;
 		
-	if (enc) {
-		tfm->crt_u.cipher.cit_xor_block(iv, src);
-		fn(crypto_tfm_ctx(tfm), dst, iv);
-		memcpy(iv, dst, crypto_tfm_alg_blocksize(tfm));
-	} else {
-		const int need_stack = (src == dst);
-		u8 stack[need_stack ? crypto_tfm_alg_blocksize(tfm) : 0];
-		u8 *buf = need_stack ? stack : dst;
-		
-		fn(crypto_tfm_ctx(tfm), buf, src);
-		tfm->crt_u.cipher.cit_xor_block(buf, iv);
-		memcpy(iv, src, crypto_tfm_alg_blocksize(tfm));
-		if (buf != dst)
-			memcpy(dst, buf, crypto_tfm_alg_blocksize(tfm));
-	}
+	if (enc)
+		cbc_encrypt_blocks(tfm, cia->cia_encrypt, dst, src, nbytes, iv);
+	else
+		cbc_decrypt_blocks(tfm, cia->cia_decrypt, dst, src, nbytes, iv);
 }
 
-static void ecb_process(struct crypto_tfm *tfm, u8 *dst, u8 *src,
-                        cryptfn_t fn, int enc, void *info)
+static void ecb_process(struct crypto_tfm *tfm, u8 *dst, const u8 *src,
+                        unsigned int nbytes, int enc, void *info)
 {
-	fn(crypto_tfm_ctx(tfm), dst, src);
+	const unsigned int bsize = crypto_tfm_alg_blocksize(tfm);
+	struct cipher_alg *cia = &tfm->__crt_alg->cra_cipher;
+	cryptfn_t *fn = enc ? cia->cia_encrypt : cia->cia_decrypt;
+	void *ctx = crypto_tfm_ctx(tfm);
+
+	do {
+		fn(ctx, dst, src);
+		src += bsize;
+		dst += bsize;
+	} while (nbytes -= bsize);
 }
 
 static int setkey(struct crypto_tfm *tfm, const u8 *key, unsigned int keylen)
@@ -260,9 +362,7 @@ static int ecb_encrypt(struct crypto_tfm *tfm,
 		       struct scatterlist *dst,
                        struct scatterlist *src, unsigned int nbytes)
 {
-	return crypt(tfm, dst, src, nbytes,
-	             tfm->__crt_alg->cra_cipher.cia_encrypt,
-	             ecb_process, 1, NULL);
+	return crypt(tfm, dst, src, nbytes, ecb_process, 1, NULL);
 }
 
 static int ecb_decrypt(struct crypto_tfm *tfm,
@@ -270,9 +370,7 @@ static int ecb_decrypt(struct crypto_tfm *tfm,
                        struct scatterlist *src,
 		       unsigned int nbytes)
 {
-	return crypt(tfm, dst, src, nbytes,
-	             tfm->__crt_alg->cra_cipher.cia_decrypt,
-	             ecb_process, 1, NULL);
+	return crypt(tfm, dst, src, nbytes, ecb_process, 0, NULL);
 }
 
 static int cbc_encrypt(struct crypto_tfm *tfm,
@@ -280,9 +378,8 @@ static int cbc_encrypt(struct crypto_tfm *tfm,
                        struct scatterlist *src,
 		       unsigned int nbytes)
 {
-	return crypt(tfm, dst, src, nbytes,
-	             tfm->__crt_alg->cra_cipher.cia_encrypt,
-	             cbc_process, 1, tfm->crt_cipher.cit_iv);
+	return crypt(tfm, dst, src, nbytes, cbc_process, 1,
+	             tfm->crt_cipher.cit_iv);
 }
 
 static int cbc_encrypt_iv(struct crypto_tfm *tfm,
@@ -290,9 +387,7 @@ static int cbc_encrypt_iv(struct crypto_tfm *tfm,
                           struct scatterlist *src,
                           unsigned int nbytes, u8 *iv)
 {
-	return crypt(tfm, dst, src, nbytes,
-	             tfm->__crt_alg->cra_cipher.cia_encrypt,
-	             cbc_process, 1, iv);
+	return crypt(tfm, dst, src, nbytes, cbc_process, 1, iv);
 }
 
 static int cbc_decrypt(struct crypto_tfm *tfm,
@@ -300,9 +395,8 @@ static int cbc_decrypt(struct crypto_tfm *tfm,
                        struct scatterlist *src,
 		       unsigned int nbytes)
 {
-	return crypt(tfm, dst, src, nbytes,
-	             tfm->__crt_alg->cra_cipher.cia_decrypt,
-	             cbc_process, 0, tfm->crt_cipher.cit_iv);
+	return crypt(tfm, dst, src, nbytes, cbc_process, 0,
+	             tfm->crt_cipher.cit_iv);
 }
 
 static int cbc_decrypt_iv(struct crypto_tfm *tfm,
@@ -310,9 +404,7 @@ static int cbc_decrypt_iv(struct crypto_tfm *tfm,
                           struct scatterlist *src,
                           unsigned int nbytes, u8 *iv)
 {
-	return crypt(tfm, dst, src, nbytes,
-	             tfm->__crt_alg->cra_cipher.cia_decrypt,
-	             cbc_process, 0, iv);
+	return crypt(tfm, dst, src, nbytes, cbc_process, 0, iv);
 }
 
 static int nocrypt(struct crypto_tfm *tfm,
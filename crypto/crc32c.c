@@ -0,0 +1,45 @@
+/* 
+ * Cryptographic API.
+ *
+ * CRC32C (Castagnoli), the checksum of iSCSI and SCTP, as a digest.
+ *
+ * The CRC itself is __crc32c_le() in lib/crc32.c; the rest of the
+ * digest is in <crypto/crc32c.h>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option) 
+ * any later version.
+ *
+ */
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/crc32.h>
+#include <crypto/crc32c.h>
+
+static void chksum_update(void *ctx, const u8 *data, unsigned int length)
+{
+	struct chksum_ctx *mctx = ctx;
+
+	mctx->crc = __crc32c_le(mctx->crc, data, length);
+}
+
+static struct crypto_alg alg =
+	CRC32C_ALG(alg, "crc32c-generic", 100, chksum_update);
+
+static int __init init(void)
+{
+	return crypto_register_alg(&alg);
+}
+
+static void __exit fini(void)
+{
+	crypto_unregister_alg(&alg);
+}
+
+module_init(init);
+module_exit(fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("CRC32c (Castagnoli) calculations wrapper for lib/crc32");
+MODULE_ALIAS("crc32c-generic");
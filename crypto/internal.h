@@ -49,8 +49,8 @@ static inline void *crypto_tfm_ctx(struct crypto_tfm *tfm)
 
 struct crypto_alg *crypto_alg_lookup(const char *name);
 
-/* A far more intelligent version of this is planned.  For now, just
- * try an exact match on the name of the algorithm. */
+/* Either the algorithm name, which gets the highest priority
+ * implementation, or the driver name of one implementation. */
 static inline struct crypto_alg *crypto_alg_mod_lookup(const char *name)
 {
 	return try_then_request_module(crypto_alg_lookup(name), name);
@@ -76,6 +76,10 @@ static inline void crypto_init_proc(void)
 { }
 #endif
 
+void crypto_init_queue(struct crypto_tfm *tfm);
+void crypto_exit_queue(struct crypto_tfm *tfm);
+int __init crypto_init_async(void);
+
 int crypto_init_digest_flags(struct crypto_tfm *tfm, u32 flags);
 int crypto_init_cipher_flags(struct crypto_tfm *tfm, u32 flags);
 int crypto_init_compress_flags(struct crypto_tfm *tfm, u32 flags);
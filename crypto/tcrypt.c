@@ -21,6 +21,11 @@
 #include <linux/string.h>
 #include <linux/crypto.h>
 #include <linux/highmem.h>
+#include <linux/interrupt.h>
+#include <linux/sched.h>
+#include <linux/timex.h>
+#include <linux/completion.h>
+#include <asm/div64.h>
 #include "tcrypt.h"
 
 /*
@@ -42,13 +47,15 @@
 #define IDX8		3000
 
 static int mode;
+static unsigned int sec;
+static char *alg;
 static char *xbuf;
 static char *tvmem;
 
 static char *check[] = {
 	"des", "md5", "des3_ede", "rot13", "sha1", "sha256", "blowfish",
 	"twofish", "serpent", "sha384", "sha512", "md4", "aes", "cast6", 
-	"deflate", NULL
+	"deflate", "crc32c", NULL
 };
 
 static void
@@ -397,6 +404,82 @@ test_md4(void)
 	crypto_free_tfm(tfm);
 }
 
+static void
+test_crc32c(void)
+{
+	char *p;
+	unsigned int i;
+	struct scatterlist sg[2];
+	char result[CRC32C_DIGEST_SIZE];
+	struct crypto_tfm *tfm;
+	struct crc32c_testvec *crc32c_tv;
+	unsigned int tsize;
+
+	printk("\ntesting crc32c\n");
+
+	tsize = sizeof (crc32c_tv_template);
+	if (tsize > TVMEMSIZE) {
+		printk("template (%u) too big for tvmem (%u)\n", tsize,
+		       TVMEMSIZE);
+		return;
+	}
+
+	memcpy(tvmem, crc32c_tv_template, tsize);
+	crc32c_tv = (void *) tvmem;
+
+	tfm = crypto_alloc_tfm("crc32c", 0);
+	if (tfm == NULL) {
+		printk("failed to load transform for crc32c\n");
+		return;
+	}
+
+	printk("driver %s\n", tfm->__crt_alg->cra_driver_name);
+
+	for (i = 0; i < CRC32C_TEST_VECTORS; i++) {
+		printk("test %u:\n", i + 1);
+		memset(result, 0, sizeof (result));
+
+		p = crc32c_tv[i].plaintext;
+		sg[0].page = virt_to_page(p);
+		sg[0].offset = offset_in_page(p);
+		sg[0].length = strlen(crc32c_tv[i].plaintext);
+
+		crypto_digest_digest(tfm, sg, 1, result);
+
+		hexdump(result, crypto_tfm_alg_digestsize(tfm));
+		printk("%s\n",
+		       memcmp(result, crc32c_tv[i].digest,
+			      crypto_tfm_alg_digestsize(tfm)) ? "fail" :
+		       "pass");
+	}
+
+	printk("\ntesting crc32c across pages\n");
+
+	/* odd lengths, so the second part is not word aligned */
+	memset(xbuf, 0, XBUFSIZE);
+	memcpy(&xbuf[IDX1], "abcdefghijklm", 13);
+	memcpy(&xbuf[IDX2], "nopqrstuvwxyz", 13);
+
+	p = &xbuf[IDX1];
+	sg[0].page = virt_to_page(p);
+	sg[0].offset = offset_in_page(p);
+	sg[0].length = 13;
+
+	p = &xbuf[IDX2];
+	sg[1].page = virt_to_page(p);
+	sg[1].offset = offset_in_page(p);
+	sg[1].length = 13;
+
+	memset(result, 0, sizeof (result));
+	crypto_digest_digest(tfm, sg, 2, result);
+	hexdump(result, crypto_tfm_alg_digestsize(tfm));
+	printk("%s\n",
+	       memcmp(result, crc32c_tv[5].digest,
+		      crypto_tfm_alg_digestsize(tfm)) ? "fail" : "pass");
+
+	crypto_free_tfm(tfm);
+}
+
 static void
 test_sha1(void)
 {
@@ -2479,6 +2562,642 @@ test_available(void)
 	}	
 }
 
+/*
+ * Speed tests, modes 200 and up.
+ *
+ * With sec=0 every case is run a few times to warm the caches and
+ * then timed in cycles over a fixed number of runs, with interrupts
+ * off.  With sec=N every case runs for N seconds instead, and the
+ * operations and bytes per second are reported as well.  alg=<name>
+ * restricts the tests to one algorithm, or to one implementation of
+ * it by its driver name.
+ */
+#define SPEED_WARMUP	4
+#define SPEED_RUNS	8
+
+struct speed_ctx {
+	struct crypto_tfm *tfm;
+	struct scatterlist sg[8];
+	unsigned int nsg;
+	unsigned int len;
+	int enc;
+	u8 *src;
+	u8 *dst;
+	unsigned int dlen;
+	u8 *key;
+	unsigned int klen;
+};
+
+typedef int (*speed_fn)(struct speed_ctx *sc);
+
+static unsigned int speed_sizes[] = { 16, 64, 256, 1024, 8192, 0 };
+
+struct cipher_speed {
+	char *name;
+	unsigned int klen[4];
+};
+
+static struct cipher_speed cipher_speed[] = {
+	{ "des",	{ 8 } },
+	{ "des3_ede",	{ 24 } },
+	{ "blowfish",	{ 16, 32, 56 } },
+	{ "twofish",	{ 16, 24, 32 } },
+	{ "serpent",	{ 16, 24, 32 } },
+	{ "aes",	{ 16, 24, 32 } },
+	{ "cast5",	{ 5, 16 } },
+	{ "cast6",	{ 16, 24, 32 } },
+	{ NULL }
+};
+
+static char *digest_speed[] = {
+	"md4", "md5", "sha1", "sha256", "sha384", "sha512", "crc32c", NULL
+};
+
+static u8 speed_key[64];
+
+static int
+speed_wanted(char *name)
+{
+	return !alg || !strcmp(alg, name) ||
+	       (!strncmp(alg, name, strlen(name)) && alg[strlen(name)] == '-');
+}
+
+static struct crypto_tfm *
+speed_alloc_tfm(char *name, u32 flags)
+{
+	struct crypto_tfm *tfm;
+
+	/* a driver name picks one implementation of name */
+	tfm = crypto_alloc_tfm(alg ? alg : name, flags);
+	if (tfm == NULL)
+		printk("failed to load transform for %s\n", alg ? alg : name);
+	else if (alg)
+		printk("using %s\n", alg);
+
+	return tfm;
+}
+
+/*
+ * Fill sg with the pages of the kmalloc()ed buf[0..len).
+ */
+static unsigned int
+speed_sg_init(struct scatterlist *sg, u8 *buf, unsigned int len)
+{
+	unsigned int n, this;
+
+	for (n = 0; len; n++, buf += this, len -= this) {
+		this = min(len, (unsigned int) (PAGE_SIZE - offset_in_page(buf)));
+		sg[n].page = virt_to_page(buf);
+		sg[n].offset = offset_in_page(buf);
+		sg[n].length = this;
+	}
+
+	return n;
+}
+
+static void
+speed_report_cycles(u64 cycles, unsigned int len)
+{
+	unsigned long per_op;
+
+	do_div(cycles, SPEED_RUNS);
+	per_op = (unsigned long) cycles;
+
+	printk("%lu cycles/operation, %lu.%lu cycles/byte\n", per_op,
+	       per_op / len, (per_op * 10 / len) % 10);
+}
+
+static int
+speed_cycles(speed_fn fn, struct speed_ctx *sc)
+{
+	cycles_t start, end;
+	int i, ret = 0;
+
+	for (i = 0; i < SPEED_WARMUP; i++) {
+		ret = fn(sc);
+		if (ret)
+			return ret;
+	}
+
+	local_bh_disable();
+	local_irq_disable();
+
+	start = get_cycles();
+	for (i = 0; i < SPEED_RUNS; i++) {
+		ret = fn(sc);
+		if (ret)
+			break;
+	}
+	end = get_cycles();
+
+	local_irq_enable();
+	local_bh_enable();
+
+	if (!ret)
+		speed_report_cycles(end - start, sc->len);
+
+	return ret;
+}
+
+static int
+speed_jiffies(speed_fn fn, struct speed_ctx *sc)
+{
+	unsigned long end = jiffies + sec * HZ;
+	unsigned long ops;
+	cycles_t start;
+	u64 cycles, bytes;
+	int ret;
+
+	start = get_cycles();
+	for (ops = 0; time_before(jiffies, end); ops++) {
+		ret = fn(sc);
+		if (ret)
+			return ret;
+		cond_resched();
+	}
+	cycles = get_cycles() - start;
+
+	if (!ops)
+		return -ETIME;
+
+	bytes = (u64) ops * sc->len;
+	do_div(bytes, sec);
+	do_div(cycles, ops);
+
+	printk("%lu operations in %u seconds (%lu ops/s, %llu bytes/s), "
+	       "%lu.%lu cycles/byte\n", ops, sec, ops / sec,
+	       (unsigned long long) bytes,
+	       (unsigned long) cycles / sc->len,
+	       ((unsigned long) cycles * 10 / sc->len) % 10);
+
+	return 0;
+}
+
+static void
+speed_run(speed_fn fn, struct speed_ctx *sc)
+{
+	int ret;
+
+	printk("test %u (%u byte blocks): ", sc->len, sc->len);
+
+	if (sec)
+		ret = speed_jiffies(fn, sc);
+	else
+		ret = speed_cycles(fn, sc);
+
+	if (ret)
+		printk("failed: ret=%d\n", ret);
+}
+
+static int
+speed_cipher_op(struct speed_ctx *sc)
+{
+	if (sc->enc)
+		return crypto_cipher_encrypt(sc->tfm, sc->sg, sc->sg, sc->len);
+	return crypto_cipher_decrypt(sc->tfm, sc->sg, sc->sg, sc->len);
+}
+
+static void
+speed_cipher(struct cipher_speed *cs, u32 mode, int enc)
+{
+	struct speed_ctx sc;
+	unsigned int *klen, *size;
+	u8 iv[32];
+
+	if (!speed_wanted(cs->name))
+		return;
+
+	printk("\ntesting speed of %s %s %s\n", cs->name,
+	       mode == CRYPTO_TFM_MODE_CBC ? "cbc" : "ecb",
+	       enc ? "encryption" : "decryption");
+
+	memset(&sc, 0, sizeof(sc));
+	sc.enc = enc;
+	sc.tfm = speed_alloc_tfm(cs->name, mode);
+	if (sc.tfm == NULL)
+		return;
+
+	memset(iv, 0xff, sizeof(iv));
+
+	for (klen = cs->klen; *klen; klen++) {
+		if (crypto_cipher_setkey(sc.tfm, speed_key, *klen)) {
+			printk("setkey() failed for %u byte key, flags=%x\n",
+			       *klen, sc.tfm->crt_flags);
+			continue;
+		}
+
+		printk("%u byte key\n", *klen);
+
+		for (size = speed_sizes; *size; size++) {
+			if (mode == CRYPTO_TFM_MODE_CBC)
+				crypto_cipher_set_iv(sc.tfm, iv,
+					crypto_tfm_alg_ivsize(sc.tfm));
+
+			sc.len = *size;
+			sc.nsg = speed_sg_init(sc.sg, (u8 *) xbuf, sc.len);
+			speed_run(speed_cipher_op, &sc);
+		}
+	}
+
+	crypto_free_tfm(sc.tfm);
+}
+
+static int
+speed_digest_op(struct speed_ctx *sc)
+{
+	crypto_digest_init(sc->tfm);
+	crypto_digest_update(sc->tfm, sc->sg, sc->nsg);
+	crypto_digest_final(sc->tfm, sc->dst);
+	return 0;
+}
+
+#ifdef CONFIG_CRYPTO_HMAC
+static int
+speed_hmac_op(struct speed_ctx *sc)
+{
+	unsigned int klen = sc->klen;
+
+	crypto_hmac(sc->tfm, sc->key, &klen, sc->sg, sc->nsg, sc->dst);
+	return 0;
+}
+#endif
+
+static void
+speed_digest(char *name, int hmac)
+{
+	struct speed_ctx sc;
+	unsigned int *size;
+	u8 result[64];
+
+	if (!speed_wanted(name))
+		return;
+
+	printk("\ntesting speed of %s%s\n", hmac ? "hmac " : "", name);
+
+	memset(&sc, 0, sizeof(sc));
+	sc.tfm = speed_alloc_tfm(name, 0);
+	if (sc.tfm == NULL)
+		return;
+
+	sc.dst = result;
+	sc.key = speed_key;
+	sc.klen = 32;
+
+	for (size = speed_sizes; *size; size++) {
+		sc.len = *size;
+		sc.nsg = speed_sg_init(sc.sg, (u8 *) xbuf, sc.len);
+#ifdef CONFIG_CRYPTO_HMAC
+		if (hmac) {
+			speed_run(speed_hmac_op, &sc);
+			continue;
+		}
+#endif
+		speed_run(speed_digest_op, &sc);
+	}
+
+	crypto_free_tfm(sc.tfm);
+}
+
+static int
+speed_comp_op(struct speed_ctx *sc)
+{
+	unsigned int dlen = XBUFSIZE / 2;
+
+	if (sc->enc)
+		return crypto_comp_compress(sc->tfm, sc->src, sc->len,
+					    sc->dst, &dlen);
+	return crypto_comp_decompress(sc->tfm, sc->src, sc->dlen,
+				      sc->dst, &dlen);
+}
+
+static void
+speed_compress(char *name)
+{
+	static const char text[] =
+		"Hash tables are used to speed up lookups of symbols, "
+		"inodes and network connections alike; ";
+	struct speed_ctx sc;
+	unsigned int *size, i;
+	u8 *buf = (u8 *) xbuf;
+
+	if (!speed_wanted(name))
+		return;
+
+	printk("\ntesting speed of %s compression and decompression\n",
+	       name);
+
+	memset(&sc, 0, sizeof(sc));
+	sc.tfm = speed_alloc_tfm(name, 0);
+	if (sc.tfm == NULL)
+		return;
+
+	/* something with about the redundancy of real traffic */
+	for (i = 0; i < XBUFSIZE / 2; i++)
+		buf[i] = text[i % (sizeof(text) - 1)] ^ (i / 97 & 0x03);
+
+	for (size = speed_sizes; *size; size++) {
+		int ret;
+
+		sc.len = *size;
+
+		printk("compression, ");
+		sc.enc = 1;
+		sc.src = buf;
+		sc.dst = buf + XBUFSIZE / 2;
+		speed_run(speed_comp_op, &sc);
+
+		/* decompression works on what compression produced */
+		sc.dlen = XBUFSIZE / 2;
+		ret = crypto_comp_compress(sc.tfm, buf, sc.len,
+					   buf + XBUFSIZE / 2, &sc.dlen);
+		if (ret) {
+			printk("compression failed: ret=%d\n", ret);
+			continue;
+		}
+
+		printk("decompression (ratio %u:%u), ", sc.len, sc.dlen);
+		sc.enc = 0;
+		sc.src = buf + XBUFSIZE / 2;
+		sc.dst = buf;
+		speed_run(speed_comp_op, &sc);
+	}
+
+	crypto_free_tfm(sc.tfm);
+}
+
+static void
+speed_test(int which)
+{
+	struct cipher_speed *cs;
+	char **name;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(speed_key); i++)
+		speed_key[i] = i * 17 + 3;
+
+	memset(xbuf, 0, XBUFSIZE);
+
+	if (which == 0 || which == 1) {
+		for (cs = cipher_speed; cs->name; cs++) {
+			speed_cipher(cs, CRYPTO_TFM_MODE_ECB, 1);
+			speed_cipher(cs, CRYPTO_TFM_MODE_ECB, 0);
+			speed_cipher(cs, CRYPTO_TFM_MODE_CBC, 1);
+			speed_cipher(cs, CRYPTO_TFM_MODE_CBC, 0);
+		}
+	}
+
+	if (which == 0 || which == 2) {
+		for (name = digest_speed; *name; name++)
+			speed_digest(*name, 0);
+	}
+
+#ifdef CONFIG_CRYPTO_HMAC
+	if (which == 0 || which == 3) {
+		for (name = digest_speed; *name; name++)
+			speed_digest(*name, 1);
+	}
+#endif
+
+	if (which == 0 || which == 4)
+		speed_compress("deflate");
+}
+
+/*
+ * Asynchronous requests: results against the vectors and against the
+ * synchronous interface, completion order, -EBUSY once the queue of a
+ * transform is full, and crypto_free_tfm() waiting for what is still
+ * queued.
+ */
+#define ASYNC_REQS		(CRYPTO_MAX_QLEN + 16)
+#define ASYNC_CHUNK		64
+#define ASYNC_STREAM		4096
+
+struct async_test {
+	atomic_t pending;	/* biased by one until all are submitted */
+	struct completion done;
+	struct completion held;
+	struct completion release;
+	unsigned int next;
+	int hold;
+	int errors;
+};
+
+struct async_req {
+	struct crypto_request req;
+	struct scatterlist sg;
+	unsigned int seq;
+};
+
+/*
+ * Called from a crypto worker, one request of a transform at a time.
+ */
+static void async_complete(struct crypto_request *req, int err)
+{
+	struct async_req *ar = container_of(req, struct async_req, req);
+	struct async_test *t = req->data;
+
+	if (err || ar->seq != t->next++)
+		t->errors++;
+
+	if (t->hold) {
+		t->hold = 0;
+		complete(&t->held);
+		wait_for_completion(&t->release);
+	}
+
+	if (atomic_dec_and_test(&t->pending))
+		complete(&t->done);
+}
+
+static void async_start(struct async_test *t)
+{
+	atomic_set(&t->pending, 1);
+	init_completion(&t->done);
+	init_completion(&t->held);
+	init_completion(&t->release);
+	t->next = 0;
+	t->hold = 0;
+	t->errors = 0;
+}
+
+static int async_submit(struct async_test *t, struct async_req *ar,
+                        struct crypto_tfm *tfm, int enc, char *p,
+                        unsigned int len, unsigned int seq)
+{
+	int ret;
+
+	ar->sg.page = virt_to_page(p);
+	ar->sg.offset = offset_in_page(p);
+	ar->sg.length = len;
+	ar->seq = seq;
+
+	crypto_request_init(&ar->req, tfm, async_complete, t);
+	crypto_request_set_crypt(&ar->req, &ar->sg, &ar->sg, len, NULL);
+
+	atomic_inc(&t->pending);
+	ret = enc ? crypto_cipher_encrypt_async(&ar->req) :
+	            crypto_cipher_decrypt_async(&ar->req);
+	if (ret)
+		atomic_dec(&t->pending);
+	return ret;
+}
+
+/* drop the bias and wait for the completions */
+static void async_wait(struct async_test *t)
+{
+	if (!atomic_dec_and_test(&t->pending))
+		wait_for_completion(&t->done);
+	else
+		complete(&t->done);
+}
+
+static void
+test_async(void)
+{
+	struct crypto_tfm *tfm, *sync_tfm;
+	struct async_test t;
+	struct async_req *reqs;
+	struct aes_tv *aes_tv;
+	unsigned int i, j, n;
+	char iv[16];
+	char *p;
+	int ret;
+
+	printk("\ntesting async aes\n");
+
+	reqs = kmalloc(ASYNC_REQS * sizeof(*reqs), GFP_KERNEL);
+	if (reqs == NULL) {
+		printk("no memory for the requests\n");
+		return;
+	}
+
+	memcpy(tvmem, aes_enc_tv_template, sizeof (aes_enc_tv_template));
+	aes_tv = (void *) tvmem;
+
+	tfm = crypto_alloc_tfm("aes", CRYPTO_TFM_MODE_ECB);
+	if (tfm == NULL) {
+		printk("failed to load transform for aes (ecb)\n");
+		goto out;
+	}
+
+	/* ECB: eight copies of each vector, encrypted then decrypted */
+	for (i = 0; i < AES_ENC_TEST_VECTORS; i++) {
+		printk("test %u (%d bit key, ecb):\n",
+		       i + 1, aes_tv[i].keylen * 8);
+		crypto_cipher_setkey(tfm, aes_tv[i].key, aes_tv[i].keylen);
+
+		for (j = 0; j < 8; j++)
+			memcpy(&xbuf[j * 16], aes_tv[i].plaintext, 16);
+
+		async_start(&t);
+		for (j = 0; j < 8; j++)
+			if (async_submit(&t, &reqs[j], tfm, 1, &xbuf[j * 16],
+			                 16, j))
+				t.errors++;
+		async_wait(&t);
+
+		for (j = 0; j < 8; j++)
+			if (memcmp(&xbuf[j * 16], aes_tv[i].result, 16))
+				t.errors++;
+
+		async_start(&t);
+		for (j = 0; j < 8; j++)
+			if (async_submit(&t, &reqs[j], tfm, 0, &xbuf[j * 16],
+			                 16, j))
+				t.errors++;
+		async_wait(&t);
+
+		for (j = 0; j < 8; j++)
+			if (memcmp(&xbuf[j * 16], aes_tv[i].plaintext, 16))
+				t.errors++;
+
+		printk("%s\n", t.errors ? "fail" : "pass");
+	}
+
+	/*
+	 * -EBUSY: hold the worker in the first completion, then fill the
+	 * queue behind it.
+	 */
+	printk("test queue limit:\n");
+	async_start(&t);
+	t.hold = 1;
+	if (async_submit(&t, &reqs[0], tfm, 1, xbuf, 16, 0))
+		t.errors++;
+	wait_for_completion(&t.held);
+
+	for (n = 1; n < ASYNC_REQS; n++) {
+		ret = async_submit(&t, &reqs[n], tfm, 1, xbuf, 16, n);
+		if (ret)
+			break;
+	}
+	complete(&t.release);
+	async_wait(&t);
+
+	printk("%u queued, then %d: %s\n", n - 1, ret,
+	       ret == -EBUSY && n - 1 == CRYPTO_MAX_QLEN && !t.errors ?
+	       "pass" : "fail");
+
+	/* crypto_free_tfm() with requests still queued */
+	printk("test free with requests pending:\n");
+	async_start(&t);
+	for (j = 0; j < 64; j++)
+		if (async_submit(&t, &reqs[j], tfm, 1, &xbuf[j * 16], 16, j))
+			t.errors++;
+	crypto_free_tfm(tfm);
+
+	printk("%d left after free: %s\n", atomic_read(&t.pending) - 1,
+	       atomic_read(&t.pending) == 1 && !t.errors ? "pass" : "fail");
+	async_wait(&t);
+
+	/*
+	 * CBC: a stream split into requests that chain through the
+	 * transform's IV, against one synchronous call.  Out of order
+	 * completion would show up here too.
+	 */
+	printk("test cbc stream against sync:\n");
+	tfm = crypto_alloc_tfm("aes", CRYPTO_TFM_MODE_CBC);
+	sync_tfm = crypto_alloc_tfm("aes", CRYPTO_TFM_MODE_CBC);
+	if (tfm == NULL || sync_tfm == NULL) {
+		printk("failed to load transform for aes (cbc)\n");
+		goto out_cbc;
+	}
+
+	crypto_cipher_setkey(tfm, aes_tv[0].key, aes_tv[0].keylen);
+	crypto_cipher_setkey(sync_tfm, aes_tv[0].key, aes_tv[0].keylen);
+	memset(iv, 0xa5, sizeof (iv));
+	crypto_cipher_set_iv(tfm, iv, crypto_tfm_alg_ivsize(tfm));
+	crypto_cipher_set_iv(sync_tfm, iv, crypto_tfm_alg_ivsize(sync_tfm));
+
+	for (i = 0; i < ASYNC_STREAM; i++)
+		xbuf[i] = xbuf[ASYNC_STREAM + i] = i * 7 + (i >> 8);
+
+	p = xbuf;
+	reqs[0].sg.page = virt_to_page(p);
+	reqs[0].sg.offset = offset_in_page(p);
+	reqs[0].sg.length = ASYNC_STREAM;
+	crypto_cipher_encrypt(sync_tfm, &reqs[0].sg, &reqs[0].sg,
+	                      ASYNC_STREAM);
+
+	async_start(&t);
+	for (j = 0; j < ASYNC_STREAM / ASYNC_CHUNK; j++)
+		if (async_submit(&t, &reqs[j], tfm, 1,
+		                 &xbuf[ASYNC_STREAM + j * ASYNC_CHUNK],
+		                 ASYNC_CHUNK, j))
+			t.errors++;
+	async_wait(&t);
+
+	printk("%s\n", memcmp(xbuf, &xbuf[ASYNC_STREAM], ASYNC_STREAM) ||
+	       t.errors ? "fail" : "pass");
+
+out_cbc:
+	if (tfm)
+		crypto_free_tfm(tfm);
+	if (sync_tfm)
+		crypto_free_tfm(sync_tfm);
+out:
+	kfree(reqs);
+}
+
 static void
 do_test(void)
 {
@@ -2501,6 +3220,8 @@ do_test(void)
 		test_deflate();
 		test_cast5();
 		test_cast6();
+		test_crc32c();
+		test_async();
 #ifdef CONFIG_CRYPTO_HMAC
 		test_hmac_md5();
 		test_hmac_sha1();
@@ -2568,6 +3289,14 @@ do_test(void)
 		test_cast6();
 		break;
 
+	case 16:
+		test_crc32c();
+		break;
+
+	case 17:
+		test_async();
+		break;
+
 #ifdef CONFIG_CRYPTO_HMAC
 	case 100:
 		test_hmac_md5();
@@ -2583,6 +3312,28 @@ do_test(void)
 
 #endif
 
+	case 200:
+		speed_test(0);
+		break;
+
+	case 201:
+		speed_test(1);
+		break;
+
+	case 202:
+		speed_test(2);
+		break;
+
+#ifdef CONFIG_CRYPTO_HMAC
+	case 203:
+		speed_test(3);
+		break;
+#endif
+
+	case 204:
+		speed_test(4);
+		break;
+
 	case 1000:
 		test_available();
 		break;
@@ -2617,6 +3368,8 @@ init(void)
 module_init(init);
 
 MODULE_PARM(mode, "i");
+MODULE_PARM(sec, "i");
+MODULE_PARM(alg, "s");
 
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("Quick & dirty crypto testing module");
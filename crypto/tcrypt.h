@@ -22,6 +22,7 @@
 #define SHA256_DIGEST_SIZE	32
 #define SHA384_DIGEST_SIZE	48
 #define SHA512_DIGEST_SIZE	64
+#define CRC32C_DIGEST_SIZE	4
 
 /*
  * MD4 test vectors from RFC1320
@@ -1837,6 +1838,49 @@ struct cast5_tv cast5_dec_tv_template[] =
 	}
 };
 
+/*
+ * CRC32C test vectors: seed ~0, inverted result, stored little-endian
+ */
+#define CRC32C_TEST_VECTORS	8
+
+struct crc32c_testvec {
+	char plaintext[128];
+	char digest[CRC32C_DIGEST_SIZE];
+} crc32c_tv_template[] = {
+	{ "",
+	  { 0x00, 0x00, 0x00, 0x00 }
+	},
+
+	{ "a",
+	  { 0x30, 0x43, 0xd0, 0xc1 }
+	},
+
+	{ "abc",
+	  { 0xb7, 0x3f, 0x4b, 0x36 }
+	},
+
+	{ "123456789",
+	  { 0x83, 0x92, 0x06, 0xe3 }
+	},
+
+	{ "message digest",
+	  { 0xd0, 0x79, 0xbd, 0x02 }
+	},
+
+	{ "abcdefghijklmnopqrstuvwxyz",
+	  { 0x25, 0xef, 0xe6, 0x9e }
+	},
+
+	{ "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+	  { 0x7d, 0xd5, 0x45, 0xa2 }
+	},
+
+	{ "123456789012345678901234567890123456789012345678901234567890123"
+	  "45678901234567890",
+	  { 0x81, 0x67, 0x7a, 0x47 }
+	},
+};
+
 /*
  * Compression stuff.
  */
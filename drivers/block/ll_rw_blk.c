@@ -2707,7 +2707,7 @@ int __init blk_dev_init(void)
 {
 	int i;
 
-	kblockd_workqueue = create_workqueue("kblockd");
+	kblockd_workqueue = alloc_workqueue("kblockd", WQ_MEM_RECLAIM, 0);
 	if (!kblockd_workqueue)
 		panic("Failed to create kblockd\n");
 
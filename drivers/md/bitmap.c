@@ -0,0 +1,740 @@
+/*
+ * bitmap.c : write-intent bitmap for md
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * (for example /usr/src/linux/COPYING); if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Every write to the array first makes sure the bit for its chunk is
+ * set on disk, and a resync after an unclean shutdown only has to
+ * visit the chunks whose bits are set.  Bits are cleared lazily by
+ * bitmap_daemon_work(), run from the personality's thread, once a
+ * chunk has seen no writes for two daemon passes, and all the bits
+ * cleared in a pass go out in one write.
+ *
+ * When the bitmap is in a file, the file's blocks are looked up with
+ * bmap() when the array is started and written directly on the
+ * underlying device, as swap files are: going through the filesystem
+ * from inside the array's write path could deadlock.  So the file must
+ * be fully allocated (no holes), must not live on the array itself,
+ * and must not be changed while the array is running.
+ */
+
+#include <linux/raid/md.h>
+#include <linux/raid/bitmap.h>
+#include <linux/file.h>
+#include <linux/highmem.h>
+
+#define BITMAP_MAX_BYTES	(BITMAP_SB_SIZE + BITMAP_MAX_CHUNKS / 8)
+#define BITMAP_DAEMON_SLICE	1024	/* chunks scanned per lock hold */
+
+static int bitmap_end_io(struct bio *bio, unsigned int bytes_done, int error)
+{
+	if (bio->bi_size)
+		return 1;
+
+	complete((struct completion*)bio->bi_private);
+	return 0;
+}
+
+static int bitmap_sync_io(struct block_device *bdev, sector_t sector,
+			  struct page *page, unsigned int offset,
+			  unsigned int size, int rw)
+{
+	struct bio bio;
+	struct bio_vec vec;
+	struct completion event;
+
+	bio_init(&bio);
+	bio.bi_io_vec = &vec;
+	vec.bv_page = page;
+	vec.bv_len = size;
+	vec.bv_offset = offset;
+	bio.bi_vcnt = 1;
+	bio.bi_idx = 0;
+	bio.bi_size = size;
+	bio.bi_bdev = bdev;
+	bio.bi_sector = sector;
+	init_completion(&event);
+	bio.bi_private = &event;
+	bio.bi_end_io = bitmap_end_io;
+	submit_bio(rw, &bio);
+	blk_run_queues();
+	wait_for_completion(&event);
+
+	return test_bit(BIO_UPTODATE, &bio.bi_flags);
+}
+
+/* bytes of page 'index' that are part of the image */
+static unsigned int page_bytes(struct bitmap *bitmap, unsigned long index)
+{
+	unsigned int n;
+
+	if (index < bitmap->nr_pages - 1)
+		return PAGE_SIZE;
+	n = bitmap->bytes & (PAGE_SIZE - 1);
+	return n ? n : PAGE_SIZE;
+}
+
+/*
+ * Read or write one page of the image.  An internal bitmap is written
+ * to every working component and read from the first one that works.
+ */
+static int bitmap_page_io(struct bitmap *bitmap, unsigned long index, int rw)
+{
+	struct page *page = bitmap->pages[index];
+	unsigned int bytes = page_bytes(bitmap, index);
+	mdk_rdev_t *rdev;
+	struct list_head *tmp;
+	int done = 0;
+
+	if (bitmap->file) {
+		struct block_device *bdev =
+			bitmap->file->f_dentry->d_inode->i_sb->s_bdev;
+		unsigned int bsize = 1 << bitmap->blkbits;
+		unsigned long block = index << (PAGE_SHIFT - bitmap->blkbits);
+		unsigned int offset;
+
+		for (offset = 0; offset < bytes; offset += bsize, block++)
+			if (!bitmap_sync_io(bdev, bitmap->blocks[block], page,
+					    offset, bsize, rw))
+				return -EIO;
+		return 0;
+	}
+
+	bytes = (bytes + 511) & ~511;
+	ITERATE_RDEV(bitmap->mddev,rdev,tmp) {
+		if (rdev->faulty || !rdev->in_sync)
+			continue;
+		if (bitmap_sync_io(rdev->bdev, (rdev->sb_offset << 1)
+				   + MD_SB_SECTORS
+				   + (index << (PAGE_SHIFT - 9)),
+				   page, 0, bytes, rw)) {
+			done++;
+			if (rw == READ)
+				break;
+		}
+	}
+	return done ? 0 : -EIO;
+}
+
+/* find the device sector of each file block the image occupies */
+static int bitmap_map_file(struct bitmap *bitmap)
+{
+	struct inode *inode = bitmap->file->f_dentry->d_inode;
+	unsigned long i, nr;
+
+	nr = (bitmap->bytes + (1 << bitmap->blkbits) - 1) >> bitmap->blkbits;
+	if (bitmap->blocks)
+		vfree(bitmap->blocks);
+	bitmap->blocks = vmalloc(nr * sizeof(sector_t));
+	if (!bitmap->blocks)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		sector_t block = bmap(inode, i);
+
+		if (!block) {
+			printk(KERN_ERR "md%d: bitmap file has holes\n",
+				mdidx(bitmap->mddev));
+			return -EINVAL;
+		}
+		bitmap->blocks[i] = block << (bitmap->blkbits - 9);
+	}
+	return 0;
+}
+
+static inline unsigned char *bitmap_byte(struct bitmap *bitmap,
+					 unsigned long chunk,
+					 unsigned long *index)
+{
+	unsigned long byte = BITMAP_SB_SIZE + (chunk >> 3);
+
+	*index = byte >> PAGE_SHIFT;
+	return (unsigned char *)page_address(bitmap->pages[*index])
+		+ (byte & (PAGE_SIZE - 1));
+}
+
+/*
+ * unplug_pending counts the pages that are dirty or being written, so
+ * that bitmap_unplug() can tell without write_sem that every bit set
+ * so far is already on disk.
+ */
+static inline void mark_page_dirty(struct bitmap *bitmap, unsigned long index)
+{
+	if (!test_and_set_bit(index, bitmap->dirty))
+		atomic_inc(&bitmap->unplug_pending);
+}
+
+/* these are called with bitmap->lock held */
+static void set_disk_bit(struct bitmap *bitmap, unsigned long chunk)
+{
+	unsigned long index;
+	unsigned char *p = bitmap_byte(bitmap, chunk, &index);
+
+	if (!(*p & (1 << (chunk & 7)))) {
+		*p |= 1 << (chunk & 7);
+		bitmap->bits_set++;
+		mark_page_dirty(bitmap, index);
+	}
+}
+
+static void clear_disk_bit(struct bitmap *bitmap, unsigned long chunk)
+{
+	unsigned long index;
+	unsigned char *p = bitmap_byte(bitmap, chunk, &index);
+
+	if (*p & (1 << (chunk & 7))) {
+		*p &= ~(1 << (chunk & 7));
+		bitmap->bits_set--;
+		mark_page_dirty(bitmap, index);
+	}
+}
+
+static int test_disk_bit(struct bitmap *bitmap, unsigned long chunk)
+{
+	unsigned long index;
+	unsigned char *p = bitmap_byte(bitmap, chunk, &index);
+
+	return (*p >> (chunk & 7)) & 1;
+}
+
+/*
+ * Write out every page that has changed.  write_sem is held across the
+ * writes, so that when this returns, any bit that was set before it
+ * was called is on disk, even if another caller started writing its
+ * page first.  A page stays counted in unplug_pending until its write
+ * has finished, so when nothing is pending there is nothing to wait
+ * for and the semaphore is not taken at all.
+ */
+void bitmap_unplug(struct bitmap *bitmap)
+{
+	unsigned long i;
+
+	if (!bitmap || !atomic_read(&bitmap->unplug_pending))
+		return;
+
+	down(&bitmap->write_sem);
+	for (i = 0; i < bitmap->nr_pages; i++) {
+		if (!test_and_clear_bit(i, bitmap->dirty))
+			continue;
+		if (bitmap_page_io(bitmap, i, WRITE))
+			printk(KERN_ERR "md%d: bitmap write failed\n",
+				mdidx(bitmap->mddev));
+		atomic_dec(&bitmap->unplug_pending);
+	}
+	up(&bitmap->write_sem);
+}
+
+/*
+ * Record that a write to [offset, offset+sectors) of the components is
+ * about to start.  The caller must call bitmap_unplug() before issuing
+ * the write.
+ */
+void bitmap_startwrite(struct bitmap *bitmap, sector_t offset,
+		       unsigned long sectors)
+{
+	if (!bitmap)
+		return;
+
+	while (sectors) {
+		unsigned long chunk = offset >> bitmap->chunkshift;
+		sector_t blocks = ((sector_t)1 << bitmap->chunkshift)
+			- (offset & (((sector_t)1 << bitmap->chunkshift) - 1));
+		bitmap_counter_t *c;
+
+		if (chunk >= bitmap->chunks)
+			break;
+
+		spin_lock_irq(&bitmap->lock);
+		c = &bitmap->counts[chunk];
+		if (COUNTER(*c) == COUNTER_MAX) {
+			DEFINE_WAIT(wait);
+
+			prepare_to_wait(&bitmap->overflow_wait, &wait,
+					TASK_UNINTERRUPTIBLE);
+			spin_unlock_irq(&bitmap->lock);
+			blk_run_queues();
+			schedule();
+			finish_wait(&bitmap->overflow_wait, &wait);
+			continue;
+		}
+		switch (COUNTER(*c)) {
+		case 0:
+			set_disk_bit(bitmap, chunk);
+			*c += 2;
+			break;
+		case 1:
+			*c += 1;
+			/* fall through */
+		case 2:
+			bitmap->lazy--;
+			break;
+		}
+		(*c)++;
+		spin_unlock_irq(&bitmap->lock);
+
+		if (sectors <= blocks)
+			break;
+		offset += blocks;
+		sectors -= blocks;
+	}
+}
+
+/* A write started with bitmap_startwrite() has finished.  May be called
+ * from interrupt context.
+ */
+void bitmap_endwrite(struct bitmap *bitmap, sector_t offset,
+		     unsigned long sectors)
+{
+	unsigned long flags;
+
+	if (!bitmap)
+		return;
+
+	while (sectors) {
+		unsigned long chunk = offset >> bitmap->chunkshift;
+		sector_t blocks = ((sector_t)1 << bitmap->chunkshift)
+			- (offset & (((sector_t)1 << bitmap->chunkshift) - 1));
+		bitmap_counter_t *c;
+
+		if (chunk >= bitmap->chunks)
+			break;
+
+		spin_lock_irqsave(&bitmap->lock, flags);
+		c = &bitmap->counts[chunk];
+		if (COUNTER(*c) <= 2) {
+			spin_unlock_irqrestore(&bitmap->lock, flags);
+			printk(KERN_ERR "md%d: bitmap count underflow"
+				" for chunk %lu\n",
+				mdidx(bitmap->mddev), chunk);
+			return;
+		}
+		if (COUNTER(*c) == COUNTER_MAX)
+			wake_up(&bitmap->overflow_wait);
+		(*c)--;
+		if (COUNTER(*c) == 2)
+			bitmap->lazy++;
+		spin_unlock_irqrestore(&bitmap->lock, flags);
+
+		if (sectors <= blocks)
+			break;
+		offset += blocks;
+		sectors -= blocks;
+	}
+}
+
+/*
+ * Called by md_do_sync() for each resync request.  Returns 0 if the
+ * chunk holding 'offset' needs no resync; either way *blocks is set
+ * to the number of sectors left in that chunk.
+ */
+int bitmap_start_sync(struct bitmap *bitmap, sector_t offset,
+		      sector_t *blocks)
+{
+	unsigned long chunk = offset >> bitmap->chunkshift;
+	bitmap_counter_t *c;
+	int rv = 0;
+
+	*blocks = ((sector_t)1 << bitmap->chunkshift)
+		- (offset & (((sector_t)1 << bitmap->chunkshift) - 1));
+	if (chunk >= bitmap->chunks)
+		return 1;
+
+	spin_lock_irq(&bitmap->lock);
+	c = &bitmap->counts[chunk];
+	if (*c & RESYNC_MASK)
+		rv = 1;
+	else if (*c & NEEDED_MASK) {
+		*c = (*c & ~NEEDED_MASK) | RESYNC_MASK;
+		rv = 1;
+	}
+	spin_unlock_irq(&bitmap->lock);
+	return rv;
+}
+
+/*
+ * The resync has stopped with every sector below 'done' in sync (all
+ * of the resync I/O has completed by now).  Chunks below 'done' may
+ * have their bits cleared; the rest are left needing resync.
+ */
+void bitmap_close_sync(struct bitmap *bitmap, sector_t done)
+{
+	unsigned long chunk;
+
+	spin_lock_irq(&bitmap->lock);
+	for (chunk = 0; chunk < bitmap->chunks; chunk++) {
+		bitmap_counter_t *c = &bitmap->counts[chunk];
+
+		if (((sector_t)(chunk + 1) << bitmap->chunkshift) <= done)
+			*c &= ~(NEEDED_MASK | RESYNC_MASK);
+		else if (*c & RESYNC_MASK)
+			*c = (*c & ~RESYNC_MASK) | NEEDED_MASK;
+	}
+	spin_unlock_irq(&bitmap->lock);
+}
+
+/*
+ * Lazily clear the bits of chunks that have been idle for two passes.
+ * Nothing is cleared while the array is degraded: those chunks will
+ * need resyncing if we crash before the array is whole again.
+ */
+void bitmap_daemon_work(struct bitmap *bitmap)
+{
+	unsigned long chunk, end;
+
+	if (!bitmap)
+		return;
+	if (time_before(jiffies, bitmap->daemon_lastrun + bitmap->daemon_sleep))
+		return;
+	bitmap->daemon_lastrun = jiffies;
+	if (!bitmap->lazy || bitmap->mddev->degraded)
+		return;
+
+	for (chunk = 0; chunk < bitmap->chunks; ) {
+		end = chunk + BITMAP_DAEMON_SLICE;
+		if (end > bitmap->chunks)
+			end = bitmap->chunks;
+
+		spin_lock_irq(&bitmap->lock);
+		for ( ; chunk < end; chunk++) {
+			bitmap_counter_t *c = &bitmap->counts[chunk];
+
+			if (*c & (NEEDED_MASK | RESYNC_MASK))
+				continue;
+			if (*c == 2)
+				*c = 1;
+			else if (*c == 1) {
+				*c = 0;
+				bitmap->lazy--;
+				clear_disk_bit(bitmap, chunk);
+			}
+		}
+		spin_unlock_irq(&bitmap->lock);
+	}
+	bitmap_unplug(bitmap);
+}
+
+/* The array superblock has been written; record its event count. */
+void bitmap_update_sb(struct bitmap *bitmap)
+{
+	bitmap_super_t *sb;
+
+	if (!bitmap)
+		return;
+
+	spin_lock_irq(&bitmap->lock);
+	sb = (bitmap_super_t *)page_address(bitmap->pages[0]);
+	sb->events = bitmap->mddev->events;
+	mark_page_dirty(bitmap, 0);
+	spin_unlock_irq(&bitmap->lock);
+	bitmap_unplug(bitmap);
+}
+
+void bitmap_status(struct seq_file *seq, struct bitmap *bitmap)
+{
+	seq_printf(seq, "\n      bitmap: %lu/%lu chunks dirty, %luKB chunk, %s",
+		   bitmap->bits_set, bitmap->chunks,
+		   (512UL << bitmap->chunkshift) >> 10,
+		   bitmap->file ? "file" : "internal");
+}
+
+static void bitmap_free(struct bitmap *bitmap)
+{
+	unsigned long i;
+
+	if (bitmap->pages) {
+		for (i = 0; i < bitmap->nr_pages; i++)
+			if (bitmap->pages[i])
+				__free_page(bitmap->pages[i]);
+		kfree(bitmap->pages);
+	}
+	if (bitmap->dirty)
+		kfree(bitmap->dirty);
+	if (bitmap->counts)
+		vfree(bitmap->counts);
+	if (bitmap->blocks)
+		vfree(bitmap->blocks);
+	kfree(bitmap);
+}
+
+static int bitmap_alloc_pages(struct bitmap *bitmap, unsigned long bytes)
+{
+	struct page **pages;
+	unsigned long i, nr = (bytes + PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+	pages = kmalloc(nr * sizeof(struct page *), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+	memset(pages, 0, nr * sizeof(struct page *));
+	for (i = 0; i < bitmap->nr_pages; i++)
+		pages[i] = bitmap->pages[i];
+	for ( ; i < nr; i++) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		if (!pages[i])
+			break;
+		clear_highpage(pages[i]);
+	}
+	if (bitmap->pages)
+		kfree(bitmap->pages);
+	bitmap->pages = pages;
+	if (i < nr) {
+		bitmap->nr_pages = i;
+		return -ENOMEM;
+	}
+	bitmap->nr_pages = nr;
+	bitmap->bytes = bytes;
+
+	if (bitmap->dirty)
+		kfree(bitmap->dirty);
+	bitmap->dirty = kmalloc(((nr + BITS_PER_LONG - 1) / BITS_PER_LONG)
+				* sizeof(unsigned long), GFP_KERNEL);
+	if (!bitmap->dirty)
+		return -ENOMEM;
+	memset(bitmap->dirty, 0, ((nr + BITS_PER_LONG - 1) / BITS_PER_LONG)
+	       * sizeof(unsigned long));
+
+	if (bitmap->file)
+		return bitmap_map_file(bitmap);
+	return 0;
+}
+
+static inline sector_t bitmap_chunks(sector_t sectors, int shift)
+{
+	return (sectors + ((sector_t)1 << shift) - 1) >> shift;
+}
+
+static int uuid_zero(__u8 *uuid)
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+		if (uuid[i])
+			return 0;
+	return 1;
+}
+
+/*
+ * Load (or create) the bitmap for an array that is about to be run,
+ * from mddev->bitmap_file if that is set, else from the area after the
+ * superblocks.  After a clean shutdown every bit is cleared; after an
+ * unclean one the chunks with bits set are marked as needing resync,
+ * or all of them are if the bitmap is new or out of date.
+ */
+int bitmap_create(mddev_t *mddev)
+{
+	struct bitmap *bitmap;
+	bitmap_super_t *sb;
+	sector_t sectors = mddev->size << 1;
+	sector_t nr;
+	unsigned long space, chunk, sleep, i;
+	unsigned int chunksize;
+	int chunkshift, fresh, stale, err;
+
+	if (mddev->level != 1 && mddev->level != 4 && mddev->level != 5) {
+		printk(KERN_ERR "md%d: bitmaps are not supported for raid"
+			" level %d\n", mdidx(mddev), mddev->level);
+		return -EINVAL;
+	}
+	if (!mddev->bitmap_file &&
+	    (mddev->major_version != 0 || !mddev->persistent)) {
+		printk(KERN_ERR "md%d: an internal bitmap needs a persistent"
+			" 0.90 superblock\n", mdidx(mddev));
+		return -EINVAL;
+	}
+
+	bitmap = kmalloc(sizeof(*bitmap), GFP_KERNEL);
+	if (!bitmap)
+		return -ENOMEM;
+	memset(bitmap, 0, sizeof(*bitmap));
+	bitmap->mddev = mddev;
+	bitmap->lock = SPIN_LOCK_UNLOCKED;
+	init_waitqueue_head(&bitmap->overflow_wait);
+	atomic_set(&bitmap->unplug_pending, 0);
+	init_MUTEX(&bitmap->write_sem);
+
+	if (mddev->bitmap_file) {
+		struct inode *inode = mddev->bitmap_file->f_dentry->d_inode;
+		loff_t size = i_size_read(inode);
+
+		bitmap->file = mddev->bitmap_file;
+		bitmap->blkbits = inode->i_blkbits;
+		space = size < BITMAP_MAX_BYTES ? size : BITMAP_MAX_BYTES;
+	} else
+		space = MD_RESERVED_BYTES - MD_SB_BYTES;
+
+	err = -ENOSPC;
+	if (space <= BITMAP_SB_SIZE) {
+		printk(KERN_ERR "md%d: no room for a bitmap\n", mdidx(mddev));
+		goto out;
+	}
+
+	/* first just the header */
+	err = bitmap_alloc_pages(bitmap, BITMAP_SB_SIZE);
+	if (err)
+		goto out;
+	err = bitmap_page_io(bitmap, 0, READ);
+	if (err) {
+		printk(KERN_ERR "md%d: cannot read bitmap\n", mdidx(mddev));
+		goto out;
+	}
+	sb = (bitmap_super_t *)page_address(bitmap->pages[0]);
+
+	err = -EINVAL;
+	fresh = 1;
+	chunksize = 0;
+	sleep = BITMAP_DEFAULT_SLEEP;
+	if (sb->magic == BITMAP_MAGIC) {
+		if (sb->version != BITMAP_MAJOR) {
+			printk(KERN_ERR "md%d: bitmap version %u not"
+				" supported\n", mdidx(mddev), sb->version);
+			goto out;
+		}
+		chunksize = sb->chunksize;
+		if (sb->daemon_sleep)
+			sleep = sb->daemon_sleep;
+		fresh = uuid_zero(sb->uuid);
+		if (!fresh && memcmp(sb->uuid, mddev->uuid, 16)) {
+			printk(KERN_ERR "md%d: bitmap belongs to another"
+				" array\n", mdidx(mddev));
+			goto out;
+		}
+		if (!fresh && sb->sync_size != sectors) {
+			printk(KERN_ERR "md%d: bitmap is for %llu sectors,"
+				" array has %llu\n", mdidx(mddev),
+				(unsigned long long)sb->sync_size,
+				(unsigned long long)sectors);
+			goto out;
+		}
+		if (chunksize && (chunksize < PAGE_SIZE ||
+				  (chunksize & (chunksize - 1)))) {
+			printk(KERN_ERR "md%d: bad bitmap chunk size %u\n",
+				mdidx(mddev), chunksize);
+			goto out;
+		}
+	}
+	stale = !fresh && ((sb->state & BITMAP_STALE) ||
+			   sb->events + 1 < mddev->events);
+
+	/* a zero chunksize means the smallest one that fits */
+	chunkshift = ffz(~((chunksize ? chunksize : BITMAP_DEFAULT_CHUNK) >> 9));
+	for (;;) {
+		nr = bitmap_chunks(sectors, chunkshift);
+		if (nr <= BITMAP_MAX_CHUNKS &&
+		    BITMAP_SB_SIZE + ((unsigned long)nr + 7) / 8 <= space)
+			break;
+		if (chunksize) {
+			printk(KERN_ERR "md%d: bitmap chunk size %uKB is too"
+				" small for the space available\n",
+				mdidx(mddev), chunksize >> 10);
+			err = -ENOSPC;
+			goto out;
+		}
+		chunkshift++;
+	}
+	bitmap->chunkshift = chunkshift;
+	bitmap->chunks = nr;
+
+	err = -ENOMEM;
+	bitmap->counts = vmalloc(bitmap->chunks * sizeof(bitmap_counter_t));
+	if (!bitmap->counts)
+		goto out;
+	memset(bitmap->counts, 0, bitmap->chunks * sizeof(bitmap_counter_t));
+
+	err = bitmap_alloc_pages(bitmap, BITMAP_SB_SIZE + (bitmap->chunks + 7) / 8);
+	if (err)
+		goto out;
+	sb = (bitmap_super_t *)page_address(bitmap->pages[0]);
+
+	if (mddev->recovery_cp == MaxSector || fresh || stale)
+		/* the bits on disk will not be used */
+		memset((char *)sb + BITMAP_SB_SIZE, 0, PAGE_SIZE - BITMAP_SB_SIZE);
+	else {
+		unsigned long i;
+
+		/* page 0 too: only its header has been read so far */
+		for (i = 0; i < bitmap->nr_pages; i++) {
+			err = bitmap_page_io(bitmap, i, READ);
+			if (err) {
+				printk(KERN_ERR "md%d: cannot read bitmap\n",
+					mdidx(mddev));
+				goto out;
+			}
+		}
+	}
+
+	if (mddev->recovery_cp == MaxSector)
+		/* clean shutdown: nothing to resync */;
+	else if (fresh || stale) {
+		printk(KERN_INFO "md%d: bitmap is %s, resyncing all chunks\n",
+			mdidx(mddev), fresh ? "new" : "out of date");
+		for (chunk = 0; chunk < bitmap->chunks; chunk++) {
+			set_disk_bit(bitmap, chunk);
+			bitmap->counts[chunk] = NEEDED_MASK | 2;
+			bitmap->lazy++;
+		}
+	} else {
+		for (chunk = 0; chunk < bitmap->chunks; chunk++)
+			if (test_disk_bit(bitmap, chunk)) {
+				bitmap->bits_set++;
+				bitmap->counts[chunk] = NEEDED_MASK | 2;
+				bitmap->lazy++;
+			}
+		printk(KERN_INFO "md%d: bitmap has %lu of %lu chunks"
+			" to resync\n", mdidx(mddev), bitmap->bits_set,
+			bitmap->chunks);
+	}
+
+	if (fresh)
+		memset(sb, 0, BITMAP_SB_SIZE);
+	sb->magic = BITMAP_MAGIC;
+	sb->version = BITMAP_MAJOR;
+	memcpy(sb->uuid, mddev->uuid, 16);
+	sb->events = mddev->events;
+	sb->sync_size = sectors;
+	sb->chunksize = 512 << chunkshift;
+	sb->daemon_sleep = sleep;
+	sb->state &= ~BITMAP_STALE;
+
+	bitmap->daemon_sleep = sleep * HZ;
+	bitmap->daemon_lastrun = jiffies;
+
+	/* write the whole image back */
+	for (i = 0; i < bitmap->nr_pages; i++)
+		mark_page_dirty(bitmap, i);
+	bitmap_unplug(bitmap);
+
+	printk(KERN_INFO "md%d: bitmap of %lu chunks of %uKB in %s,"
+		" cleared every %lus\n", mdidx(mddev), bitmap->chunks,
+		sb->chunksize >> 10, bitmap->file ? "a file" : "the superblocks",
+		sleep);
+	mddev->bitmap = bitmap;
+	return 0;
+
+out:
+	bitmap_free(bitmap);
+	return err;
+}
+
+void bitmap_destroy(mddev_t *mddev)
+{
+	struct bitmap *bitmap = mddev->bitmap;
+
+	if (!bitmap)
+		return;
+
+	mddev->bitmap = NULL;
+	bitmap_unplug(bitmap);
+	bitmap_free(bitmap);
+}
+
+EXPORT_SYMBOL(bitmap_startwrite);
+EXPORT_SYMBOL(bitmap_endwrite);
+EXPORT_SYMBOL(bitmap_unplug);
@@ -0,0 +1,874 @@
+/*
+ * Copyright (C) 2003 Sistina Software Limited.
+ *
+ * This file is released under the GPL.
+ *
+ * Multipath target: io is spread over several paths to the same
+ * device by a path selector.  A path that returns an error is
+ * failed at once and the io retried on the others; failed paths
+ * are tested periodically and reinstated when they work again.
+ */
+
+#include "dm.h"
+#include "dm-path-selector.h"
+#include "dm-bio-list.h"
+
+#include <linux/ctype.h>
+#include <linux/init.h>
+#include <linux/mempool.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+/* seconds between attempts to reinstate failed paths */
+#define DEFAULT_TEST_INTERVAL 5
+
+#define MIN_IOS 256
+
+/* Path properties */
+struct pgpath {
+	struct list_head list;
+
+	struct multipath *m;
+	struct path path;
+
+	/* Cumulative failure count */
+	unsigned int fail_count;
+
+	/* a read of the first block is testing this failed path */
+	int testing;
+	struct page *test_page;
+};
+
+#define path_to_pgpath(__path) container_of((__path), struct pgpath, path)
+
+/* Multipath context */
+struct multipath {
+	struct dm_target *ti;
+
+	/* protects everything below, and the path selector */
+	spinlock_t lock;
+
+	unsigned int nr_paths;
+	unsigned int nr_valid_paths;
+	struct list_head paths;
+	struct path_selector ps;
+
+	/*
+	 * Hold io while no path is usable rather than failing it.
+	 * Held io keeps the device from suspending until a path
+	 * comes back.
+	 */
+	int queue_if_no_path;
+	unsigned long test_interval;	/* jiffies, 0 for no testing */
+	int suspended;
+
+	struct bio_list queued_ios;
+	unsigned int queue_size;
+
+	struct work_struct process_queued_ios;
+	struct work_struct test_paths;
+	struct work_struct trigger_event;
+
+	/* test reads in flight */
+	atomic_t test_ios;
+	wait_queue_head_t test_wait;
+
+	mempool_t *mpio_pool;
+};
+
+/*
+ * What we need to put back into a bio before it can be retried
+ * on another path or handed back to dm.
+ */
+struct mpath_io {
+	struct multipath *m;
+	struct pgpath *pgpath;
+
+	bio_end_io_t *bi_end_io;
+	void *bi_private;
+
+	sector_t bi_sector;
+	unsigned int bi_size;
+	unsigned short bi_idx;
+};
+
+static kmem_cache_t *_mpio_cache;
+
+/* queued io, path tests and table events are all run from here */
+static struct workqueue_struct *kmpathd;
+
+static void process_queued_ios(void *data);
+static void test_paths(void *data);
+static void trigger_event(void *data);
+static int multipath_end_io(struct bio *bio, unsigned int done, int error);
+
+/*-----------------------------------------------
+ * Allocation routines
+ *-----------------------------------------------*/
+static struct pgpath *alloc_pgpath(void)
+{
+	struct pgpath *pgpath = kmalloc(sizeof(*pgpath), GFP_KERNEL);
+
+	if (!pgpath)
+		return NULL;
+
+	memset(pgpath, 0, sizeof(*pgpath));
+	pgpath->path.is_active = 1;
+
+	pgpath->test_page = alloc_page(GFP_KERNEL);
+	if (!pgpath->test_page) {
+		kfree(pgpath);
+		return NULL;
+	}
+
+	return pgpath;
+}
+
+static void free_pgpath(struct dm_target *ti, struct pgpath *pgpath)
+{
+	dm_put_device(ti, pgpath->path.dev);
+	__free_page(pgpath->test_page);
+	kfree(pgpath);
+}
+
+static struct multipath *alloc_multipath(struct dm_target *ti)
+{
+	struct multipath *m;
+
+	m = kmalloc(sizeof(*m), GFP_KERNEL);
+	if (!m)
+		return NULL;
+
+	memset(m, 0, sizeof(*m));
+	m->ti = ti;
+	m->lock = SPIN_LOCK_UNLOCKED;
+	INIT_LIST_HEAD(&m->paths);
+	m->test_interval = DEFAULT_TEST_INTERVAL * HZ;
+	m->suspended = 1;
+	bio_list_init(&m->queued_ios);
+	INIT_WORK(&m->process_queued_ios, process_queued_ios, m);
+	INIT_WORK(&m->test_paths, test_paths, m);
+	INIT_WORK(&m->trigger_event, trigger_event, m);
+	atomic_set(&m->test_ios, 0);
+	init_waitqueue_head(&m->test_wait);
+
+	m->mpio_pool = mempool_create(MIN_IOS, mempool_alloc_slab,
+				      mempool_free_slab, _mpio_cache);
+	if (!m->mpio_pool) {
+		kfree(m);
+		return NULL;
+	}
+
+	return m;
+}
+
+static void free_multipath(struct multipath *m)
+{
+	struct pgpath *pgpath, *tmp;
+
+	if (m->ps.type) {
+		m->ps.type->destroy(&m->ps);
+		dm_put_path_selector(m->ps.type);
+	}
+
+	list_for_each_entry_safe(pgpath, tmp, &m->paths, list) {
+		list_del(&pgpath->list);
+		free_pgpath(m->ti, pgpath);
+	}
+
+	mempool_destroy(m->mpio_pool);
+	kfree(m);
+}
+
+/*-----------------------------------------------------------------
+ * Path failure and reinstatement, called with the lock held.
+ *---------------------------------------------------------------*/
+static void __fail_path(struct pgpath *pgpath)
+{
+	struct multipath *m = pgpath->m;
+	char b[32];
+
+	if (!pgpath->path.is_active)
+		return;
+
+	format_dev_t(b, pgpath->path.dev->bdev->bd_dev);
+	DMWARN("dm-multipath: failing path %s", b);
+
+	m->ps.type->fail_path(&m->ps, &pgpath->path);
+	pgpath->path.is_active = 0;
+	pgpath->fail_count++;
+	m->nr_valid_paths--;
+
+	queue_work(kmpathd, &m->trigger_event);
+}
+
+static void __reinstate_path(struct pgpath *pgpath)
+{
+	struct multipath *m = pgpath->m;
+	char b[32];
+
+	if (pgpath->path.is_active)
+		return;
+
+	if (m->ps.type->reinstate_path(&m->ps, &pgpath->path))
+		return;
+
+	format_dev_t(b, pgpath->path.dev->bdev->bd_dev);
+	DMINFO("dm-multipath: reinstating path %s", b);
+
+	pgpath->path.is_active = 1;
+	m->nr_valid_paths++;
+
+	if (m->queue_size)
+		queue_work(kmpathd, &m->process_queued_ios);
+
+	queue_work(kmpathd, &m->trigger_event);
+}
+
+/*-----------------------------------------------------------------
+ * Mapping io.
+ *---------------------------------------------------------------*/
+static void record_bio(struct mpath_io *mpio, struct bio *bio)
+{
+	mpio->bi_sector = bio->bi_sector;
+	mpio->bi_size = bio->bi_size;
+	mpio->bi_idx = bio->bi_idx;
+}
+
+static void restore_bio(struct mpath_io *mpio, struct bio *bio)
+{
+	bio->bi_sector = mpio->bi_sector;
+	bio->bi_size = mpio->bi_size;
+	bio->bi_idx = mpio->bi_idx;
+	set_bit(BIO_UPTODATE, &bio->bi_flags);
+}
+
+/*
+ * Gives the bio back to dm, with its own completion fields.
+ */
+static void release_bio(struct mpath_io *mpio, struct bio *bio)
+{
+	bio->bi_end_io = mpio->bi_end_io;
+	bio->bi_private = mpio->bi_private;
+	mempool_free(mpio, mpio->m->mpio_pool);
+}
+
+/*
+ * Points the bio down a path.  Returns 0 if there isn't one.
+ */
+static int __map_io(struct multipath *m, struct bio *bio,
+		    struct mpath_io *mpio)
+{
+	struct path *path;
+
+	path = m->ps.type->select_path(&m->ps);
+	if (!path)
+		return 0;
+
+	mpio->pgpath = path_to_pgpath(path);
+	bio->bi_bdev = path->dev->bdev;
+
+	if (m->ps.type->start_io)
+		m->ps.type->start_io(&m->ps, path);
+
+	return 1;
+}
+
+static inline void __queue_io(struct multipath *m, struct bio *bio)
+{
+	bio_list_add(&m->queued_ios, bio);
+	m->queue_size++;
+}
+
+static int multipath_map(struct dm_target *ti, struct bio *bio)
+{
+	struct multipath *m = (struct multipath *) ti->private;
+	struct mpath_io *mpio;
+	unsigned long flags;
+	int r = 1;
+
+	bio->bi_sector -= ti->begin;
+
+	mpio = mempool_alloc(m->mpio_pool, GFP_NOIO);
+	mpio->m = m;
+	mpio->pgpath = NULL;
+	mpio->bi_end_io = bio->bi_end_io;
+	mpio->bi_private = bio->bi_private;
+	record_bio(mpio, bio);
+
+	bio->bi_end_io = multipath_end_io;
+	bio->bi_private = mpio;
+
+	spin_lock_irqsave(&m->lock, flags);
+	if (!__map_io(m, bio, mpio)) {
+		if (m->queue_if_no_path) {
+			__queue_io(m, bio);
+			r = 0;
+		} else
+			r = -EIO;
+	}
+	spin_unlock_irqrestore(&m->lock, flags);
+
+	if (r < 0)
+		release_bio(mpio, bio);
+
+	return r;
+}
+
+/*
+ * Completion of a mapped io.  An error fails the path and sends
+ * the io round again on another, unless it was readahead, which
+ * may fail without anything being wrong.
+ */
+static int multipath_end_io(struct bio *bio, unsigned int done, int error)
+{
+	struct mpath_io *mpio = (struct mpath_io *) bio->bi_private;
+	struct multipath *m = mpio->m;
+	unsigned long flags;
+
+	if (bio->bi_size)
+		return 1;
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags) && !error)
+		error = -EIO;
+
+	spin_lock_irqsave(&m->lock, flags);
+
+	if (m->ps.type->end_io)
+		m->ps.type->end_io(&m->ps, &mpio->pgpath->path);
+
+	if (error && !(bio->bi_rw & (1 << BIO_RW_AHEAD))) {
+		__fail_path(mpio->pgpath);
+
+		if (m->nr_valid_paths || m->queue_if_no_path) {
+			restore_bio(mpio, bio);
+			__queue_io(m, bio);
+			spin_unlock_irqrestore(&m->lock, flags);
+
+			queue_work(kmpathd, &m->process_queued_ios);
+			return 0;
+		}
+	}
+
+	spin_unlock_irqrestore(&m->lock, flags);
+
+	release_bio(mpio, bio);
+	return bio->bi_end_io(bio, done, error);
+}
+
+/*
+ * Sends the queued ios down whatever paths are available now.
+ */
+static void process_queued_ios(void *data)
+{
+	struct multipath *m = (struct multipath *) data;
+	struct bio_list dispatch, failed;
+	struct bio *bio, *next;
+	struct mpath_io *mpio;
+	unsigned long flags;
+
+	bio_list_init(&dispatch);
+	bio_list_init(&failed);
+
+	spin_lock_irqsave(&m->lock, flags);
+	bio = bio_list_get(&m->queued_ios);
+	m->queue_size = 0;
+
+	while (bio) {
+		next = bio->bi_next;
+		mpio = (struct mpath_io *) bio->bi_private;
+
+		if (__map_io(m, bio, mpio))
+			bio_list_add(&dispatch, bio);
+		else if (m->queue_if_no_path)
+			__queue_io(m, bio);
+		else
+			bio_list_add(&failed, bio);
+
+		bio = next;
+	}
+	spin_unlock_irqrestore(&m->lock, flags);
+
+	bio = bio_list_get(&dispatch);
+	while (bio) {
+		next = bio->bi_next;
+		bio->bi_next = NULL;
+		generic_make_request(bio);
+		bio = next;
+	}
+	blk_run_queues();
+
+	bio = bio_list_get(&failed);
+	while (bio) {
+		next = bio->bi_next;
+		bio->bi_next = NULL;
+		release_bio((struct mpath_io *) bio->bi_private, bio);
+		bio_io_error(bio, bio->bi_size);
+		bio = next;
+	}
+}
+
+static void trigger_event(void *data)
+{
+	struct multipath *m = (struct multipath *) data;
+
+	dm_table_event(m->ti->table);
+}
+
+/*-----------------------------------------------------------------
+ * Failed paths are tested by reading their first block.
+ *---------------------------------------------------------------*/
+static int test_endio(struct bio *bio, unsigned int done, int error)
+{
+	struct pgpath *pgpath = (struct pgpath *) bio->bi_private;
+	struct multipath *m = pgpath->m;
+	unsigned long flags;
+
+	if (bio->bi_size)
+		return 1;
+
+	spin_lock_irqsave(&m->lock, flags);
+	pgpath->testing = 0;
+	if (test_bit(BIO_UPTODATE, &bio->bi_flags))
+		__reinstate_path(pgpath);
+	spin_unlock_irqrestore(&m->lock, flags);
+
+	bio_put(bio);
+
+	if (atomic_dec_and_test(&m->test_ios))
+		wake_up(&m->test_wait);
+
+	return 0;
+}
+
+static void submit_test_io(struct pgpath *pgpath)
+{
+	struct block_device *bdev = pgpath->path.dev->bdev;
+	struct bio *bio;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	bio->bi_bdev = bdev;
+	bio->bi_sector = 0;
+	bio->bi_end_io = test_endio;
+	bio->bi_private = pgpath;
+	bio_add_page(bio, pgpath->test_page, bdev_hardsect_size(bdev), 0);
+
+	atomic_inc(&pgpath->m->test_ios);
+	submit_bio(READ, bio);
+}
+
+static void test_paths(void *data)
+{
+	struct multipath *m = (struct multipath *) data;
+	struct pgpath *pgpath;
+	unsigned long flags;
+	int test;
+
+	list_for_each_entry(pgpath, &m->paths, list) {
+		spin_lock_irqsave(&m->lock, flags);
+		test = !m->suspended && !pgpath->path.is_active &&
+			!pgpath->testing;
+		if (test)
+			pgpath->testing = 1;
+		spin_unlock_irqrestore(&m->lock, flags);
+
+		if (test)
+			submit_test_io(pgpath);
+	}
+	blk_run_queues();
+
+	spin_lock_irqsave(&m->lock, flags);
+	if (!m->suspended)
+		queue_delayed_work(kmpathd, &m->test_paths, m->test_interval);
+	spin_unlock_irqrestore(&m->lock, flags);
+}
+
+static void start_path_tests(struct multipath *m)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&m->lock, flags);
+	m->suspended = 0;
+	if (m->test_interval)
+		queue_delayed_work(kmpathd, &m->test_paths, m->test_interval);
+	spin_unlock_irqrestore(&m->lock, flags);
+}
+
+static void stop_path_tests(struct multipath *m)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&m->lock, flags);
+	m->suspended = 1;
+	spin_unlock_irqrestore(&m->lock, flags);
+
+	cancel_delayed_work(&m->test_paths);
+	flush_workqueue(kmpathd);
+	wait_event(m->test_wait, !atomic_read(&m->test_ios));
+}
+
+/*-----------------------------------------------------------------
+ * Constructor/argument parsing:
+ * <#features> [<feature>...] <path selector>
+ * <#paths> <#per path selector args> [<dev> [<selector args>...]]...
+ *
+ * The features are "queue_if_no_path" and "test_interval <secs>".
+ *---------------------------------------------------------------*/
+struct arg_set {
+	unsigned int argc;
+	char **argv;
+};
+
+static char *shift(struct arg_set *as)
+{
+	char *r;
+
+	if (as->argc) {
+		as->argc--;
+		r = *as->argv;
+		as->argv++;
+		return r;
+	}
+
+	return NULL;
+}
+
+static void consume(struct arg_set *as, unsigned int n)
+{
+	BUG_ON(as->argc < n);
+	as->argc -= n;
+	as->argv += n;
+}
+
+static int read_param(unsigned int min, unsigned int max, char *str,
+		      unsigned int *v, char **error, char *errmsg)
+{
+	if (!str ||
+	    (sscanf(str, "%u", v) != 1) ||
+	    (*v < min) ||
+	    (*v > max)) {
+		*error = errmsg;
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int parse_features(struct arg_set *as, struct multipath *m,
+			  struct dm_target *ti)
+{
+	int r;
+	unsigned int argc, secs;
+	char *param;
+
+	r = read_param(0, 3, shift(as), &argc, &ti->error,
+		       "invalid number of feature args");
+	if (r)
+		return r;
+
+	if (argc > as->argc) {
+		ti->error = "not enough feature arguments";
+		return -EINVAL;
+	}
+
+	while (argc) {
+		param = shift(as);
+		argc--;
+
+		if (!strnicmp(param, "queue_if_no_path", 16)) {
+			m->queue_if_no_path = 1;
+			continue;
+		}
+
+		if (!strnicmp(param, "test_interval", 13) && argc) {
+			r = read_param(0, 3600, shift(as), &secs, &ti->error,
+				       "invalid test interval");
+			if (r)
+				return r;
+
+			argc--;
+			m->test_interval = secs * HZ;
+			continue;
+		}
+
+		ti->error = "Unrecognised multipath feature request";
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int parse_path_selector(struct arg_set *as, struct multipath *m,
+			       struct dm_target *ti)
+{
+	int r;
+	struct path_selector_type *pst;
+
+	pst = dm_get_path_selector(shift(as));
+	if (!pst) {
+		ti->error = "unknown path selector type";
+		return -EINVAL;
+	}
+
+	r = pst->create(&m->ps, 0, NULL);
+	if (r) {
+		dm_put_path_selector(pst);
+		ti->error = "path selector constructor failed";
+		return r;
+	}
+
+	m->ps.type = pst;
+	return 0;
+}
+
+static int parse_path(struct arg_set *as, unsigned int nr_args,
+		      struct multipath *m, struct dm_target *ti)
+{
+	int r;
+	struct pgpath *p;
+
+	/* we need at least a path arg */
+	if (as->argc < 1 + nr_args) {
+		ti->error = "not enough path parameters";
+		return -EINVAL;
+	}
+
+	p = alloc_pgpath();
+	if (!p) {
+		ti->error = "couldn't allocate path";
+		return -ENOMEM;
+	}
+
+	r = dm_get_device(ti, shift(as), 0, ti->len,
+			  dm_table_get_mode(ti->table), &p->path.dev);
+	if (r) {
+		ti->error = "error getting device";
+		__free_page(p->test_page);
+		kfree(p);
+		return r;
+	}
+
+	r = m->ps.type->add_path(&m->ps, &p->path, nr_args, as->argv,
+				 &ti->error);
+	if (r) {
+		free_pgpath(ti, p);
+		return r;
+	}
+	consume(as, nr_args);
+
+	p->m = m;
+	list_add_tail(&p->list, &m->paths);
+	m->nr_paths++;
+	m->nr_valid_paths++;
+
+	return 0;
+}
+
+static int multipath_ctr(struct dm_target *ti, unsigned int argc,
+			 char **argv)
+{
+	int r;
+	struct multipath *m;
+	struct arg_set as;
+	unsigned int nr_paths, nr_args;
+
+	as.argc = argc;
+	as.argv = argv;
+
+	m = alloc_multipath(ti);
+	if (!m) {
+		ti->error = "can't allocate multipath";
+		return -EINVAL;
+	}
+
+	r = parse_features(&as, m, ti);
+	if (r)
+		goto bad;
+
+	r = parse_path_selector(&as, m, ti);
+	if (r)
+		goto bad;
+
+	r = read_param(1, 1024, shift(&as), &nr_paths, &ti->error,
+		       "invalid number of paths");
+	if (r)
+		goto bad;
+
+	r = read_param(0, 1024, shift(&as), &nr_args, &ti->error,
+		       "invalid number of selector args");
+	if (r)
+		goto bad;
+
+	while (nr_paths--) {
+		r = parse_path(&as, nr_args, m, ti);
+		if (r)
+			goto bad;
+	}
+
+	if (as.argc) {
+		ti->error = "too many arguments";
+		r = -EINVAL;
+		goto bad;
+	}
+
+	ti->private = m;
+	return 0;
+
+      bad:
+	free_multipath(m);
+	return r;
+}
+
+static void multipath_dtr(struct dm_target *ti)
+{
+	struct multipath *m = (struct multipath *) ti->private;
+
+	stop_path_tests(m);
+	flush_workqueue(kmpathd);
+	free_multipath(m);
+}
+
+static void multipath_suspend(struct dm_target *ti)
+{
+	stop_path_tests((struct multipath *) ti->private);
+}
+
+static void multipath_resume(struct dm_target *ti)
+{
+	start_path_tests((struct multipath *) ti->private);
+}
+
+/*
+ * Info output has the following format:
+ * num_queued num_valid_paths num_paths
+ * [<path> <A|F> <fail_count> [<selector info>]]...
+ *
+ * Table output has the following format (identical to the constructor string):
+ * num_features [features] path_selector num_paths num_selector_args
+ * [<path> [<selector args>]]...
+ */
+#define EMIT(x...) sz += ((sz >= maxlen) ? \
+			  0 : snprintf(result + sz, maxlen - sz, x))
+
+static int multipath_status(struct dm_target *ti, status_type_t type,
+			    char *result, unsigned int maxlen)
+{
+	int sz = 0;
+	unsigned long flags;
+	struct multipath *m = (struct multipath *) ti->private;
+	struct path_selector *ps = &m->ps;
+	struct pgpath *p;
+	char buffer[32];
+	char psbuf[32];
+
+	spin_lock_irqsave(&m->lock, flags);
+
+	switch (type) {
+	case STATUSTYPE_INFO:
+		EMIT("%u %u %u", m->queue_size, m->nr_valid_paths, m->nr_paths);
+
+		list_for_each_entry(p, &m->paths, list) {
+			format_dev_t(buffer, p->path.dev->bdev->bd_dev);
+			EMIT(" %s %c %u", buffer,
+			     p->path.is_active ? 'A' : 'F', p->fail_count);
+
+			if (ps->type->status) {
+				ps->type->status(ps, &p->path, type,
+						 psbuf, sizeof(psbuf));
+				if (*psbuf)
+					EMIT(" %s", psbuf);
+			}
+		}
+		break;
+
+	case STATUSTYPE_TABLE:
+		if (m->test_interval != DEFAULT_TEST_INTERVAL * HZ)
+			EMIT("%u test_interval %lu ", m->queue_if_no_path + 2,
+			     m->test_interval / HZ);
+		else
+			EMIT("%u ", m->queue_if_no_path);
+
+		if (m->queue_if_no_path)
+			EMIT("queue_if_no_path ");
+
+		EMIT("%s %u %u", ps->type->name, m->nr_paths,
+		     ps->type->table_args);
+
+		list_for_each_entry(p, &m->paths, list) {
+			format_dev_t(buffer, p->path.dev->bdev->bd_dev);
+			EMIT(" %s", buffer);
+
+			if (ps->type->status && ps->type->table_args) {
+				ps->type->status(ps, &p->path, type,
+						 psbuf, sizeof(psbuf));
+				EMIT(" %s", psbuf);
+			}
+		}
+		break;
+	}
+
+	spin_unlock_irqrestore(&m->lock, flags);
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------
+ * Module setup
+ *---------------------------------------------------------------*/
+static struct target_type multipath_target = {
+	.name = "multipath",
+	.module = THIS_MODULE,
+	.ctr = multipath_ctr,
+	.dtr = multipath_dtr,
+	.map = multipath_map,
+	.suspend = multipath_suspend,
+	.resume = multipath_resume,
+	.status = multipath_status,
+};
+
+static int __init dm_multipath_init(void)
+{
+	int r;
+
+	/* allocate a slab for the dm_ios */
+	_mpio_cache = kmem_cache_create("dm_mpath", sizeof(struct mpath_io),
+					0, 0, NULL, NULL);
+	if (!_mpio_cache)
+		return -ENOMEM;
+
+	kmpathd = alloc_workqueue("kmpathd", WQ_MEM_RECLAIM, 0);
+	if (!kmpathd) {
+		DMERR("multipath: failed to create workqueue kmpathd");
+		kmem_cache_destroy(_mpio_cache);
+		return -ENOMEM;
+	}
+
+	r = dm_register_target(&multipath_target);
+	if (r < 0) {
+		DMERR("multipath: register failed %d", r);
+		destroy_workqueue(kmpathd);
+		kmem_cache_destroy(_mpio_cache);
+		return r;
+	}
+
+	return 0;
+}
+
+static void __exit dm_multipath_exit(void)
+{
+	int r;
+
+	r = dm_unregister_target(&multipath_target);
+	if (r < 0)
+		DMERR("multipath: target unregister failed %d", r);
+
+	destroy_workqueue(kmpathd);
+	kmem_cache_destroy(_mpio_cache);
+}
+
+module_init(dm_multipath_init);
+module_exit(dm_multipath_exit);
+
+MODULE_DESCRIPTION(DM_NAME " multipath target");
+MODULE_LICENSE("GPL");
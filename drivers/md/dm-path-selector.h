@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2003 Sistina Software.
+ *
+ * This file is released under the GPL.
+ *
+ * Path-Selector registration.
+ */
+
+#ifndef	DM_PATH_SELECTOR_H
+#define	DM_PATH_SELECTOR_H
+
+#include <linux/device-mapper.h>
+
+/*
+ * The part of a multipath path that the selectors see.
+ */
+struct path {
+	struct dm_dev *dev;
+
+	/* for the selector's own use */
+	void *pscontext;
+
+	/* 0 if the path has failed and not yet been reinstated */
+	unsigned int is_active;
+};
+
+struct path_selector_type;
+struct path_selector {
+	struct path_selector_type *type;
+	void *context;
+};
+
+/*
+ * Information about a path selector type.  All the methods but
+ * create and destroy are called with the multipath's spinlock
+ * held, some of them from interrupt context, so they must not
+ * block.
+ */
+struct path_selector_type {
+	char *name;
+	struct module *module;
+
+	/* number of table arguments each path takes */
+	unsigned int table_args;
+
+	/*
+	 * Constructs a path selector object, takes custom arguments
+	 */
+	int (*create) (struct path_selector *ps, unsigned argc, char **argv);
+	void (*destroy) (struct path_selector *ps);
+
+	/*
+	 * Add an opaque path object, along with some selector
+	 * specific path args (eg, path priority).
+	 */
+	int (*add_path) (struct path_selector *ps, struct path *path,
+			 int argc, char **argv, char **error);
+
+	/*
+	 * Chooses a path for the next io, or NULL if none of the
+	 * paths are usable.
+	 */
+	struct path *(*select_path) (struct path_selector *ps);
+
+	/*
+	 * Notify the selector that a path has failed.
+	 */
+	void (*fail_path) (struct path_selector *ps, struct path *p);
+
+	/*
+	 * Ask selector to reinstate a path.
+	 */
+	int (*reinstate_path) (struct path_selector *ps, struct path *p);
+
+	/*
+	 * An io has been sent down a path, or has completed on it.
+	 * Optional.
+	 */
+	void (*start_io) (struct path_selector *ps, struct path *p);
+	void (*end_io) (struct path_selector *ps, struct path *p);
+
+	/*
+	 * Table content based on parameters added in ctr.  With
+	 * a NULL path, the selector's own arguments.
+	 */
+	int (*status) (struct path_selector *ps, struct path *path,
+		       status_type_t type, char *result, unsigned int maxlen);
+};
+
+/* Register a path selector */
+int dm_register_path_selector(struct path_selector_type *type);
+
+/* Unregister a path selector */
+int dm_unregister_path_selector(struct path_selector_type *type);
+
+/* Returns a registered path selector type */
+struct path_selector_type *dm_get_path_selector(const char *name);
+
+/* Releases a path selector  */
+void dm_put_path_selector(struct path_selector_type *pst);
+
+#endif
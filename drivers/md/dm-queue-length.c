@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2003 Sistina Software.
+ *
+ * This file is released under the GPL.
+ *
+ * Queue-length path selector: sends each io down the path with
+ * the fewest ios in flight, so a slow or busy path gets less of
+ * the load.
+ */
+
+#include "dm.h"
+#include "dm-path-selector.h"
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+
+struct path_info {
+	struct list_head list;
+	struct path *path;
+
+	/* ios in flight on this path */
+	unsigned int qlen;
+};
+
+struct selector {
+	struct list_head valid_paths;
+	struct list_head failed_paths;
+};
+
+static void free_paths(struct list_head *paths)
+{
+	struct path_info *pi, *next;
+
+	list_for_each_entry_safe(pi, next, paths, list) {
+		list_del(&pi->list);
+		kfree(pi);
+	}
+}
+
+static int ql_create(struct path_selector *ps, unsigned argc, char **argv)
+{
+	struct selector *s = kmalloc(sizeof(*s), GFP_KERNEL);
+
+	if (!s)
+		return -ENOMEM;
+
+	INIT_LIST_HEAD(&s->valid_paths);
+	INIT_LIST_HEAD(&s->failed_paths);
+	ps->context = s;
+
+	return 0;
+}
+
+static void ql_destroy(struct path_selector *ps)
+{
+	struct selector *s = (struct selector *) ps->context;
+
+	free_paths(&s->valid_paths);
+	free_paths(&s->failed_paths);
+	kfree(s);
+	ps->context = NULL;
+}
+
+static int ql_status(struct path_selector *ps, struct path *path,
+		     status_type_t type, char *result, unsigned int maxlen)
+{
+	struct path_info *pi;
+
+	if (!path || type != STATUSTYPE_INFO) {
+		result[0] = '\0';
+		return 0;
+	}
+
+	pi = (struct path_info *) path->pscontext;
+	snprintf(result, maxlen, "%u", pi->qlen);
+
+	return 0;
+}
+
+static int ql_add_path(struct path_selector *ps, struct path *path,
+		       int argc, char **argv, char **error)
+{
+	struct selector *s = (struct selector *) ps->context;
+	struct path_info *pi;
+
+	if (argc) {
+		*error = "queue-length ps: takes no path arguments";
+		return -EINVAL;
+	}
+
+	pi = kmalloc(sizeof(*pi), GFP_KERNEL);
+	if (!pi) {
+		*error = "queue-length ps: Error allocating path information";
+		return -ENOMEM;
+	}
+
+	pi->path = path;
+	pi->qlen = 0;
+
+	path->pscontext = pi;
+
+	list_add_tail(&pi->list, &s->valid_paths);
+
+	return 0;
+}
+
+static void ql_fail_path(struct path_selector *ps, struct path *path)
+{
+	struct selector *s = (struct selector *) ps->context;
+	struct path_info *pi = (struct path_info *) path->pscontext;
+
+	list_move(&pi->list, &s->failed_paths);
+}
+
+static int ql_reinstate_path(struct path_selector *ps, struct path *path)
+{
+	struct selector *s = (struct selector *) ps->context;
+	struct path_info *pi = (struct path_info *) path->pscontext;
+
+	list_move_tail(&pi->list, &s->valid_paths);
+
+	return 0;
+}
+
+/*
+ * The chosen path goes to the back of the list, so paths with
+ * equal queues take turns.
+ */
+static struct path *ql_select_path(struct path_selector *ps)
+{
+	struct selector *s = (struct selector *) ps->context;
+	struct path_info *pi, *best = NULL;
+
+	list_for_each_entry(pi, &s->valid_paths, list) {
+		if (!best || pi->qlen < best->qlen)
+			best = pi;
+
+		if (!best->qlen)
+			break;
+	}
+
+	if (!best)
+		return NULL;
+
+	list_move_tail(&best->list, &s->valid_paths);
+
+	return best->path;
+}
+
+static void ql_start_io(struct path_selector *ps, struct path *path)
+{
+	struct path_info *pi = (struct path_info *) path->pscontext;
+
+	pi->qlen++;
+}
+
+static void ql_end_io(struct path_selector *ps, struct path *path)
+{
+	struct path_info *pi = (struct path_info *) path->pscontext;
+
+	pi->qlen--;
+}
+
+static struct path_selector_type ql_ps = {
+	.name = "queue-length",
+	.module = THIS_MODULE,
+	.table_args = 0,
+	.create = ql_create,
+	.destroy = ql_destroy,
+	.status = ql_status,
+	.add_path = ql_add_path,
+	.fail_path = ql_fail_path,
+	.reinstate_path = ql_reinstate_path,
+	.select_path = ql_select_path,
+	.start_io = ql_start_io,
+	.end_io = ql_end_io,
+};
+
+static int __init dm_ql_init(void)
+{
+	int r = dm_register_path_selector(&ql_ps);
+
+	if (r < 0)
+		DMERR("queue-length: register failed %d", r);
+
+	return r;
+}
+
+static void __exit dm_ql_exit(void)
+{
+	int r = dm_unregister_path_selector(&ql_ps);
+
+	if (r < 0)
+		DMERR("queue-length: unregister failed %d", r);
+}
+
+module_init(dm_ql_init);
+module_exit(dm_ql_exit);
+
+MODULE_DESCRIPTION(DM_NAME " queue-length multipath path selector");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,1892 @@
+/*
+ * dm-thin.c
+ *
+ * Copyright (C) 2003 Sistina Software
+ *
+ * This file is released under the GPL.
+ *
+ * Thin provisioning.  A "thin-pool" target owns a data device,
+ * split into fixed size blocks, and a metadata device recording
+ * which block backs each block of each thin device.  "thin"
+ * targets are devices of any size carved out of a pool: a block is
+ * only allocated the first time it is written, so the thin devices
+ * of a pool may add up to more than the data device.
+ *
+ * A new thin device may be created as a snapshot of another one in
+ * the same pool.  It starts out sharing all of its origin's blocks,
+ * and a block is only copied when either side writes to it, so a
+ * snapshot costs no space up front, unlike a dm-snapshot COW
+ * device that must be allocated in full before it is used.
+ */
+
+#include <linux/blkdev.h>
+#include <linux/config.h>
+#include <linux/list.h>
+#include <linux/fs.h>
+#include <linux/mempool.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/highmem.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/hash.h>
+#include <linux/err.h>
+#include <asm/byteorder.h>
+
+#include "dm.h"
+#include "dm-bio-list.h"
+#include "kcopyd.h"
+
+/*
+ * Each pool reserves this many pages for copying shared blocks,
+ * which also bounds the block size.
+ */
+#define THIN_PAGES 256
+
+/*-----------------------------------------------------------------
+ * The metadata device is a header block followed by a log of
+ * entries, in 4k blocks whatever the page size.  An entry either
+ * maps a block of a thin device to a data block, superseding any
+ * earlier entry for the same block, or creates a thin device.
+ * The end of the log is marked by an entry of type 0, and the
+ * block after the one being filled is always zeroed on disk, so
+ * that a log ending exactly at a block boundary is still
+ * terminated.
+ *
+ * Which data blocks are in use, and by how many thin devices, is
+ * not stored: it is worked out from the log when the pool is
+ * loaded.  Data is always written before the entry that maps it,
+ * so after a crash an unlogged block is simply free again.
+ *
+ * All on disk structures are in little-endian format.
+ *---------------------------------------------------------------*/
+#define THIN_MAGIC 0x6e696854		/* "Thin" */
+#define THIN_DISK_VERSION 1
+
+#define METADATA_BLOCK_SIZE 4096
+#define METADATA_SECTORS (METADATA_BLOCK_SIZE >> SECTOR_SHIFT)
+
+struct disk_header {
+	uint32_t magic;
+	uint32_t version;
+
+	/* In sectors */
+	uint32_t block_size;
+	uint32_t pad;
+};
+
+/*
+ * The top byte of 'dev' is the entry type, the rest the thin
+ * device id.  A create entry holds the origin's id + 1 in 'virt',
+ * or 0 for an empty device.
+ */
+struct disk_entry {
+	uint64_t virt;
+	uint32_t dev;
+	uint32_t data;
+};
+
+#define ENTRY_END	0
+#define ENTRY_MAP	1
+#define ENTRY_CREATE	2
+
+#define ENTRIES_PER_BLOCK (METADATA_BLOCK_SIZE / sizeof(struct disk_entry))
+#define MAX_DEV_ID ((1 << 24) - 1)
+#define MAX_REFS 0xffff
+
+typedef sector_t block_t;
+
+/*
+ * A block of a thin device that is backed by a data block.
+ */
+struct mapping {
+	struct list_head hash_list;
+
+	uint32_t dev;
+	uint32_t data;
+	block_t virt;
+};
+
+struct mapping_table {
+	uint32_t hash_mask;
+	struct list_head *table;
+};
+
+struct thin_dev {
+	struct list_head list;
+
+	uint32_t id;
+
+	/* Set once the create entry is on disk */
+	int created;
+
+	/* Blocks mapped, for the status line */
+	block_t mapped;
+};
+
+struct pool {
+	/* Pools are found by their metadata device */
+	struct list_head list;
+	unsigned int ref;
+
+	struct block_device *metadata_bdev;
+	struct block_device *data_bdev;
+	struct dm_table *table;
+
+	/* Size of data blocks - must be a power of 2 */
+	sector_t block_size;
+	sector_t block_mask;
+	unsigned int block_shift;
+
+	/*
+	 * Protects the mappings and the reference counts.  The list
+	 * of thin devices only changes under _pools_lock.
+	 */
+	spinlock_t lock;
+	struct mapping_table mappings;
+	struct mapping_table pending;
+	struct list_head devs;
+
+	/* How many thin devices use each data block */
+	uint16_t *refs;
+	uint32_t nr_blocks;
+	uint32_t nr_free;
+	uint32_t alloc_rotor;
+
+	/*
+	 * An event is raised when the free blocks fall to
+	 * low_water, so that user space can grow the data device.
+	 */
+	uint32_t low_water;
+	int low_water_hit;
+	int no_space;
+
+	/* Non-zero once the metadata can't be updated */
+	int error;
+
+	/*
+	 * New mappings whose data is on disk, waiting to be
+	 * logged.  Added to from interrupt context.
+	 */
+	spinlock_t prepared_lock;
+	struct list_head prepared;
+	struct work_struct worker;
+
+	/*
+	 * Serialises updates of the log.  'area' holds the block
+	 * being filled.
+	 */
+	struct semaphore commit_sem;
+	void *area;
+	uint32_t log_block;
+	uint32_t log_entries;
+	uint32_t nr_log_blocks;
+
+	/* Written over a newly allocated block */
+	struct page *zero_page;
+
+	struct kcopyd_client *copier;
+};
+
+/*
+ * A data block being filled in for a thin device: zeroed, copied
+ * from the block it used to share, or overwritten by a single bio
+ * covering all of it.
+ */
+struct new_mapping {
+	struct mapping m;
+	struct list_head list;
+
+	struct pool *pool;
+	struct thin_dev *td;
+	int err;
+
+	/* Outstanding zeroing bios, plus one while submitting */
+	atomic_t io_count;
+
+	/* Io waiting for the block to be logged */
+	struct bio_list bios;
+
+	/*
+	 * The bio that overwrites the whole block, if any.  Its
+	 * completion is held back until the mapping is on disk.
+	 */
+	struct bio *full_bio;
+	bio_end_io_t *full_end_io;
+	void *full_private;
+	unsigned int full_size;
+};
+
+static kmem_cache_t *mapping_cache;
+static kmem_cache_t *new_mapping_cache;
+static mempool_t *new_mapping_pool;
+
+static LIST_HEAD(_pools);
+static DECLARE_MUTEX(_pools_lock);
+
+static struct workqueue_struct *_kthinpd;
+
+/*-----------------------------------------------------------------
+ * Mapping hash tables, as for snapshot exceptions.
+ *---------------------------------------------------------------*/
+static int init_mapping_table(struct mapping_table *mt, uint32_t size)
+{
+	unsigned int i;
+
+	mt->hash_mask = size - 1;
+	mt->table = vmalloc(sizeof(struct list_head) * size);
+	if (!mt->table)
+		return -ENOMEM;
+
+	for (i = 0; i < size; i++)
+		INIT_LIST_HEAD(mt->table + i);
+
+	return 0;
+}
+
+static void exit_mapping_table(struct mapping_table *mt)
+{
+	struct mapping *m, *n;
+	unsigned int i;
+
+	for (i = 0; i <= mt->hash_mask; i++)
+		list_for_each_entry_safe (m, n, mt->table + i, hash_list)
+			kmem_cache_free(mapping_cache, m);
+
+	vfree(mt->table);
+}
+
+static inline uint32_t mapping_hash(struct mapping_table *mt, uint32_t dev,
+				    block_t virt)
+{
+	return ((uint32_t) virt ^ (dev * GOLDEN_RATIO_PRIME)) & mt->hash_mask;
+}
+
+static void insert_mapping(struct mapping_table *mt, struct mapping *m)
+{
+	list_add(&m->hash_list, &mt->table[mapping_hash(mt, m->dev, m->virt)]);
+}
+
+static struct mapping *lookup_mapping(struct mapping_table *mt, uint32_t dev,
+				      block_t virt)
+{
+	struct mapping *m;
+
+	list_for_each_entry (m, &mt->table[mapping_hash(mt, dev, virt)],
+			     hash_list)
+		if (m->virt == virt && m->dev == dev)
+			return m;
+
+	return NULL;
+}
+
+/*
+ * Hard coded magic.
+ */
+static int calc_max_buckets(void)
+{
+	unsigned long mem;
+
+	mem = num_physpages << PAGE_SHIFT;
+	mem /= 50;
+	mem /= sizeof(struct list_head);
+
+	return mem;
+}
+
+/*
+ * Rounds a number down to a power of 2.
+ */
+static inline uint32_t round_down(uint32_t n)
+{
+	while (n & (n - 1))
+		n &= (n - 1);
+	return n;
+}
+
+static int init_hash_tables(struct pool *p)
+{
+	uint32_t hash_size;
+
+	hash_size = min_t(uint32_t, p->nr_blocks, calc_max_buckets());
+	hash_size = round_down(hash_size);
+	if (hash_size < 64)
+		hash_size = 64;
+
+	if (init_mapping_table(&p->mappings, hash_size))
+		return -ENOMEM;
+
+	hash_size >>= 3;
+	if (hash_size < 64)
+		hash_size = 64;
+
+	if (init_mapping_table(&p->pending, hash_size)) {
+		exit_mapping_table(&p->mappings);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------
+ * Data block allocation.  Called with the pool lock held.
+ *---------------------------------------------------------------*/
+static inline void inc_ref(struct pool *p, uint32_t b)
+{
+	if (!p->refs[b]++)
+		p->nr_free--;
+}
+
+static inline void dec_ref(struct pool *p, uint32_t b)
+{
+	if (!--p->refs[b])
+		p->nr_free++;
+}
+
+/*
+ * Allocation carries on from the last block handed out, so a
+ * block that has just been freed isn't reused straight away, and
+ * a thin device written sequentially gets sequential blocks.
+ */
+static int __alloc_block(struct pool *p, uint32_t *result)
+{
+	uint32_t b = p->alloc_rotor;
+
+	if (!p->nr_free)
+		return -ENOSPC;
+
+	while (p->refs[b])
+		if (++b == p->nr_blocks)
+			b = 0;
+
+	inc_ref(p, b);
+	p->alloc_rotor = b + 1 == p->nr_blocks ? 0 : b + 1;
+
+	if (p->nr_free <= p->low_water && !p->low_water_hit) {
+		p->low_water_hit = 1;
+		return 1;
+	}
+
+	return 0;
+}
+
+static struct thin_dev *__find_dev(struct pool *p, uint32_t id)
+{
+	struct thin_dev *td;
+
+	list_for_each_entry (td, &p->devs, list)
+		if (td->id == id)
+			return td;
+
+	return NULL;
+}
+
+static struct thin_dev *__add_dev(struct pool *p, uint32_t id)
+{
+	struct thin_dev *td;
+
+	td = kmalloc(sizeof(*td), GFP_KERNEL);
+	if (!td)
+		return NULL;
+
+	td->id = id;
+	td->created = 0;
+	td->mapped = 0;
+	list_add_tail(&td->list, &p->devs);
+
+	return td;
+}
+
+/*-----------------------------------------------------------------
+ * Metadata io.  Only ever done by one thread at a time, under the
+ * commit semaphore or while the pool is being set up.
+ *---------------------------------------------------------------*/
+struct sync_io {
+	int error;
+	struct completion done;
+};
+
+static int sync_endio(struct bio *bio, unsigned int done, int error)
+{
+	struct sync_io *io = bio->bi_private;
+
+	if (bio->bi_size)
+		return 1;
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		io->error = 1;
+
+	complete(&io->done);
+	return 0;
+}
+
+static int metadata_io(struct pool *p, void *buffer, uint32_t block, int rw)
+{
+	struct sync_io io;
+	struct bio *bio;
+
+	io.error = 0;
+	init_completion(&io.done);
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	bio->bi_bdev = p->metadata_bdev;
+	bio->bi_sector = (sector_t) block * METADATA_SECTORS;
+	bio->bi_end_io = sync_endio;
+	bio->bi_private = &io;
+	bio_add_page(bio, virt_to_page(buffer), METADATA_BLOCK_SIZE,
+		     offset_in_page(buffer));
+
+	submit_bio(rw, bio);
+	blk_run_queues();
+	wait_for_completion(&io.done);
+	bio_put(bio);
+
+	return io.error ? -EIO : 0;
+}
+
+/*
+ * Moves on to the next log block once 'area' is full.
+ */
+static int log_roll(struct pool *p)
+{
+	int r;
+
+	if (p->log_block + 1 >= p->nr_log_blocks)
+		return -ENOSPC;
+
+	r = metadata_io(p, p->area, p->log_block, WRITE);
+	if (r)
+		return r;
+
+	if (p->log_block + 2 < p->nr_log_blocks) {
+		r = metadata_io(p, page_address(p->zero_page),
+				p->log_block + 2, WRITE);
+		if (r)
+			return r;
+	}
+
+	p->log_block++;
+	p->log_entries = 0;
+	memset(p->area, 0, METADATA_BLOCK_SIZE);
+
+	return 0;
+}
+
+static int log_append(struct pool *p, unsigned int type, uint32_t id,
+		      block_t virt, uint32_t data)
+{
+	struct disk_entry *de;
+	int r;
+
+	if (p->log_entries == ENTRIES_PER_BLOCK) {
+		r = log_roll(p);
+		if (r)
+			return r;
+	}
+
+	de = (struct disk_entry *) p->area + p->log_entries++;
+	de->virt = cpu_to_le64(virt);
+	de->dev = cpu_to_le32((type << 24) | id);
+	de->data = cpu_to_le32(data);
+
+	return 0;
+}
+
+static int log_commit(struct pool *p)
+{
+	return metadata_io(p, p->area, p->log_block, WRITE);
+}
+
+/*
+ * Once the log can't be written the pool stops allocating; blocks
+ * that are already mapped can still be read and written.
+ */
+static void pool_error(struct pool *p, const char *why, int r)
+{
+	if (p->error)
+		return;
+
+	DMERR("thin pool: %s (%d), no more blocks will be allocated", why, r);
+	p->error = 1;
+	dm_table_event(p->table);
+}
+
+static int write_header(struct pool *p)
+{
+	struct disk_header *dh = (struct disk_header *) p->area;
+	int r;
+
+	memset(p->area, 0, METADATA_BLOCK_SIZE);
+	dh->magic = cpu_to_le32(THIN_MAGIC);
+	dh->version = cpu_to_le32(THIN_DISK_VERSION);
+	dh->block_size = cpu_to_le32(p->block_size);
+
+	r = metadata_io(p, p->area, 0, WRITE);
+	if (r)
+		return r;
+
+	/* an empty log, and the zeroed block after it */
+	memset(p->area, 0, METADATA_BLOCK_SIZE);
+	r = metadata_io(p, p->area, 1, WRITE);
+	if (!r)
+		r = metadata_io(p, p->area, 2, WRITE);
+	if (r)
+		return r;
+
+	p->log_block = 1;
+	p->log_entries = 0;
+	return 0;
+}
+
+static int replay_entry(struct pool *p, struct disk_entry *de)
+{
+	uint32_t dev = le32_to_cpu(de->dev);
+	uint32_t data = le32_to_cpu(de->data);
+	block_t virt = le64_to_cpu(de->virt);
+	uint32_t id = dev & MAX_DEV_ID;
+	struct thin_dev *td;
+	struct mapping *m;
+
+	td = __find_dev(p, id);
+	if (!td) {
+		td = __add_dev(p, id);
+		if (!td)
+			return -ENOMEM;
+	}
+
+	switch (dev >> 24) {
+	case ENTRY_CREATE:
+		td->created = 1;
+		return 0;
+
+	case ENTRY_MAP:
+		break;
+
+	default:
+		DMERR("thin pool: unknown metadata entry type %u", dev >> 24);
+		return -EINVAL;
+	}
+
+	if (data >= p->nr_blocks) {
+		DMERR("thin pool: data device is too small for the metadata");
+		return -EINVAL;
+	}
+
+	if (p->refs[data] == MAX_REFS) {
+		DMERR("thin pool: data block %u is shared too often", data);
+		return -EINVAL;
+	}
+
+	m = lookup_mapping(&p->mappings, id, virt);
+	if (m) {
+		dec_ref(p, m->data);
+		m->data = data;
+	} else {
+		m = kmem_cache_alloc(mapping_cache, GFP_KERNEL);
+		if (!m)
+			return -ENOMEM;
+
+		m->dev = id;
+		m->virt = virt;
+		m->data = data;
+		insert_mapping(&p->mappings, m);
+		td->mapped++;
+	}
+	inc_ref(p, data);
+
+	return 0;
+}
+
+/*
+ * Drops whatever a crash left of a snapshot that was being
+ * created: its mappings are logged before the create entry.
+ */
+static void drop_uncreated(struct pool *p)
+{
+	struct thin_dev *td, *tn;
+	struct mapping *m, *n;
+	unsigned int i;
+
+	for (i = 0; i <= p->mappings.hash_mask; i++)
+		list_for_each_entry_safe (m, n, p->mappings.table + i,
+					  hash_list) {
+			td = __find_dev(p, m->dev);
+			if (td->created)
+				continue;
+
+			list_del(&m->hash_list);
+			dec_ref(p, m->data);
+			kmem_cache_free(mapping_cache, m);
+		}
+
+	list_for_each_entry_safe (td, tn, &p->devs, list)
+		if (!td->created) {
+			list_del(&td->list);
+			kfree(td);
+		}
+}
+
+static int read_metadata(struct pool *p)
+{
+	struct disk_header *dh = (struct disk_header *) p->area;
+	struct disk_entry *de;
+	uint32_t b, i;
+	int r;
+
+	r = metadata_io(p, p->area, 0, READ);
+	if (r)
+		return r;
+
+	if (le32_to_cpu(dh->magic) == 0)
+		return write_header(p);
+
+	if (le32_to_cpu(dh->magic) != THIN_MAGIC) {
+		DMWARN("thin pool: invalid metadata magic");
+		return -EINVAL;
+	}
+
+	if (le32_to_cpu(dh->version) != THIN_DISK_VERSION) {
+		DMWARN("thin pool: unsupported metadata version %u",
+		       le32_to_cpu(dh->version));
+		return -EINVAL;
+	}
+
+	if (le32_to_cpu(dh->block_size) != p->block_size) {
+		DMWARN("thin pool block size %u doesn't match the table (%u)",
+		       le32_to_cpu(dh->block_size), (uint32_t) p->block_size);
+		return -EINVAL;
+	}
+
+	for (b = 1; b < p->nr_log_blocks; b++) {
+		r = metadata_io(p, p->area, b, READ);
+		if (r)
+			return r;
+
+		de = (struct disk_entry *) p->area;
+		for (i = 0; i < ENTRIES_PER_BLOCK; i++, de++) {
+			if (!(le32_to_cpu(de->dev) >> 24)) {
+				p->log_block = b;
+				p->log_entries = i;
+				goto out;
+			}
+
+			r = replay_entry(p, de);
+			if (r)
+				return r;
+		}
+	}
+
+	/* the log fills the device */
+	p->log_block = p->nr_log_blocks - 1;
+	p->log_entries = ENTRIES_PER_BLOCK;
+
+      out:
+	drop_uncreated(p);
+	return 0;
+}
+
+/*-----------------------------------------------------------------
+ * Pools
+ *---------------------------------------------------------------*/
+static void do_worker(void *context);
+
+static struct pool *__find_pool(struct block_device *metadata_bdev)
+{
+	struct pool *p;
+
+	list_for_each_entry (p, &_pools, list)
+		if (p->metadata_bdev == metadata_bdev)
+			return p;
+
+	return NULL;
+}
+
+static inline sector_t get_dev_size(struct block_device *bdev)
+{
+	return bdev->bd_inode->i_size >> SECTOR_SHIFT;
+}
+
+static uint32_t data_dev_blocks(struct block_device *bdev, unsigned int shift)
+{
+	sector_t nr = get_dev_size(bdev) >> shift;
+
+	/* block numbers are 32 bit on disk */
+	return nr > 0xffffffffUL ? 0xffffffffUL : nr;
+}
+
+static void pool_destroy(struct pool *p)
+{
+	struct thin_dev *td, *n;
+
+	kcopyd_client_destroy(p->copier);
+	flush_workqueue(_kthinpd);
+
+	exit_mapping_table(&p->pending);
+	exit_mapping_table(&p->mappings);
+
+	list_for_each_entry_safe (td, n, &p->devs, list)
+		kfree(td);
+
+	vfree(p->refs);
+	free_page((unsigned long) p->area);
+	__free_page(p->zero_page);
+	kfree(p);
+}
+
+static struct pool *pool_create(struct block_device *metadata_bdev,
+				struct block_device *data_bdev,
+				sector_t block_size, char **error)
+{
+	struct pool *p;
+	int r = -ENOMEM;
+
+	p = kmalloc(sizeof(*p), GFP_KERNEL);
+	if (!p) {
+		*error = "Cannot allocate pool";
+		return ERR_PTR(-ENOMEM);
+	}
+	memset(p, 0, sizeof(*p));
+
+	p->ref = 1;
+	p->metadata_bdev = metadata_bdev;
+	p->data_bdev = data_bdev;
+	p->block_size = block_size;
+	p->block_mask = block_size - 1;
+	p->block_shift = ffs(block_size) - 1;
+
+	p->lock = SPIN_LOCK_UNLOCKED;
+	INIT_LIST_HEAD(&p->devs);
+	p->prepared_lock = SPIN_LOCK_UNLOCKED;
+	INIT_LIST_HEAD(&p->prepared);
+	INIT_WORK(&p->worker, do_worker, p);
+	init_MUTEX(&p->commit_sem);
+
+	p->nr_log_blocks = get_dev_size(metadata_bdev) / METADATA_SECTORS;
+	if (p->nr_log_blocks < 3) {
+		*error = "Metadata device is too small";
+		r = -EINVAL;
+		goto bad1;
+	}
+
+	p->nr_blocks = data_dev_blocks(data_bdev, p->block_shift);
+	if (!p->nr_blocks) {
+		*error = "Data device is smaller than a block";
+		r = -EINVAL;
+		goto bad1;
+	}
+	p->nr_free = p->nr_blocks;
+
+	p->refs = vmalloc(p->nr_blocks * sizeof(*p->refs));
+	if (!p->refs) {
+		*error = "Cannot allocate block reference counts";
+		goto bad1;
+	}
+	memset(p->refs, 0, p->nr_blocks * sizeof(*p->refs));
+
+	if (init_hash_tables(p)) {
+		*error = "Unable to allocate hash table space";
+		goto bad2;
+	}
+
+	p->area = (void *) __get_free_page(GFP_KERNEL);
+	if (!p->area) {
+		*error = "Cannot allocate metadata buffer";
+		goto bad3;
+	}
+
+	p->zero_page = alloc_page(GFP_KERNEL);
+	if (!p->zero_page) {
+		*error = "Cannot allocate zero page";
+		goto bad4;
+	}
+	clear_page(page_address(p->zero_page));
+
+	r = kcopyd_client_create(THIN_PAGES, &p->copier);
+	if (r) {
+		*error = "Could not create kcopyd client";
+		goto bad5;
+	}
+
+	r = read_metadata(p);
+	if (r) {
+		*error = "Failed to read pool metadata";
+		goto bad6;
+	}
+
+	return p;
+
+      bad6:
+	kcopyd_client_destroy(p->copier);
+      bad5:
+	__free_page(p->zero_page);
+      bad4:
+	free_page((unsigned long) p->area);
+      bad3:
+	exit_mapping_table(&p->pending);
+	exit_mapping_table(&p->mappings);
+	{
+		struct thin_dev *td, *n;
+		list_for_each_entry_safe (td, n, &p->devs, list)
+			kfree(td);
+	}
+      bad2:
+	vfree(p->refs);
+      bad1:
+	kfree(p);
+	return ERR_PTR(r);
+}
+
+/*
+ * Picks up a data device that has grown since the pool was set up.
+ */
+static int pool_grow(struct pool *p)
+{
+	uint32_t nr = data_dev_blocks(p->data_bdev, p->block_shift);
+	uint16_t *refs, *old;
+
+	if (nr < p->nr_blocks)
+		return -EINVAL;
+	if (nr == p->nr_blocks)
+		return 0;
+
+	refs = vmalloc(nr * sizeof(*refs));
+	if (!refs)
+		return -ENOMEM;
+
+	spin_lock(&p->lock);
+	memcpy(refs, p->refs, p->nr_blocks * sizeof(*refs));
+	memset(refs + p->nr_blocks, 0, (nr - p->nr_blocks) * sizeof(*refs));
+	old = p->refs;
+	p->refs = refs;
+	p->nr_free += nr - p->nr_blocks;
+	p->nr_blocks = nr;
+	if (p->nr_free > p->low_water)
+		p->low_water_hit = 0;
+	p->no_space = 0;
+	spin_unlock(&p->lock);
+
+	vfree(old);
+	return 0;
+}
+
+static void pool_put(struct pool *p)
+{
+	down(&_pools_lock);
+	if (--p->ref) {
+		up(&_pools_lock);
+		return;
+	}
+	list_del(&p->list);
+	up(&_pools_lock);
+
+	pool_destroy(p);
+}
+
+/*-----------------------------------------------------------------
+ * Filling in new blocks
+ *---------------------------------------------------------------*/
+static inline void remap(struct pool *p, struct bio *bio, uint32_t data)
+{
+	bio->bi_bdev = p->data_bdev;
+	bio->bi_sector = ((sector_t) data << p->block_shift) +
+		(bio->bi_sector & p->block_mask);
+}
+
+/*
+ * The new block's data is on disk (or failed to get there); hand
+ * it to the worker to be logged.  May be called from interrupt
+ * context.
+ */
+static void mapping_prepared(struct new_mapping *nm)
+{
+	struct pool *p = nm->pool;
+	unsigned long flags;
+
+	spin_lock_irqsave(&p->prepared_lock, flags);
+	list_add_tail(&nm->list, &p->prepared);
+	spin_unlock_irqrestore(&p->prepared_lock, flags);
+
+	queue_work(_kthinpd, &p->worker);
+}
+
+static int zero_endio(struct bio *bio, unsigned int done, int error)
+{
+	struct new_mapping *nm = bio->bi_private;
+
+	if (bio->bi_size)
+		return 1;
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		nm->err = -EIO;
+
+	bio_put(bio);
+
+	if (atomic_dec_and_test(&nm->io_count))
+		mapping_prepared(nm);
+
+	return 0;
+}
+
+/*
+ * Reads of unwritten blocks return zeroes, so a block that is
+ * only partly written must be zeroed first.
+ */
+static void zero_block(struct new_mapping *nm)
+{
+	struct pool *p = nm->pool;
+	sector_t sector = (sector_t) nm->m.data << p->block_shift;
+	unsigned int remaining = p->block_size >> (PAGE_SHIFT - SECTOR_SHIFT);
+	struct bio *bio;
+
+	atomic_set(&nm->io_count, 1);
+
+	while (remaining) {
+		bio = bio_alloc(GFP_NOIO, min_t(unsigned int, remaining,
+						BIO_MAX_PAGES));
+		bio->bi_bdev = p->data_bdev;
+		bio->bi_sector = sector;
+		bio->bi_end_io = zero_endio;
+		bio->bi_private = nm;
+
+		while (remaining) {
+			if (!bio_add_page(bio, p->zero_page, PAGE_SIZE, 0))
+				break;
+
+			sector += PAGE_SIZE >> SECTOR_SHIFT;
+			remaining--;
+		}
+
+		atomic_inc(&nm->io_count);
+		submit_bio(WRITE, bio);
+	}
+
+	if (atomic_dec_and_test(&nm->io_count))
+		mapping_prepared(nm);
+}
+
+static void copy_callback(int read_err, unsigned int write_err, void *context)
+{
+	struct new_mapping *nm = (struct new_mapping *) context;
+
+	if (read_err || write_err)
+		nm->err = -EIO;
+
+	mapping_prepared(nm);
+}
+
+/*
+ * A shared block is copied before it is written to.
+ */
+static void copy_block(struct new_mapping *nm, uint32_t old)
+{
+	struct pool *p = nm->pool;
+	struct io_region src, dest;
+
+	src.bdev = p->data_bdev;
+	src.sector = (sector_t) old << p->block_shift;
+	src.count = p->block_size;
+
+	dest.bdev = p->data_bdev;
+	dest.sector = (sector_t) nm->m.data << p->block_shift;
+	dest.count = p->block_size;
+
+	kcopyd_copy(p->copier, &src, 1, &dest, copy_callback, nm);
+}
+
+static int overwrite_endio(struct bio *bio, unsigned int done, int error)
+{
+	struct new_mapping *nm = bio->bi_private;
+
+	if (bio->bi_size)
+		return 1;
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		nm->err = -EIO;
+
+	mapping_prepared(nm);
+	return 0;
+}
+
+/*
+ * A write covering the whole block needs no zeroing or copying:
+ * it goes straight to the new block, and is completed once the
+ * block has been logged.
+ */
+static void overwrite_block(struct new_mapping *nm, struct bio *bio)
+{
+	nm->full_bio = bio;
+	nm->full_end_io = bio->bi_end_io;
+	nm->full_private = bio->bi_private;
+	nm->full_size = bio->bi_size;
+
+	bio->bi_end_io = overwrite_endio;
+	bio->bi_private = nm;
+
+	remap(nm->pool, bio, nm->m.data);
+	generic_make_request(bio);
+}
+
+/*
+ * We hold lists of bios, using the bi_next field.
+ */
+static void flush_bios(struct pool *p, struct bio *bio, uint32_t data)
+{
+	struct bio *n;
+
+	while (bio) {
+		n = bio->bi_next;
+		bio->bi_next = NULL;
+		remap(p, bio, data);
+		generic_make_request(bio);
+		bio = n;
+	}
+}
+
+static void error_bios(struct bio *bio)
+{
+	struct bio *n;
+
+	while (bio) {
+		n = bio->bi_next;
+		bio->bi_next = NULL;
+		bio_io_error(bio, bio->bi_size);
+		bio = n;
+	}
+}
+
+/*
+ * Puts a logged block in the mapping table, or gives up on one that
+ * couldn't be filled in or logged, and releases the io waiting on
+ * it.
+ */
+static void complete_mapping(struct new_mapping *nm, struct mapping *new)
+{
+	struct pool *p = nm->pool;
+	struct mapping *m;
+	struct bio *bios;
+	struct bio *bio = nm->full_bio;
+
+	spin_lock(&p->lock);
+	if (!nm->err) {
+		m = lookup_mapping(&p->mappings, nm->td->id, nm->m.virt);
+		if (m) {
+			/* the block we broke away from */
+			dec_ref(p, m->data);
+			m->data = nm->m.data;
+		} else {
+			*new = nm->m;
+			insert_mapping(&p->mappings, new);
+			nm->td->mapped++;
+			new = NULL;
+		}
+	} else
+		dec_ref(p, nm->m.data);
+
+	list_del(&nm->m.hash_list);
+	bios = bio_list_get(&nm->bios);
+	spin_unlock(&p->lock);
+
+	if (new)
+		kmem_cache_free(mapping_cache, new);
+
+	if (bio) {
+		bio->bi_end_io = nm->full_end_io;
+		bio->bi_private = nm->full_private;
+		if (nm->err)
+			clear_bit(BIO_UPTODATE, &bio->bi_flags);
+		bio->bi_end_io(bio, nm->full_size, nm->err);
+	}
+
+	if (nm->err)
+		error_bios(bios);
+	else
+		flush_bios(p, bios, nm->m.data);
+
+	mempool_free(nm, new_mapping_pool);
+}
+
+/*
+ * Logs every block that is ready with one metadata write.
+ */
+static void process_prepared(struct pool *p)
+{
+	struct new_mapping *nm, *n;
+	struct mapping *new;
+	LIST_HEAD(list);
+	int logged = 0;
+	int r;
+
+	spin_lock_irq(&p->prepared_lock);
+	list_splice_init(&p->prepared, &list);
+	spin_unlock_irq(&p->prepared_lock);
+
+	if (list_empty(&list))
+		return;
+
+	down(&p->commit_sem);
+
+	list_for_each_entry (nm, &list, list) {
+		if (nm->err)
+			continue;
+
+		if (p->error) {
+			nm->err = -EIO;
+			continue;
+		}
+
+		r = log_append(p, ENTRY_MAP, nm->td->id, nm->m.virt,
+			       nm->m.data);
+		if (r) {
+			pool_error(p, r == -ENOSPC ? "metadata device is full"
+				   : "metadata write failed", r);
+			nm->err = r;
+			continue;
+		}
+		logged = 1;
+	}
+
+	if (logged) {
+		r = log_commit(p);
+		if (r) {
+			pool_error(p, "metadata write failed", r);
+			list_for_each_entry (nm, &list, list)
+				nm->err = -EIO;
+		}
+	}
+
+	/*
+	 * Installed before the log can move on, so a snapshot
+	 * taken after this sees the new blocks.
+	 */
+	list_for_each_entry_safe (nm, n, &list, list) {
+		new = NULL;
+		if (!nm->err) {
+			new = kmem_cache_alloc(mapping_cache, GFP_NOIO);
+			if (!new)
+				nm->err = -ENOMEM;
+		}
+		complete_mapping(nm, new);
+	}
+
+	up(&p->commit_sem);
+}
+
+static void do_worker(void *context)
+{
+	struct pool *p = (struct pool *) context;
+
+	process_prepared(p);
+	blk_run_queues();
+}
+
+/*-----------------------------------------------------------------
+ * Pool target: <metadata dev> <data dev> <block size>
+ *		[<low water blocks>]
+ *
+ * The pool device itself does no io; it is there to hold the
+ * devices and the settings.  Loading a pool table again with a
+ * larger data device makes the new blocks available.
+ *---------------------------------------------------------------*/
+struct pool_c {
+	struct pool *pool;
+	struct dm_dev *metadata_dev;
+	struct dm_dev *data_dev;
+	uint32_t low_water;
+};
+
+/*
+ * Round a number up to the nearest 'size' boundary.  size must
+ * be a power of 2.
+ */
+static inline ulong round_up(ulong n, ulong size)
+{
+	size--;
+	return (n + size) & ~size;
+}
+
+static int pool_ctr(struct dm_target *ti, unsigned int argc, char **argv)
+{
+	struct pool_c *pt;
+	struct pool *p;
+	unsigned long block_size, low_water = 0;
+	char *value;
+	int r;
+
+	if (argc != 3 && argc != 4) {
+		ti->error = "dm-thin-pool: requires 3 or 4 arguments";
+		return -EINVAL;
+	}
+
+	block_size = simple_strtoul(argv[2], &value, 10);
+	if (block_size == 0 || *value) {
+		ti->error = "Invalid block size";
+		return -EINVAL;
+	}
+
+	if (argc == 4) {
+		low_water = simple_strtoul(argv[3], &value, 10);
+		if (*value) {
+			ti->error = "Invalid low water mark";
+			return -EINVAL;
+		}
+	}
+
+	/*
+	 * Block size must be multiple of page size.  Silently
+	 * round up if it's not.
+	 */
+	block_size = round_up(block_size, PAGE_SIZE >> SECTOR_SHIFT);
+
+	if (block_size & (block_size - 1)) {
+		ti->error = "Block size is not a power of 2";
+		return -EINVAL;
+	}
+
+	/* A block has to fit in the kcopyd client's pages */
+	if (block_size > THIN_PAGES * (PAGE_SIZE >> SECTOR_SHIFT)) {
+		ti->error = "Block size is too big";
+		return -EINVAL;
+	}
+
+	pt = kmalloc(sizeof(*pt), GFP_KERNEL);
+	if (!pt) {
+		ti->error = "Cannot allocate pool context";
+		return -ENOMEM;
+	}
+	pt->low_water = low_water;
+
+	r = dm_get_device(ti, argv[0], 0, 0, FMODE_READ | FMODE_WRITE,
+			  &pt->metadata_dev);
+	if (r) {
+		ti->error = "Cannot get metadata device";
+		goto bad1;
+	}
+
+	r = dm_get_device(ti, argv[1], 0, 0, FMODE_READ | FMODE_WRITE,
+			  &pt->data_dev);
+	if (r) {
+		ti->error = "Cannot get data device";
+		goto bad2;
+	}
+
+	if ((block_size << SECTOR_SHIFT) %
+	    bdev_hardsect_size(pt->data_dev->bdev)) {
+		ti->error = "Block size is not a multiple of device blocksize";
+		r = -EINVAL;
+		goto bad3;
+	}
+
+	/* a reload shares the pool that is already running */
+	down(&_pools_lock);
+	p = __find_pool(pt->metadata_dev->bdev);
+	if (p) {
+		if (p->data_bdev != pt->data_dev->bdev ||
+		    p->block_size != block_size) {
+			up(&_pools_lock);
+			ti->error = "Pool is already active with a different "
+				"data device or block size";
+			r = -EINVAL;
+			goto bad3;
+		}
+
+		r = pool_grow(p);
+		if (r) {
+			up(&_pools_lock);
+			ti->error = "Cannot shrink the data device";
+			goto bad3;
+		}
+		p->ref++;
+	} else {
+		p = pool_create(pt->metadata_dev->bdev, pt->data_dev->bdev,
+				block_size, &ti->error);
+		if (IS_ERR(p)) {
+			up(&_pools_lock);
+			r = PTR_ERR(p);
+			goto bad3;
+		}
+		p->table = ti->table;
+		list_add(&p->list, &_pools);
+	}
+	up(&_pools_lock);
+
+	pt->pool = p;
+	ti->private = pt;
+	return 0;
+
+      bad3:
+	dm_put_device(ti, pt->data_dev);
+      bad2:
+	dm_put_device(ti, pt->metadata_dev);
+      bad1:
+	kfree(pt);
+	return r;
+}
+
+static void pool_dtr(struct dm_target *ti)
+{
+	struct pool_c *pt = (struct pool_c *) ti->private;
+
+	pool_put(pt->pool);
+	dm_put_device(ti, pt->data_dev);
+	dm_put_device(ti, pt->metadata_dev);
+	kfree(pt);
+}
+
+static int pool_map(struct dm_target *ti, struct bio *bio)
+{
+	return -EIO;
+}
+
+static void pool_resume(struct dm_target *ti)
+{
+	struct pool_c *pt = (struct pool_c *) ti->private;
+	struct pool *p = pt->pool;
+
+	spin_lock(&p->lock);
+	p->table = ti->table;
+	p->low_water = pt->low_water;
+	p->low_water_hit = p->nr_free <= p->low_water;
+	spin_unlock(&p->lock);
+}
+
+static int pool_status(struct dm_target *ti, status_type_t type,
+		       char *result, unsigned int maxlen)
+{
+	struct pool_c *pt = (struct pool_c *) ti->private;
+	struct pool *p = pt->pool;
+	char meta[32];
+	char data[32];
+
+	switch (type) {
+	case STATUSTYPE_INFO:
+		snprintf(result, maxlen, "%u/%u %u/%u%s",
+			 p->nr_blocks - p->nr_free, p->nr_blocks,
+			 p->log_block + 1, p->nr_log_blocks,
+			 p->error ? " Fail" : "");
+		break;
+
+	case STATUSTYPE_TABLE:
+		format_dev_t(meta, pt->metadata_dev->bdev->bd_dev);
+		format_dev_t(data, pt->data_dev->bdev->bd_dev);
+		snprintf(result, maxlen, "%s %s " SECTOR_FORMAT " %u",
+			 meta, data, p->block_size, pt->low_water);
+		break;
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------
+ * Thin target: <metadata dev> <dev id> [<origin dev id>]
+ *
+ * The device id is created in the pool the first time it is
+ * used, empty or as a snapshot of the origin.  The origin should
+ * be suspended while the snapshot is created.
+ *---------------------------------------------------------------*/
+struct thin_c {
+	struct pool *pool;
+	struct thin_dev *td;
+	struct dm_dev *metadata_dev;
+	struct dm_dev *data_dev;
+
+	/* For the status line only */
+	long origin;
+};
+
+/*
+ * Logs a new device, with all of the origin's mappings if it is a
+ * snapshot.  The mappings go first, so a crash part way through
+ * leaves nothing behind.
+ */
+static int create_thin(struct pool *p, uint32_t id, struct thin_dev *origin,
+		       struct thin_dev **result)
+{
+	struct mapping **ms = NULL;
+	struct mapping *m;
+	struct thin_dev *td;
+	block_t count = 0, n = 0, i;
+	unsigned int b;
+	int r = 0;
+
+	down(&p->commit_sem);
+
+	if (p->error) {
+		r = -EIO;
+		goto out;
+	}
+
+	td = __add_dev(p, id);
+	if (!td) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	/*
+	 * No mappings are added or removed while we hold the
+	 * commit semaphore, only remapped.
+	 */
+	if (origin && origin->mapped) {
+		count = origin->mapped;
+		ms = vmalloc(count * sizeof(*ms));
+		if (!ms) {
+			r = -ENOMEM;
+			goto bad1;
+		}
+
+		for (i = 0; i < count; i++) {
+			ms[i] = kmem_cache_alloc(mapping_cache, GFP_KERNEL);
+			if (!ms[i]) {
+				r = -ENOMEM;
+				goto bad2;
+			}
+		}
+
+		/* take a reference on every block as it stands now */
+		spin_lock(&p->lock);
+		for (b = 0; b <= p->mappings.hash_mask; b++)
+			list_for_each_entry (m, p->mappings.table + b,
+					     hash_list) {
+				if (m->dev != origin->id)
+					continue;
+
+				if (p->refs[m->data] == MAX_REFS) {
+					spin_unlock(&p->lock);
+					r = -EMLINK;
+					goto bad3;
+				}
+
+				ms[n]->dev = id;
+				ms[n]->virt = m->virt;
+				ms[n]->data = m->data;
+				inc_ref(p, m->data);
+				n++;
+			}
+		spin_unlock(&p->lock);
+
+		for (i = 0; i < n && !r; i++)
+			r = log_append(p, ENTRY_MAP, id, ms[i]->virt,
+				       ms[i]->data);
+	}
+
+	if (!r)
+		r = log_append(p, ENTRY_CREATE, id,
+			       origin ? origin->id + 1 : 0, 0);
+	if (!r)
+		r = log_commit(p);
+	if (r) {
+		pool_error(p, r == -ENOSPC ? "metadata device is full" :
+			   "metadata write failed", r);
+		goto bad3;
+	}
+
+	spin_lock(&p->lock);
+	for (i = 0; i < n; i++)
+		insert_mapping(&p->mappings, ms[i]);
+	td->mapped = n;
+	td->created = 1;
+	spin_unlock(&p->lock);
+
+	for (i = n; i < count; i++)
+		kmem_cache_free(mapping_cache, ms[i]);
+	vfree(ms);
+
+	*result = td;
+	up(&p->commit_sem);
+	return 0;
+
+      bad3:
+	spin_lock(&p->lock);
+	for (i = 0; i < n; i++)
+		dec_ref(p, ms[i]->data);
+	spin_unlock(&p->lock);
+	i = count;
+
+      bad2:
+	while (i--)
+		kmem_cache_free(mapping_cache, ms[i]);
+	vfree(ms);
+
+      bad1:
+	list_del(&td->list);
+	kfree(td);
+
+      out:
+	up(&p->commit_sem);
+	return r;
+}
+
+static int thin_ctr(struct dm_target *ti, unsigned int argc, char **argv)
+{
+	struct thin_c *tc;
+	struct thin_dev *origin = NULL;
+	struct pool *p;
+	unsigned long id, origin_id = 0;
+	char *value;
+	char data[32];
+	int r;
+
+	if (argc != 2 && argc != 3) {
+		ti->error = "dm-thin: requires 2 or 3 arguments";
+		return -EINVAL;
+	}
+
+	id = simple_strtoul(argv[1], &value, 10);
+	if (*value || id > MAX_DEV_ID) {
+		ti->error = "Invalid device id";
+		return -EINVAL;
+	}
+
+	if (argc == 3) {
+		origin_id = simple_strtoul(argv[2], &value, 10);
+		if (*value || origin_id > MAX_DEV_ID || origin_id == id) {
+			ti->error = "Invalid origin device id";
+			return -EINVAL;
+		}
+	}
+
+	tc = kmalloc(sizeof(*tc), GFP_KERNEL);
+	if (!tc) {
+		ti->error = "Cannot allocate thin context";
+		return -ENOMEM;
+	}
+	tc->origin = argc == 3 ? (long) origin_id : -1;
+
+	r = dm_get_device(ti, argv[0], 0, 0, FMODE_READ | FMODE_WRITE,
+			  &tc->metadata_dev);
+	if (r) {
+		ti->error = "Cannot get metadata device";
+		goto bad1;
+	}
+
+	down(&_pools_lock);
+	p = __find_pool(tc->metadata_dev->bdev);
+	if (p)
+		p->ref++;
+	up(&_pools_lock);
+
+	if (!p) {
+		ti->error = "No pool is active on the metadata device";
+		r = -EINVAL;
+		goto bad2;
+	}
+	tc->pool = p;
+
+	/* hold the data device open for as long as we map to it */
+	format_dev_t(data, p->data_bdev->bd_dev);
+	r = dm_get_device(ti, data, 0, 0, FMODE_READ | FMODE_WRITE,
+			  &tc->data_dev);
+	if (r) {
+		ti->error = "Cannot get data device";
+		goto bad3;
+	}
+
+	/* two tables mustn't create the same device */
+	down(&_pools_lock);
+	tc->td = __find_dev(p, id);
+	if (!tc->td && argc == 3)
+		origin = __find_dev(p, origin_id);
+
+	if (!tc->td) {
+		if (argc == 3 && !origin) {
+			up(&_pools_lock);
+			ti->error = "Origin device does not exist";
+			r = -EINVAL;
+			goto bad4;
+		}
+
+		r = create_thin(p, id, origin, &tc->td);
+		if (r) {
+			up(&_pools_lock);
+			ti->error = "Cannot create thin device";
+			goto bad4;
+		}
+	}
+	up(&_pools_lock);
+
+	ti->private = tc;
+	ti->split_io = p->block_size;
+	return 0;
+
+      bad4:
+	dm_put_device(ti, tc->data_dev);
+      bad3:
+	pool_put(p);
+      bad2:
+	dm_put_device(ti, tc->metadata_dev);
+      bad1:
+	kfree(tc);
+	return r;
+}
+
+static void thin_dtr(struct dm_target *ti)
+{
+	struct thin_c *tc = (struct thin_c *) ti->private;
+
+	pool_put(tc->pool);
+	dm_put_device(ti, tc->data_dev);
+	dm_put_device(ti, tc->metadata_dev);
+	kfree(tc);
+}
+
+static void zero_fill_bio(struct bio *bio)
+{
+	struct bio_vec *bv;
+	char *data;
+	int i;
+
+	bio_for_each_segment (bv, bio, i) {
+		data = kmap_atomic(bv->bv_page, KM_USER0);
+		memset(data + bv->bv_offset, 0, bv->bv_len);
+		flush_dcache_page(bv->bv_page);
+		kunmap_atomic(data, KM_USER0);
+	}
+}
+
+static int thin_map(struct dm_target *ti, struct bio *bio)
+{
+	struct thin_c *tc = (struct thin_c *) ti->private;
+	struct pool *p = tc->pool;
+	uint32_t id = tc->td->id;
+	struct new_mapping *nm = NULL;
+	struct mapping *m, *pm;
+	uint32_t old = 0;
+	block_t virt;
+	int full, event, r;
+
+	bio->bi_sector -= ti->begin;
+	virt = bio->bi_sector >> p->block_shift;
+	full = bio_data_dir(bio) == WRITE &&
+		!(bio->bi_sector & p->block_mask) &&
+		bio->bi_size == p->block_size << SECTOR_SHIFT;
+
+      again:
+	spin_lock(&p->lock);
+	m = lookup_mapping(&p->mappings, id, virt);
+	pm = lookup_mapping(&p->pending, id, virt);
+
+	/*
+	 * Reads of a block being broken away from its snapshot
+	 * can still use the old block, but writes must wait for
+	 * the copy.
+	 */
+	if (m && (bio_data_dir(bio) == READ || (!pm && p->refs[m->data] == 1))) {
+		remap(p, bio, m->data);
+		r = 1;
+		goto out_unlock;
+	}
+
+	if (pm) {
+		nm = container_of(pm, struct new_mapping, m);
+		bio_list_add(&nm->bios, bio);
+		nm = NULL;
+		r = 0;
+		goto out_unlock;
+	}
+
+	if (bio_data_dir(bio) == READ) {
+		spin_unlock(&p->lock);
+		zero_fill_bio(bio);
+		bio_endio(bio, bio->bi_size, 0);
+		r = 0;
+		goto out;
+	}
+
+	if (p->error) {
+		r = -EIO;
+		goto out_unlock;
+	}
+
+	if (!nm) {
+		/* don't hold the lock while we wait for memory */
+		spin_unlock(&p->lock);
+		nm = mempool_alloc(new_mapping_pool, GFP_NOIO);
+		goto again;
+	}
+
+	event = __alloc_block(p, &nm->m.data);
+	if (event < 0) {
+		event = !p->no_space;
+		p->no_space = 1;
+		spin_unlock(&p->lock);
+
+		if (event) {
+			DMERR("thin pool: out of data space");
+			dm_table_event(p->table);
+		}
+		r = -EIO;
+		goto out;
+	}
+
+	nm->m.dev = id;
+	nm->m.virt = virt;
+	nm->pool = p;
+	nm->td = tc->td;
+	nm->err = 0;
+	bio_list_init(&nm->bios);
+	nm->full_bio = NULL;
+	insert_mapping(&p->pending, &nm->m);
+
+	if (!full)
+		bio_list_add(&nm->bios, bio);
+	if (m)
+		old = m->data;
+	spin_unlock(&p->lock);
+
+	if (event)
+		dm_table_event(p->table);
+
+	if (full)
+		overwrite_block(nm, bio);
+	else if (m)
+		copy_block(nm, old);
+	else
+		zero_block(nm);
+
+	return 0;
+
+      out_unlock:
+	spin_unlock(&p->lock);
+      out:
+	if (nm)
+		mempool_free(nm, new_mapping_pool);
+	return r;
+}
+
+static int thin_status(struct dm_target *ti, status_type_t type,
+		       char *result, unsigned int maxlen)
+{
+	struct thin_c *tc = (struct thin_c *) ti->private;
+	char meta[32];
+
+	switch (type) {
+	case STATUSTYPE_INFO:
+		snprintf(result, maxlen, SECTOR_FORMAT,
+			 tc->td->mapped << tc->pool->block_shift);
+		break;
+
+	case STATUSTYPE_TABLE:
+		format_dev_t(meta, tc->metadata_dev->bdev->bd_dev);
+		if (tc->origin < 0)
+			snprintf(result, maxlen, "%s %u", meta, tc->td->id);
+		else
+			snprintf(result, maxlen, "%s %u %ld", meta,
+				 tc->td->id, tc->origin);
+		break;
+	}
+
+	return 0;
+}
+
+static struct target_type pool_target = {
+	.name   = "thin-pool",
+	.module = THIS_MODULE,
+	.ctr    = pool_ctr,
+	.dtr    = pool_dtr,
+	.map    = pool_map,
+	.resume = pool_resume,
+	.status = pool_status,
+};
+
+static struct target_type thin_target = {
+	.name   = "thin",
+	.module = THIS_MODULE,
+	.ctr    = thin_ctr,
+	.dtr    = thin_dtr,
+	.map    = thin_map,
+	.status = thin_status,
+};
+
+static int __init dm_thin_init(void)
+{
+	int r;
+
+	r = dm_register_target(&pool_target);
+	if (r) {
+		DMERR("thin-pool target register failed %d", r);
+		return r;
+	}
+
+	r = dm_register_target(&thin_target);
+	if (r < 0) {
+		DMERR("thin target register failed %d", r);
+		goto bad1;
+	}
+
+	mapping_cache = kmem_cache_create("dm-thin-map",
+					  sizeof(struct mapping),
+					  __alignof__(struct mapping),
+					  0, NULL, NULL);
+	if (!mapping_cache) {
+		DMERR("Couldn't create mapping cache.");
+		r = -ENOMEM;
+		goto bad2;
+	}
+
+	new_mapping_cache = kmem_cache_create("dm-thin-new",
+					      sizeof(struct new_mapping),
+					      __alignof__(struct new_mapping),
+					      0, NULL, NULL);
+	if (!new_mapping_cache) {
+		DMERR("Couldn't create new mapping cache.");
+		r = -ENOMEM;
+		goto bad3;
+	}
+
+	new_mapping_pool = mempool_create(128, mempool_alloc_slab,
+					  mempool_free_slab, new_mapping_cache);
+	if (!new_mapping_pool) {
+		DMERR("Couldn't create new mapping pool.");
+		r = -ENOMEM;
+		goto bad4;
+	}
+
+	_kthinpd = alloc_workqueue("kthinpd", WQ_UNBOUND | WQ_MEM_RECLAIM, 1);
+	if (!_kthinpd) {
+		DMERR("Failed to create kthinpd workqueue.");
+		r = -ENOMEM;
+		goto bad5;
+	}
+
+	return 0;
+
+      bad5:
+	mempool_destroy(new_mapping_pool);
+      bad4:
+	kmem_cache_destroy(new_mapping_cache);
+      bad3:
+	kmem_cache_destroy(mapping_cache);
+      bad2:
+	dm_unregister_target(&thin_target);
+      bad1:
+	dm_unregister_target(&pool_target);
+	return r;
+}
+
+static void __exit dm_thin_exit(void)
+{
+	int r;
+
+	destroy_workqueue(_kthinpd);
+
+	r = dm_unregister_target(&thin_target);
+	if (r)
+		DMERR("thin unregister failed %d", r);
+
+	r = dm_unregister_target(&pool_target);
+	if (r)
+		DMERR("thin-pool unregister failed %d", r);
+
+	mempool_destroy(new_mapping_pool);
+	kmem_cache_destroy(new_mapping_cache);
+	kmem_cache_destroy(mapping_cache);
+}
+
+/* Module hooks */
+module_init(dm_thin_init);
+module_exit(dm_thin_exit);
+
+MODULE_DESCRIPTION(DM_NAME " thin provisioning targets");
+MODULE_LICENSE("GPL");
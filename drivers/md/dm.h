@@ -167,4 +167,10 @@ void dm_linear_exit(void);
 int dm_stripe_init(void);
 void dm_stripe_exit(void);
 
+/*
+ * The background copy engine, for targets such as snapshots.
+ */
+int kcopyd_init(void);
+void kcopyd_exit(void);
+
 #endif
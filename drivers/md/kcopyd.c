@@ -0,0 +1,436 @@
+/*
+ * Copyright (C) 2003 Sistina Software
+ *
+ * This file is released under the GPL.
+ *
+ * kcopyd copies regions of block devices in the background, for
+ * targets that have to move data around without holding up the io
+ * that made it necessary.  A copy is read into pages belonging to
+ * the client, then written to all of the destinations at once.
+ *
+ * Everything runs from one ordered workqueue, so jobs move through
+ * their states without extra locking and the notify functions never
+ * run concurrently.
+ */
+
+#include "kcopyd.h"
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/mempool.h>
+#include <linux/workqueue.h>
+#include <linux/bio.h>
+#include <linux/mm.h>
+
+#define SECTORS_PER_PAGE (PAGE_SIZE >> SECTOR_SHIFT)
+
+struct kcopyd_client {
+	spinlock_t lock;
+	struct list_head pages;
+	unsigned int nr_pages;
+	unsigned int nr_free_pages;
+
+	/* jobs that haven't been notified yet */
+	atomic_t nr_jobs;
+	wait_queue_head_t destroyq;
+};
+
+struct kcopyd_job {
+	struct kcopyd_client *kc;
+	struct list_head list;
+
+	/*
+	 * READ while the source is being read, WRITE while the
+	 * destinations are being written.
+	 */
+	int rw;
+	int read_err;
+	unsigned int write_err;
+
+	struct io_region source;
+	unsigned int num_dests;
+	struct io_region dests[KCOPYD_MAX_REGIONS];
+
+	unsigned int nr_pages;
+	struct list_head pages;
+
+	/* bios in flight, plus one while they're being submitted */
+	atomic_t count;
+
+	kcopyd_notify_fn fn;
+	void *context;
+};
+
+#define MIN_JOBS 256
+static kmem_cache_t *_job_cache;
+static mempool_t *_job_pool;
+
+static struct workqueue_struct *_kcopyd_wq;
+static struct work_struct _kcopyd_work;
+
+/*
+ * Jobs waiting for pages, jobs ready for io and jobs ready to be
+ * notified.  The io completion moves jobs from interrupt context.
+ */
+static spinlock_t _job_lock = SPIN_LOCK_UNLOCKED;
+static LIST_HEAD(_pages_jobs);
+static LIST_HEAD(_io_jobs);
+static LIST_HEAD(_complete_jobs);
+
+static inline void wake(void)
+{
+	queue_work(_kcopyd_wq, &_kcopyd_work);
+}
+
+/*-----------------------------------------------------------------
+ * Each client has its own pool of pages.
+ *---------------------------------------------------------------*/
+static int kcopyd_get_pages(struct kcopyd_client *kc, unsigned int nr,
+			    struct list_head *pages)
+{
+	spin_lock(&kc->lock);
+	if (kc->nr_free_pages < nr) {
+		spin_unlock(&kc->lock);
+		return -ENOMEM;
+	}
+
+	kc->nr_free_pages -= nr;
+	while (nr--)
+		list_move(kc->pages.next, pages);
+	spin_unlock(&kc->lock);
+
+	return 0;
+}
+
+static void kcopyd_put_pages(struct kcopyd_client *kc, unsigned int nr,
+			     struct list_head *pages)
+{
+	spin_lock(&kc->lock);
+	list_splice_init(pages, &kc->pages);
+	kc->nr_free_pages += nr;
+	spin_unlock(&kc->lock);
+}
+
+static void drop_pages(struct list_head *pages)
+{
+	struct page *page;
+
+	while (!list_empty(pages)) {
+		page = list_entry(pages->next, struct page, list);
+		list_del(&page->list);
+		__free_page(page);
+	}
+}
+
+static int client_alloc_pages(struct kcopyd_client *kc, unsigned int nr)
+{
+	unsigned int i;
+	struct page *page;
+
+	for (i = 0; i < nr; i++) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			drop_pages(&kc->pages);
+			return -ENOMEM;
+		}
+		list_add(&page->list, &kc->pages);
+	}
+
+	kc->nr_pages = kc->nr_free_pages = nr;
+	return 0;
+}
+
+/*-----------------------------------------------------------------
+ * The job lists.
+ *---------------------------------------------------------------*/
+static struct kcopyd_job *pop(struct list_head *jobs)
+{
+	struct kcopyd_job *job = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&_job_lock, flags);
+	if (!list_empty(jobs)) {
+		job = list_entry(jobs->next, struct kcopyd_job, list);
+		list_del(&job->list);
+	}
+	spin_unlock_irqrestore(&_job_lock, flags);
+
+	return job;
+}
+
+static void push(struct list_head *jobs, struct kcopyd_job *job)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&_job_lock, flags);
+	list_add_tail(&job->list, jobs);
+	spin_unlock_irqrestore(&_job_lock, flags);
+}
+
+static void push_front(struct list_head *jobs, struct kcopyd_job *job)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&_job_lock, flags);
+	list_add(&job->list, jobs);
+	spin_unlock_irqrestore(&_job_lock, flags);
+}
+
+/*-----------------------------------------------------------------
+ * io
+ *---------------------------------------------------------------*/
+static void io_done(struct kcopyd_job *job)
+{
+	if (!atomic_dec_and_test(&job->count))
+		return;
+
+	if (job->rw == READ && !job->read_err) {
+		job->rw = WRITE;
+		push(&_io_jobs, job);
+	} else
+		push(&_complete_jobs, job);
+
+	wake();
+}
+
+static int endio(struct bio *bio, unsigned int done, int error)
+{
+	struct kcopyd_job *job = bio->bi_private;
+
+	if (bio->bi_size)
+		return 1;
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags)) {
+		if (job->rw == READ)
+			job->read_err = 1;
+		else
+			job->write_err = 1;
+	}
+
+	bio_put(bio);
+	io_done(job);
+	return 0;
+}
+
+/*
+ * Reads or writes the whole of the job's pages to one region,
+ * in as few bios as the queue will take.
+ */
+static void dispatch_region(struct kcopyd_job *job, struct io_region *where)
+{
+	struct list_head *p = job->pages.next;
+	sector_t sector = where->sector;
+	sector_t remaining = where->count;
+	unsigned int len, nr_vecs;
+	struct page *page;
+	struct bio *bio;
+
+	while (remaining) {
+		nr_vecs = dm_div_up(remaining, SECTORS_PER_PAGE);
+		if (nr_vecs > BIO_MAX_PAGES)
+			nr_vecs = BIO_MAX_PAGES;
+
+		bio = bio_alloc(GFP_NOIO, nr_vecs);
+		bio->bi_bdev = where->bdev;
+		bio->bi_sector = sector;
+		bio->bi_end_io = endio;
+		bio->bi_private = job;
+
+		while (remaining) {
+			page = list_entry(p, struct page, list);
+			len = remaining < SECTORS_PER_PAGE ?
+				remaining : SECTORS_PER_PAGE;
+
+			if (!bio_add_page(bio, page, len << SECTOR_SHIFT, 0))
+				break;
+
+			sector += len;
+			remaining -= len;
+			p = p->next;
+		}
+
+		atomic_inc(&job->count);
+		submit_bio(job->rw, bio);
+	}
+}
+
+static int run_io_job(struct kcopyd_job *job)
+{
+	unsigned int i;
+
+	atomic_set(&job->count, 1);
+
+	if (job->rw == READ)
+		dispatch_region(job, &job->source);
+	else
+		for (i = 0; i < job->num_dests; i++)
+			dispatch_region(job, job->dests + i);
+
+	blk_run_queues();
+	io_done(job);
+	return 0;
+}
+
+static int run_pages_job(struct kcopyd_job *job)
+{
+	if (kcopyd_get_pages(job->kc, job->nr_pages, &job->pages))
+		return 1;	/* wait for another job to finish */
+
+	push(&_io_jobs, job);
+	return 0;
+}
+
+static int run_complete_job(struct kcopyd_job *job)
+{
+	struct kcopyd_client *kc = job->kc;
+	kcopyd_notify_fn fn = job->fn;
+	void *context = job->context;
+	int read_err = job->read_err;
+	unsigned int write_err = job->write_err;
+
+	kcopyd_put_pages(kc, job->nr_pages, &job->pages);
+	mempool_free(job, _job_pool);
+
+	fn(read_err, write_err, context);
+
+	if (atomic_dec_and_test(&kc->nr_jobs))
+		wake_up(&kc->destroyq);
+
+	return 0;
+}
+
+/*
+ * Runs fn on each job in the list, stopping early if fn says the
+ * job has to wait.
+ */
+static void process_jobs(struct list_head *jobs,
+			 int (*fn) (struct kcopyd_job *))
+{
+	struct kcopyd_job *job;
+
+	while ((job = pop(jobs))) {
+		if (fn(job) > 0) {
+			push_front(jobs, job);
+			break;
+		}
+	}
+}
+
+/*
+ * Completed jobs go first, since they give back the pages that
+ * the waiting jobs need.
+ */
+static void do_work(void *ignored)
+{
+	process_jobs(&_complete_jobs, run_complete_job);
+	process_jobs(&_pages_jobs, run_pages_job);
+	process_jobs(&_io_jobs, run_io_job);
+}
+
+int kcopyd_copy(struct kcopyd_client *kc, struct io_region *from,
+		unsigned int num_dests, struct io_region *dests,
+		kcopyd_notify_fn fn, void *context)
+{
+	struct kcopyd_job *job;
+	unsigned int nr_pages;
+
+	if (!num_dests || num_dests > KCOPYD_MAX_REGIONS)
+		return -EINVAL;
+
+	nr_pages = dm_div_up(from->count, SECTORS_PER_PAGE);
+	if (nr_pages > kc->nr_pages)
+		return -EINVAL;
+
+	job = mempool_alloc(_job_pool, GFP_NOIO);
+
+	job->kc = kc;
+	job->rw = READ;
+	job->read_err = 0;
+	job->write_err = 0;
+	job->source = *from;
+	job->num_dests = num_dests;
+	memcpy(job->dests, dests, sizeof(*dests) * num_dests);
+	job->nr_pages = nr_pages;
+	INIT_LIST_HEAD(&job->pages);
+	job->fn = fn;
+	job->context = context;
+
+	atomic_inc(&kc->nr_jobs);
+	push(&_pages_jobs, job);
+	wake();
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------
+ * Clients
+ *---------------------------------------------------------------*/
+int kcopyd_client_create(unsigned int nr_pages, struct kcopyd_client **result)
+{
+	struct kcopyd_client *kc;
+
+	kc = kmalloc(sizeof(*kc), GFP_KERNEL);
+	if (!kc)
+		return -ENOMEM;
+
+	kc->lock = SPIN_LOCK_UNLOCKED;
+	INIT_LIST_HEAD(&kc->pages);
+	atomic_set(&kc->nr_jobs, 0);
+	init_waitqueue_head(&kc->destroyq);
+
+	if (client_alloc_pages(kc, nr_pages)) {
+		kfree(kc);
+		return -ENOMEM;
+	}
+
+	*result = kc;
+	return 0;
+}
+
+void kcopyd_client_destroy(struct kcopyd_client *kc)
+{
+	wait_event(kc->destroyq, !atomic_read(&kc->nr_jobs));
+
+	BUG_ON(kc->nr_free_pages != kc->nr_pages);
+	drop_pages(&kc->pages);
+	kfree(kc);
+}
+
+int __init kcopyd_init(void)
+{
+	_job_cache = kmem_cache_create("kcopyd-jobs",
+				       sizeof(struct kcopyd_job),
+				       __alignof__(struct kcopyd_job),
+				       0, NULL, NULL);
+	if (!_job_cache)
+		return -ENOMEM;
+
+	_job_pool = mempool_create(MIN_JOBS, mempool_alloc_slab,
+				   mempool_free_slab, _job_cache);
+	if (!_job_pool) {
+		kmem_cache_destroy(_job_cache);
+		return -ENOMEM;
+	}
+
+	INIT_WORK(&_kcopyd_work, do_work, NULL);
+	_kcopyd_wq = alloc_workqueue("kcopyd", WQ_UNBOUND | WQ_MEM_RECLAIM, 1);
+	if (!_kcopyd_wq) {
+		mempool_destroy(_job_pool);
+		kmem_cache_destroy(_job_cache);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void kcopyd_exit(void)
+{
+	destroy_workqueue(_kcopyd_wq);
+	mempool_destroy(_job_pool);
+	kmem_cache_destroy(_job_cache);
+}
+
+EXPORT_SYMBOL(kcopyd_client_create);
+EXPORT_SYMBOL(kcopyd_client_destroy);
+EXPORT_SYMBOL(kcopyd_copy);
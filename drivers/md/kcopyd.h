@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2003 Sistina Software
+ *
+ * This file is released under the GPL.
+ */
+
+#ifndef DM_KCOPYD_H
+#define DM_KCOPYD_H
+
+#include "dm.h"
+
+/*
+ * A region of a block device, in sectors.
+ */
+struct io_region {
+	struct block_device *bdev;
+	sector_t sector;
+	sector_t count;
+};
+
+#define KCOPYD_MAX_REGIONS 8
+
+/*
+ * Each client owns a fixed set of pages that its copies are staged
+ * through, so one busy client can't starve the others.  A single
+ * copy may not be larger than the client's pages.
+ */
+struct kcopyd_client;
+int kcopyd_client_create(unsigned int nr_pages, struct kcopyd_client **result);
+void kcopyd_client_destroy(struct kcopyd_client *kc);
+
+/*
+ * read_err is non-zero if the source couldn't be read, write_err
+ * if any of the destinations couldn't be written.  The notify
+ * functions are called from the kcopyd thread one at a time, and
+ * may block.
+ */
+typedef void (*kcopyd_notify_fn)(int read_err, unsigned int write_err,
+				 void *context);
+
+int kcopyd_copy(struct kcopyd_client *kc, struct io_region *from,
+		unsigned int num_dests, struct io_region *dests,
+		kcopyd_notify_fn fn, void *context);
+
+#endif
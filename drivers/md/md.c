@@ -32,10 +32,12 @@
 #include <linux/config.h>
 #include <linux/linkage.h>
 #include <linux/raid/md.h>
+#include <linux/raid/bitmap.h>
 #include <linux/sysctl.h>
 #include <linux/devfs_fs_kernel.h>
 #include <linux/buffer_head.h> /* for invalidate_bdev */
 #include <linux/suspend.h>
+#include <linux/file.h>
 
 #include <linux/init.h>
 
@@ -601,6 +603,8 @@ static int super_90_validate(mddev_t *mddev, mdk_rdev_t *rdev)
 		memcpy(mddev->uuid+12,&sb->set_uuid3, 4);
 
 		mddev->max_disks = MD_SB_DISKS;
+		mddev->bitmap_internal =
+			(sb->state & (1<<MD_SB_BITMAP_PRESENT)) != 0;
 	} else {
 		__u64 ev1;
 		ev1 = md_event(sb);
@@ -681,6 +685,8 @@ static void super_90_sync(mddev_t *mddev, mdk_rdev_t *rdev)
 			sb->state = (1<< MD_SB_CLEAN);
 	} else
 		sb->recovery_cp = 0;
+	if (mddev->bitmap_internal)
+		sb->state |= (1<<MD_SB_BITMAP_PRESENT);
 
 	sb->layout = mddev->layout;
 	sb->chunk_size = mddev->chunk_size;
@@ -1112,6 +1118,11 @@ static void export_array(mddev_t *mddev)
 		MD_BUG();
 	mddev->raid_disks = 0;
 	mddev->major_version = 0;
+	if (mddev->bitmap_file) {
+		fput(mddev->bitmap_file);
+		mddev->bitmap_file = NULL;
+	}
+	mddev->bitmap_internal = 0;
 }
 
 static void print_desc(mdp_disk_t *desc)
@@ -1290,6 +1301,7 @@ repeat:
 		printk(KERN_ERR \
 			"md: excessive errors occurred during superblock update, exiting\n");
 	}
+	bitmap_update_sb(mddev->bitmap);
 }
 
 /*
@@ -1436,7 +1448,8 @@ static int analyze_sbs(mddev_t * mddev)
 	}
 
 	if ((mddev->recovery_cp != MaxSector) && ((mddev->level == 1) ||
-			(mddev->level == 4) || (mddev->level == 5)))
+			(mddev->level == 4) || (mddev->level == 5) ||
+			(mddev->level == 6)))
 		printk(KERN_ERR "md: md%d: raid array is not clean"
 			" -- starting background reconstruction\n", 
 			mdidx(mddev));
@@ -1609,13 +1622,27 @@ static int do_md_run(mddev_t * mddev)
 	mddev->pers = pers[pnum];
 	spin_unlock(&pers_lock);
 
+	if (mddev->bitmap_file || mddev->bitmap_internal) {
+		err = bitmap_create(mddev);
+		if (err) {
+			printk(KERN_ERR "md: md%d: cannot load bitmap\n",
+				mdidx(mddev));
+			module_put(mddev->pers->owner);
+			mddev->pers = NULL;
+			return err;
+		}
+	}
+
 	err = mddev->pers->run(mddev);
 	if (err) {
 		printk(KERN_ERR "md: pers->run() failed ...\n");
+		bitmap_destroy(mddev);
 		module_put(mddev->pers->owner);
 		mddev->pers = NULL;
 		return -EINVAL;
 	}
+	if (mddev->bitmap)
+		mddev->thread->timeout = mddev->bitmap->daemon_sleep;
  	atomic_set(&mddev->writes_pending,0);
 	mddev->safemode = 0;
 	mddev->safemode_timer.function = md_safemode_timeout;
@@ -1720,6 +1747,8 @@ static int do_md_stop(mddev_t * mddev, int ro)
 			mddev->in_sync = 1;
 			md_update_sb(mddev);
 		}
+		if (!ro)
+			bitmap_destroy(mddev);
 		if (ro)
 			set_disk_ro(disk, 1);
 	}
@@ -1961,6 +1990,8 @@ static int get_array_info(mddev_t * mddev, void * arg)
 	info.state         = 0;
 	if (mddev->in_sync)
 		info.state = (1<<MD_SB_CLEAN);
+	if (mddev->bitmap_internal)
+		info.state |= (1<<MD_SB_BITMAP_PRESENT);
 	info.active_disks  = active;
 	info.working_disks = working;
 	info.failed_disks  = failed;
@@ -2333,6 +2364,7 @@ static int set_array_info(mddev_t * mddev, mdu_array_info_t *info)
 	else
 		mddev->recovery_cp = 0;
 	mddev->persistent    = ! info->not_persistent;
+	mddev->bitmap_internal = (info->state & (1<<MD_SB_BITMAP_PRESENT)) != 0;
 
 	mddev->layout        = info->layout;
 	mddev->chunk_size    = info->chunk_size;
@@ -2348,6 +2380,52 @@ static int set_array_info(mddev_t * mddev, mdu_array_info_t *info)
 	return 0;
 }
 
+/*
+ * Give the array a file to keep its write-intent bitmap in, or take
+ * it away again with fd == -1.  Only before the array is started: the
+ * bitmap is loaded by do_md_run().
+ */
+static int set_bitmap_file(mddev_t *mddev, int fd)
+{
+	struct file *file;
+	struct inode *inode;
+	struct block_device *bdev;
+
+	if (mddev->pers)
+		return -EBUSY;
+
+	if (fd < 0) {
+		if (mddev->bitmap_file)
+			fput(mddev->bitmap_file);
+		mddev->bitmap_file = NULL;
+		return 0;
+	}
+	if (mddev->bitmap_file)
+		return -EEXIST;
+
+	file = fget(fd);
+	if (!file)
+		return -EBADF;
+
+	inode = file->f_dentry->d_inode;
+	bdev = inode->i_sb->s_bdev;
+	if (!S_ISREG(inode->i_mode) || !bdev ||
+	    !inode->i_mapping->a_ops->bmap) {
+		printk(KERN_ERR "md: md%d: bitmap must be a regular file on"
+			" a block based filesystem\n", mdidx(mddev));
+		fput(file);
+		return -EINVAL;
+	}
+	if (bdev->bd_disk == disks[mdidx(mddev)]) {
+		printk(KERN_ERR "md: md%d: bitmap file cannot be on the"
+			" array itself\n", mdidx(mddev));
+		fput(file);
+		return -EINVAL;
+	}
+	mddev->bitmap_file = file;
+	return 0;
+}
+
 static int set_disk_faulty(mddev_t *mddev, dev_t dev)
 {
 	mdk_rdev_t *rdev;
@@ -2476,7 +2554,8 @@ static int md_ioctl(struct inode *inode, struct file *file,
 	 * Commands querying/configuring an existing array:
 	 */
 	/* if we are initialised yet, only ADD_NEW_DISK or STOP_ARRAY is allowed */
-	if (!mddev->raid_disks && cmd != ADD_NEW_DISK && cmd != STOP_ARRAY && cmd != RUN_ARRAY) {
+	if (!mddev->raid_disks && cmd != ADD_NEW_DISK && cmd != STOP_ARRAY &&
+	    cmd != RUN_ARRAY && cmd != SET_BITMAP_FILE) {
 		err = -ENODEV;
 		goto abort_unlock;
 	}
@@ -2568,6 +2647,10 @@ static int md_ioctl(struct inode *inode, struct file *file,
 			err = set_disk_faulty(mddev, new_decode_dev(arg));
 			goto done_unlock;
 
+		case SET_BITMAP_FILE:
+			err = set_bitmap_file(mddev, (int)arg);
+			goto done_unlock;
+
 		case RUN_ARRAY:
 		{
 			err = do_md_run (mddev);
@@ -2680,8 +2763,9 @@ int md_thread(void * arg)
 	while (thread->run) {
 		void (*run)(mddev_t *);
 
-		wait_event_interruptible(thread->wqueue,
-					 test_bit(THREAD_WAKEUP, &thread->flags));
+		wait_event_interruptible_timeout(thread->wqueue,
+					 test_bit(THREAD_WAKEUP, &thread->flags),
+					 thread->timeout);
 		if (current->flags & PF_FREEZE)
 			refrigerator(PF_IOTHREAD);
 
@@ -2728,6 +2812,7 @@ mdk_thread_t *md_register_thread(void (*run) (mddev_t *), mddev_t *mddev,
 	thread->run = run;
 	thread->mddev = mddev;
 	thread->name = name;
+	thread->timeout = MAX_SCHEDULE_TIMEOUT;
 	ret = kernel_thread(md_thread, thread, 0);
 	if (ret < 0) {
 		kfree(thread);
@@ -2975,6 +3060,8 @@ static int md_seq_show(struct seq_file *seq, void *v)
 
 		if (mddev->pers) {
 			mddev->pers->status (seq, mddev);
+			if (mddev->bitmap)
+				bitmap_status(seq, mddev->bitmap);
 	 		seq_printf(seq, "\n      ");
 			if (mddev->curr_resync > 2)
 				status_resync (seq, mddev);
@@ -3232,6 +3319,25 @@ static void md_do_sync(mddev_t *mddev)
 
 	while (j < max_sectors) {
 		int sectors;
+		sector_t skip;
+
+		if (mddev->bitmap &&
+		    test_bit(MD_RECOVERY_SYNC, &mddev->recovery) &&
+		    !bitmap_start_sync(mddev->bitmap, j, &skip)) {
+			/*
+			 * Clean chunk: step over it, keeping it out of
+			 * the speed calculations.
+			 */
+			if (skip > max_sectors - j)
+				skip = max_sectors - j;
+			j += skip;
+			last_check += skip;
+			for (m = 0; m < SYNC_MARKS; m++)
+				mark_cnt[m] += skip;
+			mddev->resync_mark_cnt += skip;
+			if (j>1) mddev->curr_resync = j;
+			continue;
+		}
 
 		sectors = mddev->pers->sync_request(mddev, j, currspeed < sysctl_speed_limit_min);
 		if (sectors < 0) {
@@ -3319,6 +3425,8 @@ static void md_do_sync(mddev_t *mddev)
 		} else
 			mddev->recovery_cp = MaxSector;
 	}
+	if (mddev->bitmap && test_bit(MD_RECOVERY_SYNC, &mddev->recovery))
+		bitmap_close_sync(mddev->bitmap, mddev->recovery_cp);
 
 	if (mddev->safemode)
 		md_enter_safemode(mddev);
@@ -3361,6 +3469,9 @@ void md_check_recovery(mddev_t *mddev)
 
 	if (mddev->ro)
 		return;
+
+	bitmap_daemon_work(mddev->bitmap);
+
 	if ( ! (
 		mddev->sb_dirty ||
 		test_bit(MD_RECOVERY_NEEDED, &mddev->recovery) ||
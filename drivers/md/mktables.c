@@ -0,0 +1,109 @@
+/*
+ * mktables.c : generate the RAID-6 Galois field tables
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * Run at build time on the host; the output becomes raid6tables.c.
+ * The field is GF(2^8) with the generator polynomial
+ * x^8 + x^4 + x^3 + x^2 + 1 (0x11d), and g = {02}.
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+
+static uint8_t gfmul(uint8_t a, uint8_t b)
+{
+	uint8_t v = 0;
+
+	while (b) {
+		if (b & 1)
+			v ^= a;
+		a = (a << 1) ^ (a & 0x80 ? 0x1d : 0);
+		b >>= 1;
+	}
+	return v;
+}
+
+static uint8_t gfpow(uint8_t a, int b)
+{
+	uint8_t v = 1;
+
+	b %= 255;
+	if (b < 0)
+		b += 255;
+
+	while (b) {
+		if (b & 1)
+			v = gfmul(v, a);
+		a = gfmul(a, a);
+		b >>= 1;
+	}
+	return v;
+}
+
+static void print_row(const uint8_t *row)
+{
+	int i, j;
+
+	for (i = 0; i < 256; i += 8) {
+		printf("\t\t");
+		for (j = 0; j < 8; j++)
+			printf("0x%02x,%c", row[i + j], (j == 7) ? '\n' : ' ');
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t row[256];
+	uint8_t exptbl[256];
+	int i, j;
+
+	printf("/* Generated by mktables, do not edit */\n\n");
+	printf("#ifdef __KERNEL__\n"
+	       "#include <linux/types.h>\n"
+	       "#else\n"
+	       "#include <inttypes.h>\n"
+	       "typedef uint8_t u8;\n"
+	       "#endif\n\n");
+
+	/* Multiplication table */
+	printf("const u8 __attribute__((aligned(256)))\n"
+	       "raid6_gfmul[256][256] =\n{\n");
+	for (i = 0; i < 256; i++) {
+		printf("\t{\n");
+		for (j = 0; j < 256; j++)
+			row[j] = gfmul(i, j);
+		print_row(row);
+		printf("\t},\n");
+	}
+	printf("};\n\n");
+
+	/* Power-of-2 table (exponent) */
+	printf("const u8 __attribute__((aligned(256)))\n"
+	       "raid6_gfexp[256] =\n{\n");
+	for (i = 0; i < 256; i++)
+		exptbl[i] = gfpow(2, i);
+	print_row(exptbl);
+	printf("};\n\n");
+
+	/* Inverse table */
+	printf("const u8 __attribute__((aligned(256)))\n"
+	       "raid6_gfinv[256] =\n{\n");
+	for (i = 0; i < 256; i++)
+		row[i] = gfpow(i, 254);
+	print_row(row);
+	printf("};\n\n");
+
+	/* Inv(2^x + 1) (exponent-xor-inverse) table */
+	printf("const u8 __attribute__((aligned(256)))\n"
+	       "raid6_gfexi[256] =\n{\n");
+	for (i = 0; i < 256; i++)
+		row[i] = gfpow(exptbl[i] ^ 1, 254);
+	print_row(row);
+	printf("};\n");
+
+	return 0;
+}
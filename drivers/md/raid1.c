@@ -23,6 +23,7 @@
  */
 
 #include <linux/raid/raid1.h>
+#include <linux/raid/bitmap.h>
 
 #define MAJOR_NR MD_MAJOR
 #define MD_DRIVER
@@ -323,6 +324,8 @@ static int raid1_end_request(struct bio *bio, unsigned int bytes_done, int error
 		 * already.
 		 */
 		if (atomic_dec_and_test(&r1_bio->remaining)) {
+			bitmap_endwrite(r1_bio->mddev->bitmap, r1_bio->sector,
+					r1_bio->master_bio->bi_size >> 9);
 			md_write_end(r1_bio->mddev);
 			raid_end_bio_io(r1_bio);
 		}	
@@ -527,6 +530,9 @@ static int make_request(request_queue_t *q, struct bio * bio)
 
 	atomic_set(&r1_bio->remaining, 1);
 	md_write_start(mddev);
+	/* the bitmap must be on disk before any of the mirrors is written */
+	bitmap_startwrite(mddev->bitmap, r1_bio->sector, bio->bi_size >> 9);
+	bitmap_unplug(mddev->bitmap);
 	for (i = 0; i < disks; i++) {
 		struct bio *mbio;
 		if (!r1_bio->write_bios[i])
@@ -546,6 +552,8 @@ static int make_request(request_queue_t *q, struct bio * bio)
 	}
 
 	if (atomic_dec_and_test(&r1_bio->remaining)) {
+		bitmap_endwrite(mddev->bitmap, r1_bio->sector,
+				bio->bi_size >> 9);
 		md_write_end(mddev);
 		raid_end_bio_io(r1_bio);
 	}
@@ -20,7 +20,9 @@
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/raid/raid5.h>
+#include <linux/raid/bitmap.h>
 #include <linux/highmem.h>
+#include <linux/suspend.h>
 #include <asm/bitops.h>
 #include <asm/atomic.h>
 
@@ -39,6 +41,7 @@
 #define HASH_MASK		(NR_HASH - 1)
 
 #define stripe_hash(conf, sect)	((conf)->stripe_hashtbl[((sect) >> STRIPE_SHIFT) & HASH_MASK])
+#define stripe_worker(conf, sect) (&(conf)->workers[(((sect) >> STRIPE_SHIFT) & HASH_MASK) % (conf)->nr_workers])
 
 /* bio's attached to a stripe+device for I/O are linked together in bi_sector
  * order without overlap.  There may be several bio's per stripe+device, and
@@ -69,6 +72,30 @@
 
 static void print_raid5_conf (raid5_conf_t *conf);
 
+static inline void raid5_wakeup_worker(struct raid5_worker *worker)
+{
+	set_bit(THREAD_WAKEUP, &worker->flags);
+	wake_up(&worker->wqueue);
+}
+
+/*
+ * Queue a stripe for handling: on the list of the worker that owns its
+ * hash bucket if we have workers, else on the list raid5d works from.
+ * Called with device_lock held.
+ */
+static inline void raid5_queue_stripe(raid5_conf_t *conf, struct stripe_head *sh)
+{
+	if (conf->nr_workers) {
+		struct raid5_worker *worker = stripe_worker(conf, sh->sector);
+
+		list_add_tail(&sh->lru, &worker->handle_list);
+		raid5_wakeup_worker(worker);
+	} else {
+		list_add_tail(&sh->lru, &conf->handle_list);
+		md_wakeup_thread(conf->mddev->thread);
+	}
+}
+
 static inline void __release_stripe(raid5_conf_t *conf, struct stripe_head *sh)
 {
 	if (atomic_dec_and_test(&sh->count)) {
@@ -77,11 +104,11 @@ static inline void __release_stripe(raid5_conf_t *conf, struct stripe_head *sh)
 		if (atomic_read(&conf->active_stripes)==0)
 			BUG();
 		if (test_bit(STRIPE_HANDLE, &sh->state)) {
-			if (test_bit(STRIPE_DELAYED, &sh->state))
+			if (test_bit(STRIPE_DELAYED, &sh->state)) {
 				list_add_tail(&sh->lru, &conf->delayed_list);
-			else
-				list_add_tail(&sh->lru, &conf->handle_list);
-			md_wakeup_thread(conf->mddev->thread);
+				md_wakeup_thread(conf->mddev->thread);
+			} else
+				raid5_queue_stripe(conf, sh);
 		} else {
 			if (test_and_clear_bit(STRIPE_PREREAD_ACTIVE, &sh->state)) {
 				atomic_dec(&conf->preread_active_stripes);
@@ -560,6 +587,35 @@ static unsigned long raid5_compute_sector(sector_t r_sector, unsigned int raid_d
 	return new_sector;
 }
 
+/*
+ * The write-intent bitmap is kept per write bio, not per stripe: the
+ * component sectors of a bio's stripes form one range, so the whole
+ * bio is counted once when it arrives and once when it completes, and
+ * all of its bits go to disk in a single bitmap_unplug().
+ */
+static void raid5_bitmap_bio(raid5_conf_t *conf, struct bio *bi, int start)
+{
+	const unsigned int raid_disks = conf->raid_disks;
+	const unsigned int data_disks = raid_disks - 1;
+	unsigned int dd_idx, pd_idx;
+	sector_t first, last;
+
+	if (!conf->mddev->bitmap || !bi->bi_size)
+		return;
+
+	first = raid5_compute_sector(bi->bi_sector & ~(STRIPE_SECTORS-1),
+				     raid_disks, data_disks, &dd_idx, &pd_idx,
+				     conf);
+	last = raid5_compute_sector((bi->bi_sector + (bi->bi_size>>9) - 1)
+				    & ~(STRIPE_SECTORS-1),
+				    raid_disks, data_disks, &dd_idx, &pd_idx,
+				    conf) + STRIPE_SECTORS;
+	if (start)
+		bitmap_startwrite(conf->mddev->bitmap, first, last - first);
+	else
+		bitmap_endwrite(conf->mddev->bitmap, first, last - first);
+}
+
 
 static sector_t compute_blocknr(struct stripe_head *sh, int i)
 {
@@ -947,6 +1003,7 @@ static void handle_stripe(struct stripe_head *sh)
 				struct bio *nextbi = r5_next_bio(bi, sh->dev[i].sector);
 				clear_bit(BIO_UPTODATE, &bi->bi_flags);
 				if (--bi->bi_phys_segments == 0) {
+					raid5_bitmap_bio(conf, bi, 0);
 					md_write_end(conf->mddev);
 					bi->bi_next = return_bi;
 					return_bi = bi;
@@ -960,6 +1017,7 @@ static void handle_stripe(struct stripe_head *sh)
 				struct bio *bi2 = r5_next_bio(bi, sh->dev[i].sector);
 				clear_bit(BIO_UPTODATE, &bi->bi_flags);
 				if (--bi->bi_phys_segments == 0) {
+					raid5_bitmap_bio(conf, bi, 0);
 					md_write_end(conf->mddev);
 					bi->bi_next = return_bi;
 					return_bi = bi;
@@ -1018,6 +1076,7 @@ static void handle_stripe(struct stripe_head *sh)
 			    while (wbi && wbi->bi_sector < dev->sector + STRIPE_SECTORS) {
 				    wbi2 = r5_next_bio(wbi, dev->sector);
 				    if (--wbi->bi_phys_segments == 0) {
+					    raid5_bitmap_bio(conf, wbi, 0);
 					    md_write_end(conf->mddev);
 					    wbi->bi_next = return_bi;
 					    return_bi = wbi;
@@ -1288,10 +1347,34 @@ static inline void raid5_activate_delayed(raid5_conf_t *conf)
 			clear_bit(STRIPE_DELAYED, &sh->state);
 			if (!test_and_set_bit(STRIPE_PREREAD_ACTIVE, &sh->state))
 				atomic_inc(&conf->preread_active_stripes);
-			list_add_tail(&sh->lru, &conf->handle_list);
+			raid5_queue_stripe(conf, sh);
 		}
 	}
 }
+
+static inline int raid5_handle_list_empty(raid5_conf_t *conf)
+{
+	int i;
+
+	for (i = 0; i < conf->nr_workers; i++)
+		if (!list_empty(&conf->workers[i].handle_list))
+			return 0;
+	return list_empty(&conf->handle_list);
+}
+
+/*
+ * Release the delayed stripes once nothing else is waiting to be
+ * handled and no pre-reading is in progress.  Called with device_lock
+ * held, by raid5d and by each worker that runs out of stripes.
+ */
+static inline void raid5_check_delayed(raid5_conf_t *conf)
+{
+	if (!list_empty(&conf->delayed_list) &&
+	    atomic_read(&conf->preread_active_stripes) < IO_THRESHOLD &&
+	    !blk_queue_plugged(conf->mddev->queue) &&
+	    raid5_handle_list_empty(conf))
+		raid5_activate_delayed(conf);
+}
 static void raid5_unplug_device(void *data)
 {
 	request_queue_t *q = data;
@@ -1331,8 +1414,14 @@ static int make_request (request_queue_t *q, struct bio * bi)
 
 	bi->bi_next = NULL;
 	bi->bi_phys_segments = 1;	/* over-loaded to count active stripes */
-	if ( bio_data_dir(bi) == WRITE )
+	if ( bio_data_dir(bi) == WRITE ) {
 		md_write_start(mddev);
+		/* every bit the bio needs must be on disk before any
+		 * stripe can see it
+		 */
+		raid5_bitmap_bio(conf, bi, 1);
+		bitmap_unplug(mddev->bitmap);
+	}
 	for (;logical_sector < last_sector; logical_sector += STRIPE_SECTORS) {
 		
 		new_sector = raid5_compute_sector(logical_sector,
@@ -1361,8 +1450,10 @@ static int make_request (request_queue_t *q, struct bio * bi)
 	if (--bi->bi_phys_segments == 0) {
 		int bytes = bi->bi_size;
 
-		if ( bio_data_dir(bi) == WRITE )
+		if ( bio_data_dir(bi) == WRITE ) {
+			raid5_bitmap_bio(conf, bi, 0);
 			md_write_end(mddev);
+		}
 		bi->bi_size = 0;
 		bi->bi_end_io(bi, bytes, 0);
 	}
@@ -1413,6 +1504,8 @@ static int sync_request (mddev_t *mddev, sector_t sector_nr, int go_faster)
  * We scan the hash table for stripes which can be handled now.
  * During the scan, completed stripes are saved for us by the interrupt
  * handler, so that they will not have to wait for our next wakeup.
+ * When there are stripe handling workers, the handle_list stays empty
+ * and we only look after recovery and the delayed stripes.
  */
 static void raid5d (mddev_t *mddev)
 {
@@ -1430,11 +1523,7 @@ static void raid5d (mddev_t *mddev)
 	while (1) {
 		struct list_head *first;
 
-		if (list_empty(&conf->handle_list) &&
-		    atomic_read(&conf->preread_active_stripes) < IO_THRESHOLD &&
-		    !blk_queue_plugged(mddev->queue) &&
-		    !list_empty(&conf->delayed_list))
-			raid5_activate_delayed(conf);
+		raid5_check_delayed(conf);
 
 		if (list_empty(&conf->handle_list))
 			break;
@@ -1461,6 +1550,169 @@ static void raid5d (mddev_t *mddev)
 	PRINTK("--- raid5d inactive\n");
 }
 
+/*
+ * Handle the stripes queued to one worker.  Up to RAID5_WORKER_BATCH
+ * stripes are taken off the list under one hold of device_lock,
+ * handled back to back, and released together.
+ */
+static void raid5_do_work(struct raid5_worker *worker)
+{
+	raid5_conf_t *conf = worker->conf;
+	struct stripe_head *batch[RAID5_WORKER_BATCH];
+	int i, cnt, handled;
+
+	PRINTK("+++ raid5 worker %d active\n", worker->index);
+
+	handled = 0;
+	spin_lock_irq(&conf->device_lock);
+	while (1) {
+		cnt = 0;
+		while (cnt < RAID5_WORKER_BATCH &&
+		       !list_empty(&worker->handle_list)) {
+			struct list_head *first = worker->handle_list.next;
+			struct stripe_head *sh;
+
+			sh = list_entry(first, struct stripe_head, lru);
+			list_del_init(first);
+			atomic_inc(&sh->count);
+			if (atomic_read(&sh->count)!= 1)
+				BUG();
+			batch[cnt++] = sh;
+		}
+		if (cnt == 0) {
+			raid5_check_delayed(conf);
+			if (list_empty(&worker->handle_list))
+				break;
+			continue;
+		}
+		spin_unlock_irq(&conf->device_lock);
+
+		for (i = 0; i < cnt; i++)
+			handle_stripe(batch[i]);
+		handled += cnt;
+
+		spin_lock_irq(&conf->device_lock);
+		for (i = 0; i < cnt; i++)
+			__release_stripe(conf, batch[i]);
+	}
+	spin_unlock_irq(&conf->device_lock);
+
+	PRINTK("%d stripes handled\n", handled);
+	PRINTK("--- raid5 worker %d inactive\n", worker->index);
+}
+
+/*
+ * The worker threads are run like md_thread(), but each is bound to
+ * its own CPU and works from its own list.
+ */
+static int raid5_worker_thread(void *arg)
+{
+	struct raid5_worker *worker = arg;
+
+	lock_kernel();
+
+	daemonize("md%d_raid5/%d", mdidx(worker->conf->mddev), worker->index);
+
+	current->exit_signal = SIGCHLD;
+	allow_signal(SIGKILL);
+	worker->tsk = current;
+
+	unlock_kernel();
+
+	set_cpus_allowed(current, cpumask_of_cpu(worker->cpu));
+
+	complete(worker->event);
+	while (worker->running) {
+		wait_event_interruptible(worker->wqueue,
+					 test_bit(THREAD_WAKEUP, &worker->flags));
+		if (current->flags & PF_FREEZE)
+			refrigerator(PF_IOTHREAD);
+
+		clear_bit(THREAD_WAKEUP, &worker->flags);
+
+		if (worker->running) {
+			raid5_do_work(worker);
+			blk_run_queues();
+		}
+		if (signal_pending(current))
+			flush_signals(current);
+	}
+	complete(worker->event);
+	return 0;
+}
+
+/*
+ * Start one worker per online CPU.  If we cannot get them all, the
+ * stripes are spread over the ones we did get; with none (or on UP)
+ * raid5d handles the stripes itself, as it always has.
+ */
+static void raid5_start_workers(raid5_conf_t *conf)
+{
+	struct completion event;
+	int nr, cpu, i;
+
+	nr = num_online_cpus();
+	if (nr > RAID5_MAX_WORKERS)
+		nr = RAID5_MAX_WORKERS;
+	if (nr < 2)
+		return;
+
+	conf->workers = kmalloc(nr * sizeof(struct raid5_worker), GFP_KERNEL);
+	if (!conf->workers)
+		return;
+	memset(conf->workers, 0, nr * sizeof(struct raid5_worker));
+
+	for (cpu = 0, i = 0; cpu < NR_CPUS && i < nr; cpu++) {
+		struct raid5_worker *worker = &conf->workers[i];
+
+		if (!cpu_online(cpu))
+			continue;
+		worker->conf = conf;
+		worker->index = i;
+		worker->cpu = cpu;
+		INIT_LIST_HEAD(&worker->handle_list);
+		init_waitqueue_head(&worker->wqueue);
+		worker->running = 1;
+
+		init_completion(&event);
+		worker->event = &event;
+		if (kernel_thread(raid5_worker_thread, worker, 0) < 0) {
+			printk(KERN_WARNING
+				"raid5: couldn't start stripe handling thread"
+				" %d for md%d\n", i, mdidx(conf->mddev));
+			break;
+		}
+		wait_for_completion(&event);
+		conf->nr_workers = ++i;
+	}
+	if (conf->nr_workers == 0) {
+		kfree(conf->workers);
+		conf->workers = NULL;
+	} else
+		printk(KERN_INFO "raid5: md%d handling stripes in %d threads\n",
+			mdidx(conf->mddev), conf->nr_workers);
+}
+
+static void raid5_stop_workers(raid5_conf_t *conf)
+{
+	struct completion event;
+	int i;
+
+	for (i = 0; i < conf->nr_workers; i++) {
+		struct raid5_worker *worker = &conf->workers[i];
+
+		init_completion(&event);
+		worker->event = &event;
+		worker->running = 0;
+		send_sig(SIGKILL, worker->tsk, 1);
+		wait_for_completion(&event);
+	}
+	conf->nr_workers = 0;
+	if (conf->workers)
+		kfree(conf->workers);
+	conf->workers = NULL;
+}
+
 static int run (mddev_t *mddev)
 {
 	raid5_conf_t *conf;
@@ -1562,6 +1814,7 @@ static int run (mddev_t *mddev)
 			goto abort;
 		}
 	}
+	raid5_start_workers(conf);
 memory = conf->max_nr_stripes * (sizeof(struct stripe_head) +
 		 conf->raid_disks * ((sizeof(struct bio) + PAGE_SIZE))) / 1024;
 	if (grow_stripes(conf, conf->max_nr_stripes)) {
@@ -1569,6 +1822,7 @@ memory = conf->max_nr_stripes * (sizeof(struct stripe_head) +
 			"raid5: couldn't allocate %dkB for buffers\n", memory);
 		shrink_stripes(conf);
 		md_unregister_thread(mddev->thread);
+		raid5_stop_workers(conf);
 		goto abort;
 	} else
 		printk(KERN_INFO "raid5: allocated %dkB for md%d\n",
@@ -1611,6 +1865,7 @@ static int stop (mddev_t *mddev)
 
 	md_unregister_thread(mddev->thread);
 	mddev->thread = NULL;
+	raid5_stop_workers(conf);
 	shrink_stripes(conf);
 	free_pages((unsigned long) conf->stripe_hashtbl, HASH_PAGES_ORDER);
 	kfree(conf);
@@ -0,0 +1,141 @@
+/*
+ * raid6.h : RAID-6 syndrome and recovery functions
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * (for example /usr/src/linux/COPYING); if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _RAID6_H
+#define _RAID6_H
+
+#ifdef __KERNEL__
+
+#include <linux/config.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/stringify.h>
+#include <linux/raid/md.h>
+#include <linux/raid/raid5.h>
+
+/*
+ * RAID-6 uses the RAID-5 stripe cache unchanged; the Q syndrome
+ * lives on the disk following the P disk.
+ */
+typedef raid5_conf_t raid6_conf_t;
+
+#else /* !__KERNEL__ */
+
+/*
+ * Enough of the kernel for the syndrome, recovery and algorithm
+ * selection code to build in user space, for raid6test/.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#define BITS_PER_LONG	__WORDSIZE
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE	4096
+#endif
+#define PAGE_SHIFT	12
+
+#define __stringify_1(x)	#x
+#define __stringify(x)		__stringify_1(x)
+
+#define KERN_INFO
+#define KERN_ERR
+#define printk		printf
+
+#define GFP_KERNEL	0
+#define __get_free_pages(x, y)	((unsigned long)mmap(NULL, PAGE_SIZE << (y), \
+						     PROT_READ|PROT_WRITE, \
+						     MAP_PRIVATE|MAP_ANONYMOUS, \
+						     0, 0))
+#define free_pages(x, y)	munmap((void *)(x), PAGE_SIZE << (y))
+
+/* Milliseconds stand in for jiffies */
+#define HZ		1000
+#define jiffies		raid6_jiffies()
+static inline unsigned long raid6_jiffies(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+#define preempt_enable()
+#define preempt_disable()
+#define cpu_relax()		do { } while (0)
+
+#endif /* __KERNEL__ */
+
+/*
+ * Upper bound on the member disks of an array; the syndrome code
+ * keeps one pointer per disk on the stack.  GF(2^8) itself allows
+ * up to 257.
+ */
+#define RAID6_MAX_DISKS		32
+
+/*
+ * A syndrome generator.  ptrs[0 .. disks-3] are the data blocks,
+ * ptrs[disks-2] receives P and ptrs[disks-1] receives Q.  All
+ * blocks are "bytes" long, and bytes is a multiple of 64.
+ */
+struct raid6_calls {
+	void (*gen_syndrome)(int disks, size_t bytes, void **ptrs);
+	int  (*valid)(void);	/* Returns 1 if this routine set is usable */
+	const char *name;	/* Name of this routine set */
+};
+
+/* Selected algorithm */
+extern struct raid6_calls raid6_call;
+
+/* Algorithms, and the NULL terminated list of them */
+extern const struct raid6_calls raid6_intx1;
+extern const struct raid6_calls raid6_intx2;
+extern const struct raid6_calls raid6_intx4;
+extern const struct raid6_calls raid6_intx8;
+extern const struct raid6_calls raid6_mmxx1;
+extern const struct raid6_calls raid6_mmxx2;
+extern const struct raid6_calls raid6_sse1x1;
+extern const struct raid6_calls raid6_sse1x2;
+extern const struct raid6_calls raid6_sse2x1;
+extern const struct raid6_calls raid6_sse2x2;
+extern const struct raid6_calls * const raid6_algos[];
+
+/* Galois field tables, generated at build time by mktables */
+extern const u8 raid6_gfmul[256][256] __attribute__((aligned(256)));
+extern const u8 raid6_gfexp[256]      __attribute__((aligned(256)));
+extern const u8 raid6_gfinv[256]      __attribute__((aligned(256)));
+extern const u8 raid6_gfexi[256]      __attribute__((aligned(256)));
+
+/* A page of zeroes standing in for missing data blocks */
+extern const char raid6_empty_zero_page[PAGE_SIZE];
+
+/* Recovery routines */
+void raid6_2data_recov(int disks, size_t bytes, int faila, int failb,
+		       void **ptrs);
+void raid6_datap_recov(int disks, size_t bytes, int faila, void **ptrs);
+
+int raid6_select_algo(void);
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * raid6algos.c : Multiple Devices driver for Linux
+ *
+ * Algorithm list and algorithm selection for RAID-6.  Works the same
+ * way as the xor template selection in xor.c: every usable syndrome
+ * routine is timed for a few jiffies, and the fastest one is used.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * (for example /usr/src/linux/COPYING); if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifdef __KERNEL__
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#endif
+#include "raid6.h"
+#include "raid6x86.h"
+
+struct raid6_calls raid6_call;
+
+const char raid6_empty_zero_page[PAGE_SIZE] __attribute__((aligned(256)));
+
+#if defined(__i386__) || defined(__x86_64__)
+const struct raid6_x86_constants raid6_x86_constants = {
+	{ 0x1d1d1d1d, 0x1d1d1d1d, 0x1d1d1d1d, 0x1d1d1d1d },
+};
+#endif
+
+const struct raid6_calls * const raid6_algos[] = {
+	&raid6_intx1,
+	&raid6_intx2,
+	&raid6_intx4,
+	&raid6_intx8,
+#if defined(__i386__)
+	&raid6_mmxx1,
+	&raid6_mmxx2,
+	&raid6_sse1x1,
+	&raid6_sse1x2,
+	&raid6_sse2x1,
+	&raid6_sse2x2,
+#endif
+#if defined(__x86_64__)
+	&raid6_sse2x1,
+	&raid6_sse2x2,
+#endif
+	NULL
+};
+
+/* Number of data disks and jiffies used for the benchmark */
+#define RAID6_TEST_DISKS	8
+#define RAID6_TEST_ORDER	3	/* RAID6_TEST_DISKS pages */
+#define RAID6_TIME_JIFFIES_LG2	2
+
+/* Data throughput of "perf" syndromes in 2^RAID6_TIME_JIFFIES_LG2 jiffies */
+#define RAID6_MBPS(perf) \
+	(((perf) * HZ * (RAID6_TEST_DISKS-2)) >> \
+	 (20-PAGE_SHIFT+RAID6_TIME_JIFFIES_LG2))
+
+/* Try to pick the best algorithm */
+int raid6_select_algo(void)
+{
+	const struct raid6_calls * const * algo;
+	const struct raid6_calls * best;
+	char *buf;
+	void *dptrs[RAID6_TEST_DISKS];
+	unsigned long perf, bestperf;
+	unsigned long j0, j1;
+	int i;
+
+	buf = (char *) __get_free_pages(GFP_KERNEL, RAID6_TEST_ORDER);
+	if (!buf) {
+		printk(KERN_ERR "raid6: Yikes!  No memory available.\n");
+		return -ENOMEM;
+	}
+
+	/* Fill the data disks with something that is not all zeroes */
+	for (i = 0; i < RAID6_TEST_DISKS-2; i++) {
+		dptrs[i] = buf + i*PAGE_SIZE;
+		memcpy(dptrs[i], raid6_gfmul[i+1], 256);
+		memcpy(dptrs[i] + 256, dptrs[i], PAGE_SIZE - 256);
+	}
+	dptrs[RAID6_TEST_DISKS-2] = buf + (RAID6_TEST_DISKS-2)*PAGE_SIZE;
+	dptrs[RAID6_TEST_DISKS-1] = buf + (RAID6_TEST_DISKS-1)*PAGE_SIZE;
+
+	bestperf = 0;
+	best = NULL;
+	for (algo = raid6_algos; *algo; algo++) {
+		if (!(*algo)->valid || (*algo)->valid()) {
+			perf = 0;
+
+			preempt_disable();
+			j0 = jiffies;
+			while ((j1 = jiffies) == j0)
+				cpu_relax();
+			while ((jiffies - j1) < (1 << RAID6_TIME_JIFFIES_LG2)) {
+				(*algo)->gen_syndrome(RAID6_TEST_DISKS,
+						      PAGE_SIZE, dptrs);
+				perf++;
+			}
+			preempt_enable();
+
+			if (perf > bestperf) {
+				bestperf = perf;
+				best = *algo;
+			}
+			printk(KERN_INFO "raid6: %-8s %5ld MB/s\n",
+			       (*algo)->name,
+			       RAID6_MBPS(perf));
+		}
+	}
+
+	free_pages((unsigned long)buf, RAID6_TEST_ORDER);
+
+	if (!best) {
+		printk(KERN_ERR "raid6: Yikes!  No algorithm found!\n");
+		return -EINVAL;
+	}
+
+	raid6_call = *best;
+	printk(KERN_INFO "raid6: using algorithm %s (%ld MB/s)\n",
+	       best->name, RAID6_MBPS(bestperf));
+
+	return 0;
+}
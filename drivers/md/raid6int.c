@@ -0,0 +1,107 @@
+/*
+ * raid6int.c : RAID-6 syndrome calculation in native integer registers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * (for example /usr/src/linux/COPYING); if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * P is the plain xor of the data blocks.  Q is the Reed-Solomon
+ * syndrome sum(g^i * D_i) over GF(2^8), evaluated by Horner's rule
+ * starting at the highest data disk.  Multiplying by g = {02} is
+ * done on all the bytes of a machine word at once: shift every byte
+ * left by one and xor 0x1d into the bytes whose top bit was set.
+ *
+ * The variants differ only in how many words are kept in flight per
+ * pass, which trades registers for instruction-level parallelism.
+ */
+
+#include "raid6.h"
+
+typedef unsigned long unative_t;	/* One machine word */
+#define NSIZE	sizeof(unative_t)
+
+#if BITS_PER_LONG == 64
+#define NBYTES(x) ((x) * 0x0101010101010101UL)
+#else
+#define NBYTES(x) ((x) * 0x01010101UL)
+#endif
+
+/* Shift every byte of v left by one, dropping the carries */
+static inline unative_t SHLBYTE(unative_t v)
+{
+	return (v << 1) & NBYTES(0xfe);
+}
+
+/* 0xff in every byte of v whose top bit is set, 0x00 elsewhere */
+static inline unative_t MASK(unative_t v)
+{
+	unative_t vv;
+
+	vv = v & NBYTES(0x80);
+	vv = (vv << 1) - (vv >> 7);	/* Overflow on the top bit is OK */
+	return vv;
+}
+
+#define RAID6_INT_MAXUNROLL	8
+
+static inline void raid6_int_gen_syndrome(int disks, size_t bytes,
+					  void **ptrs, const int unroll)
+{
+	u8 **dptr = (u8 **)ptrs;
+	u8 *p, *q;
+	int z, z0, u;
+	size_t d;
+	unative_t wd[RAID6_INT_MAXUNROLL];
+	unative_t wp[RAID6_INT_MAXUNROLL];
+	unative_t wq[RAID6_INT_MAXUNROLL];
+	unative_t w1, w2;
+
+	z0 = disks - 3;		/* Highest data disk */
+	p = dptr[z0+1];		/* XOR parity */
+	q = dptr[z0+2];		/* RS syndrome */
+
+	for (d = 0; d < bytes; d += NSIZE*unroll) {
+		for (u = 0; u < unroll; u++)
+			wq[u] = wp[u] = *(unative_t *)&dptr[z0][d+u*NSIZE];
+		for (z = z0-1; z >= 0; z--) {
+			for (u = 0; u < unroll; u++) {
+				wd[u] = *(unative_t *)&dptr[z][d+u*NSIZE];
+				wp[u] ^= wd[u];
+				w2 = MASK(wq[u]);
+				w1 = SHLBYTE(wq[u]);
+				w2 &= NBYTES(0x1d);
+				w1 ^= w2;
+				wq[u] = w1 ^ wd[u];
+			}
+		}
+		for (u = 0; u < unroll; u++) {
+			*(unative_t *)&p[d+u*NSIZE] = wp[u];
+			*(unative_t *)&q[d+u*NSIZE] = wq[u];
+		}
+	}
+}
+
+#define RAID6_INT(n)							\
+static void raid6_int##n##_gen_syndrome(int disks, size_t bytes,	\
+					void **ptrs)			\
+{									\
+	raid6_int_gen_syndrome(disks, bytes, ptrs, n);			\
+}									\
+									\
+const struct raid6_calls raid6_intx##n = {				\
+	.gen_syndrome	= raid6_int##n##_gen_syndrome,			\
+	.valid		= NULL,		/* always valid */		\
+	.name		= "int" __stringify(BITS_PER_LONG) "x" #n,	\
+}
+
+RAID6_INT(1);
+RAID6_INT(2);
+RAID6_INT(4);
+RAID6_INT(8);
@@ -0,0 +1,136 @@
+/*
+ * raid6test/test.c : RAID-6 recovery test, run in user space
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * (for example /usr/src/linux/COPYING); if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * For every usable syndrome algorithm, fail each pair of blocks
+ * (x, y) of a stripe, data, P or Q, and recover them the way
+ * compute_block_2() in raid6main.c does.  Then run the algorithm
+ * selection benchmark.
+ */
+
+#include <stdlib.h>
+#include "raid6.h"
+
+#define NDISKS		16	/* Including P and Q */
+
+static char data[NDISKS][PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static char recovi[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static char recovj[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static void *dataptrs[NDISKS];
+
+static void makedata(void)
+{
+	int i, j;
+
+	for (i = 0; i < NDISKS; i++) {
+		for (j = 0; j < PAGE_SIZE; j++)
+			data[i][j] = rand();
+		dataptrs[i] = data[i];
+	}
+}
+
+static char disk_type(int d)
+{
+	if (d == NDISKS-2)
+		return 'P';
+	if (d == NDISKS-1)
+		return 'Q';
+	return 'D';
+}
+
+/* Recover blocks faila < failb, as compute_block_2() does */
+static void raid6_dual_recov(int disks, size_t bytes, int faila, int failb,
+			     void **ptrs)
+{
+	u8 *p, *d;
+	size_t i;
+	int z;
+
+	if (failb == disks-1) {
+		if (faila != disks-2) {
+			/* D+Q: recover D from P first */
+			p = ptrs[disks-2];
+			d = ptrs[faila];
+			memcpy(d, p, bytes);
+			for (z = 0; z < disks-2; z++)
+				if (z != faila)
+					for (i = 0; i < bytes; i++)
+						d[i] ^= ((u8 *)ptrs[z])[i];
+		}
+		/* then P+Q is just a syndrome regeneration */
+		raid6_call.gen_syndrome(disks, bytes, ptrs);
+	} else if (failb == disks-2)
+		raid6_datap_recov(disks, bytes, faila, ptrs);
+	else
+		raid6_2data_recov(disks, bytes, faila, failb, ptrs);
+}
+
+static int test_algo(const struct raid6_calls *algo)
+{
+	int i, j, erra, errb;
+	int errors = 0;
+
+	raid6_call = *algo;
+
+	/* Nuke P and Q, and generate an assumed good syndrome */
+	memset(data[NDISKS-2], 0xee, 2*PAGE_SIZE);
+	raid6_call.gen_syndrome(NDISKS, PAGE_SIZE, dataptrs);
+
+	for (i = 0; i < NDISKS-1; i++) {
+		for (j = i+1; j < NDISKS; j++) {
+			memset(recovi, 0xf0, PAGE_SIZE);
+			memset(recovj, 0xba, PAGE_SIZE);
+
+			dataptrs[i] = recovi;
+			dataptrs[j] = recovj;
+
+			raid6_dual_recov(NDISKS, PAGE_SIZE, i, j, dataptrs);
+
+			erra = memcmp(data[i], recovi, PAGE_SIZE);
+			errb = memcmp(data[j], recovj, PAGE_SIZE);
+			if (erra || errb) {
+				printf("algo=%-8s  faila=%3d(%c)  failb=%3d(%c)"
+				       "  ERRA=%s  ERRB=%s\n",
+				       raid6_call.name,
+				       i, disk_type(i), j, disk_type(j),
+				       erra ? "BAD" : "OK", errb ? "BAD" : "OK");
+				errors++;
+			}
+
+			dataptrs[i] = data[i];
+			dataptrs[j] = data[j];
+		}
+	}
+
+	printf("algo=%-8s  %d of %d double failures %s\n", raid6_call.name,
+	       errors ? errors : NDISKS*(NDISKS-1)/2, NDISKS*(NDISKS-1)/2,
+	       errors ? "FAILED" : "recovered");
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct raid6_calls * const *algo;
+	int errors = 0;
+
+	makedata();
+
+	for (algo = raid6_algos; *algo; algo++)
+		if (!(*algo)->valid || (*algo)->valid())
+			errors += test_algo(*algo);
+	printf("\n");
+
+	raid6_select_algo();
+
+	return errors ? 1 : 0;
+}
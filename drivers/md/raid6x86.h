@@ -0,0 +1,83 @@
+/*
+ * raid6x86.h : common definitions for the x86 SIMD RAID-6 routines
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * (for example /usr/src/linux/COPYING); if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _RAID6X86_H
+#define _RAID6X86_H
+
+#if defined(__i386__) || defined(__x86_64__)
+
+#ifdef __KERNEL__
+
+#include <linux/preempt.h>
+#include <asm/i387.h>
+#include <asm/cpufeature.h>
+
+#else /* !__KERNEL__ */
+
+/* User space owns its FPU state; ask cpuid for the features */
+#define kernel_fpu_begin()
+#define kernel_fpu_end()
+
+#define X86_FEATURE_MMX		(0*32+23)
+#define X86_FEATURE_FXSR	(0*32+24)
+#define X86_FEATURE_XMM		(0*32+25)
+#define X86_FEATURE_XMM2	(0*32+26)
+#define X86_FEATURE_MMXEXT	(1*32+22)
+
+static inline int boot_cpu_has(int flag)
+{
+	u32 eax = (flag >> 5) ? 0x80000001 : 1;
+	u32 ebx, ecx, edx;
+
+	/* %ebx may be the PIC register */
+	asm volatile("xchgl %%ebx,%1 ; cpuid ; xchgl %%ebx,%1"
+		     : "+a" (eax), "=r" (ebx), "=c" (ecx), "=d" (edx));
+
+	return (edx >> (flag & 31)) & 1;
+}
+
+#define cpu_has_xmm		boot_cpu_has(X86_FEATURE_XMM)
+
+#endif /* __KERNEL__ */
+
+/*
+ * The MMX and SSE registers belong to the FPU state of the current
+ * task, so save that state (if it is live) and stay on this CPU
+ * until we are done, as the MMX xor templates do.  The i386
+ * kernel_fpu_begin() disables preemption itself; x86_64's does not.
+ */
+static inline void raid6_before_simd(void)
+{
+#ifdef __x86_64__
+	preempt_disable();
+#endif
+	kernel_fpu_begin();
+}
+
+static inline void raid6_after_simd(void)
+{
+	kernel_fpu_end();
+#ifdef __x86_64__
+	preempt_enable();
+#endif
+}
+
+/* {1d} in every byte, for the multiply-by-{02} reduction */
+struct raid6_x86_constants {
+	u32 x1d[4];
+} __attribute__((aligned(16)));
+
+extern const struct raid6_x86_constants raid6_x86_constants;
+
+#endif
+#endif
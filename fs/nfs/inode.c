@@ -339,17 +339,16 @@ nfs_sb_init(struct super_block *sb, rpc_authflavor_t authflavor)
 	if (fsinfo.wtmax >= 512 && server->wsize > fsinfo.wtmax)
 		server->wsize = nfs_block_size(fsinfo.wtmax, NULL);
 
-	server->rpages = (server->rsize + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
-	if (server->rpages > NFS_READ_MAXIOV) {
-		server->rpages = NFS_READ_MAXIOV;
-		server->rsize = server->rpages << PAGE_CACHE_SHIFT;
+	/* A UDP request or reply has to fit in a single datagram */
+	if (!server->client->cl_xprt->stream) {
+		if (server->rsize > NFS_MAX_UDP_IO_BUFFER_SIZE)
+			server->rsize = NFS_MAX_UDP_IO_BUFFER_SIZE;
+		if (server->wsize > NFS_MAX_UDP_IO_BUFFER_SIZE)
+			server->wsize = NFS_MAX_UDP_IO_BUFFER_SIZE;
 	}
 
+	server->rpages = (server->rsize + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
 	server->wpages = (server->wsize + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
-        if (server->wpages > NFS_WRITE_MAXIOV) {
-		server->wpages = NFS_WRITE_MAXIOV;
-                server->wsize = server->wpages << PAGE_CACHE_SHIFT;
-	}
 
 	server->dtsize = nfs_block_size(fsinfo.dtpref, NULL);
 	if (server->dtsize > PAGE_CACHE_SIZE)
@@ -422,6 +421,10 @@ nfs_create_client(struct nfs_server *server, const struct nfs_mount_data *data)
 	clnt->cl_droppriv = (server->flags & NFS_MOUNT_BROKEN_SUID) ? 1 : 0;
 	clnt->cl_chatty   = 1;
 
+	if (data->nconnect > 1 && rpc_set_nconnect(clnt, data->nconnect) < 0)
+		printk(KERN_WARNING "NFS: using only %u of %u connections.\n",
+				clnt->cl_nxprts, data->nconnect);
+
 	return clnt;
 
 out_fail:
@@ -598,6 +601,8 @@ static int nfs_show_options(struct seq_file *m, struct vfsmount *mnt)
 	seq_printf(m, ",v%d", nfss->rpc_ops->version);
 	seq_printf(m, ",rsize=%d", nfss->rsize);
 	seq_printf(m, ",wsize=%d", nfss->wsize);
+	if (nfss->client->cl_nxprts > 1)
+		seq_printf(m, ",nconnect=%u", nfss->client->cl_nxprts);
 	if (nfss->acregmin != 3*HZ)
 		seq_printf(m, ",acregmin=%d", nfss->acregmin/HZ);
 	if (nfss->acregmax != 60*HZ)
@@ -1286,6 +1291,8 @@ static struct super_block *nfs_get_sb(struct file_system_type *fs_type,
 		}
 		if (data->version < 5)
 			data->flags &= ~NFS_MOUNT_SECFLAVOUR;
+		if (data->version < 6)
+			data->nconnect = 0;
 	}
 
 	if (root->size > sizeof(root->data)) {
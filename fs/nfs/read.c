@@ -38,22 +38,37 @@ static int nfs_pagein_one(struct list_head *, struct inode *);
 
 static kmem_cache_t *nfs_rdata_cachep;
 static mempool_t *nfs_rdata_mempool;
+static kmem_cache_t *nfs_rpagevec_cachep;
+static mempool_t *nfs_rpagevec_mempool;
 
 #define MIN_POOL_READ	(32)
+#define MIN_POOL_READ_PAGEVEC	(4)
 
-static __inline__ struct nfs_read_data *nfs_readdata_alloc(void)
+static __inline__ struct nfs_read_data *nfs_readdata_alloc(unsigned int pagecount)
 {
 	struct nfs_read_data   *p;
 	p = (struct nfs_read_data *)mempool_alloc(nfs_rdata_mempool, SLAB_NOFS);
 	if (p) {
 		memset(p, 0, sizeof(*p));
 		INIT_LIST_HEAD(&p->pages);
+		if (pagecount <= NFS_PAGEVEC_SIZE)
+			p->pagevec = p->page_array;
+		else {
+			p->pagevec = mempool_alloc(nfs_rpagevec_mempool,
+						   SLAB_NOFS);
+			if (!p->pagevec) {
+				mempool_free(p, nfs_rdata_mempool);
+				p = NULL;
+			}
+		}
 	}
 	return p;
 }
 
 static __inline__ void nfs_readdata_free(struct nfs_read_data *p)
 {
+	if (p->pagevec != p->page_array)
+		mempool_free(p->pagevec, nfs_rpagevec_mempool);
 	mempool_free(p, nfs_rdata_mempool);
 }
 
@@ -211,9 +226,13 @@ nfs_pagein_one(struct list_head *head, struct inode *inode)
 {
 	struct rpc_clnt		*clnt = NFS_CLIENT(inode);
 	struct nfs_read_data	*data;
+	struct list_head	*pos;
+	unsigned int		pagecount = 0;
 	sigset_t		oldset;
 
-	data = nfs_readdata_alloc();
+	list_for_each(pos, head)
+		pagecount++;
+	data = nfs_readdata_alloc(pagecount);
 	if (!data)
 		goto out_bad;
 
@@ -412,11 +431,27 @@ int nfs_init_readpagecache(void)
 	if (nfs_rdata_mempool == NULL)
 		return -ENOMEM;
 
+	nfs_rpagevec_cachep = kmem_cache_create("nfs_read_pagevec",
+				NFS_MAX_PAGEVEC_SIZE * sizeof(struct page *),
+				0, 0, NULL, NULL);
+	if (nfs_rpagevec_cachep == NULL)
+		return -ENOMEM;
+
+	nfs_rpagevec_mempool = mempool_create(MIN_POOL_READ_PAGEVEC,
+					      mempool_alloc_slab,
+					      mempool_free_slab,
+					      nfs_rpagevec_cachep);
+	if (nfs_rpagevec_mempool == NULL)
+		return -ENOMEM;
+
 	return 0;
 }
 
 void nfs_destroy_readpagecache(void)
 {
+	mempool_destroy(nfs_rpagevec_mempool);
+	if (kmem_cache_destroy(nfs_rpagevec_cachep))
+		printk(KERN_INFO "nfs_read_pagevec: not all structures were freed\n");
 	mempool_destroy(nfs_rdata_mempool);
 	if (kmem_cache_destroy(nfs_rdata_cachep))
 		printk(KERN_INFO "nfs_read_data: not all structures were freed\n");
@@ -67,6 +67,7 @@
 
 #define MIN_POOL_WRITE		(32)
 #define MIN_POOL_COMMIT		(4)
+#define MIN_POOL_WRITE_PAGEVEC	(4)
 
 /*
  * Local function declarations
@@ -78,21 +79,35 @@ static void	nfs_strategy(struct inode *inode);
 
 static kmem_cache_t *nfs_wdata_cachep;
 static mempool_t *nfs_wdata_mempool;
+static kmem_cache_t *nfs_wpagevec_cachep;
+static mempool_t *nfs_wpagevec_mempool;
 static mempool_t *nfs_commit_mempool;
 
-static __inline__ struct nfs_write_data *nfs_writedata_alloc(void)
+static __inline__ struct nfs_write_data *nfs_writedata_alloc(unsigned int pagecount)
 {
 	struct nfs_write_data	*p;
 	p = (struct nfs_write_data *)mempool_alloc(nfs_wdata_mempool, SLAB_NOFS);
 	if (p) {
 		memset(p, 0, sizeof(*p));
 		INIT_LIST_HEAD(&p->pages);
+		if (pagecount <= NFS_PAGEVEC_SIZE)
+			p->pagevec = p->page_array;
+		else {
+			p->pagevec = mempool_alloc(nfs_wpagevec_mempool,
+						   SLAB_NOFS);
+			if (!p->pagevec) {
+				mempool_free(p, nfs_wdata_mempool);
+				p = NULL;
+			}
+		}
 	}
 	return p;
 }
 
 static __inline__ void nfs_writedata_free(struct nfs_write_data *p)
 {
+	if (p->pagevec != p->page_array)
+		mempool_free(p->pagevec, nfs_wpagevec_mempool);
 	mempool_free(p, nfs_wdata_mempool);
 }
 
@@ -774,9 +789,13 @@ nfs_flush_one(struct list_head *head, struct inode *inode, int how)
 {
 	struct rpc_clnt 	*clnt = NFS_CLIENT(inode);
 	struct nfs_write_data	*data;
+	struct list_head	*pos;
+	unsigned int		pagecount = 0;
 	sigset_t		oldset;
 
-	data = nfs_writedata_alloc();
+	list_for_each(pos, head)
+		pagecount++;
+	data = nfs_writedata_alloc(pagecount);
 	if (!data)
 		goto out_bad;
 
@@ -1125,6 +1144,19 @@ int nfs_init_writepagecache(void)
 	if (nfs_wdata_mempool == NULL)
 		return -ENOMEM;
 
+	nfs_wpagevec_cachep = kmem_cache_create("nfs_write_pagevec",
+				NFS_MAX_PAGEVEC_SIZE * sizeof(struct page *),
+				0, 0, NULL, NULL);
+	if (nfs_wpagevec_cachep == NULL)
+		return -ENOMEM;
+
+	nfs_wpagevec_mempool = mempool_create(MIN_POOL_WRITE_PAGEVEC,
+					      mempool_alloc_slab,
+					      mempool_free_slab,
+					      nfs_wpagevec_cachep);
+	if (nfs_wpagevec_mempool == NULL)
+		return -ENOMEM;
+
 	nfs_commit_mempool = mempool_create(MIN_POOL_COMMIT,
 					   mempool_alloc_slab,
 					   mempool_free_slab,
@@ -1138,6 +1170,9 @@ int nfs_init_writepagecache(void)
 void nfs_destroy_writepagecache(void)
 {
 	mempool_destroy(nfs_commit_mempool);
+	mempool_destroy(nfs_wpagevec_mempool);
+	if (kmem_cache_destroy(nfs_wpagevec_cachep))
+		printk(KERN_INFO "nfs_write_pagevec: not all structures were freed\n");
 	mempool_destroy(nfs_wdata_mempool);
 	if (kmem_cache_destroy(nfs_wdata_cachep))
 		printk(KERN_INFO "nfs_write_data: not all structures were freed\n");
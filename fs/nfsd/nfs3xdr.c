@@ -337,8 +337,8 @@ nfs3svc_decode_readargs(struct svc_rqst *rqstp, u32 *p,
 
 	len = args->count = ntohl(*p++);
 
-	if (len > NFSSVC_MAXBLKSIZE)
-		len = NFSSVC_MAXBLKSIZE;
+	if (len > svc_max_payload(rqstp))
+		len = svc_max_payload(rqstp);
 
 	/* set up the iovec */
 	v=0;
@@ -372,8 +372,8 @@ nfs3svc_decode_writeargs(struct svc_rqst *rqstp, u32 *p,
 	args->vec[0].iov_len = rqstp->rq_arg.head[0].iov_len -
 		(((void*)p) - rqstp->rq_arg.head[0].iov_base);
 
-	if (len > NFSSVC_MAXBLKSIZE)
-		len = NFSSVC_MAXBLKSIZE;
+	if (len > svc_max_payload(rqstp))
+		len = svc_max_payload(rqstp);
 	v=  0;
 	while (len > args->vec[v].iov_len) {
 		len -= args->vec[v].iov_len;
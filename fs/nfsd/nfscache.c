@@ -1,8 +1,8 @@
 /*
  * linux/fs/nfsd/nfscache.c
  *
- * Request reply cache. This is currently a global cache, but this may
- * change in the future and be a per-client cache.
+ * Request reply cache. This is a global cache, hashed on xid and
+ * client, with fair sharing of its space between clients.
  *
  * This code is heavily inspired by the 44BSD implementation, although
  * it does things a bit differently.
@@ -15,30 +15,44 @@
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/spinlock.h>
+#include <linux/mm.h>
+#include <linux/jhash.h>
+#include <net/checksum.h>
 
 #include <linux/sunrpc/svc.h>
 #include <linux/nfsd/nfsd.h>
 #include <linux/nfsd/cache.h>
 
-/* Size of reply cache. Common values are:
+/*
+ * Size of reply cache. Common values are:
  * 4.3BSD:	128
  * 4.4BSD:	256
  * Solaris2:	1024
  * DEC Unix:	512-4096
+ *
+ * A busy server turns a cache of that size over in milliseconds,
+ * long before a client retransmits, so entries are allocated as
+ * needed up to a limit set from the amount of memory (about one
+ * entry per 16 pages).  Entries are hashed on xid and client address
+ * into buckets, each with its own lock and LRU list.
  */
-#define CACHESIZE		1024
-#define HASHSIZE		64
-#define REQHASH(xid)		((((xid) >> 24) ^ (xid)) & (HASHSIZE-1))
-
-struct nfscache_head {
-	struct svc_cacherep *	next;
-	struct svc_cacherep *	prev;
+#define RC_MINSIZE		1024
+#define RC_MAXSIZE		(256*1024)
+#define RC_BUCKETLEN		8	/* average entries per bucket when full */
+#define RC_EXPIRE		(120*HZ)
+#define RC_CSUMLEN		256	/* bytes of the arguments to checksum */
+
+struct nfscache_bucket {
+	struct list_head	lru;	/* newest first */
+	spinlock_t		lock;
 };
 
-static struct nfscache_head *	hash_list;
-static struct svc_cacherep *	lru_head;
-static struct svc_cacherep *	lru_tail;
-static struct svc_cacherep *	nfscache;
+static struct nfscache_bucket *	hash_list;
+static unsigned int		hash_size;	/* power of 2 */
+static unsigned long		hash_order;	/* of the hash_list pages */
+static unsigned int		max_entries;
+static atomic_t			num_entries = ATOMIC_INIT(0);
+static kmem_cache_t *		nfscache_slab;
 static int			cache_disabled = 1;
 
 static int	nfsd_cache_append(struct svc_rqst *rqstp, struct iovec *vec);
@@ -46,138 +60,173 @@ static int	nfsd_cache_append(struct svc_rqst *rqstp, struct iovec *vec);
 /* 
  * locking for the reply cache:
  * A cache entry is "single use" if c_state == RC_INPROG
- * Otherwise, it when accessing _prev or _next, the lock must be held.
+ * Otherwise, it when accessing c_lru, the lock of its bucket
+ * must be held.
  */
-static spinlock_t cache_lock = SPIN_LOCK_UNLOCKED;
+
+static inline struct nfscache_bucket *
+nfscache_bucket(u32 xid, struct sockaddr_in *addr)
+{
+	return &hash_list[jhash_3words(xid, addr->sin_addr.s_addr,
+				       addr->sin_port, 0) & (hash_size-1)];
+}
 
 void
 nfsd_cache_init(void)
 {
-	struct svc_cacherep	*rp;
-	struct nfscache_head	*rh;
+	struct nfscache_bucket	*b;
 	size_t			i;
-	unsigned long		order;
-
 
-	i = CACHESIZE * sizeof (struct svc_cacherep);
-	for (order = 0; (PAGE_SIZE << order) < i; order++)
+	max_entries = num_physpages >> 4;
+	if (max_entries < RC_MINSIZE)
+		max_entries = RC_MINSIZE;
+	if (max_entries > RC_MAXSIZE)
+		max_entries = RC_MAXSIZE;
+	for (hash_size = 1; hash_size * RC_BUCKETLEN < max_entries; hash_size <<= 1)
 		;
-	nfscache = (struct svc_cacherep *)
-		__get_free_pages(GFP_KERNEL, order);
-	if (!nfscache) {
-		printk (KERN_ERR "nfsd: cannot allocate %Zd bytes for reply cache\n", i);
+
+	nfscache_slab = kmem_cache_create("nfsd_drc",
+				sizeof(struct svc_cacherep), 0, 0, NULL, NULL);
+	if (!nfscache_slab) {
+		printk (KERN_ERR "nfsd: cannot create reply cache slab\n");
 		return;
 	}
-	memset(nfscache, 0, i);
 
-	i = HASHSIZE * sizeof (struct nfscache_head);
-	hash_list = kmalloc (i, GFP_KERNEL);
+	i = hash_size * sizeof (struct nfscache_bucket);
+	for (hash_order = 0; (PAGE_SIZE << hash_order) < i; hash_order++)
+		;
+	hash_list = (struct nfscache_bucket *)
+		__get_free_pages(GFP_KERNEL, hash_order);
 	if (!hash_list) {
-		free_pages ((unsigned long)nfscache, order);
-		nfscache = NULL;
+		kmem_cache_destroy(nfscache_slab);
+		nfscache_slab = NULL;
 		printk (KERN_ERR "nfsd: cannot allocate %Zd bytes for hash list\n", i);
 		return;
 	}
 
-	for (i = 0, rh = hash_list; i < HASHSIZE; i++, rh++)
-		rh->next = rh->prev = (struct svc_cacherep *) rh;
-
-	for (i = 0, rp = nfscache; i < CACHESIZE; i++, rp++) {
-		rp->c_state = RC_UNUSED;
-		rp->c_type = RC_NOCACHE;
-		rp->c_hash_next =
-		rp->c_hash_prev = rp;
-		rp->c_lru_next = rp + 1;
-		rp->c_lru_prev = rp - 1;
+	for (i = 0, b = hash_list; i < hash_size; i++, b++) {
+		INIT_LIST_HEAD(&b->lru);
+		spin_lock_init(&b->lock);
 	}
-	lru_head = nfscache;
-	lru_tail = nfscache + CACHESIZE - 1;
-	lru_head->c_lru_prev = NULL;
-	lru_tail->c_lru_next = NULL;
+	nfsdstats.rcsize = max_entries;
 
 	cache_disabled = 0;
 }
 
+/*
+ * Unhash and free an entry.  Must have the lock of its bucket held.
+ */
+static void
+nfscache_free(struct svc_cacherep *rp)
+{
+	list_del(&rp->c_lru);
+	if (rp->c_type == RC_REPLBUFF)
+		kfree(rp->c_replvec.iov_base);
+	kmem_cache_free(nfscache_slab, rp);
+	atomic_dec(&num_entries);
+}
+
 void
 nfsd_cache_shutdown(void)
 {
-	struct svc_cacherep	*rp;
+	struct nfscache_bucket	*b;
 	size_t			i;
-	unsigned long		order;
-
-	for (rp = lru_head; rp; rp = rp->c_lru_next) {
-		if (rp->c_state == RC_DONE && rp->c_type == RC_REPLBUFF)
-			kfree(rp->c_replvec.iov_base);
-	}
 
+	if (cache_disabled)
+		return;
 	cache_disabled = 1;
 
-	i = CACHESIZE * sizeof (struct svc_cacherep);
-	for (order = 0; (PAGE_SIZE << order) < i; order++)
-		;
-	free_pages ((unsigned long)nfscache, order);
-	nfscache = NULL;
-	kfree (hash_list);
+	for (i = 0, b = hash_list; i < hash_size; i++, b++) {
+		while (!list_empty(&b->lru))
+			nfscache_free(list_entry(b->lru.next,
+						 struct svc_cacherep, c_lru));
+	}
+
+	free_pages ((unsigned long)hash_list, hash_order);
 	hash_list = NULL;
+	if (kmem_cache_destroy(nfscache_slab))
+		printk(KERN_INFO "nfsd: reply cache entries not freed\n");
+	nfscache_slab = NULL;
+}
+
+unsigned int
+nfsd_cache_entries(void)
+{
+	return atomic_read(&num_entries);
 }
 
 /*
- * Move cache entry to front of LRU list
+ * Checksum the start of the call arguments, so that a new call which
+ * happens to reuse an xid is not answered with the reply to another.
  */
-static void
-lru_put_front(struct svc_cacherep *rp)
+static u32
+nfsd_cache_csum(struct svc_rqst *rqstp)
 {
-	struct svc_cacherep	*prev = rp->c_lru_prev,
-				*next = rp->c_lru_next;
-
-	if (prev)
-		prev->c_lru_next = next;
-	else
-		lru_head = next;
-	if (next)
-		next->c_lru_prev = prev;
-	else
-		lru_tail = prev;
-
-	rp->c_lru_next = lru_head;
-	rp->c_lru_prev = NULL;
-	if (lru_head)
-		lru_head->c_lru_prev = rp;
-	lru_head = rp;
+	struct iovec	*vec = &rqstp->rq_arg.head[0];
+	int		len = vec->iov_len;
+
+	if (len > RC_CSUMLEN)
+		len = RC_CSUMLEN;
+	return csum_partial(vec->iov_base, len, 0);
 }
 
 /*
- * Move a cache entry from one hash list to another
+ * Free the expired entries at the old end of a bucket.  Then, if the
+ * cache is full, pick an entry of the bucket to recycle: the oldest
+ * one from the same client if there is one, so that a busy client
+ * pushes out its own replies rather than those of others, otherwise
+ * the oldest one.  Returns NULL if the cache is not full or nothing
+ * can be recycled.
  */
-static void
-hash_refile(struct svc_cacherep *rp)
+static struct svc_cacherep *
+nfscache_prune(struct nfscache_bucket *b, struct sockaddr_in *addr)
 {
-	struct svc_cacherep	*prev = rp->c_hash_prev,
-				*next = rp->c_hash_next;
-	struct nfscache_head	*head = hash_list + REQHASH(rp->c_xid);
-
-	prev->c_hash_next = next;
-	next->c_hash_prev = prev;
+	struct svc_cacherep	*rp, *victim = NULL;
+	struct list_head	*le, *prev;
+
+	for (le = b->lru.prev; le != &b->lru; le = prev) {
+		prev = le->prev;
+		rp = list_entry(le, struct svc_cacherep, c_lru);
+		if (rp->c_state == RC_INPROG)
+			continue;
+		if (time_before(jiffies, rp->c_timestamp + RC_EXPIRE))
+			break;
+		nfscache_free(rp);
+		nfsdstats.rcexpired++;
+	}
 
-	rp->c_hash_next = head->next;
-	rp->c_hash_prev = (struct svc_cacherep *) head;
-	head->next->c_hash_prev = rp;
-	head->next = rp;
+	if (atomic_read(&num_entries) < max_entries)
+		return NULL;
+
+	list_for_each_prev(le, &b->lru) {
+		rp = list_entry(le, struct svc_cacherep, c_lru);
+		if (rp->c_state == RC_INPROG)
+			continue;
+		if (rp->c_addr.sin_addr.s_addr == addr->sin_addr.s_addr)
+			return rp;
+		if (!victim)
+			victim = rp;
+	}
+	return victim;
 }
 
 /*
  * Try to find an entry matching the current call in the cache. When none
- * is found, we grab the oldest unlocked entry off the LRU list.
+ * is found, we add a new one, or recycle an old one if the cache is full.
  * Note that no operation within the loop may sleep.
  */
 int
 nfsd_cache_lookup(struct svc_rqst *rqstp, int type)
 {
-	struct svc_cacherep	*rh, *rp;
+	struct nfscache_bucket	*b;
+	struct svc_cacherep	*rp, *new;
+	struct list_head	*le;
 	u32			xid = rqstp->rq_xid,
 				proto =  rqstp->rq_prot,
 				vers = rqstp->rq_vers,
-				proc = rqstp->rq_proc;
+				proc = rqstp->rq_proc,
+				csum;
+	unsigned int		len;
 	unsigned long		age;
 	int rtn;
 
@@ -187,15 +236,23 @@ nfsd_cache_lookup(struct svc_rqst *rqstp, int type)
 		return RC_DOIT;
 	}
 
-	spin_lock(&cache_lock);
+	len = rqstp->rq_arg.head[0].iov_len + rqstp->rq_arg.page_len;
+	csum = nfsd_cache_csum(rqstp);
+
+	/* allocate before taking the bucket lock; freed if not needed */
+	new = kmem_cache_alloc(nfscache_slab, SLAB_KERNEL);
+
+	b = nfscache_bucket(xid, &rqstp->rq_addr);
+	spin_lock(&b->lock);
 	rtn = RC_DOIT;
 
-	rp = rh = (struct svc_cacherep *) &hash_list[REQHASH(xid)];
-	while ((rp = rp->c_hash_next) != rh) {
+	list_for_each(le, &b->lru) {
+		rp = list_entry(le, struct svc_cacherep, c_lru);
 		if (rp->c_state != RC_UNUSED &&
 		    xid == rp->c_xid && proc == rp->c_proc &&
 		    proto == rp->c_prot && vers == rp->c_vers &&
-		    time_before(jiffies, rp->c_timestamp + 120*HZ) &&
+		    len == rp->c_len && csum == rp->c_csum &&
+		    time_before(jiffies, rp->c_timestamp + RC_EXPIRE) &&
 		    memcmp((char*)&rqstp->rq_addr, (char*)&rp->c_addr, sizeof(rp->c_addr))==0) {
 			nfsdstats.rchits++;
 			goto found_entry;
@@ -203,29 +260,22 @@ nfsd_cache_lookup(struct svc_rqst *rqstp, int type)
 	}
 	nfsdstats.rcmisses++;
 
-	/* This loop shouldn't take more than a few iterations normally */
-	{
-	int	safe = 0;
-	for (rp = lru_tail; rp; rp = rp->c_lru_prev) {
-		if (rp->c_state != RC_INPROG)
-			break;
-		if (safe++ > CACHESIZE) {
-			printk("nfsd: loop in repcache LRU list\n");
-			cache_disabled = 1;
-			goto out;
-		}
-	}
-	}
-
-	/* This should not happen */
-	if (rp == NULL) {
-		static int	complaints;
-
-		printk(KERN_WARNING "nfsd: all repcache entries locked!\n");
-		if (++complaints > 5) {
-			printk(KERN_WARNING "nfsd: disabling repcache.\n");
-			cache_disabled = 1;
+	rp = nfscache_prune(b, &rqstp->rq_addr);
+	if (rp) {
+		/* recycle an old entry of this bucket */
+		nfsdstats.rcevicted++;
+		if (rp->c_type == RC_REPLBUFF) {
+			kfree(rp->c_replvec.iov_base);
+			rp->c_replvec.iov_base = NULL;
 		}
+		list_del(&rp->c_lru);
+	} else if (atomic_read(&num_entries) < max_entries && new) {
+		rp = new;
+		new = NULL;
+		atomic_inc(&num_entries);
+	} else {
+		/* full of calls in progress, or out of memory */
+		nfsdstats.rcnocache++;
 		goto out;
 	}
 
@@ -236,25 +286,22 @@ nfsd_cache_lookup(struct svc_rqst *rqstp, int type)
 	rp->c_addr = rqstp->rq_addr;
 	rp->c_prot = proto;
 	rp->c_vers = vers;
+	rp->c_len = len;
+	rp->c_csum = csum;
 	rp->c_timestamp = jiffies;
-
-	hash_refile(rp);
-
-	/* release any buffer */
-	if (rp->c_type == RC_REPLBUFF) {
-		kfree(rp->c_replvec.iov_base);
-		rp->c_replvec.iov_base = NULL;
-	}
 	rp->c_type = RC_NOCACHE;
+	list_add(&rp->c_lru, &b->lru);
  out:
-	spin_unlock(&cache_lock);
+	spin_unlock(&b->lock);
+	if (new)
+		kmem_cache_free(nfscache_slab, new);
 	return rtn;
 
 found_entry:
 	/* We found a matching entry which is either in progress or done. */
 	age = jiffies - rp->c_timestamp;
 	rp->c_timestamp = jiffies;
-	lru_put_front(rp);
+	list_move(&rp->c_lru, &b->lru);
 
 	rtn = RC_DROPIT;
 	/* Request being processed or excessive rexmits */
@@ -282,7 +329,7 @@ found_entry:
 		break;
 	default:
 		printk(KERN_WARNING "nfsd: bad repcache type %d\n", rp->c_type);
-		rp->c_state = RC_UNUSED;
+		nfscache_free(rp);
 	}
 
 	goto out;
@@ -308,20 +355,20 @@ void
 nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, u32 *statp)
 {
 	struct svc_cacherep *rp;
+	struct nfscache_bucket *b;
 	struct iovec	*resv = &rqstp->rq_res.head[0], *cachv;
 	int		len;
 
 	if (!(rp = rqstp->rq_cacherep) || cache_disabled)
 		return;
+	b = nfscache_bucket(rp->c_xid, &rp->c_addr);
 
 	len = resv->iov_len - ((char*)statp - (char*)resv->iov_base);
 	len >>= 2;
 	
 	/* Don't cache excessive amounts of data and XDR failures */
-	if (!statp || len > (256 >> 2)) {
-		rp->c_state = RC_UNUSED;
-		return;
-	}
+	if (!statp || len > (256 >> 2))
+		goto out_free;
 
 	switch (cachetype) {
 	case RC_REPLSTAT:
@@ -332,24 +379,25 @@ nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, u32 *statp)
 	case RC_REPLBUFF:
 		cachv = &rp->c_replvec;
 		cachv->iov_base = kmalloc(len << 2, GFP_KERNEL);
-		if (!cachv->iov_base) {
-			spin_lock(&cache_lock);
-			rp->c_state = RC_UNUSED;
-			spin_unlock(&cache_lock);
-			return;
-		}
+		if (!cachv->iov_base)
+			goto out_free;
 		cachv->iov_len = len << 2;
 		memcpy(cachv->iov_base, statp, len << 2);
 		break;
 	}
-	spin_lock(&cache_lock);
-	lru_put_front(rp);
+	spin_lock(&b->lock);
+	list_move(&rp->c_lru, &b->lru);
 	rp->c_secure = rqstp->rq_secure;
 	rp->c_type = cachetype;
 	rp->c_state = RC_DONE;
 	rp->c_timestamp = jiffies;
-	spin_unlock(&cache_lock);
+	spin_unlock(&b->lock);
 	return;
+
+out_free:
+	spin_lock(&b->lock);
+	nfscache_free(rp);
+	spin_unlock(&b->lock);
 }
 
 /*
@@ -48,6 +48,8 @@ enum {
 	NFSD_List,
 	NFSD_Fh,
 	NFSD_Threads,
+	NFSD_PoolMode,
+	NFSD_PoolStats,
 };
 
 /*
@@ -62,6 +64,8 @@ static ssize_t write_getfd(struct file *file, char *buf, size_t size);
 static ssize_t write_getfs(struct file *file, char *buf, size_t size);
 static ssize_t write_filehandle(struct file *file, char *buf, size_t size);
 static ssize_t write_threads(struct file *file, char *buf, size_t size);
+static ssize_t write_pool_mode(struct file *file, char *buf, size_t size);
+static ssize_t write_pool_stats(struct file *file, char *buf, size_t size);
 
 static ssize_t (*write_op[])(struct file *, char *, size_t) = {
 	[NFSD_Svc] = write_svc,
@@ -73,6 +77,8 @@ static ssize_t (*write_op[])(struct file *, char *, size_t) = {
 	[NFSD_Getfs] = write_getfs,
 	[NFSD_Fh] = write_filehandle,
 	[NFSD_Threads] = write_threads,
+	[NFSD_PoolMode] = write_pool_mode,
+	[NFSD_PoolStats] = write_pool_stats,
 };
 
 /* an argresp is stored in an allocated page and holds the 
@@ -391,6 +397,38 @@ static ssize_t write_threads(struct file *file, char *buf, size_t size)
 	return strlen(buf);
 }
 
+static ssize_t write_pool_mode(struct file *file, char *buf, size_t size)
+{
+	/* if size > 0, look for a pool mode ("auto", "global", "percpu"
+	 * or "pernode") for the next start of the service, then write
+	 * out the current mode as reply
+	 */
+	char *mesg = buf;
+	char mode[16];
+	int rv;
+	if (size > 0) {
+		if (buf[size-1] != '\n')
+			return -EINVAL;
+		buf[size-1] = 0;
+		if (qword_get(&mesg, mode, sizeof(mode)) <= 0)
+			return -EINVAL;
+		rv = svc_pool_map_set_mode(mode);
+		if (rv)
+			return rv;
+	}
+	sprintf(buf, "%s\n", svc_pool_map_get_mode());
+	return strlen(buf);
+}
+
+extern int nfsd_pool_stats(char *buf, int size);
+
+static ssize_t write_pool_stats(struct file *file, char *buf, size_t size)
+{
+	if (size > 0)
+		return -EINVAL;
+	return nfsd_pool_stats(buf, PAGE_SIZE - sizeof(struct argresp));
+}
+
 /*----------------------------------------------------------------------------*/
 /*
  *	populating the filesystem.
@@ -409,6 +447,8 @@ static int nfsd_fill_super(struct super_block * sb, void * data, int silent)
 		[NFSD_List] = {"exports", &exports_operations, S_IRUGO},
 		[NFSD_Fh] = {"filehandle", &transaction_ops, S_IWUSR|S_IRUSR},
 		[NFSD_Threads] = {"threads", &transaction_ops, S_IWUSR|S_IRUSR},
+		[NFSD_PoolMode] = {"pool_mode", &transaction_ops, S_IWUSR|S_IRUSR},
+		[NFSD_PoolStats] = {"pool_stats", &transaction_ops, S_IRUGO},
 		/* last one */ {""}
 	};
 	return simple_fill_super(sb, 0x6e667364, nfsd_files);
@@ -75,6 +75,31 @@ int nfsd_nrthreads(void)
 		return nfsd_serv->sv_nrthreads;
 }
 
+/*
+ * Describe the thread pools of the running service into buf,
+ * one line per pool.  Returns the length written.
+ */
+int nfsd_pool_stats(char *buf, int size)
+{
+	struct svc_pool *pool;
+	unsigned int i;
+	int len;
+
+	len = snprintf(buf, size, "# pool packets-arrived sockets-enqueued"
+		       " threads-woken threads\n");
+	lock_kernel();
+	for (i = 0; nfsd_serv && i < nfsd_serv->sv_nrpools && len < size; i++) {
+		pool = &nfsd_serv->sv_pools[i];
+		len += snprintf(buf + len, size - len, "%u %lu %lu %lu %u\n",
+				pool->sp_id, pool->sp_packets, pool->sp_queued,
+				pool->sp_threads_woken, pool->sp_nrthreads);
+	}
+	unlock_kernel();
+	if (len > size)
+		len = size;
+	return len;
+}
+
 int
 nfsd_svc(unsigned short port, int nrservs)
 {
@@ -98,7 +123,7 @@ nfsd_svc(unsigned short port, int nrservs)
 	if (!nfsd_serv) {
 		atomic_set(&nfsd_busy, 0);
 		error = -ENOMEM;
-		nfsd_serv = svc_create(&nfsd_program, NFSD_BUFSIZE);
+		nfsd_serv = svc_create_pooled(&nfsd_program, NFSD_BUFSIZE);
 		if (nfsd_serv == NULL)
 			goto out;
 		error = svc_makesock(nfsd_serv, IPPROTO_UDP, port);
@@ -12,12 +12,18 @@
  *			statistics for filehandle lookup
  *	io <bytes-read> <bytes-writtten>
  *			statistics for IO throughput
+ *	drc <max-entries> <entries> <evicted> <expired>
+ *			size of the reply cache, and number of entries
+ *			recycled before and freed after they expired
  *	th <threads> <fullcnt> <10%-20%> <20%-30%> ... <90%-100%> <100%> 
  *			time (seconds) when nfsd thread usage above thresholds
  *			and number of times that all threads were in use
  *	ra cache-size  <10%  <20%  <30% ... <100% not-found
  *			number of times that read-ahead entry was found that deep in
  *			the cache.
+ *	zc <zero-copy> <copied>
+ *			number of reads sent from page cache pages, and
+ *			number of reads copied into the reply buffer
  *	plus generic RPC stats (see net/sunrpc/stats.c)
  *
  * Copyright (C) 1995, 1996, 1997 Olaf Kirch <okir@monad.swb.de>
@@ -33,6 +39,7 @@
 #include <linux/sunrpc/stats.h>
 #include <linux/nfsd/nfsd.h>
 #include <linux/nfsd/stats.h>
+#include <linux/nfsd/cache.h>
 
 struct nfsd_stats	nfsdstats;
 struct svc_stat		nfsd_svcstats = {
@@ -57,6 +64,11 @@ nfsd_proc_read(char *buffer, char **start, off_t offset, int count,
 		      nfsdstats.fh_nocache_nondir,
 		      nfsdstats.io_read,
 		      nfsdstats.io_write);
+	/* reply cache size and turnover: */
+	len += sprintf(buffer+len, "drc %u %u %u %u\n",
+		       nfsdstats.rcsize, nfsd_cache_entries(),
+		       nfsdstats.rcevicted, nfsdstats.rcexpired);
+
 	/* thread usage: */
 	len += sprintf(buffer+len, "th %u %u", nfsdstats.th_cnt, nfsdstats.th_fullcnt);
 	for (i=0; i<10; i++) {
@@ -70,6 +82,10 @@ nfsd_proc_read(char *buffer, char **start, off_t offset, int count,
 	for (i=0; i<11; i++)
 		len += sprintf(buffer+len, " %u", nfsdstats.ra_depth[i]);
 	len += sprintf(buffer+len, "\n");
+
+	/* zero-copy reads */
+	len += sprintf(buffer+len, "zc %u %u\n",
+		       nfsdstats.rd_zerocopy, nfsdstats.rd_copied);
 	
 
 	/* Assume we haven't hit EOF yet. Will be set by svc_proc_read. */
@@ -602,6 +602,8 @@ found:
  * Grab and keep cached pages assosiated with a file in the svc_rqst
  * so that they can be passed to the netowork sendmsg/sendpage routines
  * directrly. They will be released after the sending has completed.
+ * The reply pages are referenced, not copied; stop short if we run
+ * out of room in rq_respages.
  */
 static int
 nfsd_read_actor(read_descriptor_t *desc, struct page *page, unsigned long offset , unsigned long size)
@@ -612,6 +614,11 @@ nfsd_read_actor(read_descriptor_t *desc, struct page *page, unsigned long offset
 	if (size > count)
 		size = count;
 
+	if ((rqstp->rq_res.page_len == 0 ||
+	     page != rqstp->rq_respages[rqstp->rq_resused-1]) &&
+	    rqstp->rq_resused >= RPCSVC_MAXPAGES)
+		return 0;
+
 	if (rqstp->rq_res.page_len == 0) {
 		get_page(page);
 		rqstp->rq_respages[rqstp->rq_resused++] = page;
@@ -662,14 +669,19 @@ nfsd_read(struct svc_rqst *rqstp, struct svc_fh *fhp, loff_t offset,
 		file.f_ra = ra->p_ra;
 
 	if (file.f_op->sendfile) {
+		/* hand the page cache pages to svc_sendto() */
 		svc_pushback_unused_pages(rqstp);
 		err = file.f_op->sendfile(&file, &offset, *count,
 						 nfsd_read_actor, rqstp);
+		if (err >= 0)
+			nfsdstats.rd_zerocopy++;
 	} else {
 		oldfs = get_fs();
 		set_fs(KERNEL_DS);
 		err = vfs_readv(&file, vec, vlen, &offset);
 		set_fs(oldfs);
+		if (err >= 0)
+			nfsdstats.rd_copied++;
 	}
 
 	/* Write back readahead params */
@@ -72,8 +72,17 @@ typedef struct {
 #define hardirq_trylock()	(!in_interrupt())
 #define hardirq_endlock()	do { } while (0)
 
+#ifdef CONFIG_NO_IDLE_HZ
+extern void hrtimer_irq_enter(void);
+#define irq_enter()							\
+do {									\
+		preempt_count() += HARDIRQ_OFFSET;			\
+		hrtimer_irq_enter();					\
+} while (0)
+#else
 #define irq_enter()		(preempt_count() += HARDIRQ_OFFSET)
-#define nmi_enter()		(irq_enter())
+#endif
+#define nmi_enter()		(preempt_count() += HARDIRQ_OFFSET)
 #define nmi_exit()		(preempt_count() -= HARDIRQ_OFFSET)
 
 #ifdef CONFIG_PREEMPT
@@ -0,0 +1,32 @@
+/*
+ * Cryptographic API.
+ *
+ * AES: the key schedule and lookup tables of crypto/aes.c, which the
+ * assembler versions of the block functions use as well.
+ */
+#ifndef _CRYPTO_AES_H
+#define _CRYPTO_AES_H
+
+#include <linux/types.h>
+
+#define AES_MIN_KEY_SIZE	16
+#define AES_MAX_KEY_SIZE	32
+
+#define AES_BLOCK_SIZE		16
+
+/* the layout is known to the assembler versions */
+struct aes_ctx {
+	int key_length;
+	u32 E[60];
+	u32 D[60];
+};
+
+extern u32 crypto_ft_tab[4][256];
+extern u32 crypto_fl_tab[4][256];
+extern u32 crypto_it_tab[4][256];
+extern u32 crypto_il_tab[4][256];
+
+int crypto_aes_set_key(void *ctx_arg, const u8 *in_key, unsigned int key_len,
+		       u32 *flags);
+
+#endif	/* _CRYPTO_AES_H */
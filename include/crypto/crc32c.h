@@ -0,0 +1,57 @@
+/*
+ * Cryptographic API.
+ *
+ * CRC32C (Castagnoli) as a digest: what the generic version in
+ * crypto/crc32c.c and the ones using a CRC instruction share.  The
+ * digest is the inverted CRC of the data with a seed of ~0, stored
+ * little-endian; only the update step differs between them.
+ */
+#ifndef _CRYPTO_CRC32C_H
+#define _CRYPTO_CRC32C_H
+
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/crypto.h>
+#include <asm/byteorder.h>
+
+#define CHKSUM_DIGEST_SIZE	4
+/* a CRC has no blocks; this is the pad size, should anyone HMAC it */
+#define CHKSUM_BLOCK_SIZE	32
+
+struct chksum_ctx {
+	u32 crc;
+};
+
+static inline void chksum_init(void *ctx)
+{
+	struct chksum_ctx *mctx = ctx;
+
+	mctx->crc = ~(u32)0;
+}
+
+static inline void chksum_final(void *ctx, u8 *out)
+{
+	struct chksum_ctx *mctx = ctx;
+	u32 crc = cpu_to_le32(~mctx->crc);
+
+	memcpy(out, &crc, CHKSUM_DIGEST_SIZE);
+}
+
+/* initializer for the struct crypto_alg named alg */
+#define CRC32C_ALG(alg, driver, prio, update) {			\
+	.cra_name	=	"crc32c",				\
+	.cra_driver_name =	driver,					\
+	.cra_priority	=	prio,					\
+	.cra_flags	=	CRYPTO_ALG_TYPE_DIGEST,			\
+	.cra_blocksize	=	CHKSUM_BLOCK_SIZE,			\
+	.cra_ctxsize	=	sizeof(struct chksum_ctx),		\
+	.cra_module	=	THIS_MODULE,				\
+	.cra_list	=	LIST_HEAD_INIT(alg.cra_list),		\
+	.cra_u		=	{ .digest = {				\
+	.dia_digestsize	=	CHKSUM_DIGEST_SIZE,			\
+	.dia_init	=	chksum_init,				\
+	.dia_update	=	update,					\
+	.dia_final	=	chksum_final } }			\
+}
+
+#endif	/* _CRYPTO_CRC32C_H */
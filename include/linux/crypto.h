@@ -21,6 +21,8 @@
 #include <linux/types.h>
 #include <linux/list.h>
 #include <linux/string.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 #include <asm/page.h>
 
 /*
@@ -98,6 +100,16 @@ struct crypto_alg {
 	unsigned int cra_ctxsize;
 	const char cra_name[CRYPTO_MAX_ALG_NAME];
 
+	/*
+	 * Several implementations of one algorithm can be registered
+	 * under the same cra_name, each with its own driver name.
+	 * Lookups by cra_name get the one with the highest priority;
+	 * a lookup by driver name gets exactly that implementation.
+	 * The driver name defaults to cra_name.
+	 */
+	const char cra_driver_name[CRYPTO_MAX_ALG_NAME];
+	int cra_priority;
+
 	union {
 		struct cipher_alg cipher;
 		struct digest_alg digest;
@@ -175,6 +187,17 @@ struct compress_tfm {
 #define crt_digest	crt_u.digest
 #define crt_compress	crt_u.compress
 
+/*
+ * Asynchronous requests queued on a transform, see below.
+ */
+struct crypto_queue {
+	spinlock_t lock;
+	struct list_head list;
+	unsigned int qlen;
+	int busy;
+	struct work_struct work;
+};
+
 struct crypto_tfm {
 
 	u32 crt_flags;
@@ -186,6 +209,8 @@ struct crypto_tfm {
 	} crt_u;
 	
 	struct crypto_alg *__crt_alg;
+
+	struct crypto_queue crt_queue;
 };
 
 /* 
@@ -357,6 +382,82 @@ static inline int crypto_comp_decompress(struct crypto_tfm *tfm,
 	return tfm->crt_compress.cot_decompress(tfm, src, slen, dst, dlen);
 }
 
+/*
+ * Asynchronous cipher interface.
+ *
+ * A request is queued on its transform and run later by one of the
+ * crypto worker threads, which calls req->complete(req, err) from
+ * process context once the request is done.  Requests queued on one
+ * transform run and complete one at a time, in the order they were
+ * submitted, so they can carry the chained IV of a CBC stream or the
+ * packets of one security association; requests on different
+ * transforms run in parallel on different CPUs.
+ *
+ * Submission never sleeps and may be done from softirq context.  It
+ * fails with -EBUSY once CRYPTO_MAX_QLEN requests are waiting on the
+ * transform, leaving the caller to back off or to do the work itself.
+ * The request, the scatterlists and the iv must stay around until
+ * completion.  crypto_free_tfm() waits for outstanding requests.
+ */
+#define CRYPTO_MAX_QLEN			256
+
+#define CRYPTO_REQ_ENCRYPT		1
+#define CRYPTO_REQ_DECRYPT		2
+
+struct crypto_request;
+typedef void (*crypto_completion_t)(struct crypto_request *req, int err);
+
+struct crypto_request {
+	struct list_head list;
+	struct crypto_tfm *tfm;
+	int op;
+
+	struct scatterlist *dst;
+	struct scatterlist *src;
+	unsigned int nbytes;
+	u8 *iv;			/* NULL to use the transform's own IV */
+
+	crypto_completion_t complete;
+	void *data;
+};
+
+static inline void crypto_request_init(struct crypto_request *req,
+                                       struct crypto_tfm *tfm,
+                                       crypto_completion_t complete,
+                                       void *data)
+{
+	req->tfm = tfm;
+	req->complete = complete;
+	req->data = data;
+}
+
+static inline void crypto_request_set_crypt(struct crypto_request *req,
+                                            struct scatterlist *dst,
+                                            struct scatterlist *src,
+                                            unsigned int nbytes, u8 *iv)
+{
+	req->dst = dst;
+	req->src = src;
+	req->nbytes = nbytes;
+	req->iv = iv;
+}
+
+int crypto_submit_request(struct crypto_request *req);
+
+static inline int crypto_cipher_encrypt_async(struct crypto_request *req)
+{
+	BUG_ON(crypto_tfm_alg_type(req->tfm) != CRYPTO_ALG_TYPE_CIPHER);
+	req->op = CRYPTO_REQ_ENCRYPT;
+	return crypto_submit_request(req);
+}
+
+static inline int crypto_cipher_decrypt_async(struct crypto_request *req)
+{
+	BUG_ON(crypto_tfm_alg_type(req->tfm) != CRYPTO_ALG_TYPE_CIPHER);
+	req->op = CRYPTO_REQ_DECRYPT;
+	return crypto_submit_request(req);
+}
+
 /*
  * HMAC support.
  */
@@ -8,13 +8,40 @@
 #define FUTEX_WAKE (1)
 #define FUTEX_FD (2)
 #define FUTEX_REQUEUE (3)
+#define FUTEX_CMP_REQUEUE (4)
+#define FUTEX_LOCK_PI (6)
+#define FUTEX_UNLOCK_PI (7)
+#define FUTEX_TRYLOCK_PI (8)
+
+/*
+ * Or'ed into the operation by userspace when the futex is known to be
+ * private to the process: the kernel then keys it on (mm, address)
+ * without looking up the vma or taking mmap_sem.
+ */
+#define FUTEX_PRIVATE_FLAG	128
+#define FUTEX_CMD_MASK		~FUTEX_PRIVATE_FLAG
+
+/*
+ * Priority-inheritance futex word layout: the owner's TID, plus
+ * FUTEX_WAITERS once a waiter is queued in the kernel, which forces
+ * the owner through FUTEX_UNLOCK_PI.  FUTEX_OWNER_DIED is set when a
+ * waiter inherits the lock from a task that exited holding it.
+ */
+#define FUTEX_WAITERS		0x80000000
+#define FUTEX_OWNER_DIED	0x40000000
+#define FUTEX_TID_MASK		0x3fffffff
 
 
 asmlinkage long sys_futex(u32 __user *uaddr, int op, int val,
-			  struct timespec __user *utime, u32 __user *uaddr2);
+			  struct timespec __user *utime, u32 __user *uaddr2,
+			  int val3);
 
 
 long do_futex(unsigned long uaddr, int op, int val,
-		unsigned long timeout, unsigned long uaddr2, int val2);
+		unsigned long timeout, unsigned long uaddr2, int val2,
+		int val3);
+
+struct task_struct;
+void exit_futex_pi(struct task_struct *tsk);
 
 #endif
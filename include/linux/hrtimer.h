@@ -0,0 +1,108 @@
+#ifndef _LINUX_HRTIMER_H
+#define _LINUX_HRTIMER_H
+
+/*
+ * High-resolution kernel timers.
+ *
+ * hrtimers live next to the jiffies timer wheel, not instead of it.
+ * They are kept per cpu in an rbtree sorted by their expiry time in
+ * nanoseconds of CLOCK_MONOTONIC, and are expired from the one-shot
+ * clock event device of the cpu if the architecture registered one.
+ * Without such a device they are run from the tick and are no more
+ * precise than a timer_list.
+ *
+ * The callback runs in hard interrupt context with the base lock
+ * dropped and returns HRTIMER_RESTART if it moved ->expires forward
+ * (see hrtimer_forward()) and wants to be requeued.
+ */
+
+#include <linux/config.h>
+#include <linux/types.h>
+#include <linux/rbtree.h>
+#include <linux/time.h>
+
+typedef s64 ktime_t;
+
+#define KTIME_MAX	((ktime_t)~((u64)1 << 63))
+
+enum hrtimer_restart {
+	HRTIMER_NORESTART,
+	HRTIMER_RESTART,
+};
+
+#define HRTIMER_INACTIVE	0
+#define HRTIMER_ENQUEUED	1
+
+struct hrtimer_base;
+
+struct hrtimer {
+	struct rb_node		node;
+	ktime_t			expires;
+	int			(*function)(struct hrtimer *);
+	unsigned long		data;
+	struct hrtimer_base	*base;
+	int			state;
+};
+
+/*
+ * A per-cpu interrupt source which can be armed to fire once,
+ * delta_ns nanoseconds from now.  The hrtimer code clamps delta_ns to
+ * [min_delta_ns, max_delta_ns] and emulates the periodic local tick on
+ * top of it.
+ */
+struct clock_event_device {
+	const char		*name;
+	unsigned long		min_delta_ns;
+	unsigned long		max_delta_ns;
+	void			(*set_next_event)(unsigned long delta_ns);
+};
+
+static inline ktime_t timespec_to_ktime(const struct timespec *ts)
+{
+	return (ktime_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+/* kt must not be negative. */
+static inline struct timespec ktime_to_timespec(ktime_t kt)
+{
+	struct timespec ts;
+
+	ts.tv_sec = div_long_long_rem(kt, NSEC_PER_SEC, &ts.tv_nsec);
+	return ts;
+}
+
+extern ktime_t ktime_get(void);
+
+extern void hrtimer_init(struct hrtimer *timer);
+extern int hrtimer_start(struct hrtimer *timer, ktime_t expires);
+extern int hrtimer_try_to_cancel(struct hrtimer *timer);
+extern int hrtimer_cancel(struct hrtimer *timer);
+extern unsigned long hrtimer_forward(struct hrtimer *timer, ktime_t now,
+				     ktime_t interval);
+extern unsigned long hrtimer_resolution(void);
+
+static inline int hrtimer_active(const struct hrtimer *timer)
+{
+	return timer->state != HRTIMER_INACTIVE;
+}
+
+extern int hrtimer_sleep_until(struct hrtimer *timer, ktime_t expires);
+extern long hrtimer_nanosleep(struct timespec *rqtp,
+			      struct timespec __user *rmtp);
+
+/* Interfaces to the architecture's timer interrupt code. */
+extern int hrtimer_register_event(struct clock_event_device *evt);
+extern int hrtimer_interrupt(void);
+extern void hrtimer_run_queues(void);
+extern void hrtimers_init(void);
+
+#ifdef CONFIG_NO_IDLE_HZ
+/* Called by the idle loop around the time the cpu sleeps. */
+extern void hrtimer_stop_tick(void);
+extern void hrtimer_restart_tick(void);
+#else
+static inline void hrtimer_stop_tick(void) { }
+static inline void hrtimer_restart_tick(void) { }
+#endif
+
+#endif
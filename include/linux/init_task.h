@@ -69,6 +69,7 @@
 	.lock_depth	= -1,						\
 	.prio		= MAX_PRIO-20,					\
 	.static_prio	= MAX_PRIO-20,					\
+	.pi_prio	= MAX_PRIO,					\
 	.policy		= SCHED_NORMAL,					\
 	.cpus_allowed	= CPU_MASK_ALL,					\
 	.mm		= NULL,						\
@@ -104,6 +105,7 @@
 		.signal = {{0}}},					\
 	.blocked	= {{0}},					\
 	.posix_timers	 = LIST_HEAD_INIT(tsk.posix_timers),		\
+	.pi_state_list	 = LIST_HEAD_INIT(tsk.pi_state_list),		\
 	.alloc_lock	= SPIN_LOCK_UNLOCKED,				\
 	.proc_lock	= SPIN_LOCK_UNLOCKED,				\
 	.switch_lock	= SPIN_LOCK_UNLOCKED,				\
@@ -0,0 +1,47 @@
+/* POSIX message queues, see ipc/mqueue.c */
+
+#ifndef _LINUX_MQUEUE_H
+#define _LINUX_MQUEUE_H
+
+#define MQ_PRIO_MAX 	32768
+
+struct mq_attr {
+	long	mq_flags;	/* message queue flags			*/
+	long	mq_maxmsg;	/* maximum number of messages		*/
+	long	mq_msgsize;	/* maximum message size			*/
+	long	mq_curmsgs;	/* number of messages currently queued	*/
+	long	__reserved[4];	/* ignored for input, zeroed for output */
+};
+
+/*
+ * Reading a queue (on the mqueue filesystem) gives one line of
+ *	QSIZE:<bytes queued> NOTIFY:<sigev_notify> SIGNO:<sigev_signo>
+ *	NOTIFY_PID:<pid registered with mq_notify(), or 0>
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/linkage.h>
+#include <linux/time.h>
+#include <asm/siginfo.h>
+
+typedef int mqd_t;
+
+asmlinkage long sys_mq_open(const char __user *name, int oflag, mode_t mode,
+			    struct mq_attr __user *attr);
+asmlinkage long sys_mq_unlink(const char __user *name);
+asmlinkage long sys_mq_timedsend(mqd_t mqdes, const char __user *msg_ptr,
+				 size_t msg_len, unsigned int msg_prio,
+				 const struct timespec __user *abs_timeout);
+asmlinkage ssize_t sys_mq_timedreceive(mqd_t mqdes, char __user *msg_ptr,
+				       size_t msg_len,
+				       unsigned int __user *msg_prio,
+				       const struct timespec __user *abs_timeout);
+asmlinkage long sys_mq_notify(mqd_t mqdes,
+			      const struct sigevent __user *notification);
+asmlinkage long sys_mq_getsetattr(mqd_t mqdes,
+				  const struct mq_attr __user *mqstat,
+				  struct mq_attr __user *omqstat);
+#endif
+
+#endif
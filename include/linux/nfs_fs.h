@@ -37,7 +37,8 @@
 # define NFS_DEBUG
 #endif
 
-#define NFS_MAX_FILE_IO_BUFFER_SIZE	32768
+#define NFS_MAX_FILE_IO_BUFFER_SIZE	1048576
+#define NFS_MAX_UDP_IO_BUFFER_SIZE	32768
 #define NFS_DEF_FILE_IO_BUFFER_SIZE	4096
 
 /*
@@ -151,12 +151,6 @@ struct nfs_closeres {
 /*
  * Arguments to the read call.
  */
-
-#define NFS_READ_MAXIOV		(9U)
-#if (NFS_READ_MAXIOV > (MAX_IOVEC -2))
-#error "NFS_READ_MAXIOV is too large"
-#endif
-
 struct nfs_readargs {
 	struct nfs_fh *		fh;
 	nfs4_stateid		stateid;
@@ -175,11 +169,6 @@ struct nfs_readres {
 /*
  * Arguments to the write call.
  */
-#define NFS_WRITE_MAXIOV	(9U)
-#if (NFS_WRITE_MAXIOV > (MAX_IOVEC -2))
-#error "NFS_WRITE_MAXIOV is too large"
-#endif
-
 struct nfs_writeargs {
 	struct nfs_fh *		fh;
 	nfs4_stateid		stateid;
@@ -589,6 +578,15 @@ struct nfs4_compound {
 
 #endif /* CONFIG_NFS_V4 */
 
+/*
+ * Page vectors for READ and WRITE.  Requests of up to NFS_PAGEVEC_SIZE
+ * pages use the array embedded in nfs_read_data/nfs_write_data, larger
+ * ones (rsize/wsize go up to NFS_MAX_FILE_IO_BUFFER_SIZE) get one of
+ * NFS_MAX_PAGEVEC_SIZE entries from a mempool along with the request.
+ */
+#define NFS_PAGEVEC_SIZE	(8U)
+#define NFS_MAX_PAGEVEC_SIZE	(NFS_MAX_FILE_IO_BUFFER_SIZE / PAGE_SIZE)
+
 struct nfs_read_data {
 	int			flags;
 	struct rpc_task		task;
@@ -596,7 +594,8 @@ struct nfs_read_data {
 	struct rpc_cred		*cred;
 	struct nfs_fattr	fattr;	/* fattr storage */
 	struct list_head	pages;	/* Coalesced read requests */
-	struct page		*pagevec[NFS_READ_MAXIOV];
+	struct page		**pagevec;
+	struct page		*page_array[NFS_PAGEVEC_SIZE];
 	struct nfs_readargs args;
 	struct nfs_readres  res;
 #ifdef CONFIG_NFS_V4
@@ -612,7 +611,8 @@ struct nfs_write_data {
 	struct nfs_fattr	fattr;
 	struct nfs_writeverf	verf;
 	struct list_head	pages;		/* Coalesced requests we wish to flush */
-	struct page		*pagevec[NFS_WRITE_MAXIOV];
+	struct page		**pagevec;
+	struct page		*page_array[NFS_PAGEVEC_SIZE];
 	struct nfs_writeargs	args;		/* argument struct */
 	struct nfs_writeres	res;		/* result struct */
 #ifdef CONFIG_NFS_V4
@@ -13,16 +13,13 @@
 #ifdef __KERNEL__
 #include <linux/in.h>
 #include <linux/uio.h>
+#include <linux/list.h>
 
 /*
- * Representation of a reply cache entry. The first two members *must*
- * be hash_next and hash_prev.
+ * Representation of a reply cache entry.
  */
 struct svc_cacherep {
-	struct svc_cacherep *	c_hash_next;
-	struct svc_cacherep *	c_hash_prev;
-	struct svc_cacherep *	c_lru_next;
-	struct svc_cacherep *	c_lru_prev;
+	struct list_head	c_lru;		/* in its hash bucket, newest first */
 	unsigned char		c_state,	/* unused, inprog, done */
 				c_type,		/* status, buffer */
 				c_secure : 1;	/* req came from port < 1024 */
@@ -31,6 +28,8 @@ struct svc_cacherep {
 	u32			c_prot;
 	u32			c_proc;
 	u32			c_vers;
+	unsigned int		c_len;		/* length of request arguments */
+	u32			c_csum;		/* checksum of their start */
 	unsigned long		c_timestamp;
 	union {
 		struct iovec	u_vec;
@@ -77,6 +76,7 @@ void	nfsd_cache_init(void);
 void	nfsd_cache_shutdown(void);
 int	nfsd_cache_lookup(struct svc_rqst *, int);
 void	nfsd_cache_update(struct svc_rqst *, int, u32 *);
+unsigned int	nfsd_cache_entries(void);
 
 #endif /* __KERNEL__ */
 #endif /* NFSCACHE_H */
@@ -20,9 +20,12 @@
 #define NFSSVC_MAXVERS		3
 
 /*
- * Maximum blocksize supported by daemon currently at 32K
+ * Maximum blocksize supported by daemon, matching RPCSVC_MAXPAYLOAD.
+ * Transfers over UDP are still limited to 32K (see svc_max_payload),
+ * as is NFSv2, which has always been served with 32K buffers.
  */
-#define NFSSVC_MAXBLKSIZE	(32*1024)
+#define NFSSVC_MAXBLKSIZE	(1024*1024)
+#define NFSSVC_MAXBLKSIZE_V2	(32*1024)
 
 #ifdef __KERNEL__
 
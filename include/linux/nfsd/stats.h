@@ -13,6 +13,9 @@ struct nfsd_stats {
 	unsigned int	rchits;		/* repcache hits */
 	unsigned int	rcmisses;	/* repcache hits */
 	unsigned int	rcnocache;	/* uncached reqs */
+	unsigned int	rcsize;		/* max entries in repcache */
+	unsigned int	rcevicted;	/* entries recycled while fresh */
+	unsigned int	rcexpired;	/* entries freed after RC_EXPIRE */
 	unsigned int	fh_stale;	/* FH stale error */
 	unsigned int	fh_lookup;	/* dentry cached */
 	unsigned int	fh_anon;	/* anon file dentry returned */
@@ -27,6 +30,8 @@ struct nfsd_stats {
 	unsigned int	ra_size;	/* size of ra cache */
 	unsigned int	ra_depth[11];	/* number of times ra entry was found that deep
 					 * in the cache (10percentiles). [10] = not found */
+	unsigned int	rd_zerocopy;	/* reads sent straight from the page cache */
+	unsigned int	rd_copied;	/* reads copied into RPC pages */
 };
 
 /* thread usage wraps very million seconds (approx one fortnight) */
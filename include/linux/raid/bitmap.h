@@ -0,0 +1,117 @@
+/*
+ * bitmap.h: write-intent bitmap for md
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+#ifndef _BITMAP_H
+#define _BITMAP_H
+
+#define BITMAP_MAGIC		0x6d746962	/* "bitm" */
+#define BITMAP_MAJOR		3
+
+/*
+ * The bitmap lives either in a file given with SET_BITMAP_FILE, or
+ * (0.90 superblocks only) in the reserved area just after the md
+ * superblock on every component.  Either way it starts with this
+ * 256 byte header, followed by one bit per chunk, with chunk 0 in
+ * bit 0 of the first byte.  Like the 0.90 superblock it is stored in
+ * host byte order.
+ *
+ * User space may create the header to choose chunksize and
+ * daemon_sleep; if the kernel finds no header it writes one with
+ * defaults.  A header with a zero uuid is taken as new.
+ */
+typedef struct bitmap_super_s {
+	__u32 magic;		/*  0 BITMAP_MAGIC */
+	__u32 version;		/*  4 BITMAP_MAJOR */
+	__u8  uuid[16];		/*  8 uuid of the array */
+	__u64 events;		/* 24 array events when last written */
+	__u64 sync_size;	/* 32 sectors of each component covered */
+	__u32 chunksize;	/* 40 bytes of each component per bit */
+	__u32 daemon_sleep;	/* 44 seconds between clearing passes */
+	__u32 state;		/* 48 BITMAP_STALE */
+	__u8  pad[256 - 52];	/* 52 */
+} bitmap_super_t;
+
+#define BITMAP_SB_SIZE		256
+
+/* header state bits */
+#define BITMAP_STALE		1	/* bits cannot be trusted, resync all */
+
+#define BITMAP_DEFAULT_CHUNK	(64 * 1024)	/* smallest default chunk */
+#define BITMAP_DEFAULT_SLEEP	5		/* seconds */
+#define BITMAP_MAX_CHUNKS	(1UL << 22)	/* 8MB of counters */
+
+#ifdef __KERNEL__
+
+/*
+ * In memory, each chunk has a 16 bit counter:
+ *
+ *   NEEDED  the chunk must be resynced
+ *   RESYNC  the chunk is being resynced
+ *   COUNTER 0:   the on-disk bit is clear
+ *           1,2: the on-disk bit is set and no writes are pending;
+ *                the daemon will clear it in 1 or 2 passes
+ *           n>2: n-2 writes are pending
+ *
+ * So a bit is set (synchronously) before the first write to a clean
+ * chunk, and cleared (lazily, many at a time) once the chunk has been
+ * idle for two daemon passes.
+ */
+typedef __u16 bitmap_counter_t;
+
+#define NEEDED_MASK		((bitmap_counter_t)0x8000)
+#define RESYNC_MASK		((bitmap_counter_t)0x4000)
+#define COUNTER_MAX		((bitmap_counter_t)0x3fff)
+#define COUNTER(x)		((x) & COUNTER_MAX)
+
+struct bitmap {
+	mddev_t			*mddev;
+
+	unsigned long		chunks;		/* bits in the bitmap */
+	int			chunkshift;	/* log2 of sectors per chunk */
+	bitmap_counter_t	*counts;	/* one per chunk */
+	unsigned long		lazy;		/* chunks at count 1 or 2 */
+	unsigned long		bits_set;	/* bits set in the image */
+	spinlock_t		lock;		/* protects counts and the pages */
+	wait_queue_head_t	overflow_wait;
+
+	/* the on-disk image: header and bits, and which pages need writing */
+	struct page		**pages;
+	unsigned long		nr_pages;
+	unsigned long		bytes;		/* used bytes of the image */
+	unsigned long		*dirty;
+	atomic_t		unplug_pending;	/* pages dirty or being written */
+	struct semaphore	write_sem;	/* held while writing pages */
+
+	/* when stored in a file: the device sector of each file block */
+	struct file		*file;
+	sector_t		*blocks;
+	int			blkbits;
+
+	unsigned long		daemon_sleep;	/* in jiffies */
+	unsigned long		daemon_lastrun;
+};
+
+extern int  bitmap_create(mddev_t *mddev);
+extern void bitmap_destroy(mddev_t *mddev);
+extern void bitmap_update_sb(struct bitmap *bitmap);
+extern void bitmap_status(struct seq_file *seq, struct bitmap *bitmap);
+
+extern void bitmap_startwrite(struct bitmap *bitmap, sector_t offset,
+			      unsigned long sectors);
+extern void bitmap_endwrite(struct bitmap *bitmap, sector_t offset,
+			    unsigned long sectors);
+extern void bitmap_unplug(struct bitmap *bitmap);
+
+extern int  bitmap_start_sync(struct bitmap *bitmap, sector_t offset,
+			      sector_t *blocks);
+extern void bitmap_close_sync(struct bitmap *bitmap, sector_t done);
+extern void bitmap_daemon_work(struct bitmap *bitmap);
+
+#endif
+
+#endif
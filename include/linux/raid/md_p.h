@@ -95,6 +95,7 @@ typedef struct mdp_device_descriptor_s {
  */
 #define MD_SB_CLEAN		0
 #define MD_SB_ERRORS		1
+#define MD_SB_BITMAP_PRESENT	8 /* write-intent bitmap after the superblock */
 
 typedef struct mdp_superblock_s {
 	/*
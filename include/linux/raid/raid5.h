@@ -160,6 +160,8 @@ struct stripe_head {
 #define READ_MODIFY_WRITE	2
 /* not a write method, but a compute_parity mode */
 #define	CHECK_PARITY		3
+/* RAID-6 only: regenerate P and Q from the data blocks */
+#define	UPDATE_PARITY		4
 
 /*
  * Stripe state
@@ -199,6 +201,33 @@ struct disk_info {
 	mdk_rdev_t	*rdev;
 };
 
+/*
+ * Stripe handling threads:
+ *
+ * On SMP, raid5d only does recovery and plugging bookkeeping, and the
+ * stripes themselves are handled by one worker thread per online CPU
+ * (at most RAID5_MAX_WORKERS).  Every stripe is queued to the worker
+ * selected by its stripe hash bucket, so a stripe is never being
+ * handled by two workers at once and each worker keeps to its own
+ * part of the stripe cache.  Workers take stripes off their list in
+ * batches of up to RAID5_WORKER_BATCH, so the parity work for a batch
+ * runs back to back on one CPU and device_lock is taken once per
+ * batch rather than once per stripe.
+ */
+#define RAID5_MAX_WORKERS	16
+#define RAID5_WORKER_BATCH	8
+
+struct raid5_worker {
+	struct raid5_private_data *conf;
+	int			index, cpu;
+	struct list_head	handle_list; /* stripes hashed to this worker */
+	wait_queue_head_t	wqueue;
+	unsigned long		flags;	/* THREAD_WAKEUP */
+	int			running;
+	struct completion	*event;
+	struct task_struct	*tsk;
+};
+
 struct raid5_private_data {
 	struct stripe_head	**stripe_hashtbl;
 	mddev_t			*mddev;
@@ -211,6 +240,9 @@ struct raid5_private_data {
 	struct list_head	delayed_list; /* stripes that have plugged requests */
 	atomic_t		preread_active_stripes; /* stripes with scheduled io */
 
+	int			nr_workers; /* 0: raid5d handles stripes itself */
+	struct raid5_worker	*workers;
+
 	char			cache_name[20];
 	kmem_cache_t		*slab_cache; /* for allocating stripes */
 	/*
@@ -70,6 +70,14 @@ struct rcu_ctrlblk {
 	long		maxbatch;	/* Max requested batch number.        */
 	cpumask_t	rcu_cpu_mask; 	/* CPUs that need to switch in order  */
 					/* for current batch to proceed.      */
+	int		groups_pending;	/* CPU groups with CPUs still in the  */
+					/* mask, see rcu_check_quiescent_state*/
+	unsigned long	batch_start;	/* jiffies when current batch started */
+
+	/* Statistics, see /proc/rcu */
+	unsigned long	nr_batches;	/* grace periods completed            */
+	unsigned long	batch_jiffies;	/* their total length                 */
+	unsigned long	batch_max;	/* and the longest one                */
 };
 
 /* Is batch a before batch b ? */
@@ -88,6 +96,7 @@ static inline int rcu_batch_after(long a, long b)
  * Per-CPU data for Read-Copy UPdate.
  * nxtlist - new callbacks are added here
  * curlist - current batch for which quiescent cycle started if any
+ * donelist - callbacks whose grace period is over, to be invoked
  */
 struct rcu_data {
 	long		qsctr;		 /* User-mode/idle loop etc. */
@@ -96,6 +105,14 @@ struct rcu_data {
         long  	       	batch;           /* Batch # for current RCU batch */
         struct list_head  nxtlist;
         struct list_head  curlist;
+        struct list_head  donelist;
+
+	/* Statistics, see /proc/rcu */
+	long		qlen;		 /* callbacks queued, not invoked */
+	long		donelen;	 /* length of donelist */
+	unsigned long	nr_invoked;	 /* callbacks invoked */
+	unsigned long	nr_offloaded;	 /* of which by krcud */
+	unsigned long	batch_max;	 /* largest batch completed */
 };
 
 DECLARE_PER_CPU(struct rcu_data, rcu_data);
@@ -106,6 +123,7 @@ extern struct rcu_ctrlblk rcu_ctrlblk;
 #define RCU_batch(cpu) 		(per_cpu(rcu_data, (cpu)).batch)
 #define RCU_nxtlist(cpu) 	(per_cpu(rcu_data, (cpu)).nxtlist)
 #define RCU_curlist(cpu) 	(per_cpu(rcu_data, (cpu)).curlist)
+#define RCU_donelist(cpu) 	(per_cpu(rcu_data, (cpu)).donelist)
 
 #define RCU_QSCTR_INVALID	0
 
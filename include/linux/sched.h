@@ -136,6 +136,7 @@ extern unsigned long nr_iowait(void);
 #include <linux/param.h>
 #include <linux/resource.h>
 #include <linux/timer.h>
+#include <linux/hrtimer.h>
 
 #include <asm/processor.h>
 
@@ -358,9 +359,9 @@ struct k_itimer {
 	int it_sigev_notify;		 /* notify word of sigevent struct */
 	int it_sigev_signo;		 /* signo word of sigevent struct */
 	sigval_t it_sigev_value;	 /* value word of sigevent struct */
-	unsigned long it_incr;		/* interval specified in jiffies */
+	ktime_t it_incr;		/* interval in nanoseconds */
 	struct task_struct *it_process;	/* process to send signal to */
-	struct timer_list it_timer;
+	struct hrtimer it_timer;	/* expires is CLOCK_MONOTONIC */
 	struct sigqueue *sigq;		/* signal queue entry. */
 };
 
@@ -378,6 +379,7 @@ struct task_struct {
 	int lock_depth;		/* Lock depth */
 
 	int prio, static_prio;
+	int pi_prio;		/* inherited from PI futex waiters */
 	struct list_head run_list;
 	prio_array_t *array;
 
@@ -434,6 +436,7 @@ struct task_struct {
 	unsigned long it_real_incr, it_prof_incr, it_virt_incr;
 	struct timer_list real_timer;
 	struct list_head posix_timers; /* POSIX.1b Interval Timers */
+	struct list_head pi_state_list; /* PI futexes we own */
 	unsigned long utime, stime, cutime, cstime;
 	unsigned long nvcsw, nivcsw, cnvcsw, cnivcsw; /* context switch counts */
 	u64 start_time;
@@ -492,6 +495,9 @@ struct task_struct {
 /* journalling filesystem info */
 	void *journal_info;
 
+/* workqueue worker, if PF_WQ_WORKER */
+	void *wq_worker;
+
 /* VM state */
 	struct reclaim_state *reclaim_state;
 
@@ -538,6 +544,7 @@ do { if (atomic_dec_and_test(&(tsk)->usage)) __put_task_struct(tsk); } while(0)
 #define PF_SWAPOFF	0x00080000	/* I am in swapoff */
 #define PF_LESS_THROTTLE 0x00100000	/* Throttle me less: I clean memory */
 #define PF_SYNCWRITE	0x00200000	/* I am doing a sync write */
+#define PF_WQ_WORKER	0x00400000	/* I am a workqueue worker */
 
 #ifdef CONFIG_SMP
 extern int set_cpus_allowed(task_t *p, cpumask_t new_mask);
@@ -559,11 +566,19 @@ extern void node_nr_running_init(void);
 #endif
 
 extern void set_user_nice(task_t *p, long nice);
+extern void set_task_pi_prio(task_t *p, int prio);
 extern int task_prio(task_t *p);
 extern int task_nice(task_t *p);
 extern int task_curr(task_t *p);
 extern int idle_cpu(int cpu);
 
+#ifdef CONFIG_NO_IDLE_HZ
+/* Idle cpus whose local tick is stopped, see kernel/hrtimer.c */
+extern cpumask_t nohz_cpu_mask;
+extern void wake_idle_cpu(int cpu);
+extern void account_idle_ticks(unsigned long ticks);
+#endif
+
 void yield(void);
 
 /*
@@ -30,12 +30,23 @@ struct rpc_portmap {
 
 struct rpc_inode;
 
+/*
+ * A client may talk to its server over several transports (see
+ * rpc_set_nconnect), each with its own request slots and congestion
+ * window.  cl_xprt is the first of them; addresses, timeouts and the
+ * like are kept there.
+ */
+#define RPC_MAXXPRTS		16
+
 /*
  * The high-level client handle
  */
 struct rpc_clnt {
 	atomic_t		cl_users;	/* number of references */
 	struct rpc_xprt *	cl_xprt;	/* transport */
+	struct rpc_xprt *	cl_xprts[RPC_MAXXPRTS];	/* all transports */
+	unsigned int		cl_nxprts;	/* # of transports */
+	unsigned int		cl_xprtnext;	/* round robin for xprt_reserve */
 	struct rpc_procinfo *	cl_procinfo;	/* procedure info */
 	u32			cl_maxproc;	/* max procedure number */
 
@@ -124,6 +135,7 @@ void		rpc_restart_call(struct rpc_task *);
 void		rpc_clnt_sigmask(struct rpc_clnt *clnt, sigset_t *oldset);
 void		rpc_clnt_sigunmask(struct rpc_clnt *clnt, sigset_t *oldset);
 void		rpc_setbufsize(struct rpc_clnt *, unsigned int, unsigned int);
+int		rpc_set_nconnect(struct rpc_clnt *, unsigned int);
 
 static __inline__
 int rpc_call(struct rpc_clnt *clnt, u32 proc, void *argp, void *resp, int flags)
@@ -16,6 +16,28 @@
 #include <linux/sunrpc/svcauth.h>
 #include <linux/wait.h>
 #include <linux/mm.h>
+#include <linux/cache.h>
+
+/*
+ * RPC service thread pool.
+ *
+ * Pool of threads and sockets for a service, one per cpu or per
+ * NUMA node (see svc_pool_map in svc.c), so that idle threads and
+ * ready sockets are not all queued under one service-wide lock, and
+ * a request is handled near the cpu its data arrived on.
+ */
+struct svc_pool {
+	unsigned int		sp_id;		/* pool id */
+	spinlock_t		sp_lock;	/* protects all fields */
+	struct list_head	sp_threads;	/* idle server threads */
+	struct list_head	sp_sockets;	/* pending sockets */
+	unsigned int		sp_nrthreads;	/* # of threads in pool */
+	unsigned long		sp_packets;	/* # of sockets enqueued */
+	unsigned long		sp_queued;	/* # enqueued with no idle thread */
+	unsigned long		sp_threads_woken; /* # of idle threads woken */
+	struct list_head	sp_pages;	/* spare request pages, via lru */
+	unsigned int		sp_nrpages;	/* # of pages on sp_pages */
+} ____cacheline_aligned_in_smp;
 
 /*
  * RPC service.
@@ -23,16 +45,14 @@
  * An RPC service is a ``daemon,'' possibly multithreaded, which
  * receives and processes incoming RPC messages.
  * It has one or more transport sockets associated with it, and maintains
- * a list of idle threads waiting for input.
+ * a list of idle threads waiting for input in each of its pools.
  *
  * We currently do not support more than one RPC program per daemon.
  */
 struct svc_serv {
-	struct list_head	sv_threads;	/* idle server threads */
-	struct list_head	sv_sockets;	/* pending sockets */
 	struct svc_program *	sv_program;	/* RPC program */
 	struct svc_stat *	sv_stats;	/* RPC statistics */
-	spinlock_t		sv_lock;
+	spinlock_t		sv_lock;	/* socket lists, sv_tmpcnt */
 	unsigned int		sv_nrthreads;	/* # of server threads */
 	unsigned int		sv_bufsz;	/* datagram buffer size */
 	unsigned int		sv_xdrsize;	/* XDR buffer size */
@@ -40,16 +60,26 @@ struct svc_serv {
 	struct list_head	sv_permsocks;	/* all permanent sockets */
 	struct list_head	sv_tempsocks;	/* all temporary sockets */
 	int			sv_tmpcnt;	/* count of temporary sockets */
+	unsigned long		sv_tempcheck;	/* last idle check, in seconds */
 
 	char *			sv_name;	/* service name */
+
+	int			sv_pooled;	/* pools follow svc_pool_map */
+	unsigned int		sv_nrpools;	/* # of thread pools */
+	struct svc_pool *	sv_pools;	/* array of thread pools */
 };
 
 /*
  * Maximum payload size supported by a kernel RPC server.
  * This is use to determine the max number of pages nfsd is
  * willing to return in a single READ operation.
+ *
+ * Over UDP a request or reply has to fit in one datagram, so the
+ * payload stays at the traditional 32K there, see svc_max_payload().
  */
-#define RPCSVC_MAXPAYLOAD	(64*1024u)
+#define RPCSVC_MAXPAYLOAD	(1024*1024u)
+#define RPCSVC_MAXPAYLOAD_TCP	RPCSVC_MAXPAYLOAD
+#define RPCSVC_MAXPAYLOAD_UDP	(32*1024u)
 
 /*
  * RPC Requsts and replies are stored in one or more pages.
@@ -74,9 +104,21 @@ struct svc_serv {
  * in a page - NFSd ensures this.  lockd also has no trouble.
  *
  * Each request/reply pair can have at most one "payload", plus two pages,
- * one for the request, and one for the reply.
+ * one for the request, and one for the reply.  A payload of page cache
+ * pages (see nfsd_read) need not start on a page boundary, so it can
+ * span one more page.
+ */
+#define RPCSVC_MAXPAGES		((RPCSVC_MAXPAYLOAD+PAGE_SIZE-1)/PAGE_SIZE + 2 + 1)
+
+/*
+ * A thread only needs its full set of pages while it is handling a
+ * request.  An idle thread keeps the request and reply head pages and
+ * gives the rest back to its pool (sp_pages), where the next thread to
+ * pick up a socket finds them.  The pool keeps at most
+ * RPCSVC_POOL_REQS requests' worth; the rest go back to the allocator.
  */
-#define RPCSVC_MAXPAGES		((RPCSVC_MAXPAYLOAD+PAGE_SIZE-1)/PAGE_SIZE + 2)
+#define RPCSVC_IDLEPAGES	2
+#define RPCSVC_POOL_REQS	4
 
 static inline u32 svc_getu32(struct iovec *iov)
 {
@@ -103,6 +145,7 @@ static inline void svc_putu32(struct iovec *iov, u32 val)
 struct svc_rqst {
 	struct list_head	rq_list;	/* idle list */
 	struct svc_sock *	rq_sock;	/* socket */
+	struct svc_pool *	rq_pool;	/* thread pool */
 	struct sockaddr_in	rq_addr;	/* peer address */
 	int			rq_addrlen;
 
@@ -115,6 +158,7 @@ struct svc_rqst {
 
 	struct xdr_buf		rq_arg;
 	struct xdr_buf		rq_res;
+	struct iovec		rq_vec[RPCSVC_MAXPAGES]; /* scratch for recvmsg */
 	struct page *		rq_argpages[RPCSVC_MAXPAGES];
 	struct page *		rq_respages[RPCSVC_MAXPAGES];
 	int			rq_restailpage;
@@ -152,6 +196,8 @@ struct svc_rqst {
 						 */
 
 	wait_queue_head_t	rq_wait;	/* synchronization */
+	void			(*rq_threadfn)(struct svc_rqst *);
+						/* thread main, see svc_create_thread */
 };
 
 /*
@@ -285,6 +331,7 @@ typedef void		(*svc_thread_fn)(struct svc_rqst *);
  * Function prototypes.
  */
 struct svc_serv *  svc_create(struct svc_program *, unsigned int);
+struct svc_serv *  svc_create_pooled(struct svc_program *, unsigned int);
 int		   svc_create_thread(svc_thread_fn, struct svc_serv *);
 void		   svc_exit_thread(struct svc_rqst *);
 void		   svc_destroy(struct svc_serv *);
@@ -292,5 +339,9 @@ int		   svc_process(struct svc_serv *, struct svc_rqst *);
 int		   svc_register(struct svc_serv *, int, unsigned short);
 void		   svc_wake_up(struct svc_serv *);
 void		   svc_reserve(struct svc_rqst *rqstp, int space);
+u32		   svc_max_payload(const struct svc_rqst *rqstp);
+struct svc_pool *  svc_pool_for_cpu(struct svc_serv *serv, int cpu);
+int		   svc_pool_map_set_mode(const char *name);
+const char *	   svc_pool_map_get_mode(void);
 
 #endif /* SUNRPC_SVC_H */
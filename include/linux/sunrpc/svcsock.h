@@ -21,7 +21,8 @@ struct svc_sock {
 	struct sock *		sk_sk;		/* INET layer */
 
 	struct svc_serv *	sk_server;	/* service for this socket */
-	unsigned int		sk_inuse;	/* use count */
+	struct svc_pool *	sk_pool;	/* current pool iff queued */
+	atomic_t		sk_inuse;	/* use count */
 	unsigned long		sk_flags;
 #define	SK_BUSY		0			/* enqueued/receiving */
 #define	SK_CONN		1			/* conn pending */
@@ -32,7 +33,7 @@ struct svc_sock {
 #define	SK_CHNGBUF	7			/* need to change snd/rcv buffer sizes */
 #define	SK_DEFERRED	8			/* request on sk_deferred */
 
-	int			sk_reserved;	/* space on outq that is reserved */
+	atomic_t		sk_reserved;	/* space on outq that is reserved */
 
 	struct list_head	sk_deferred;	/* deferred requests that need to
 						 * be revisted */
@@ -172,6 +172,15 @@ struct rpc_xprt {
 
 	struct list_head	recv;
 
+	/*
+	 * Statistics, see /proc/net/rpc/xprt
+	 */
+	struct list_head	all_xprts;	/* list of all transports */
+	unsigned int		inuse;		/* request slots in use */
+	unsigned long		stat_connects,	/* connection attempts */
+				stat_sends,	/* transmissions */
+				stat_recvs,	/* replies received */
+				stat_backlog;	/* waits for a free slot */
 
 	void			(*old_data_ready)(struct sock *, int);
 	void			(*old_state_change)(struct sock *);
@@ -199,6 +208,8 @@ void			xprt_release(struct rpc_task *);
 void			xprt_connect(struct rpc_task *);
 int			xprt_clear_backlog(struct rpc_xprt *);
 void			xprt_sock_setbufsize(struct rpc_xprt *);
+int			xprt_proc_init(void);
+void			xprt_proc_exit(void);
 
 #define XPRT_CONNECT	0
 
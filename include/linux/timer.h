@@ -93,5 +93,8 @@ static inline void add_timer(struct timer_list * timer)
 extern void init_timers(void);
 extern void run_local_timers(void);
 extern void it_real_fn(unsigned long);
+#ifdef CONFIG_NO_IDLE_HZ
+extern unsigned long next_timer_interrupt(void);
+#endif
 
 #endif
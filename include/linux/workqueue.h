@@ -49,7 +49,41 @@ struct work_struct {
 		init_timer(&(_work)->timer);			\
 	} while (0)
 
-extern struct workqueue_struct *create_workqueue(const char *name);
+/*
+ * Workqueues share per-cpu pools of worker threads.  Work is run on
+ * the cpu it was queued on, and a pool only starts another worker when
+ * the running ones block, so works of different workqueues don't wait
+ * behind each other's sleeps.
+ *
+ * WQ_UNBOUND queues go to a pool not bound to any cpu, where each work
+ * may get a worker of its own.  An ordered workqueue is an unbound one
+ * which runs at most one work at a time, in queueing order.
+ *
+ * max_active limits how many works of the queue run at once on each
+ * cpu (in total for unbound ones); 0 means WQ_DFL_ACTIVE.
+ *
+ * Starting a worker needs memory.  A workqueue which memory reclaim
+ * waits on must be created with WQ_MEM_RECLAIM: it gets a rescuer
+ * thread of its own, which runs its works when the pool can't get a
+ * new worker in time.
+ */
+#define WQ_UNBOUND		(1 << 0)
+#define WQ_MEM_RECLAIM		(1 << 1)
+
+#define WQ_MAX_ACTIVE		512
+#define WQ_DFL_ACTIVE		256
+
+extern struct workqueue_struct *alloc_workqueue(const char *name,
+						unsigned int flags,
+						int max_active);
+
+#define create_workqueue(name)					\
+	alloc_workqueue((name), 0, 0)
+#define create_unbound_workqueue(name)				\
+	alloc_workqueue((name), WQ_UNBOUND, 0)
+#define create_ordered_workqueue(name)				\
+	alloc_workqueue((name), WQ_UNBOUND, 1)
+
 extern void destroy_workqueue(struct workqueue_struct *wq);
 
 extern int FASTCALL(queue_work(struct workqueue_struct *wq, struct work_struct *work));
@@ -63,6 +97,11 @@ extern int current_is_keventd(void);
 
 extern void init_workqueues(void);
 
+/* Called by schedule() for tasks with PF_WQ_WORKER set. */
+struct task_struct;
+extern void wq_worker_sleeping(struct task_struct *task);
+extern void wq_worker_waking_up(struct task_struct *task);
+
 /*
  * Kill off a pending schedule_delayed_work().  Note that the work callback
  * function may still be running on return from cancel_delayed_work().  Run
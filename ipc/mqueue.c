@@ -0,0 +1,1136 @@
+/*
+ * linux/ipc/mqueue.c
+ *
+ * POSIX message queues.
+ *
+ * Every queue is a file on the internal mqueue filesystem, which can
+ * also be mounted to list the queues, remove them with rm or look at
+ * their state with cat.  A queue descriptor is a file descriptor, so
+ * it works with poll(), select() and epoll.
+ *
+ * Messages are kept in an rbtree of priorities, each with a FIFO of
+ * its messages, so sending and receiving are O(log number of distinct
+ * priorities in the queue).  A sender which finds a receiver asleep on
+ * an empty queue hands the message over directly, and the other way
+ * around, without queueing it.
+ *
+ * Limits are per queue (mq_maxmsg, mq_msgsize) and on the number of
+ * queues; CAP_SYS_RESOURCE lifts the defaults.
+ */
+
+#include <linux/init.h>
+#include <linux/pagemap.h>
+#include <linux/file.h>
+#include <linux/mount.h>
+#include <linux/namei.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/rbtree.h>
+#include <linux/mqueue.h>
+#include <asm/uaccess.h>
+
+#define MQUEUE_MAGIC	0x19800202
+#define DIRENT_SIZE	20
+#define FILENT_SIZE	80
+
+#define SEND		0
+#define RECV		1
+
+#define STATE_NONE	0
+#define STATE_PENDING	1
+#define STATE_READY	2
+
+#define DFLT_QUEUESMAX	256	/* max number of message queues */
+#define DFLT_MSGMAX	10	/* max number of messages in each queue */
+#define HARD_MSGMAX	(131072/sizeof(void *))
+#define DFLT_MSGSIZEMAX	8192	/* max message size */
+#define HARD_MSGSIZEMAX	(16*1024*1024)
+
+struct mq_msg {
+	struct list_head	list;	/* in the FIFO of its priority */
+	unsigned int		prio;
+	size_t			len;
+	char			data[0];
+};
+
+/* The messages of one priority */
+struct mq_prio_node {
+	struct rb_node		rb_node;
+	struct list_head	msg_list;
+	unsigned int		prio;
+};
+
+struct ext_wait_queue {		/* queue of sleeping tasks */
+	struct task_struct *task;
+	struct list_head list;
+	struct mq_msg *msg;	/* ptr of loaded message */
+	struct mq_prio_node *leaf; /* spare tree node of a sleeping sender */
+	int state;		/* one of STATE_* values */
+};
+
+struct mqueue_inode_info {
+	spinlock_t lock;
+	struct inode vfs_inode;
+	wait_queue_head_t wait_q;	/* for poll */
+
+	struct rb_root msg_tree;
+	struct mq_prio_node *node_cache; /* spare node, see sys_mq_timedsend */
+	struct mq_attr attr;
+
+	struct sigevent notify;
+	pid_t notify_owner;
+
+	/* for tasks waiting for free space and messages, respectively */
+	struct ext_wait_queue e_wait_q[2];
+
+	unsigned long qsize; /* size of queue in memory (sum of all msgs) */
+};
+
+static struct inode_operations mqueue_dir_inode_operations;
+static struct file_operations mqueue_file_operations;
+static struct super_operations mqueue_super_ops;
+
+static spinlock_t mq_lock = SPIN_LOCK_UNLOCKED;
+static kmem_cache_t *mqueue_inode_cachep;
+static struct vfsmount *mqueue_mnt;
+
+static unsigned int queues_count;
+static unsigned int queues_max	= DFLT_QUEUESMAX;
+static unsigned int msg_max	= DFLT_MSGMAX;
+static unsigned int msgsize_max	= DFLT_MSGSIZEMAX;
+
+static inline struct mqueue_inode_info *MQUEUE_I(struct inode *inode)
+{
+	return container_of(inode, struct mqueue_inode_info, vfs_inode);
+}
+
+static struct inode *mqueue_get_inode(struct super_block *sb, int mode,
+				      struct mq_attr *attr)
+{
+	struct inode *inode;
+
+	inode = new_inode(sb);
+	if (inode) {
+		inode->i_mode = mode;
+		inode->i_uid = current->fsuid;
+		inode->i_gid = current->fsgid;
+		inode->i_blksize = PAGE_CACHE_SIZE;
+		inode->i_blocks = 0;
+		inode->i_mtime = inode->i_ctime = inode->i_atime =
+				CURRENT_TIME;
+
+		if (S_ISREG(mode)) {
+			struct mqueue_inode_info *info;
+
+			inode->i_fop = &mqueue_file_operations;
+			inode->i_size = FILENT_SIZE;
+			/* mqueue specific info */
+			info = MQUEUE_I(inode);
+			spin_lock_init(&info->lock);
+			init_waitqueue_head(&info->wait_q);
+			INIT_LIST_HEAD(&info->e_wait_q[0].list);
+			INIT_LIST_HEAD(&info->e_wait_q[1].list);
+			info->msg_tree = RB_ROOT;
+			info->node_cache = NULL;
+			info->notify_owner = 0;
+			info->qsize = 0;
+			memset(&info->attr, 0, sizeof(info->attr));
+			info->attr.mq_maxmsg = DFLT_MSGMAX;
+			info->attr.mq_msgsize = DFLT_MSGSIZEMAX;
+			if (attr) {
+				info->attr.mq_maxmsg = attr->mq_maxmsg;
+				info->attr.mq_msgsize = attr->mq_msgsize;
+			}
+		} else if (S_ISDIR(mode)) {
+			inode->i_nlink++;
+			/* Some things misbehave if size == 0 on a directory */
+			inode->i_size = 2 * DIRENT_SIZE;
+			inode->i_op = &mqueue_dir_inode_operations;
+			inode->i_fop = &simple_dir_operations;
+		}
+	}
+	return inode;
+}
+
+static int mqueue_fill_super(struct super_block *sb, void *data, int silent)
+{
+	struct inode *inode;
+
+	sb->s_blocksize = PAGE_CACHE_SIZE;
+	sb->s_blocksize_bits = PAGE_CACHE_SHIFT;
+	sb->s_magic = MQUEUE_MAGIC;
+	sb->s_op = &mqueue_super_ops;
+
+	inode = mqueue_get_inode(sb, S_IFDIR | S_ISVTX | S_IRWXUGO, NULL);
+	if (!inode)
+		return -ENOMEM;
+
+	sb->s_root = d_alloc_root(inode);
+	if (!sb->s_root) {
+		iput(inode);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static struct super_block *mqueue_get_sb(struct file_system_type *fs_type,
+					 int flags, const char *dev_name,
+					 void *data)
+{
+	return get_sb_single(fs_type, flags, data, mqueue_fill_super);
+}
+
+static void init_once(void *foo, kmem_cache_t * cachep, unsigned long flags)
+{
+	struct mqueue_inode_info *p = (struct mqueue_inode_info *) foo;
+
+	if ((flags & (SLAB_CTOR_VERIFY | SLAB_CTOR_CONSTRUCTOR)) ==
+		SLAB_CTOR_CONSTRUCTOR)
+		inode_init_once(&p->vfs_inode);
+}
+
+static struct inode *mqueue_alloc_inode(struct super_block *sb)
+{
+	struct mqueue_inode_info *ei;
+
+	ei = kmem_cache_alloc(mqueue_inode_cachep, SLAB_KERNEL);
+	if (!ei)
+		return NULL;
+	return &ei->vfs_inode;
+}
+
+static void mqueue_destroy_inode(struct inode *inode)
+{
+	kmem_cache_free(mqueue_inode_cachep, MQUEUE_I(inode));
+}
+
+static void mqueue_delete_inode(struct inode *inode)
+{
+	struct mqueue_inode_info *info;
+	struct mq_prio_node *leaf;
+	struct mq_msg *msg;
+	struct rb_node *p;
+
+	if (S_ISDIR(inode->i_mode)) {
+		clear_inode(inode);
+		return;
+	}
+	info = MQUEUE_I(inode);
+
+	/* Nobody can reach the queue any more, no locking needed */
+	while ((p = rb_first(&info->msg_tree))) {
+		leaf = rb_entry(p, struct mq_prio_node, rb_node);
+		while (!list_empty(&leaf->msg_list)) {
+			msg = list_entry(leaf->msg_list.next,
+					 struct mq_msg, list);
+			list_del(&msg->list);
+			kfree(msg);
+		}
+		rb_erase(p, &info->msg_tree);
+		kfree(leaf);
+	}
+	if (info->node_cache)
+		kfree(info->node_cache);
+	clear_inode(inode);
+
+	spin_lock(&mq_lock);
+	queues_count--;
+	spin_unlock(&mq_lock);
+}
+
+/*
+ * The attributes for a queue created with mq_open() are passed in the
+ * d_fsdata of the directory, under its i_sem.  Queues created through
+ * a mount point get the defaults.
+ */
+static int mqueue_create(struct inode *dir, struct dentry *dentry,
+			 int mode, struct nameidata *nd)
+{
+	struct inode *inode;
+	struct mq_attr *attr = dentry->d_parent->d_fsdata;
+	int error;
+
+	spin_lock(&mq_lock);
+	if (queues_count >= queues_max && !capable(CAP_SYS_RESOURCE)) {
+		error = -ENOSPC;
+		goto out_lock;
+	}
+	queues_count++;
+	spin_unlock(&mq_lock);
+
+	inode = mqueue_get_inode(dir->i_sb, mode, attr);
+	if (!inode) {
+		error = -ENOMEM;
+		spin_lock(&mq_lock);
+		queues_count--;
+		goto out_lock;
+	}
+
+	dir->i_size += DIRENT_SIZE;
+	dir->i_ctime = dir->i_mtime = dir->i_atime = CURRENT_TIME;
+
+	d_instantiate(dentry, inode);
+	dget(dentry);
+	return 0;
+out_lock:
+	spin_unlock(&mq_lock);
+	return error;
+}
+
+static int mqueue_unlink(struct inode *dir, struct dentry *dentry)
+{
+	struct inode *inode = dentry->d_inode;
+
+	dir->i_ctime = dir->i_mtime = dir->i_atime = CURRENT_TIME;
+	dir->i_size -= DIRENT_SIZE;
+	inode->i_nlink--;
+	dput(dentry);
+	return 0;
+}
+
+/*
+ * This is routine for system read from queue file.
+ * To avoid mess with doing here some sort of mq_receive we allow
+ * to read only queue size & notification info (the only values
+ * that are interesting from user point of view and aren't accessible
+ * through std routines)
+ */
+static ssize_t mqueue_read_file(struct file *filp, char __user *u_data,
+				size_t count, loff_t *off)
+{
+	struct mqueue_inode_info *info = MQUEUE_I(filp->f_dentry->d_inode);
+	char buffer[FILENT_SIZE];
+	size_t slen;
+	loff_t o;
+
+	if (!count)
+		return 0;
+
+	spin_lock(&info->lock);
+	snprintf(buffer, sizeof(buffer),
+			"QSIZE:%-10lu NOTIFY:%-5d SIGNO:%-5d NOTIFY_PID:%-6d\n",
+			info->qsize,
+			info->notify_owner ? info->notify.sigev_notify : 0,
+			(info->notify_owner &&
+			 info->notify.sigev_notify == SIGEV_SIGNAL) ?
+				info->notify.sigev_signo : 0,
+			info->notify_owner);
+	spin_unlock(&info->lock);
+	buffer[sizeof(buffer)-1] = '\0';
+	slen = strlen(buffer)+1;
+
+	o = *off;
+	if (o > slen)
+		return 0;
+
+	if (o + count > slen)
+		count = slen - o;
+
+	if (copy_to_user(u_data, buffer + o, count))
+		return -EFAULT;
+
+	*off = o + count;
+	filp->f_dentry->d_inode->i_atime = filp->f_dentry->d_inode->i_ctime = CURRENT_TIME;
+	return count;
+}
+
+static int mqueue_flush_file(struct file *filp)
+{
+	struct mqueue_inode_info *info = MQUEUE_I(filp->f_dentry->d_inode);
+
+	spin_lock(&info->lock);
+	if (current->tgid == info->notify_owner)
+		info->notify_owner = 0;
+	spin_unlock(&info->lock);
+	return 0;
+}
+
+static unsigned int mqueue_poll_file(struct file *filp,
+				     struct poll_table_struct *poll_tab)
+{
+	struct mqueue_inode_info *info = MQUEUE_I(filp->f_dentry->d_inode);
+	int retval = 0;
+
+	poll_wait(filp, &info->wait_q, poll_tab);
+
+	spin_lock(&info->lock);
+	if (info->attr.mq_curmsgs)
+		retval = POLLIN | POLLRDNORM;
+
+	if (info->attr.mq_curmsgs < info->attr.mq_maxmsg)
+		retval |= POLLOUT | POLLWRNORM;
+	spin_unlock(&info->lock);
+
+	return retval;
+}
+
+/* Adds current to info->e_wait_q[sr] before element with smaller prio */
+static void wq_add(struct mqueue_inode_info *info, int sr,
+		   struct ext_wait_queue *ewp)
+{
+	struct ext_wait_queue *walk;
+
+	ewp->task = current;
+
+	list_for_each_entry(walk, &info->e_wait_q[sr].list, list) {
+		if (walk->task->static_prio <= current->static_prio) {
+			list_add_tail(&ewp->list, &walk->list);
+			return;
+		}
+	}
+	list_add_tail(&ewp->list, &info->e_wait_q[sr].list);
+}
+
+/*
+ * Puts current task to sleep. Caller must hold queue lock. After return
+ * lock isn't held.
+ * sr: SEND or RECV
+ */
+static int wq_sleep(struct mqueue_inode_info *info, int sr,
+		    long timeout, struct ext_wait_queue *ewp)
+{
+	int retval;
+	signed long time;
+
+	wq_add(info, sr, ewp);
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+
+		spin_unlock(&info->lock);
+		time = schedule_timeout(timeout);
+
+		while (ewp->state == STATE_PENDING)
+			cpu_relax();
+
+		if (ewp->state == STATE_READY) {
+			retval = 0;
+			goto out;
+		}
+		spin_lock(&info->lock);
+		if (ewp->state == STATE_READY) {
+			retval = 0;
+			goto out_unlock;
+		}
+		if (signal_pending(current)) {
+			retval = -ERESTARTSYS;
+			break;
+		}
+		if (time == 0) {
+			retval = -ETIMEDOUT;
+			break;
+		}
+		timeout = time;
+	}
+	list_del(&ewp->list);
+out_unlock:
+	spin_unlock(&info->lock);
+out:
+	return retval;
+}
+
+/*
+ * Returns waiting process for given sr (SEND or RECV), if any.
+ */
+static struct ext_wait_queue *wq_get_first_waiter(
+		struct mqueue_inode_info *info, int sr)
+{
+	struct list_head *ptr;
+
+	ptr = info->e_wait_q[sr].list.prev;
+	if (ptr == &info->e_wait_q[sr].list)
+		return NULL;
+	return list_entry(ptr, struct ext_wait_queue, list);
+}
+
+/* Queue a message, using node_cache for a new priority. */
+static void msg_insert(struct mq_msg *msg, struct mqueue_inode_info *info)
+{
+	struct rb_node **p, *parent = NULL;
+	struct mq_prio_node *leaf;
+
+	p = &info->msg_tree.rb_node;
+	while (*p) {
+		parent = *p;
+		leaf = rb_entry(parent, struct mq_prio_node, rb_node);
+
+		if (leaf->prio == msg->prio)
+			goto insert_msg;
+		else if (msg->prio < leaf->prio)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	leaf = info->node_cache;
+	info->node_cache = NULL;
+	BUG_ON(!leaf);
+	leaf->prio = msg->prio;
+	INIT_LIST_HEAD(&leaf->msg_list);
+	rb_link_node(&leaf->rb_node, parent, p);
+	rb_insert_color(&leaf->rb_node, &info->msg_tree);
+insert_msg:
+	list_add_tail(&msg->list, &leaf->msg_list);
+	info->attr.mq_curmsgs++;
+	info->qsize += msg->len;
+	wake_up(&info->wait_q);
+}
+
+/* Dequeue the oldest message of the highest priority. */
+static struct mq_msg *msg_get(struct mqueue_inode_info *info)
+{
+	struct mq_prio_node *leaf;
+	struct mq_msg *msg;
+	struct rb_node *p;
+
+	p = rb_last(&info->msg_tree);
+	BUG_ON(!p);
+	leaf = rb_entry(p, struct mq_prio_node, rb_node);
+	msg = list_entry(leaf->msg_list.next, struct mq_msg, list);
+	list_del(&msg->list);
+	if (list_empty(&leaf->msg_list)) {
+		rb_erase(p, &info->msg_tree);
+		if (info->node_cache)
+			kfree(leaf);
+		else
+			info->node_cache = leaf;
+	}
+	info->attr.mq_curmsgs--;
+	info->qsize -= msg->len;
+	wake_up(&info->wait_q);
+	return msg;
+}
+
+/*
+ * The next function is only to split too long sys_mq_timedsend
+ */
+static void __do_notify(struct mqueue_inode_info *info)
+{
+	/* notification
+	 * invoked when there is registered process and there isn't process
+	 * waiting synchronously for message AND state of queue changed from
+	 * empty to not empty. Here we are sure that no one is waiting
+	 * synchronously. */
+	if (info->notify_owner && info->attr.mq_curmsgs == 1) {
+		if (info->notify.sigev_notify == SIGEV_SIGNAL) {
+			struct siginfo sig_i;
+
+			sig_i.si_signo = info->notify.sigev_signo;
+			sig_i.si_errno = 0;
+			sig_i.si_code = SI_MESGQ;
+			sig_i.si_value = info->notify.sigev_value;
+			sig_i.si_pid = current->tgid;
+			sig_i.si_uid = current->uid;
+
+			kill_proc_info(info->notify.sigev_signo,
+				       &sig_i, info->notify_owner);
+		}
+		/* after notification unregisters process */
+		info->notify_owner = 0;
+	}
+}
+
+/*
+ * Convert an absolute CLOCK_REALTIME timeout to jiffies from now.
+ * Returns MAX_SCHEDULE_TIMEOUT for no timeout, 0 if it has passed.
+ */
+static long prepare_timeout(const struct timespec __user *u_arg)
+{
+	struct timespec ts;
+	struct timeval now;
+
+	if (!u_arg)
+		return MAX_SCHEDULE_TIMEOUT;
+
+	if (copy_from_user(&ts, u_arg, sizeof(struct timespec)))
+		return -EFAULT;
+
+	if (ts.tv_nsec < 0 || ts.tv_sec < 0 || ts.tv_nsec >= NSEC_PER_SEC)
+		return -EINVAL;
+
+	/* Only the time left goes through timespec_to_jiffies() */
+	do_gettimeofday(&now);
+	ts.tv_sec -= now.tv_sec;
+	ts.tv_nsec -= now.tv_usec * NSEC_PER_USEC;
+	if (ts.tv_nsec < 0) {
+		ts.tv_sec--;
+		ts.tv_nsec += NSEC_PER_SEC;
+	}
+	if (ts.tv_sec < 0)
+		return 0;
+
+	return timespec_to_jiffies(&ts) + 1;
+}
+
+static void remove_notification(struct mqueue_inode_info *info)
+{
+	info->notify_owner = 0;
+}
+
+/*
+ * Invoked when creating a new queue via sys_mq_open
+ */
+static struct file *do_create(struct dentry *dir, struct dentry *dentry,
+			      int oflag, mode_t mode,
+			      struct mq_attr __user *u_attr)
+{
+	struct file *filp;
+	struct mq_attr attr;
+	int ret;
+
+	if (u_attr != NULL) {
+		if (copy_from_user(&attr, u_attr, sizeof(attr)))
+			return ERR_PTR(-EFAULT);
+
+		if (attr.mq_maxmsg <= 0 || attr.mq_msgsize <= 0)
+			return ERR_PTR(-EINVAL);
+		if (capable(CAP_SYS_RESOURCE)) {
+			if (attr.mq_maxmsg > HARD_MSGMAX ||
+			    attr.mq_msgsize > HARD_MSGSIZEMAX)
+				return ERR_PTR(-EINVAL);
+		} else {
+			if (attr.mq_maxmsg > msg_max ||
+			    attr.mq_msgsize > msgsize_max)
+				return ERR_PTR(-EINVAL);
+		}
+		/* store for use during create */
+		dir->d_fsdata = &attr;
+	}
+
+	ret = vfs_create(dir->d_inode, dentry, mode, NULL);
+	dir->d_fsdata = NULL;
+	if (ret)
+		return ERR_PTR(ret);
+
+	dget(dentry);
+	mntget(mqueue_mnt);
+	filp = dentry_open(dentry, mqueue_mnt, oflag);
+	return filp;
+}
+
+/* Opens existing queue */
+static struct file *do_open(struct dentry *dentry, int oflag)
+{
+static int oflag2acc[O_ACCMODE] = { MAY_READ, MAY_WRITE,
+					MAY_READ | MAY_WRITE };
+	struct file *filp;
+
+	if ((oflag & O_ACCMODE) == (O_RDWR | O_WRONLY))
+		return ERR_PTR(-EINVAL);
+
+	if (permission(dentry->d_inode, oflag2acc[oflag & O_ACCMODE], NULL))
+		return ERR_PTR(-EACCES);
+
+	dget(dentry);
+	mntget(mqueue_mnt);
+	filp = dentry_open(dentry, mqueue_mnt, oflag);
+	return filp;
+}
+
+asmlinkage long sys_mq_open(const char __user *u_name, int oflag, mode_t mode,
+				struct mq_attr __user *u_attr)
+{
+	struct dentry *dentry;
+	struct file *filp;
+	char *name;
+	int fd, error;
+
+	if (IS_ERR(name = getname(u_name)))
+		return PTR_ERR(name);
+
+	fd = get_unused_fd();
+	if (fd < 0)
+		goto out_putname;
+
+	down(&mqueue_mnt->mnt_root->d_inode->i_sem);
+	dentry = lookup_one_len(name, mqueue_mnt->mnt_root, strlen(name));
+	if (IS_ERR(dentry)) {
+		error = PTR_ERR(dentry);
+		goto out_putfd;
+	}
+
+	if (oflag & O_CREAT) {
+		if (dentry->d_inode) {	/* entry already exists */
+			filp = (oflag & O_EXCL) ? ERR_PTR(-EEXIST) :
+					do_open(dentry, oflag);
+		} else {
+			filp = do_create(mqueue_mnt->mnt_root, dentry,
+					 oflag, mode & ~current->fs->umask,
+					 u_attr);
+		}
+	} else
+		filp = (dentry->d_inode) ? do_open(dentry, oflag) :
+					ERR_PTR(-ENOENT);
+
+	dput(dentry);
+
+	if (IS_ERR(filp)) {
+		error = PTR_ERR(filp);
+		goto out_putfd;
+	}
+
+	set_close_on_exec(fd, 1);
+	fd_install(fd, filp);
+	goto out_upsem;
+
+out_putfd:
+	put_unused_fd(fd);
+	fd = error;
+out_upsem:
+	up(&mqueue_mnt->mnt_root->d_inode->i_sem);
+out_putname:
+	putname(name);
+	return fd;
+}
+
+asmlinkage long sys_mq_unlink(const char __user *u_name)
+{
+	int err;
+	char *name;
+	struct dentry *dentry;
+	struct inode *inode = NULL;
+
+	name = getname(u_name);
+	if (IS_ERR(name))
+		return PTR_ERR(name);
+
+	down(&mqueue_mnt->mnt_root->d_inode->i_sem);
+	dentry = lookup_one_len(name, mqueue_mnt->mnt_root, strlen(name));
+	if (IS_ERR(dentry)) {
+		err = PTR_ERR(dentry);
+		goto out_unlock;
+	}
+
+	if (!dentry->d_inode) {
+		err = -ENOENT;
+		goto out_err;
+	}
+
+	inode = dentry->d_inode;
+	if (inode)
+		atomic_inc(&inode->i_count);
+
+	err = vfs_unlink(dentry->d_parent->d_inode, dentry);
+out_err:
+	dput(dentry);
+
+out_unlock:
+	up(&mqueue_mnt->mnt_root->d_inode->i_sem);
+	putname(name);
+	if (inode)
+		iput(inode);
+
+	return err;
+}
+
+/* Pipelined send and receive functions.
+ *
+ * If a receiver finds no waiting message, then it registers itself in the
+ * list of waiting receivers. A sender checks that list before adding the new
+ * message into the message array. If there is a waiting receiver, then it
+ * bypasses the message array and directly hands the message over to the
+ * receiver.
+ * The receiver accepts the message and returns without grabbing the queue
+ * spinlock. Therefore an intermediate STATE_PENDING state and memory barriers
+ * are necessary. The same algorithm is used for sysv semaphores, see
+ * ipc/sem.c for more details.
+ *
+ * The same algorithm is used for senders.
+ */
+
+/* pipelined_send() - send a message directly to the task waiting in
+ * sys_mq_timedreceive() (without inserting message into a queue).
+ */
+static inline void pipelined_send(struct mqueue_inode_info *info,
+				  struct mq_msg *message,
+				  struct ext_wait_queue *receiver)
+{
+	receiver->msg = message;
+	list_del(&receiver->list);
+	receiver->state = STATE_PENDING;
+	wake_up_process(receiver->task);
+	smp_wmb();
+	receiver->state = STATE_READY;
+}
+
+/* pipelined_receive() - if there is task waiting in sys_mq_timedsend()
+ * gets its message and put to the queue (we have one free place for sure). */
+static inline void pipelined_receive(struct mqueue_inode_info *info)
+{
+	struct ext_wait_queue *sender = wq_get_first_waiter(info, SEND);
+
+	if (!sender) {
+		/* for poll */
+		wake_up_interruptible(&info->wait_q);
+		return;
+	}
+	if (!info->node_cache) {
+		info->node_cache = sender->leaf;
+		sender->leaf = NULL;
+	}
+	msg_insert(sender->msg, info);
+	list_del(&sender->list);
+	sender->state = STATE_PENDING;
+	wake_up_process(sender->task);
+	smp_wmb();
+	sender->state = STATE_READY;
+}
+
+/* Look up a queue descriptor, with the access it needs. */
+static struct file *mq_fget(mqd_t mqdes, int mode)
+{
+	struct file *filp;
+
+	filp = fget(mqdes);
+	if (!filp)
+		return ERR_PTR(-EBADF);
+	if (filp->f_op != &mqueue_file_operations) {
+		fput(filp);
+		return ERR_PTR(-EBADF);
+	}
+	if (mode && !(filp->f_mode & mode)) {
+		fput(filp);
+		return ERR_PTR(-EBADF);
+	}
+	return filp;
+}
+
+asmlinkage long sys_mq_timedsend(mqd_t mqdes, const char __user *u_msg_ptr,
+	size_t msg_len, unsigned int msg_prio,
+	const struct timespec __user *u_abs_timeout)
+{
+	struct file *filp;
+	struct inode *inode;
+	struct ext_wait_queue wait;
+	struct ext_wait_queue *receiver;
+	struct mq_msg *msg_ptr;
+	struct mqueue_inode_info *info;
+	struct mq_prio_node *new_leaf = NULL;
+	long timeout;
+	int ret;
+
+	if (unlikely(msg_prio >= (unsigned long) MQ_PRIO_MAX))
+		return -EINVAL;
+
+	timeout = prepare_timeout(u_abs_timeout);
+	if (timeout < 0)
+		return timeout;
+
+	filp = mq_fget(mqdes, FMODE_WRITE);
+	if (IS_ERR(filp))
+		return PTR_ERR(filp);
+
+	inode = filp->f_dentry->d_inode;
+	info = MQUEUE_I(inode);
+
+	ret = -EMSGSIZE;
+	if (unlikely(msg_len > info->attr.mq_msgsize))
+		goto out_fput;
+
+	/* First try to allocate memory, before doing anything with
+	 * existing queues. */
+	ret = -ENOMEM;
+	msg_ptr = kmalloc(sizeof(*msg_ptr) + msg_len, GFP_KERNEL);
+	if (!msg_ptr)
+		goto out_fput;
+	msg_ptr->prio = msg_prio;
+	msg_ptr->len = msg_len;
+	ret = -EFAULT;
+	if (copy_from_user(msg_ptr->data, u_msg_ptr, msg_len))
+		goto out_free;
+
+	/*
+	 * A new priority needs a tree node, which we can't allocate under
+	 * the lock.  The queue keeps one at hand; a sender that has to
+	 * sleep brings its own for the receiver that queues its message.
+	 */
+	ret = -ENOMEM;
+	new_leaf = kmalloc(sizeof(*new_leaf), GFP_KERNEL);
+	if (!new_leaf)
+		goto out_free;
+
+	spin_lock(&info->lock);
+
+	if (info->attr.mq_curmsgs == info->attr.mq_maxmsg) {
+		if (filp->f_flags & O_NONBLOCK) {
+			spin_unlock(&info->lock);
+			ret = -EAGAIN;
+		} else if (unlikely(timeout == 0)) {
+			spin_unlock(&info->lock);
+			ret = -ETIMEDOUT;
+		} else {
+			wait.task = current;
+			wait.msg = msg_ptr;
+			wait.leaf = new_leaf;
+			wait.state = STATE_NONE;
+			ret = wq_sleep(info, SEND, timeout, &wait);
+			new_leaf = wait.leaf;
+		}
+		if (ret < 0)
+			goto out_free;
+	} else {
+		if (!info->node_cache) {
+			info->node_cache = new_leaf;
+			new_leaf = NULL;
+		}
+		receiver = wq_get_first_waiter(info, RECV);
+		if (receiver) {
+			pipelined_send(info, msg_ptr, receiver);
+		} else {
+			/* adds message to the queue */
+			msg_insert(msg_ptr, info);
+			__do_notify(info);
+		}
+		inode->i_atime = inode->i_mtime = inode->i_ctime =
+				CURRENT_TIME;
+		spin_unlock(&info->lock);
+		ret = 0;
+	}
+	goto out_fput;
+
+out_free:
+	kfree(msg_ptr);
+out_fput:
+	if (new_leaf)
+		kfree(new_leaf);
+	fput(filp);
+	return ret;
+}
+
+asmlinkage ssize_t sys_mq_timedreceive(mqd_t mqdes, char __user *u_msg_ptr,
+	size_t msg_len, unsigned int __user *u_msg_prio,
+	const struct timespec __user *u_abs_timeout)
+{
+	long timeout;
+	ssize_t ret;
+	struct mq_msg *msg_ptr;
+	struct file *filp;
+	struct inode *inode;
+	struct mqueue_inode_info *info;
+	struct ext_wait_queue wait;
+
+	timeout = prepare_timeout(u_abs_timeout);
+	if (timeout < 0)
+		return timeout;
+
+	filp = mq_fget(mqdes, FMODE_READ);
+	if (IS_ERR(filp))
+		return PTR_ERR(filp);
+
+	inode = filp->f_dentry->d_inode;
+	info = MQUEUE_I(inode);
+
+	/* checks if buffer is big enough */
+	if (unlikely(msg_len < info->attr.mq_msgsize)) {
+		ret = -EMSGSIZE;
+		goto out_fput;
+	}
+
+	spin_lock(&info->lock);
+	if (info->attr.mq_curmsgs == 0) {
+		if (filp->f_flags & O_NONBLOCK) {
+			spin_unlock(&info->lock);
+			ret = -EAGAIN;
+			msg_ptr = NULL;
+		} else if (unlikely(timeout == 0)) {
+			spin_unlock(&info->lock);
+			ret = -ETIMEDOUT;
+			msg_ptr = NULL;
+		} else {
+			wait.task = current;
+			wait.state = STATE_NONE;
+			ret = wq_sleep(info, RECV, timeout, &wait);
+			msg_ptr = wait.msg;
+		}
+	} else {
+		msg_ptr = msg_get(info);
+
+		inode->i_atime = inode->i_mtime = inode->i_ctime =
+				CURRENT_TIME;
+
+		/* There is now free space in queue. */
+		pipelined_receive(info);
+		spin_unlock(&info->lock);
+		ret = 0;
+	}
+	if (ret == 0) {
+		ret = msg_ptr->len;
+
+		if ((u_msg_prio && put_user(msg_ptr->prio, u_msg_prio)) ||
+		    copy_to_user(u_msg_ptr, msg_ptr->data, msg_ptr->len))
+			ret = -EFAULT;
+		kfree(msg_ptr);
+	}
+out_fput:
+	fput(filp);
+	return ret;
+}
+
+/*
+ * Notes: the case when user wants us to deregister (with NULL as pointer)
+ * and he isn't currently owner of notification, will be silently discarded.
+ * It isn't explicitly defined in the POSIX.
+ *
+ * SIGEV_THREAD is left to libpthread, which turns it into SIGEV_SIGNAL.
+ */
+asmlinkage long sys_mq_notify(mqd_t mqdes,
+				const struct sigevent __user *u_notification)
+{
+	int ret;
+	struct file *filp;
+	struct mqueue_inode_info *info;
+	struct sigevent notification;
+
+	if (u_notification) {
+		if (copy_from_user(&notification, u_notification,
+					sizeof(struct sigevent)))
+			return -EFAULT;
+
+		if (unlikely(notification.sigev_notify != SIGEV_NONE &&
+			     notification.sigev_notify != SIGEV_SIGNAL))
+			return -EINVAL;
+		if (notification.sigev_notify == SIGEV_SIGNAL &&
+			(notification.sigev_signo <= 0 ||
+			 notification.sigev_signo > _NSIG)) {
+			return -EINVAL;
+		}
+	}
+
+	filp = mq_fget(mqdes, 0);
+	if (IS_ERR(filp))
+		return PTR_ERR(filp);
+
+	info = MQUEUE_I(filp->f_dentry->d_inode);
+
+	ret = 0;
+	spin_lock(&info->lock);
+	if (u_notification == NULL) {
+		if (info->notify_owner == current->tgid) {
+			remove_notification(info);
+			filp->f_dentry->d_inode->i_atime =
+				filp->f_dentry->d_inode->i_ctime = CURRENT_TIME;
+		}
+	} else if (info->notify_owner != 0) {
+		ret = -EBUSY;
+	} else {
+		info->notify = notification;
+		info->notify_owner = current->tgid;
+		filp->f_dentry->d_inode->i_atime =
+			filp->f_dentry->d_inode->i_ctime = CURRENT_TIME;
+	}
+	spin_unlock(&info->lock);
+
+	fput(filp);
+	return ret;
+}
+
+asmlinkage long sys_mq_getsetattr(mqd_t mqdes,
+			const struct mq_attr __user *u_mqstat,
+			struct mq_attr __user *u_omqstat)
+{
+	int ret;
+	struct mq_attr mqstat, omqstat;
+	struct file *filp;
+	struct inode *inode;
+	struct mqueue_inode_info *info;
+
+	if (u_mqstat != NULL) {
+		if (copy_from_user(&mqstat, u_mqstat, sizeof(struct mq_attr)))
+			return -EFAULT;
+		if (mqstat.mq_flags & (~O_NONBLOCK))
+			return -EINVAL;
+	}
+
+	filp = mq_fget(mqdes, 0);
+	if (IS_ERR(filp))
+		return PTR_ERR(filp);
+
+	inode = filp->f_dentry->d_inode;
+	info = MQUEUE_I(inode);
+
+	spin_lock(&info->lock);
+
+	omqstat = info->attr;
+	omqstat.mq_flags = filp->f_flags & O_NONBLOCK;
+	if (u_mqstat) {
+		if (mqstat.mq_flags & O_NONBLOCK)
+			filp->f_flags |= O_NONBLOCK;
+		else
+			filp->f_flags &= ~O_NONBLOCK;
+
+		inode->i_atime = inode->i_ctime = CURRENT_TIME;
+	}
+
+	spin_unlock(&info->lock);
+
+	ret = 0;
+	if (u_omqstat != NULL && copy_to_user(u_omqstat, &omqstat,
+						sizeof(struct mq_attr)))
+		ret = -EFAULT;
+
+	fput(filp);
+	return ret;
+}
+
+static struct inode_operations mqueue_dir_inode_operations = {
+	.lookup = simple_lookup,
+	.create = mqueue_create,
+	.unlink = mqueue_unlink,
+};
+
+static struct file_operations mqueue_file_operations = {
+	.flush = mqueue_flush_file,
+	.poll = mqueue_poll_file,
+	.read = mqueue_read_file,
+};
+
+static struct super_operations mqueue_super_ops = {
+	.alloc_inode = mqueue_alloc_inode,
+	.destroy_inode = mqueue_destroy_inode,
+	.statfs = simple_statfs,
+	.delete_inode = mqueue_delete_inode,
+	.drop_inode = generic_delete_inode,
+};
+
+static struct file_system_type mqueue_fs_type = {
+	.name = "mqueue",
+	.get_sb = mqueue_get_sb,
+	.kill_sb = kill_litter_super,
+};
+
+static int __init init_mqueue_fs(void)
+{
+	int error;
+
+	mqueue_inode_cachep = kmem_cache_create("mqueue_inode_cache",
+				sizeof(struct mqueue_inode_info), 0,
+				SLAB_HWCACHE_ALIGN, init_once, NULL);
+	if (mqueue_inode_cachep == NULL)
+		return -ENOMEM;
+
+	error = register_filesystem(&mqueue_fs_type);
+	if (error)
+		goto out_cache;
+
+	mqueue_mnt = kern_mount(&mqueue_fs_type);
+	if (IS_ERR(mqueue_mnt)) {
+		error = PTR_ERR(mqueue_mnt);
+		goto out_filesystem;
+	}
+
+	/* internal initialization - not common for vfs */
+	queues_count = 0;
+
+	return 0;
+
+out_filesystem:
+	unregister_filesystem(&mqueue_fs_type);
+out_cache:
+	if (kmem_cache_destroy(mqueue_inode_cachep)) {
+		printk(KERN_INFO "mqueue_inode_cache: not all structures "
+			"were freed\n");
+	}
+	return error;
+}
+
+__initcall(init_mqueue_fs);
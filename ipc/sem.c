@@ -59,6 +59,14 @@
  * (c) 1999 Manfred Spraul <manfreds@colorfullife.com>
  * Enforced range limit on SEM_UNDO
  * (c) 2001 Red Hat Inc <alan@redhat.com>
+ *
+ * Per-semaphore locking:
+ * - Operations on a single semaphore only take the lock of that
+ *   semaphore and only look at its own queue of waiters, as long as
+ *   no multi-sembuf ("complex") operation is sleeping on the array.
+ *   Everything else takes the array lock, and then waits for the
+ *   semaphore locks to be dropped.  See sem_lock_ops().
+ * - Sleepers are woken after the locks are dropped.
  */
 
 #include <linux/config.h>
@@ -73,7 +81,6 @@
 #include "util.h"
 
 
-#define sem_lock(id)	((struct sem_array*)ipc_lock(&sem_ids,id))
 #define sem_unlock(sma)	ipc_unlock(&(sma)->sem_perm)
 #define sem_rmid(id)	((struct sem_array*)ipc_rmid(&sem_ids,id))
 #define sem_checkid(sma, semid)	\
@@ -82,6 +89,29 @@
 	ipc_buildid(&sem_ids, id, seq)
 static struct ipc_ids sem_ids;
 
+/*
+ * Wait until nobody holds the lock of a single semaphore of the array.
+ * Called with the array lock held, which keeps new ones from starting.
+ */
+static void sem_wait_array(struct sem_array *sma)
+{
+	int i;
+
+	for (i = 0; i < sma->sem_nsems; i++)
+		spin_unlock_wait(&sma->sem_base[i].lock);
+}
+
+/* Lock the whole array, for anything but semop on a single semaphore */
+static inline struct sem_array *sem_lock(int id)
+{
+	struct sem_array *sma;
+
+	sma = (struct sem_array *)ipc_lock(&sem_ids, id);
+	if (sma)
+		sem_wait_array(sma);
+	return sma;
+}
+
 static int newary (key_t, int, int);
 static void freeary (struct sem_array *sma, int id);
 #ifdef CONFIG_PROC_FS
@@ -94,8 +124,9 @@ static int sysvipc_sem_read_proc(char *buffer, char **start, off_t offset, int l
 /*
  * linked list protection:
  *	sem_undo.id_next,
- *	sem_array.sem_pending{,last},
+ *	sem_array.sem_pending, complex_count,
  *	sem_array.sem_undo: sem_lock() for read/write
+ *	sem.sem_pending: sem.lock or sem_lock(), see sem_lock_ops()
  *	sem_undo.proc_next: only "current" is allowed to read/write that field.
  *	
  */
@@ -120,7 +151,7 @@ void __init sem_init (void)
 
 static int newary (key_t key, int nsems, int semflg)
 {
-	int id;
+	int id, i;
 	int retval;
 	struct sem_array *sma;
 	int size;
@@ -156,8 +187,12 @@ static int newary (key_t key, int nsems, int semflg)
 	used_sems += nsems;
 
 	sma->sem_base = (struct sem *) &sma[1];
-	/* sma->sem_pending = NULL; */
-	sma->sem_pending_last = &sma->sem_pending;
+	for (i = 0; i < nsems; i++) {
+		spin_lock_init(&sma->sem_base[i].lock);
+		INIT_LIST_HEAD(&sma->sem_base[i].sem_pending);
+	}
+	INIT_LIST_HEAD(&sma->sem_pending);
+	/* sma->complex_count = 0; */
 	/* sma->undo = NULL; */
 	sma->sem_nsems = nsems;
 	sma->sem_ctime = get_seconds();
@@ -224,36 +259,118 @@ static int sem_revalidate(int semid, struct sem_array* sma, int nsems, short flg
 	}
 	return 0;
 }
-/* Manage the doubly linked list sma->sem_pending as a FIFO:
- * insert new queue elements at the tail sma->sem_pending_last.
+/*
+ * Lock what a semop on @sma needs: the lock of the semaphore for a
+ * single-sembuf operation if no complex operation is pending, else the
+ * array lock.  Returns the semaphore number locked, or -1 for the
+ * array.  Called and returns in an RCU read-side critical section, see
+ * ipc_obtain().
+ *
+ * The two cannot be held at the same time: the array locker waits for
+ * all semaphore locks to be released, and a semaphore locker which
+ * finds the array locked backs off and takes the array lock itself.
+ * complex_count only changes under the array lock.
  */
-static inline void append_to_queue (struct sem_array * sma,
-				    struct sem_queue * q)
+static int sem_lock_ops(struct sem_array *sma, struct sembuf *sops, int nsops)
 {
-	*(q->prev = sma->sem_pending_last) = q;
-	*(sma->sem_pending_last = &q->next) = NULL;
+	if (nsops == 1 && !sma->complex_count) {
+		struct sem *sem = sma->sem_base + sops->sem_num;
+
+		spin_lock(&sem->lock);
+		if (!spin_is_locked(&sma->sem_perm.lock)) {
+			/* spin_is_locked() is not a memory barrier */
+			smp_mb();
+			if (!sma->complex_count)
+				return sops->sem_num;
+		}
+		spin_unlock(&sem->lock);
+	}
+
+	spin_lock(&sma->sem_perm.lock);
+	sem_wait_array(sma);
+	return -1;
 }
 
-static inline void prepend_to_queue (struct sem_array * sma,
-				     struct sem_queue * q)
+static inline void sem_unlock_ops(struct sem_array *sma, int locknum)
 {
-	q->next = sma->sem_pending;
-	*(q->prev = &sma->sem_pending) = q;
-	if (q->next)
-		q->next->prev = &q->next;
-	else /* sma->sem_pending_last == &sma->sem_pending */
-		sma->sem_pending_last = &q->next;
+	if (locknum == -1)
+		spin_unlock(&sma->sem_perm.lock);
+	else
+		spin_unlock(&sma->sem_base[locknum].lock);
+	rcu_read_unlock();
 }
 
-static inline void remove_from_queue (struct sem_array * sma,
-				      struct sem_queue * q)
+/* Queue a sleeper: single-sembuf operations wait on their semaphore. */
+static void queue_sem_op(struct sem_array *sma, struct sem_queue *q, int alter)
 {
-	*(q->prev) = q->next;
-	if (q->next)
-		q->next->prev = q->prev;
-	else /* sma->sem_pending_last == &q->next */
-		sma->sem_pending_last = q->prev;
-	q->prev = NULL; /* mark as removed */
+	struct list_head *pending;
+
+	if (q->nsops == 1)
+		pending = &sma->sem_base[q->sops->sem_num].sem_pending;
+	else {
+		pending = &sma->sem_pending;
+		sma->complex_count++;
+	}
+
+	/* FIFO, but waiting-for-zero goes first */
+	if (alter)
+		list_add_tail(&q->list, pending);
+	else
+		list_add(&q->list, pending);
+}
+
+static void unlink_queue(struct sem_array *sma, struct sem_queue *q)
+{
+	list_del(&q->list);
+	if (q->nsops > 1)
+		sma->complex_count--;
+}
+
+/*
+ * Wakeups are collected on a list while the lock is held and done
+ * after it is dropped.  The sleeper may only leave once the final
+ * status is set, until then it spins on IN_WAKEUP in
+ * get_queue_result(): that keeps its task_struct and the queue entry,
+ * which lives on its stack, around for wake_up_sem_queue_do().
+ * Preemption stays off meanwhile, so that it doesn't spin long.
+ */
+#define IN_WAKEUP	1
+
+static void wake_up_sem_queue_prepare(struct list_head *pt,
+				      struct sem_queue *q, int error)
+{
+	if (list_empty(pt))
+		preempt_disable();
+	q->status = IN_WAKEUP;
+	q->pid = error;
+	list_add_tail(&q->list, pt);
+}
+
+static void wake_up_sem_queue_do(struct list_head *pt)
+{
+	struct sem_queue *q, *t;
+	int did_something = !list_empty(pt);
+
+	list_for_each_entry_safe(q, t, pt, list) {
+		wake_up_process(q->sleeper);
+		/* q can disappear immediately after writing q->status. */
+		smp_wmb();
+		q->status = q->pid;
+	}
+	if (did_something)
+		preempt_enable();
+}
+
+static int get_queue_result(struct sem_queue *q)
+{
+	int error;
+
+	error = q->status;
+	while (unlikely(error == IN_WAKEUP)) {
+		cpu_relax();
+		error = q->status;
+	}
+	return error;
 }
 
 /*
@@ -323,26 +440,71 @@ undo:
 	return result;
 }
 
-/* Go through the pending queue for the indicated semaphore
- * looking for tasks that can be completed.
+/*
+ * Go through the pending queue of semaphore @semnum, or the complex
+ * operations if @semnum is -1, looking for tasks that can be completed.
+ * Every completed operation which changed a semaphore may have made
+ * one earlier in the queue possible, so start over after it.
+ * Returns nonzero if any semaphore was changed.
  */
-static void update_queue (struct sem_array * sma)
+static int update_queue(struct sem_array *sma, int semnum,
+			struct list_head *pt)
 {
-	int error;
-	struct sem_queue * q;
+	struct list_head *pending;
+	struct sem_queue *q, *t;
+	int error, i, alter, changed = 0;
+
+	if (semnum == -1)
+		pending = &sma->sem_pending;
+	else
+		pending = &sma->sem_base[semnum].sem_pending;
 
-	for (q = sma->sem_pending; q; q = q->next) {
-			
+again:
+	list_for_each_entry_safe(q, t, pending, list) {
 		error = try_atomic_semop(sma, q->sops, q->nsops,
 					 q->undo, q->pid);
 
 		/* Does q->sleeper still need to sleep? */
-		if (error <= 0) {
-			q->status = error;
-			remove_from_queue(sma,q);
-			wake_up_process(q->sleeper);
+		if (error > 0)
+			continue;
+
+		unlink_queue(sma, q);
+		alter = 0;
+		if (!error)
+			for (i = 0; i < q->nsops; i++)
+				if (q->sops[i].sem_op)
+					alter = 1;
+		wake_up_sem_queue_prepare(pt, q, error);
+		if (alter) {
+			changed = 1;
+			goto again;
 		}
 	}
+	return changed;
+}
+
+/*
+ * Wake up whoever can proceed after semaphore values changed.
+ * @sops is the operation which changed them, or NULL if anything may
+ * have changed.  Anything but a single-sembuf operation with no complex
+ * operations pending must hold the array lock.
+ */
+static void do_smart_update(struct sem_array *sma, struct sembuf *sops,
+			    int nsops, struct list_head *pt)
+{
+	int i, changed;
+
+	if (sops && nsops == 1 && !sma->complex_count) {
+		if (sops->sem_op)
+			update_queue(sma, sops->sem_num, pt);
+		return;
+	}
+
+	do {
+		changed = update_queue(sma, -1, pt);
+		for (i = 0; i < sma->sem_nsems; i++)
+			changed |= update_queue(sma, i, pt);
+	} while (changed);
 }
 
 /* The following counts are associated to each semaphore:
@@ -354,41 +516,33 @@ static void update_queue (struct sem_array * sma)
  * The counts we return here are a rough approximation, but still
  * warrant that semncnt+semzcnt>0 if the task is on the pending queue.
  */
-static int count_semncnt (struct sem_array * sma, ushort semnum)
+static int count_semcnt (struct list_head *pending, ushort semnum, int zero)
 {
-	int semncnt;
+	int semcnt;
 	struct sem_queue * q;
 
-	semncnt = 0;
-	for (q = sma->sem_pending; q; q = q->next) {
+	semcnt = 0;
+	list_for_each_entry(q, pending, list) {
 		struct sembuf * sops = q->sops;
 		int nsops = q->nsops;
 		int i;
 		for (i = 0; i < nsops; i++)
 			if (sops[i].sem_num == semnum
-			    && (sops[i].sem_op < 0)
+			    && (zero ? sops[i].sem_op == 0 : sops[i].sem_op < 0)
 			    && !(sops[i].sem_flg & IPC_NOWAIT))
-				semncnt++;
+				semcnt++;
 	}
-	return semncnt;
+	return semcnt;
+}
+static int count_semncnt (struct sem_array * sma, ushort semnum)
+{
+	return count_semcnt(&sma->sem_base[semnum].sem_pending, semnum, 0) +
+		count_semcnt(&sma->sem_pending, semnum, 0);
 }
 static int count_semzcnt (struct sem_array * sma, ushort semnum)
 {
-	int semzcnt;
-	struct sem_queue * q;
-
-	semzcnt = 0;
-	for (q = sma->sem_pending; q; q = q->next) {
-		struct sembuf * sops = q->sops;
-		int nsops = q->nsops;
-		int i;
-		for (i = 0; i < nsops; i++)
-			if (sops[i].sem_num == semnum
-			    && (sops[i].sem_op == 0)
-			    && !(sops[i].sem_flg & IPC_NOWAIT))
-				semzcnt++;
-	}
-	return semzcnt;
+	return count_semcnt(&sma->sem_base[semnum].sem_pending, semnum, 1) +
+		count_semcnt(&sma->sem_pending, semnum, 1);
 }
 
 /* Free a semaphore set. freeary() is called with sem_ids.sem down and
@@ -398,8 +552,9 @@ static int count_semzcnt (struct sem_array * sma, ushort semnum)
 static void freeary (struct sem_array *sma, int id)
 {
 	struct sem_undo *un;
-	struct sem_queue *q;
-	int size;
+	struct sem_queue *q, *t;
+	LIST_HEAD(tasks);
+	int size, i;
 
 	/* Invalidate the existing undo structures for this semaphore set.
 	 * (They will be freed without any further action in exit_sem()
@@ -409,15 +564,22 @@ static void freeary (struct sem_array *sma, int id)
 		un->semid = -1;
 
 	/* Wake up all pending processes and let them fail with EIDRM. */
-	for (q = sma->sem_pending; q; q = q->next) {
-		q->status = -EIDRM;
-		q->prev = NULL;
-		wake_up_process(q->sleeper); /* doesn't sleep */
+	list_for_each_entry_safe(q, t, &sma->sem_pending, list) {
+		unlink_queue(sma, q);
+		wake_up_sem_queue_prepare(&tasks, q, -EIDRM);
+	}
+	for (i = 0; i < sma->sem_nsems; i++) {
+		list_for_each_entry_safe(q, t, &sma->sem_base[i].sem_pending,
+					 list) {
+			unlink_queue(sma, q);
+			wake_up_sem_queue_prepare(&tasks, q, -EIDRM);
+		}
 	}
 
 	/* Remove the semaphore set from the ID array*/
 	sma = sem_rmid(id);
 	sem_unlock(sma);
+	wake_up_sem_queue_do(&tasks);
 
 	used_sems -= sma->sem_nsems;
 	size = sizeof (*sma) + sma->sem_nsems * sizeof (struct sem);
@@ -536,6 +698,7 @@ static int semctl_main(int semid, int semnum, int cmd, int version, union semun
 	ushort fast_sem_io[SEMMSL_FAST];
 	ushort* sem_io = fast_sem_io;
 	int nsems;
+	LIST_HEAD(tasks);
 
 	sma = sem_lock(semid);
 	if(sma==NULL)
@@ -615,7 +778,7 @@ static int semctl_main(int semid, int semnum, int cmd, int version, union semun
 				un->semadj[i] = 0;
 		sma->sem_ctime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, NULL, 0, &tasks);
 		err = 0;
 		goto out_unlock;
 	}
@@ -667,13 +830,14 @@ static int semctl_main(int semid, int semnum, int cmd, int version, union semun
 		curr->sempid = current->tgid;
 		sma->sem_ctime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, NULL, 0, &tasks);
 		err = 0;
 		goto out_unlock;
 	}
 	}
 out_unlock:
 	sem_unlock(sma);
+	wake_up_sem_queue_do(&tasks);
 out_free:
 	if(sem_io != fast_sem_io)
 		ipc_free(sem_io, sizeof(ushort)*nsems);
@@ -976,6 +1140,8 @@ asmlinkage long sys_semtimedop(int semid, struct sembuf __user *tsops,
 	int undos = 0, decrease = 0, alter = 0, max;
 	struct sem_queue queue;
 	unsigned long jiffies_left = 0;
+	int locknum;
+	LIST_HEAD(tasks);
 
 	if (nsops < 1 || semid < 0)
 		return -EINVAL;
@@ -1026,37 +1192,45 @@ retry_undos:
 	} else
 		un = NULL;
 
-	sma = sem_lock(semid);
+	sma = (struct sem_array *)ipc_obtain(&sem_ids, semid);
 	error=-EINVAL;
 	if(sma==NULL)
 		goto out_free;
 	error = -EIDRM;
 	if (sem_checkid(sma,semid))
-		goto out_unlock_free;
-	/*
-	 * semid identifies are not unique - find_undo may have
-	 * allocated an undo structure, it was invalidated by an RMID
-	 * and now a new array with received the same id. Check and retry.
-	 */
-	if (un && un->semid == -1) {
-		sem_unlock(sma);
-		goto retry_undos;
-	}
+		goto out_rcu_free;
 	error = -EFBIG;
 	if (max >= sma->sem_nsems)
-		goto out_unlock_free;
+		goto out_rcu_free;
 
 	error = -EACCES;
 	if (ipcperms(&sma->sem_perm, alter ? S_IWUGO : S_IRUGO))
-		goto out_unlock_free;
+		goto out_rcu_free;
 
 	error = security_sem_semop(sma, sops, nsops, alter);
 	if (error)
+		goto out_rcu_free;
+
+	locknum = sem_lock_ops(sma, sops, nsops);
+	error = -EIDRM;
+	if (sma->sem_perm.deleted)
 		goto out_unlock_free;
+	/*
+	 * semid identifies are not unique - find_undo may have
+	 * allocated an undo structure, it was invalidated by an RMID
+	 * and now a new array with received the same id. Check and retry.
+	 */
+	if (un && un->semid == -1) {
+		sem_unlock_ops(sma, locknum);
+		goto retry_undos;
+	}
 
 	error = try_atomic_semop (sma, sops, nsops, un, current->tgid);
-	if (error <= 0)
-		goto update;
+	if (error <= 0) {
+		if (alter && !error)
+			do_smart_update(sma, sops, nsops, &tasks);
+		goto out_unlock_free;
+	}
 
 	/* We need to sleep on this operation, so we put the current
 	 * task into the pending queue and go to sleep.
@@ -1068,50 +1242,58 @@ retry_undos:
 	queue.undo = un;
 	queue.pid = current->tgid;
 	queue.id = semid;
-	if (alter)
-		append_to_queue(sma ,&queue);
-	else
-		prepend_to_queue(sma ,&queue);
+	queue_sem_op(sma, &queue, alter);
 
 	queue.status = -EINTR;
 	queue.sleeper = current;
 	current->state = TASK_INTERRUPTIBLE;
-	sem_unlock(sma);
+	sem_unlock_ops(sma, locknum);
 
 	if (timeout)
 		jiffies_left = schedule_timeout(jiffies_left);
 	else
 		schedule();
 
-	sma = sem_lock(semid);
-	if(sma==NULL) {
-		if(queue.prev != NULL)
-			BUG();
-		error = -EIDRM;
+	/*
+	 * If queue.status != -EINTR we are woken up by another process,
+	 * which is done with us and our queue entry.
+	 */
+	error = get_queue_result(&queue);
+	if (error != -EINTR) {
+		/* see wake_up_sem_queue_do() */
+		smp_mb();
 		goto out_free;
 	}
 
-	/*
-	 * If queue.status != -EINTR we are woken up by another process
-	 */
-	error = queue.status;
-	if (queue.status != -EINTR) {
-		goto out_unlock_free;
+	sma = (struct sem_array *)ipc_obtain(&sem_ids, semid);
+	if (sma == NULL || sem_checkid(sma, semid)) {
+		/* Removed, and freeary() has woken us meanwhile */
+		if (sma)
+			rcu_read_unlock();
+		error = get_queue_result(&queue);
+		BUG_ON(error == -EINTR);
+		goto out_free;
 	}
+	locknum = sem_lock_ops(sma, sops, nsops);
+
+	/* We may have been woken up after all, before we got the lock. */
+	error = get_queue_result(&queue);
+	if (error != -EINTR)
+		goto out_unlock_free;
 
 	/*
 	 * If an interrupt occurred we have to clean up the queue
 	 */
 	if (timeout && jiffies_left == 0)
 		error = -EAGAIN;
-	remove_from_queue(sma,&queue);
-	goto out_unlock_free;
+	unlink_queue(sma, &queue);
 
-update:
-	if (alter)
-		update_queue (sma);
 out_unlock_free:
-	sem_unlock(sma);
+	sem_unlock_ops(sma, locknum);
+	wake_up_sem_queue_do(&tasks);
+	goto out_free;
+out_rcu_free:
+	rcu_read_unlock();
 out_free:
 	if(sops != fast_sops)
 		kfree(sops);
@@ -1177,6 +1359,7 @@ void exit_sem(struct task_struct *tsk)
 		int nsems, i;
 		struct sem_undo *un, **unp;
 		int semid;
+		LIST_HEAD(tasks);
 	       
 		semid = u->semid;
 
@@ -1213,9 +1396,10 @@ found:
 		}
 		sma->sem_otime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, NULL, 0, &tasks);
 next_entry:
 		sem_unlock(sma);
+		wake_up_sem_queue_do(&tasks);
 	}
 	kfree(undo_list);
 }
@@ -450,7 +450,15 @@ struct kern_ipc_perm* ipc_get(struct ipc_ids* ids, int id)
 	return out;
 }
 
-struct kern_ipc_perm* ipc_lock(struct ipc_ids* ids, int id)
+/*
+ * Look up an ipc object without taking its lock.  On success the
+ * caller is in an RCU read-side critical section, which keeps the
+ * object from being freed, and must leave it with rcu_read_unlock()
+ * (or ipc_unlock() after locking the object).  The object may have
+ * been removed already, check ->deleted under whatever lock protects
+ * what you are going to look at.
+ */
+struct kern_ipc_perm* ipc_obtain(struct ipc_ids* ids, int id)
 {
 	struct kern_ipc_perm* out;
 	int lid = id % SEQ_MULTIPLIER;
@@ -478,6 +486,16 @@ struct kern_ipc_perm* ipc_lock(struct ipc_ids* ids, int id)
 		rcu_read_unlock();
 		return NULL;
 	}
+	return out;
+}
+
+struct kern_ipc_perm* ipc_lock(struct ipc_ids* ids, int id)
+{
+	struct kern_ipc_perm* out;
+
+	out = ipc_obtain(ids, id);
+	if(out == NULL)
+		return NULL;
 	spin_lock(&out->lock);
 	
 	/* ipc_rmid() may have already freed the ID while ipc_lock
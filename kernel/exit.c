@@ -22,6 +22,7 @@
 #include <linux/profile.h>
 #include <linux/mount.h>
 #include <linux/proc_fs.h>
+#include <linux/futex.h>
 
 #include <asm/uaccess.h>
 #include <asm/pgtable.h>
@@ -759,6 +760,7 @@ NORET_TYPE void do_exit(long code)
 		ptrace_notify((PTRACE_EVENT_EXIT << 8) | SIGTRAP);
 	}
 
+	exit_futex_pi(tsk);
 	acct_process(code);
 	__exit_mm(tsk);
 
@@ -38,8 +38,7 @@
 #include <linux/futex.h>
 #include <linux/mount.h>
 #include <linux/pagemap.h>
-
-#define FUTEX_HASHBITS 8
+#include <linux/cache.h>
 
 /*
  * Futexes are matched on equal values of this key.
@@ -89,17 +88,27 @@ struct futex_q {
 	/* For fd, sigio sent using these. */
 	int fd;
 	struct file *filp;
+
+	/* For PI futexes: the sleeping task and what it is queued on. */
+	struct task_struct *task;
+	struct futex_pi_state *pi_state;
+	/* Set under futex_pi_lock when woken to inherit from a dead owner. */
+	int pi_owner_died;
 };
 
 /*
  * Split the global futex_lock into every hash list lock.
+ * Buckets get a cacheline each so that busy neighbours don't bounce.
  */
 struct futex_hash_bucket {
        spinlock_t              lock;
        struct list_head       chain;
-};
+       struct list_head       pi_chain;
+} ____cacheline_aligned_in_smp;
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+/* Sized at boot from the number of cpus and memory, see init(). */
+static struct futex_hash_bucket *futex_queues;
+static unsigned long futex_hashmask;
 
 /* Futex-fs vfsmount entry: */
 static struct vfsmount *futex_mnt;
@@ -112,7 +121,7 @@ static struct futex_hash_bucket *hash_futex(union futex_key *key)
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+	return &futex_queues[hash & futex_hashmask];
 }
 
 /*
@@ -125,6 +134,24 @@ static inline int match_futex(union futex_key *key1, union futex_key *key2)
 		&& key1->both.offset == key2->both.offset);
 }
 
+/*
+ * Shared futexes need mmap_sem to keep the vma, and so the key, valid
+ * while it is looked up and referenced.  Futexes which userspace
+ * flagged FUTEX_PRIVATE_FLAG key on (uaddr, current->mm) alone and
+ * don't touch mmap_sem at all.
+ */
+static inline void futex_lock_mm(int fshared)
+{
+	if (fshared)
+		down_read(&current->mm->mmap_sem);
+}
+
+static inline void futex_unlock_mm(int fshared)
+{
+	if (fshared)
+		up_read(&current->mm->mmap_sem);
+}
+
 /*
  * Get parameters which are the keys for a futex.
  *
@@ -132,12 +159,18 @@ static inline int match_futex(union futex_key *key1, union futex_key *key2)
  * offset_within_page).  For private mappings, it's (uaddr, current->mm).
  * We can usually work out the index without swapping in the page.
  *
+ * If !fshared the caller promised the futex is process-private, and
+ * we skip the vma lookup: the key is then the same as for a private
+ * mapping, so private and non-private operations still pair up.
+ *
  * Returns: 0, or negative error code.
  * The key words are stored in *key on success.
  *
- * Should be called with &current->mm->mmap_sem but NOT any spinlocks.
+ * Should be called with &current->mm->mmap_sem (if fshared) but NOT
+ * any spinlocks.
  */
-static int get_futex_key(unsigned long uaddr, union futex_key *key)
+static int get_futex_key(unsigned long uaddr, int fshared,
+			 union futex_key *key)
 {
 	struct mm_struct *mm = current->mm;
 	struct vm_area_struct *vma;
@@ -152,6 +185,14 @@ static int get_futex_key(unsigned long uaddr, union futex_key *key)
 		return -EINVAL;
 	uaddr -= key->both.offset;
 
+	if (!fshared) {
+		if (unlikely(!access_ok(VERIFY_WRITE, uaddr, sizeof(u32))))
+			return -EFAULT;
+		key->private.mm = mm;
+		key->private.uaddr = uaddr;
+		return 0;
+	}
+
 	/*
 	 * The futex is hashed differently depending on whether
 	 * it's in a shared or private mapping.  So check vma first.
@@ -231,6 +272,7 @@ static int get_futex_key(unsigned long uaddr, union futex_key *key)
  *
  * NOTE: mmap_sem MUST be held between get_futex_key() and calling this
  * function, if it is called at all.  mmap_sem keeps key->shared.inode valid.
+ * Keys from a private lookup reference current->mm, which cannot go away.
  */
 static inline void get_key_refs(union futex_key *key)
 {
@@ -281,7 +323,7 @@ static inline void wake_futex(struct futex_q *q)
  * Wake up all waiters hashed on the physical page that is mapped
  * to this virtual address:
  */
-static int futex_wake(unsigned long uaddr, int nr_wake)
+static int futex_wake(unsigned long uaddr, int fshared, int nr_wake)
 {
 	union futex_key key;
 	struct futex_hash_bucket *bh;
@@ -289,9 +331,9 @@ static int futex_wake(unsigned long uaddr, int nr_wake)
 	struct futex_q *this, *next;
 	int ret;
 
-	down_read(&current->mm->mmap_sem);
+	futex_lock_mm(fshared);
 
-	ret = get_futex_key(uaddr, &key);
+	ret = get_futex_key(uaddr, fshared, &key);
 	if (unlikely(ret != 0))
 		goto out;
 
@@ -309,16 +351,22 @@ static int futex_wake(unsigned long uaddr, int nr_wake)
 
 	spin_unlock(&bh->lock);
 out:
-	up_read(&current->mm->mmap_sem);
+	futex_unlock_mm(fshared);
 	return ret;
 }
 
 /*
  * Requeue all waiters hashed on one physical page to another
  * physical page.
+ *
+ * If valp is non-NULL this is FUTEX_CMP_REQUEUE: the futex at uaddr1
+ * must still hold *valp once both hash buckets are locked, otherwise
+ * nothing is done and -EAGAIN returned.  That closes the window in
+ * which a condvar broadcast could requeue waiters after the value has
+ * changed, so userspace need not wake everybody instead.
  */
 static int futex_requeue(unsigned long uaddr1, unsigned long uaddr2,
-				int nr_wake, int nr_requeue)
+			 int fshared, int nr_wake, int nr_requeue, int *valp)
 {
 	union futex_key key1, key2;
 	struct futex_hash_bucket *bh1, *bh2;
@@ -326,24 +374,53 @@ static int futex_requeue(unsigned long uaddr1, unsigned long uaddr2,
 	struct futex_q *this, *next;
 	int ret, drop_count = 0;
 
-	down_read(&current->mm->mmap_sem);
+	futex_lock_mm(fshared);
 
-	ret = get_futex_key(uaddr1, &key1);
+	ret = get_futex_key(uaddr1, fshared, &key1);
 	if (unlikely(ret != 0))
 		goto out;
-	ret = get_futex_key(uaddr2, &key2);
+	ret = get_futex_key(uaddr2, fshared, &key2);
 	if (unlikely(ret != 0))
 		goto out;
 
 	bh1 = hash_futex(&key1);
 	bh2 = hash_futex(&key2);
 
+ retry:
 	if (bh1 < bh2)
 		spin_lock(&bh1->lock);
 	spin_lock(&bh2->lock);
 	if (bh1 > bh2)
 		spin_lock(&bh1->lock);
 
+	if (likely(valp != NULL)) {
+		int curval;
+
+		/*
+		 * We cannot sleep on a fault with the bucket locks held,
+		 * so the read is done atomically and, if the page is not
+		 * present, faulted in with the locks dropped.
+		 */
+		inc_preempt_count();
+		ret = get_user(curval, (int __user *)uaddr1);
+		dec_preempt_count();
+
+		if (unlikely(ret)) {
+			spin_unlock(&bh1->lock);
+			if (bh1 != bh2)
+				spin_unlock(&bh2->lock);
+
+			ret = get_user(curval, (int __user *)uaddr1);
+			if (!ret)
+				goto retry;
+			goto out;
+		}
+		if (curval != *valp) {
+			ret = -EAGAIN;
+			goto out_unlock;
+		}
+	}
+
 	head1 = &bh1->chain;
 	list_for_each_entry_safe(this, next, head1, list) {
 		if (!match_futex (&this->key, &key1))
@@ -365,6 +442,7 @@ static int futex_requeue(unsigned long uaddr1, unsigned long uaddr2,
 		}
 	}
 
+ out_unlock:
 	spin_unlock(&bh1->lock);
 	if (bh1 != bh2)
 		spin_unlock(&bh2->lock);
@@ -374,7 +452,7 @@ static int futex_requeue(unsigned long uaddr1, unsigned long uaddr2,
 		drop_key_refs(&key1);
 
 out:
-	up_read(&current->mm->mmap_sem);
+	futex_unlock_mm(fshared);
 	return ret;
 }
 
@@ -441,15 +519,16 @@ static int unqueue_me(struct futex_q *q)
 	return ret;
 }
 
-static int futex_wait(unsigned long uaddr, int val, unsigned long time)
+static int futex_wait(unsigned long uaddr, int fshared, int val,
+		      unsigned long time)
 {
 	DECLARE_WAITQUEUE(wait, current);
 	int ret, curval;
 	struct futex_q q;
 
-	down_read(&current->mm->mmap_sem);
+	futex_lock_mm(fshared);
 
-	ret = get_futex_key(uaddr, &q.key);
+	ret = get_futex_key(uaddr, fshared, &q.key);
 	if (unlikely(ret != 0))
 		goto out_release_sem;
 
@@ -458,7 +537,8 @@ static int futex_wait(unsigned long uaddr, int val, unsigned long time)
 	/*
 	 * Access the page after the futex is queued.
 	 * We hold the mmap semaphore, so the mapping cannot have changed
-	 * since we looked it up.
+	 * since we looked it up.  (A private futex has no mapping in its
+	 * key, so there is nothing to hold stable.)
 	 */
 	if (get_user(curval, (int *)uaddr) != 0) {
 		ret = -EFAULT;
@@ -473,7 +553,7 @@ static int futex_wait(unsigned long uaddr, int val, unsigned long time)
 	 * Now the futex is queued and we have checked the data, we
 	 * don't want to hold mmap_sem while we sleep.
 	 */	
-	up_read(&current->mm->mmap_sem);
+	futex_unlock_mm(fshared);
 
 	/*
 	 * There might have been scheduling since the queue_me(), as we
@@ -514,7 +594,7 @@ static int futex_wait(unsigned long uaddr, int val, unsigned long time)
 	if (!unqueue_me(&q))
 		ret = 0;
  out_release_sem:
-	up_read(&current->mm->mmap_sem);
+	futex_unlock_mm(fshared);
 	return ret;
 }
 
@@ -599,7 +679,7 @@ static int futex_fd(unsigned long uaddr, int signal)
 	}
 
 	down_read(&current->mm->mmap_sem);
-	err = get_futex_key(uaddr, &q->key);
+	err = get_futex_key(uaddr, 1, &q->key);
 
 	if (unlikely(err != 0)) {
 		up_read(&current->mm->mmap_sem);
@@ -624,25 +704,485 @@ out:
 	return ret;
 }
 
+#ifdef __HAVE_ARCH_CMPXCHG
+/*
+ * Priority-inheritance futexes.
+ *
+ * The futex word holds the owner's TID.  Userspace takes and releases
+ * an uncontended lock with cmpxchg alone; a contender sets
+ * FUTEX_WAITERS and sleeps here, queued on a futex_pi_state rather
+ * than on the hash chain, so FUTEX_WAKE and FUTEX_REQUEUE never see
+ * PI waiters.  Until it unlocks, the owner runs at the priority of its
+ * best waiter, and FUTEX_UNLOCK_PI hands the lock directly to that
+ * waiter instead of waking everybody up to fight over it.
+ *
+ * pi_state->waiters, pi_state->owner and task->pi_state_list are all
+ * protected by futex_pi_lock, which nests inside the hash bucket lock
+ * and outside the runqueue locks.  A pi_state exists exactly as long
+ * as it has waiters, and holds a task reference on its owner.
+ */
+struct futex_pi_state {
+	struct list_head list;		/* on futex_hash_bucket.pi_chain */
+	struct list_head owner_list;	/* on owner->pi_state_list */
+	struct list_head waiters;	/* futex_q.list, in arrival order */
+	struct task_struct *owner;	/* NULL once the owner has exited */
+	union futex_key key;
+};
+
+static spinlock_t futex_pi_lock = SPIN_LOCK_UNLOCKED;
+
+/*
+ * The word of a PI futex is modified by the kernel while holding the
+ * hash bucket lock, so we cannot take faults on it: pin the page
+ * (breaking COW) and work through the kernel mapping instead.
+ *
+ * Should be called with &current->mm->mmap_sem but NOT any spinlocks.
+ */
+static int futex_pin_page(unsigned long uaddr, struct page **page)
+{
+	int err;
+
+	err = get_user_pages(current, current->mm, uaddr, 1, 1, 0, page, NULL);
+	return err < 0 ? err : 0;
+}
+
+static inline void futex_unpin_page(struct page *page)
+{
+	set_page_dirty_lock(page);
+	page_cache_release(page);
+}
+
+/*
+ * Atomically replace the futex word with newval if it contains oldval.
+ * Returns the value found, so success is indicated by it being oldval.
+ */
+static u32 futex_cmpxchg(struct page *page, unsigned long uaddr,
+			 u32 oldval, u32 newval)
+{
+	char *kaddr;
+	u32 curval;
+
+	kaddr = kmap_atomic(page, KM_USER0);
+	curval = cmpxchg((u32 *)(kaddr + (uaddr & ~PAGE_MASK)), oldval, newval);
+	kunmap_atomic(kaddr, KM_USER0);
+	return curval;
+}
+
+/* The hash bucket lock must be held. */
+static struct futex_pi_state *lookup_pi_state(struct futex_hash_bucket *bh,
+					      union futex_key *key)
+{
+	struct futex_pi_state *pi;
+
+	list_for_each_entry(pi, &bh->pi_chain, list)
+		if (match_futex(&pi->key, key))
+			return pi;
+	return NULL;
+}
+
+/* futex_pi_lock must be held. */
+static struct futex_q *pi_top_waiter(struct futex_pi_state *pi)
+{
+	struct futex_q *this, *top = NULL;
+
+	list_for_each_entry(this, &pi->waiters, list)
+		if (!top || this->task->prio < top->task->prio)
+			top = this;
+	return top;
+}
+
+/*
+ * The owner of @pi is gone: wake the top waiter, which will inherit
+ * the lock.  It stays queued, so it is flagged to tell it why it was
+ * woken.  futex_pi_lock must be held.
+ */
+static void pi_wake_top(struct futex_pi_state *pi)
+{
+	struct futex_q *top = pi_top_waiter(pi);
+
+	top->pi_owner_died = 1;
+	wake_up_process(top->task);
+}
+
+/*
+ * Recompute the priority @owner inherits from the waiters of all the
+ * PI futexes it holds.  futex_pi_lock must be held.
+ */
+static void futex_pi_adjust(struct task_struct *owner)
+{
+	struct futex_pi_state *pi;
+	struct futex_q *top;
+	int prio = MAX_PRIO;
+
+	list_for_each_entry(pi, &owner->pi_state_list, owner_list) {
+		top = pi_top_waiter(pi);
+		if (top && top->task->prio < prio)
+			prio = top->task->prio;
+	}
+	set_task_pi_prio(owner, prio);
+}
+
+/*
+ * Look up the owner named by a futex word which has no pi_state yet.
+ * An exiting owner counts as dead: exit_futex_pi() takes futex_pi_lock
+ * after setting PF_EXITING, so checking it under that lock guarantees
+ * the owner cannot exit with our pi_state left on its list.
+ */
+static struct task_struct *futex_find_owner(pid_t pid)
+{
+	struct task_struct *p;
+
+	read_lock(&tasklist_lock);
+	p = find_task_by_pid(pid);
+	if (p && !(p->flags & PF_EXITING))
+		get_task_struct(p);
+	else
+		p = NULL;
+	read_unlock(&tasklist_lock);
+	return p;
+}
+
+/*
+ * Take a PI waiter off its pi_state after a timeout, a signal or the
+ * death of the owner.  Returns 1 if we were still queued (ie. 0 means
+ * the lock was handed over to us meanwhile).  A waiter woken to inherit
+ * the lock passes the wakeup on to the next waiter as it leaves, since
+ * it may give up with a timeout or a signal rather than inherit.  When
+ * it does inherit, the next waiter just finds a new owner and queues
+ * again.
+ */
+static int unqueue_pi(struct futex_q *q)
+{
+	struct futex_pi_state *pi, *free_pi = NULL;
+	int ret = 0;
+
+	/* PI waiters are never requeued, so q->lock_ptr is stable. */
+	spin_lock(q->lock_ptr);
+	if (!list_empty(&q->list)) {
+		spin_lock(&futex_pi_lock);
+		list_del_init(&q->list);
+		pi = q->pi_state;
+		if (list_empty(&pi->waiters)) {
+			list_del(&pi->list);
+			if (pi->owner)
+				list_del(&pi->owner_list);
+			free_pi = pi;
+		} else if (!pi->owner && q->pi_owner_died)
+			pi_wake_top(pi);
+		if (pi->owner)
+			futex_pi_adjust(pi->owner);
+		spin_unlock(&futex_pi_lock);
+		ret = 1;
+	}
+	spin_unlock(q->lock_ptr);
+
+	if (free_pi) {
+		if (free_pi->owner)
+			put_task_struct(free_pi->owner);
+		kfree(free_pi);
+	}
+	drop_key_refs(&q->key);
+	return ret;
+}
+
+static int futex_lock_pi(unsigned long uaddr, unsigned long time, int trylock)
+{
+	struct futex_pi_state *pi, *new_pi = NULL;
+	struct futex_hash_bucket *bh;
+	struct task_struct *owner;
+	struct futex_q q;
+	struct page *page;
+	u32 curval, newval, tid = current->pid;
+	int ret;
+
+ retry:
+	if (!trylock && !new_pi) {
+		new_pi = kmalloc(sizeof(*new_pi), GFP_KERNEL);
+		if (!new_pi)
+			return -ENOMEM;
+	}
+
+	down_read(&current->mm->mmap_sem);
+
+	ret = get_futex_key(uaddr, 1, &q.key);
+	if (unlikely(ret != 0))
+		goto out_release_sem;
+	ret = futex_pin_page(uaddr, &page);
+	if (unlikely(ret != 0))
+		goto out_release_sem;
+
+	bh = hash_futex(&q.key);
+	spin_lock(&bh->lock);
+	spin_lock(&futex_pi_lock);
+
+ again:
+	ret = 0;
+	curval = futex_cmpxchg(page, uaddr, 0, tid);
+	if (curval == 0)
+		goto out_unlock;
+	ret = -EDEADLK;
+	if ((curval & FUTEX_TID_MASK) == tid)
+		goto out_unlock;
+
+	pi = lookup_pi_state(bh, &q.key);
+	if (pi)
+		owner = pi->owner;
+	else
+		owner = futex_find_owner(curval & FUTEX_TID_MASK);
+
+	if (!owner) {
+		/*
+		 * The owner died holding the lock: inherit it, and tell
+		 * userspace the protected state may be inconsistent.
+		 */
+		newval = tid | FUTEX_OWNER_DIED | (pi ? FUTEX_WAITERS : 0);
+		if (futex_cmpxchg(page, uaddr, curval, newval) != curval)
+			goto again;
+		if (pi) {
+			pi->owner = current;
+			get_task_struct(current);
+			list_add(&pi->owner_list, &current->pi_state_list);
+			futex_pi_adjust(current);
+		}
+		ret = 0;
+		goto out_unlock;
+	}
+
+	ret = -EAGAIN;
+	if (trylock)
+		goto out_put_owner;
+
+	if (!(curval & FUTEX_WAITERS) &&
+	    futex_cmpxchg(page, uaddr, curval, curval | FUTEX_WAITERS) != curval) {
+		if (!pi)
+			put_task_struct(owner);
+		goto again;
+	}
+
+	if (!pi) {
+		/* The reference from futex_find_owner() goes to pi->owner. */
+		pi = new_pi;
+		new_pi = NULL;
+		INIT_LIST_HEAD(&pi->waiters);
+		pi->owner = owner;
+		pi->key = q.key;
+		list_add(&pi->list, &bh->pi_chain);
+		list_add(&pi->owner_list, &owner->pi_state_list);
+	}
+
+	q.fd = -1;
+	q.filp = NULL;
+	q.task = current;
+	q.pi_state = pi;
+	q.pi_owner_died = 0;
+	q.lock_ptr = &bh->lock;
+	get_key_refs(&q.key);
+	list_add_tail(&q.list, &pi->waiters);
+	futex_pi_adjust(owner);
+
+	/*
+	 * futex_unlock_pi() makes us the owner by taking us off the
+	 * waiters list before waking us, and exit_futex_pi() sets
+	 * q.pi_owner_died; both do so under these locks, so setting our
+	 * state before dropping them means no wakeup can be lost.  The
+	 * page is unpinned only after we sleep, as that may sleep too.
+	 */
+	set_current_state(TASK_INTERRUPTIBLE);
+	spin_unlock(&futex_pi_lock);
+	spin_unlock(&bh->lock);
+	up_read(&current->mm->mmap_sem);
+
+	if (likely(!list_empty(&q.list) && !q.pi_owner_died))
+		time = schedule_timeout(time);
+	__set_current_state(TASK_RUNNING);
+	futex_unpin_page(page);
+
+	if (!unqueue_pi(&q)) {
+		ret = 0;
+		goto out_free;
+	}
+	ret = -ETIMEDOUT;
+	if (time == 0)
+		goto out_free;
+	ret = -EINTR;
+	if (signal_pending(current))
+		goto out_free;
+	/* The owner exited: go and inherit the lock. */
+	goto retry;
+
+ out_put_owner:
+	if (!pi)
+		put_task_struct(owner);
+ out_unlock:
+	spin_unlock(&futex_pi_lock);
+	spin_unlock(&bh->lock);
+	futex_unpin_page(page);
+ out_release_sem:
+	up_read(&current->mm->mmap_sem);
+ out_free:
+	if (new_pi)
+		kfree(new_pi);
+	return ret;
+}
+
+static int futex_unlock_pi(unsigned long uaddr)
+{
+	struct futex_pi_state *pi, *free_pi = NULL;
+	struct futex_hash_bucket *bh;
+	struct task_struct *new_owner = NULL;
+	union futex_key key;
+	struct futex_q *top;
+	struct page *page;
+	u32 curval, newval, tid = current->pid;
+	int ret, more;
+
+	down_read(&current->mm->mmap_sem);
+
+	ret = get_futex_key(uaddr, 1, &key);
+	if (unlikely(ret != 0))
+		goto out;
+	ret = futex_pin_page(uaddr, &page);
+	if (unlikely(ret != 0))
+		goto out;
+
+	bh = hash_futex(&key);
+	spin_lock(&bh->lock);
+	spin_lock(&futex_pi_lock);
+
+	ret = 0;
+	curval = futex_cmpxchg(page, uaddr, tid, 0);
+	if (curval == tid)
+		goto out_unlock;
+	ret = -EPERM;
+	if ((curval & FUTEX_TID_MASK) != tid)
+		goto out_unlock;
+
+	pi = lookup_pi_state(bh, &key);
+	if (!pi) {
+		/* All the waiters gave up: just release the word. */
+		ret = 0;
+		if (futex_cmpxchg(page, uaddr, curval, 0) != curval)
+			ret = -EAGAIN;
+		goto out_unlock;
+	}
+	if (pi->owner != current)
+		goto out_unlock;
+
+	/*
+	 * Hand the lock to the top waiter.  Nobody else modifies the
+	 * word while FUTEX_WAITERS is set, so this cannot race with
+	 * userspace lockers.
+	 */
+	top = pi_top_waiter(pi);
+	more = pi->waiters.next != pi->waiters.prev;
+	newval = top->task->pid | (more ? FUTEX_WAITERS : 0);
+	ret = -EAGAIN;
+	if (futex_cmpxchg(page, uaddr, curval, newval) != curval)
+		goto out_unlock;
+
+	new_owner = top->task;
+	get_task_struct(new_owner);
+	/* After this, the waiter may return and *top must not be touched. */
+	list_del_init(&top->list);
+
+	list_del(&pi->owner_list);
+	put_task_struct(current);
+	if (more) {
+		pi->owner = new_owner;
+		get_task_struct(new_owner);
+		list_add(&pi->owner_list, &new_owner->pi_state_list);
+		futex_pi_adjust(new_owner);
+	} else {
+		list_del(&pi->list);
+		free_pi = pi;
+	}
+	futex_pi_adjust(current);
+	wake_up_process(new_owner);
+	ret = 0;
+
+ out_unlock:
+	spin_unlock(&futex_pi_lock);
+	spin_unlock(&bh->lock);
+	futex_unpin_page(page);
+ out:
+	up_read(&current->mm->mmap_sem);
+	if (new_owner)
+		put_task_struct(new_owner);
+	if (free_pi)
+		kfree(free_pi);
+	return ret;
+}
+
+/*
+ * Called from do_exit() once PF_EXITING is set.  The dying task can no
+ * longer release the PI futexes it holds, so detach them and wake each
+ * top waiter, which will inherit the lock with FUTEX_OWNER_DIED set.
+ */
+void exit_futex_pi(struct task_struct *tsk)
+{
+	struct futex_pi_state *pi;
+	int refs = 0;
+
+	spin_lock(&futex_pi_lock);
+	while (!list_empty(&tsk->pi_state_list)) {
+		pi = list_entry(tsk->pi_state_list.next,
+				struct futex_pi_state, owner_list);
+		list_del_init(&pi->owner_list);
+		pi->owner = NULL;
+		pi_wake_top(pi);
+		refs++;
+	}
+	set_task_pi_prio(tsk, MAX_PRIO);
+	spin_unlock(&futex_pi_lock);
+
+	while (--refs >= 0)
+		put_task_struct(tsk);
+}
+#else
+/* Without an atomic cmpxchg we cannot implement the PI protocol. */
+void exit_futex_pi(struct task_struct *tsk)
+{
+}
+#endif
+
 long do_futex(unsigned long uaddr, int op, int val, unsigned long timeout,
-		unsigned long uaddr2, int val2)
+		unsigned long uaddr2, int val2, int val3)
 {
+	int fshared = !(op & FUTEX_PRIVATE_FLAG);
 	int ret;
 
-	switch (op) {
+	/*
+	 * FUTEX_FD and the PI operations need mmap_sem anyway, so they
+	 * simply ignore FUTEX_PRIVATE_FLAG.
+	 */
+	switch (op & FUTEX_CMD_MASK) {
 	case FUTEX_WAIT:
-		ret = futex_wait(uaddr, val, timeout);
+		ret = futex_wait(uaddr, fshared, val, timeout);
 		break;
 	case FUTEX_WAKE:
-		ret = futex_wake(uaddr, val);
+		ret = futex_wake(uaddr, fshared, val);
 		break;
 	case FUTEX_FD:
 		/* non-zero val means F_SETOWN(getpid()) & F_SETSIG(val) */
 		ret = futex_fd(uaddr, val);
 		break;
 	case FUTEX_REQUEUE:
-		ret = futex_requeue(uaddr, uaddr2, val, val2);
+		ret = futex_requeue(uaddr, uaddr2, fshared, val, val2, NULL);
+		break;
+	case FUTEX_CMP_REQUEUE:
+		ret = futex_requeue(uaddr, uaddr2, fshared, val, val2, &val3);
 		break;
+#ifdef __HAVE_ARCH_CMPXCHG
+	case FUTEX_LOCK_PI:
+		ret = futex_lock_pi(uaddr, timeout, 0);
+		break;
+	case FUTEX_UNLOCK_PI:
+		ret = futex_unlock_pi(uaddr);
+		break;
+	case FUTEX_TRYLOCK_PI:
+		ret = futex_lock_pi(uaddr, 0, 1);
+		break;
+#endif
 	default:
 		ret = -ENOSYS;
 	}
@@ -651,25 +1191,28 @@ long do_futex(unsigned long uaddr, int op, int val, unsigned long timeout,
 
 
 asmlinkage long sys_futex(u32 __user *uaddr, int op, int val,
-			  struct timespec __user *utime, u32 __user *uaddr2)
+			  struct timespec __user *utime, u32 __user *uaddr2,
+			  int val3)
 {
 	struct timespec t;
 	unsigned long timeout = MAX_SCHEDULE_TIMEOUT;
 	int val2 = 0;
+	int cmd = op & FUTEX_CMD_MASK;
 
-	if ((op == FUTEX_WAIT) && utime) {
+	if ((cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI) && utime) {
 		if (copy_from_user(&t, utime, sizeof(t)) != 0)
 			return -EFAULT;
 		timeout = timespec_to_jiffies(&t) + 1;
 	}
 	/*
-	 * requeue parameter in 'utime' if op == FUTEX_REQUEUE.
+	 * requeue parameter in 'utime' if op == FUTEX_REQUEUE
+	 * or FUTEX_CMP_REQUEUE.
 	 */
-	if (op == FUTEX_REQUEUE)
+	if (cmd == FUTEX_REQUEUE || cmd == FUTEX_CMP_REQUEUE)
 		val2 = (int) (long) utime;
 
 	return do_futex((unsigned long)uaddr, op, val, timeout,
-			(unsigned long)uaddr2, val2);
+			(unsigned long)uaddr2, val2, val3);
 }
 
 static struct super_block *
@@ -687,13 +1230,42 @@ static struct file_system_type futex_fs_type = {
 
 static int __init init(void)
 {
-	unsigned int i;
+	unsigned long i, size, nr;
+	int order;
 
 	register_filesystem(&futex_fs_type);
 	futex_mnt = kern_mount(&futex_fs_type);
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
+	/*
+	 * 256 buckets per cpu, but no more than one per 16 pages of
+	 * memory, rounded down to a power of two.
+	 */
+	nr = 256 * num_online_cpus();
+	if (nr > (num_physpages >> 4))
+		nr = num_physpages >> 4;
+	size = nr * sizeof(struct futex_hash_bucket);
+
+	for (order = 0; (PAGE_SIZE << order) < size; order++)
+		/* NOTHING */;
+
+	do {
+		nr = (PAGE_SIZE << order) / sizeof(struct futex_hash_bucket);
+		while (nr & (nr - 1))
+			nr--;
+		futex_queues = (struct futex_hash_bucket *)
+			__get_free_pages(GFP_KERNEL, order);
+	} while (futex_queues == NULL && --order >= 0);
+
+	if (!futex_queues)
+		panic("Failed to allocate futex hash table\n");
+
+	printk(KERN_INFO "Futex hash table of %lu buckets, %luKbytes\n",
+	       nr, (nr * sizeof(struct futex_hash_bucket)) / 1024);
+	futex_hashmask = nr - 1;
+
+	for (i = 0; i < nr; i++) {
 		INIT_LIST_HEAD(&futex_queues[i].chain);
+		INIT_LIST_HEAD(&futex_queues[i].pi_chain);
 		futex_queues[i].lock = SPIN_LOCK_UNLOCKED;
 	}
 	return 0;
@@ -0,0 +1,807 @@
+/*
+ *  linux/kernel/hrtimer.c
+ *
+ *  High-resolution kernel timers
+ *
+ *  The timer wheel in kernel/timer.c is optimized for the common case
+ *  of timeouts which are cancelled long before they expire, and can
+ *  do no better than jiffy resolution.  hrtimers are for the other
+ *  case: sleeps and interval timers that actually expire and want to
+ *  do so at the right time.  They are kept sorted in a per-cpu rbtree
+ *  and expired from a one-shot clock event device, which also stands
+ *  in for the periodic local timer interrupt of that cpu.
+ *
+ *  With CONFIG_NO_IDLE_HZ an idle cpu pushes that emulated tick out
+ *  to its next timer_list timer, see hrtimer_stop_tick().
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/init.h>
+#include <linux/notifier.h>
+#include <linux/cpu.h>
+#include <linux/interrupt.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/rcupdate.h>
+#include <linux/hrtimer.h>
+
+#include <asm/uaccess.h>
+#include <asm/div64.h>
+
+struct hrtimer_base {
+	spinlock_t		lock;
+	struct rb_root		active;
+	struct rb_node		*first;		/* leftmost, ie. next to expire */
+	struct hrtimer		*running;	/* callback in progress */
+
+	struct clock_event_device *event;	/* NULL: run from the tick */
+	ktime_t			next_event;	/* what event is armed for */
+	ktime_t			next_tick;	/* emulated periodic tick */
+
+	/* Statistics, see /proc/hrtimers */
+	unsigned long		nr_events;
+	unsigned long		nr_expired;
+	u64			lat_total;
+	ktime_t			lat_max;
+
+#ifdef CONFIG_NO_IDLE_HZ
+	int			tick_stopped;
+	unsigned long		idle_jiffies;	/* jiffies when stopped */
+	ktime_t			idle_tick;	/* next_tick when stopped */
+	unsigned long		nr_idle_stops;
+	unsigned long		nr_idle_skipped; /* ticks slept through */
+#endif
+} ____cacheline_aligned_in_smp;
+
+static DEFINE_PER_CPU(struct hrtimer_base, hrtimer_bases);
+
+/* Number of cpus which have a clock event device. */
+static int hrtimer_hres_cpus;
+
+static int hrtimer_hres_enabled = 1;
+
+static int __init setup_hrtimer_hres(char *str)
+{
+	if (!strcmp(str, "off"))
+		hrtimer_hres_enabled = 0;
+	else if (!strcmp(str, "on"))
+		hrtimer_hres_enabled = 1;
+	else
+		return 0;
+	return 1;
+}
+
+__setup("highres=", setup_hrtimer_hres);
+
+/**
+ * ktime_get - get the current CLOCK_MONOTONIC time in nanoseconds
+ */
+ktime_t ktime_get(void)
+{
+	struct timespec ts;
+
+	do_posix_clock_monotonic_gettime(&ts);
+	return timespec_to_ktime(&ts);
+}
+
+EXPORT_SYMBOL(ktime_get);
+
+/**
+ * hrtimer_resolution - the expiry precision hrtimers can honour
+ */
+unsigned long hrtimer_resolution(void)
+{
+	/* do_gettimeofday() gives microseconds */
+	return hrtimer_hres_cpus ? NSEC_PER_USEC : TICK_NSEC;
+}
+
+/*
+ * The timer can be migrated to another base by hrtimer_start(), which
+ * sets ->base to NULL while it holds neither lock.
+ */
+static struct hrtimer_base *lock_hrtimer_base(struct hrtimer *timer,
+					      unsigned long *flags)
+{
+	struct hrtimer_base *base;
+
+	for (;;) {
+		base = timer->base;
+		if (likely(base != NULL)) {
+			spin_lock_irqsave(&base->lock, *flags);
+			if (likely(base == timer->base))
+				return base;
+			spin_unlock_irqrestore(&base->lock, *flags);
+		}
+		cpu_relax();
+	}
+}
+
+/*
+ * Arm the clock event device for the earlier of the first timer and
+ * the next emulated tick.  base->lock must be held, with irqs off.
+ */
+static void hrtimer_reprogram(struct hrtimer_base *base, ktime_t now)
+{
+	struct clock_event_device *evt = base->event;
+	ktime_t expires = base->next_tick;
+	s64 delta;
+
+	if (base->first) {
+		struct hrtimer *timer;
+
+		timer = rb_entry(base->first, struct hrtimer, node);
+		if (timer->expires < expires)
+			expires = timer->expires;
+	}
+	base->next_event = expires;
+
+	delta = expires - now;
+	if (delta < (s64)evt->min_delta_ns)
+		delta = evt->min_delta_ns;
+	if (delta > (s64)evt->max_delta_ns)
+		delta = evt->max_delta_ns;
+	evt->set_next_event((unsigned long)delta);
+}
+
+/*
+ * Timers with equal expiry times are expired in the order they were
+ * queued, so walk right on equality.
+ */
+static void enqueue_hrtimer(struct hrtimer *timer, struct hrtimer_base *base)
+{
+	struct rb_node **link = &base->active.rb_node;
+	struct rb_node *parent = NULL;
+	struct hrtimer *entry;
+	int leftmost = 1;
+
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct hrtimer, node);
+		if (timer->expires < entry->expires)
+			link = &(*link)->rb_left;
+		else {
+			link = &(*link)->rb_right;
+			leftmost = 0;
+		}
+	}
+	rb_link_node(&timer->node, parent, link);
+	rb_insert_color(&timer->node, &base->active);
+	timer->state = HRTIMER_ENQUEUED;
+
+	if (!leftmost)
+		return;
+	base->first = &timer->node;
+
+	/*
+	 * Only the local event device can be reprogrammed, and not from
+	 * inside hrtimer_interrupt(), which does so when it is done.
+	 */
+	if (base->event && !base->running &&
+	    base == &__get_cpu_var(hrtimer_bases) &&
+	    timer->expires < base->next_event)
+		hrtimer_reprogram(base, ktime_get());
+}
+
+/* Returns 1 if the timer was queued. */
+static int remove_hrtimer(struct hrtimer *timer, struct hrtimer_base *base)
+{
+	if (timer->state != HRTIMER_ENQUEUED)
+		return 0;
+
+	if (base->first == &timer->node)
+		base->first = rb_next(&timer->node);
+	rb_erase(&timer->node, &base->active);
+	timer->state = HRTIMER_INACTIVE;
+	/*
+	 * We don't reprogram the event device: an early interrupt
+	 * finds nothing to do and arms it for the next timer.
+	 */
+	return 1;
+}
+
+/**
+ * hrtimer_init - initialize a timer before it is first used
+ * @timer: the timer to be initialized
+ *
+ * The caller sets ->function and ->data afterwards.
+ */
+void hrtimer_init(struct hrtimer *timer)
+{
+	memset(timer, 0, sizeof(*timer));
+	timer->base = &per_cpu(hrtimer_bases, 0);
+	timer->state = HRTIMER_INACTIVE;
+}
+
+EXPORT_SYMBOL(hrtimer_init);
+
+/**
+ * hrtimer_start - (re)start a timer on the current CPU
+ * @timer: the timer to be added
+ * @expires: absolute CLOCK_MONOTONIC expiry time
+ *
+ * Returns 1 if the timer was pending and has been moved, 0 otherwise.
+ */
+int hrtimer_start(struct hrtimer *timer, ktime_t expires)
+{
+	struct hrtimer_base *base, *new_base;
+	unsigned long flags;
+	int ret;
+
+	base = lock_hrtimer_base(timer, &flags);
+	ret = remove_hrtimer(timer, base);
+
+	/*
+	 * Move the timer to this cpu, unless its callback is running
+	 * on the old base: the callback may rely on that.
+	 */
+	new_base = &__get_cpu_var(hrtimer_bases);
+	if (base != new_base && base->running != timer) {
+		timer->base = NULL;
+		spin_unlock(&base->lock);
+		spin_lock(&new_base->lock);
+		timer->base = new_base;
+		base = new_base;
+	}
+
+	timer->expires = expires;
+	enqueue_hrtimer(timer, base);
+	spin_unlock_irqrestore(&base->lock, flags);
+
+	return ret;
+}
+
+EXPORT_SYMBOL(hrtimer_start);
+
+/**
+ * hrtimer_try_to_cancel - try to deactivate a timer
+ * @timer: the timer to be deactivated
+ *
+ * Returns 0 if the timer was not active, 1 if it was and has been
+ * deactivated, and -1 if its callback is running and it cannot be
+ * stopped right now.
+ */
+int hrtimer_try_to_cancel(struct hrtimer *timer)
+{
+	struct hrtimer_base *base;
+	unsigned long flags;
+	int ret = -1;
+
+	base = lock_hrtimer_base(timer, &flags);
+	if (base->running != timer)
+		ret = remove_hrtimer(timer, base);
+	spin_unlock_irqrestore(&base->lock, flags);
+
+	return ret;
+}
+
+EXPORT_SYMBOL(hrtimer_try_to_cancel);
+
+/**
+ * hrtimer_cancel - deactivate a timer and wait for the handler to finish
+ * @timer: the timer to be deactivated
+ *
+ * Must not be called from the timer's own callback.
+ */
+int hrtimer_cancel(struct hrtimer *timer)
+{
+	for (;;) {
+		int ret = hrtimer_try_to_cancel(timer);
+
+		if (ret >= 0)
+			return ret;
+		cpu_relax();
+	}
+}
+
+EXPORT_SYMBOL(hrtimer_cancel);
+
+/*
+ * 64-bit division with a possibly 64-bit divisor: scale both down
+ * until the divisor fits do_div().  The result may be slightly off,
+ * hrtimer_forward() corrects for that.
+ */
+static unsigned long ktime_divns(ktime_t kt, s64 div)
+{
+	u64 dclc = (u64)kt;
+	int sft = 0;
+
+	while (div >> 32) {
+		sft++;
+		div >>= 1;
+	}
+	dclc >>= sft;
+	do_div(dclc, (unsigned long)div);
+
+	return (unsigned long)dclc;
+}
+
+/**
+ * hrtimer_forward - move the expiry of a timer past now
+ * @timer: the timer, which must not be queued
+ * @now: the current time
+ * @interval: the period, which must not be zero
+ *
+ * Returns the number of periods the timer was moved by, which is
+ * 0 if it had not expired yet.
+ */
+unsigned long hrtimer_forward(struct hrtimer *timer, ktime_t now,
+			      ktime_t interval)
+{
+	unsigned long orun = 1;
+	s64 delta;
+
+	delta = now - timer->expires;
+	if (delta < 0)
+		return 0;
+
+	if (delta >= interval) {
+		orun = ktime_divns(delta, interval);
+		timer->expires += interval * orun;
+		if (timer->expires > now)
+			return orun;
+		/*
+		 * This (and maybe the approximation in ktime_divns())
+		 * leaves us one period short:
+		 */
+		orun++;
+	}
+	timer->expires += interval;
+	while (unlikely(timer->expires <= now)) {
+		timer->expires += interval;
+		orun++;
+	}
+	return orun;
+}
+
+EXPORT_SYMBOL(hrtimer_forward);
+
+/*
+ * Expire all timers which are due at @now.  Called with base->lock
+ * held and irqs off; the lock is dropped around each callback.
+ */
+static void __run_hrtimers(struct hrtimer_base *base, ktime_t now)
+{
+	struct hrtimer *timer;
+	int (*fn)(struct hrtimer *);
+	ktime_t lat;
+	int restart;
+
+	while (base->first) {
+		timer = rb_entry(base->first, struct hrtimer, node);
+		if (now < timer->expires)
+			break;
+
+		lat = now - timer->expires;
+		base->nr_expired++;
+		base->lat_total += lat;
+		if (lat > base->lat_max)
+			base->lat_max = lat;
+
+		fn = timer->function;
+		remove_hrtimer(timer, base);
+		base->running = timer;
+		spin_unlock(&base->lock);
+
+		restart = fn(timer);
+
+		spin_lock(&base->lock);
+		/*
+		 * hrtimer_cancel() waits for base->running to change,
+		 * so the timer can still be touched here.
+		 */
+		if (restart == HRTIMER_RESTART &&
+		    timer->state == HRTIMER_INACTIVE)
+			enqueue_hrtimer(timer, base);
+		base->running = NULL;
+	}
+}
+
+/**
+ * hrtimer_interrupt - called by the clock event device's interrupt
+ *
+ * Runs the expired timers and rearms the device.  Returns the number
+ * of emulated periodic ticks that have come due since the last call;
+ * the caller must do the work of its local timer interrupt once for
+ * each of them.
+ */
+int hrtimer_interrupt(void)
+{
+	struct hrtimer_base *base = &__get_cpu_var(hrtimer_bases);
+	ktime_t now = ktime_get();
+	int ticks = 0;
+
+	spin_lock(&base->lock);
+	base->nr_events++;
+
+	__run_hrtimers(base, now);
+
+	while (now >= base->next_tick) {
+		base->next_tick += TICK_NSEC;
+		ticks++;
+	}
+	hrtimer_reprogram(base, now);
+	spin_unlock(&base->lock);
+
+	return ticks;
+}
+
+#ifdef CONFIG_NO_IDLE_HZ
+cpumask_t nohz_cpu_mask = CPU_MASK_NONE;
+
+static int hrtimer_nohz_enabled = 1;
+
+static int __init setup_hrtimer_nohz(char *str)
+{
+	if (!strcmp(str, "off"))
+		hrtimer_nohz_enabled = 0;
+	else if (!strcmp(str, "on"))
+		hrtimer_nohz_enabled = 1;
+	else
+		return 0;
+	return 1;
+}
+
+__setup("nohz=", setup_hrtimer_nohz);
+
+/**
+ * hrtimer_stop_tick - stop the local tick of an idle cpu
+ *
+ * Called by the idle loop each time before it sleeps.  Pushes the
+ * emulated tick out to the jiffy the first timer_list timer of this
+ * cpu is due at, or by a second at most, unless the cpu has RCU work
+ * or is about to leave the idle loop anyway.  hrtimers are not
+ * affected.  A cpu with its tick stopped is in nohz_cpu_mask and is
+ * left out of new RCU batches.
+ */
+void hrtimer_stop_tick(void)
+{
+	struct hrtimer_base *base;
+	unsigned long flags, next, target;
+	ktime_t next_tick;
+	int cpu;
+
+	if (!hrtimer_nohz_enabled)
+		return;
+
+	local_irq_save(flags);
+	cpu = smp_processor_id();
+	base = &per_cpu(hrtimer_bases, cpu);
+	if (!base->event || need_resched() || local_softirq_pending() ||
+	    rcu_pending(cpu))
+		goto out;
+
+	target = jiffies;
+	next = next_timer_interrupt();
+	if (time_after(next, target + HZ))
+		target += HZ;
+	else if (time_after(next, target + 1))
+		target = next;
+	else if (!base->tick_stopped)
+		goto out;
+	else
+		target++;
+
+	if (!base->tick_stopped) {
+		cpu_set(cpu, nohz_cpu_mask);
+		smp_mb();
+		/* rcu_start_batch() may have missed us */
+		if (rcu_pending(cpu)) {
+			cpu_clear(cpu, nohz_cpu_mask);
+			goto out;
+		}
+	}
+
+	spin_lock(&base->lock);
+	if (!base->tick_stopped) {
+		base->tick_stopped = 1;
+		base->idle_jiffies = jiffies;
+		base->idle_tick = base->next_tick;
+		base->nr_idle_stops++;
+	}
+	/* idle_tick is roughly when jiffies became idle_jiffies + 1 */
+	next_tick = base->idle_tick +
+		(ktime_t)(target - base->idle_jiffies - 1) * TICK_NSEC;
+	if (next_tick != base->next_tick) {
+		base->next_tick = next_tick;
+		hrtimer_reprogram(base, ktime_get());
+	}
+	spin_unlock(&base->lock);
+out:
+	local_irq_restore(flags);
+}
+
+/**
+ * hrtimer_restart_tick - restart the local tick when leaving idle
+ *
+ * Puts the emulated tick back on its old phase and accounts the ticks
+ * we slept through as idle time, less one if the tick is due already:
+ * the pending interrupt takes that one.
+ */
+void hrtimer_restart_tick(void)
+{
+	struct hrtimer_base *base;
+	unsigned long flags;
+	long skipped;
+	ktime_t now;
+
+	local_irq_save(flags);
+	base = &__get_cpu_var(hrtimer_bases);
+	if (!base->tick_stopped)
+		goto out;
+
+	/*
+	 * Out of nohz_cpu_mask before anything can enter an RCU read-side
+	 * section: a batch which missed us was started before that.
+	 */
+	cpu_clear(smp_processor_id(), nohz_cpu_mask);
+	smp_mb();
+
+	spin_lock(&base->lock);
+	base->tick_stopped = 0;
+	now = ktime_get();
+	skipped = jiffies - base->idle_jiffies - (base->next_tick <= now);
+	if (skipped > 0)
+		base->nr_idle_skipped += skipped;
+	if (base->next_tick > now)
+		base->next_tick -= (ktime_t)TICK_NSEC *
+			ktime_divns(base->next_tick - now, TICK_NSEC);
+	hrtimer_reprogram(base, now);
+	spin_unlock(&base->lock);
+
+	if (skipped > 0)
+		account_idle_ticks(skipped);
+out:
+	local_irq_restore(flags);
+}
+
+/*
+ * Called by irq_enter().  An interrupt taking the cpu out of tickless
+ * idle restarts the tick before any handler runs, so the handlers are
+ * not hidden from RCU.  Only the idle loop stops it again, after its
+ * last rcu_pending() check.
+ */
+void hrtimer_irq_enter(void)
+{
+	if (unlikely(__get_cpu_var(hrtimer_bases).tick_stopped))
+		hrtimer_restart_tick();
+}
+#endif
+
+/*
+ * Called from the tick on cpus without a clock event device.
+ */
+void hrtimer_run_queues(void)
+{
+	struct hrtimer_base *base = &__get_cpu_var(hrtimer_bases);
+	unsigned long flags;
+
+	if (base->event || !base->first)
+		return;
+
+	spin_lock_irqsave(&base->lock, flags);
+	__run_hrtimers(base, ktime_get());
+	spin_unlock_irqrestore(&base->lock, flags);
+}
+
+/**
+ * hrtimer_register_event - drive this cpu's hrtimers by a clock event
+ * @evt: the one-shot device, which is armed before this returns
+ *
+ * Called by the architecture on each cpu with a suitable device.
+ * From then on the device also generates the local tick, see
+ * hrtimer_interrupt().  Returns -ENODEV if booted with highres=off.
+ */
+int hrtimer_register_event(struct clock_event_device *evt)
+{
+	struct hrtimer_base *base = &__get_cpu_var(hrtimer_bases);
+	unsigned long flags;
+	ktime_t now;
+
+	if (!hrtimer_hres_enabled)
+		return -ENODEV;
+
+	spin_lock_irqsave(&base->lock, flags);
+	base->event = evt;
+	now = ktime_get();
+	base->next_tick = now + TICK_NSEC;
+	hrtimer_reprogram(base, now);
+	spin_unlock_irqrestore(&base->lock, flags);
+
+	hrtimer_hres_cpus++;
+	printk(KERN_INFO "CPU%d: high-resolution timers using %s\n",
+	       smp_processor_id(), evt->name);
+	return 0;
+}
+
+static int hrtimer_wakeup(struct hrtimer *timer)
+{
+	struct task_struct *task = (struct task_struct *)timer->data;
+
+	timer->data = 0;
+	wake_up_process(task);
+
+	return HRTIMER_NORESTART;
+}
+
+/**
+ * hrtimer_sleep_until - sleep until a CLOCK_MONOTONIC time
+ * @timer: an initialized, inactive timer
+ * @expires: the wakeup time
+ *
+ * Sleeps interruptibly, once: any wakeup ends the sleep.  Returns 1 if
+ * the timer expired, 0 if we were woken early.
+ */
+int hrtimer_sleep_until(struct hrtimer *timer, ktime_t expires)
+{
+	timer->function = hrtimer_wakeup;
+	timer->data = (unsigned long)current;
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	hrtimer_start(timer, expires);
+	if (likely(timer->data))
+		schedule();
+	hrtimer_cancel(timer);
+	__set_current_state(TASK_RUNNING);
+
+	return timer->data == 0;
+}
+
+EXPORT_SYMBOL(hrtimer_sleep_until);
+
+static long nanosleep_restart(struct restart_block *restart);
+
+static long do_hrtimer_nanosleep(ktime_t expires,
+				 struct timespec __user *rmtp)
+{
+	struct restart_block *restart;
+	struct hrtimer timer;
+	struct timespec t;
+	ktime_t rem;
+
+	hrtimer_init(&timer);
+	do {
+		if (hrtimer_sleep_until(&timer, expires))
+			return 0;
+	} while (!signal_pending(current));
+
+	rem = expires - ktime_get();
+	if (rem <= 0)
+		return 0;
+
+	t = ktime_to_timespec(rem);
+	if (rmtp && copy_to_user(rmtp, &t, sizeof(t)))
+		return -EFAULT;
+
+	restart = &current_thread_info()->restart_block;
+	restart->fn = nanosleep_restart;
+	restart->arg0 = (unsigned long) rmtp;
+	restart->arg1 = (u64)expires & 0xffffffff;
+	restart->arg2 = (u64)expires >> 32;
+	return -ERESTART_RESTARTBLOCK;
+}
+
+static long nanosleep_restart(struct restart_block *restart)
+{
+	ktime_t expires;
+
+	expires = ((u64)restart->arg2 << 32) | restart->arg1;
+	return do_hrtimer_nanosleep(expires,
+			    (struct timespec __user *) restart->arg0);
+}
+
+/**
+ * hrtimer_nanosleep - the body of sys_nanosleep()
+ * @rqtp: the (validated) relative sleep time
+ * @rmtp: where to store the remaining time if interrupted
+ */
+long hrtimer_nanosleep(struct timespec *rqtp, struct timespec __user *rmtp)
+{
+	return do_hrtimer_nanosleep(ktime_get() + timespec_to_ktime(rqtp), rmtp);
+}
+
+static void __devinit init_hrtimers_cpu(int cpu)
+{
+	struct hrtimer_base *base = &per_cpu(hrtimer_bases, cpu);
+
+	spin_lock_init(&base->lock);
+	base->active = RB_ROOT;
+	base->first = NULL;
+	base->running = NULL;
+	base->event = NULL;
+}
+
+static int __devinit hrtimer_cpu_notify(struct notifier_block *self,
+					unsigned long action, void *hcpu)
+{
+	long cpu = (long)hcpu;
+
+	switch(action) {
+	case CPU_UP_PREPARE:
+		init_hrtimers_cpu(cpu);
+		break;
+	default:
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __devinitdata hrtimers_nb = {
+	.notifier_call	= hrtimer_cpu_notify,
+};
+
+void __init hrtimers_init(void)
+{
+	hrtimer_cpu_notify(&hrtimers_nb, (unsigned long)CPU_UP_PREPARE,
+			   (void *)(long)smp_processor_id());
+	register_cpu_notifier(&hrtimers_nb);
+}
+
+#ifdef CONFIG_PROC_FS
+/*
+ * Per-cpu expiry statistics: latency is the time from a timer's
+ * expiry time to the start of its callback.
+ */
+static int proc_hrtimers_show(struct seq_file *m, void *v)
+{
+	struct hrtimer_base *base;
+	u64 avg;
+	int cpu;
+
+	seq_printf(m, "resolution: %lu ns\n", hrtimer_resolution());
+	seq_printf(m, "CPU %12s %12s %12s %12s  device\n",
+		   "events", "expired", "avg_lat_ns", "max_lat_ns");
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		if (!cpu_online(cpu))
+			continue;
+		base = &per_cpu(hrtimer_bases, cpu);
+		avg = base->lat_total;
+		if (base->nr_expired)
+			do_div(avg, base->nr_expired);
+		seq_printf(m, "%3d %12lu %12lu %12llu %12llu  %s\n", cpu,
+			   base->nr_events, base->nr_expired,
+			   (unsigned long long)avg,
+			   (unsigned long long)base->lat_max,
+			   base->event ? base->event->name : "tick");
+	}
+#ifdef CONFIG_NO_IDLE_HZ
+	seq_printf(m, "\nCPU %12s %12s  (tickless idle)\n",
+		   "stops", "skipped");
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		if (!cpu_online(cpu))
+			continue;
+		base = &per_cpu(hrtimer_bases, cpu);
+		seq_printf(m, "%3d %12lu %12lu\n", cpu,
+			   base->nr_idle_stops, base->nr_idle_skipped);
+	}
+#endif
+	return 0;
+}
+
+static int proc_hrtimers_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, proc_hrtimers_show, NULL);
+}
+
+static struct file_operations proc_hrtimers_operations = {
+	.open		= proc_hrtimers_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init proc_hrtimers_init(void)
+{
+	struct proc_dir_entry *e;
+
+	e = create_proc_entry("hrtimers", 0, NULL);
+	if (e)
+		e->proc_fops = &proc_hrtimers_operations;
+
+	return 0;
+}
+
+__initcall(proc_hrtimers_init);
+#endif
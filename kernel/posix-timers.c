@@ -22,6 +22,7 @@
 #include <linux/compiler.h>
 #include <linux/idr.h>
 #include <linux/posix-timers.h>
+#include <linux/hrtimer.h>
 #include <linux/wait.h>
 
 #ifndef div_long_long_rem
@@ -35,10 +36,6 @@
 #endif
 #define CLOCK_REALTIME_RES TICK_NSEC  // In nano seconds.
 
-static inline u64  mpy_l_X_l_ll(unsigned long mpy1,unsigned long mpy2)
-{
-	return (u64)mpy1 * mpy2;
-}
 /*
  * Management arrays for POSIX timers.	 Timers are kept in slab memory
  * Timer ids are allocated by an external routine that keeps track of the
@@ -65,24 +62,12 @@ static struct idr posix_timers_id;
 static spinlock_t idr_lock = SPIN_LOCK_UNLOCKED;
 
 /*
- * Just because the timer is not in the timer list does NOT mean it is
- * inactive.  It could be in the "fire" routine getting a new expire time.
+ * Just because the timer is not queued does NOT mean it is inactive.
+ * It could be in the "fire" routine, in which case hrtimer_try_to_cancel()
+ * fails and we have to drop the timer lock and retry.
  */
-#define TIMER_INACTIVE 1
 #define TIMER_RETRY 1
 
-#ifdef CONFIG_SMP
-# define timer_active(tmr) \
-		((tmr)->it_timer.entry.prev != (void *)TIMER_INACTIVE)
-# define set_timer_inactive(tmr) \
-		do { \
-			(tmr)->it_timer.entry.prev = (void *)TIMER_INACTIVE; \
-		} while (0)
-#else
-# define timer_active(tmr) BARFY	// error to use outside of SMP
-# define set_timer_inactive(tmr) do { } while (0)
-#endif
-
 /*
  * For some reason mips/mips64 define the SIGEV constants plus 128.
  * Here we define a mask to get rid of the common bits.	 The
@@ -110,8 +95,8 @@ static spinlock_t idr_lock = SPIN_LOCK_UNLOCKED;
  *	    clocks and allows the possibility of adding others.	 We
  *	    provide an interface to add clocks to the table and expect
  *	    the "arch" code to add at least one clock that is high
- *	    resolution.	 Here we define the standard CLOCK_REALTIME as a
- *	    1/HZ resolution clock.
+ *	    resolution.	 Timers on the standard clocks are hrtimers, so
+ *	    their resolution is whatever hrtimer_resolution() says.
  *
  * CPUTIME & THREAD_CPUTIME: We are not, at this time, definding these
  *	    two clocks (and the other process related clocks (Std
@@ -198,44 +183,40 @@ static __init int init_posix_timers(void)
 
 __initcall(init_posix_timers);
 
-static void tstojiffie(struct timespec *tp, int res, u64 *jiff)
+/*
+ * Convert a timer or sleep expiry time on @clock to the absolute
+ * CLOCK_MONOTONIC time hrtimers run on.  An absolute time on a settable
+ * clock is converted at the current offset between the two clocks;
+ * clock_was_set() tells the sleepers when that changes.
+ */
+static ktime_t clock_to_mono(struct k_clock *clock, struct timespec *tp,
+			     int abs)
 {
-	long sec = tp->tv_sec;
-	long nsec = tp->tv_nsec + res - 1;
+	struct timespec now;
+	ktime_t mono = ktime_get();
 
-	if (nsec > NSEC_PER_SEC) {
-		sec++;
-		nsec -= NSEC_PER_SEC;
-	}
+	if (!abs)
+		return mono + timespec_to_ktime(tp);
 
-	/*
-	 * The scaling constants are defined in <linux/time.h>
-	 * The difference between there and here is that we do the
-	 * res rounding and compute a 64-bit result (well so does that
-	 * but it then throws away the high bits).
-  	 */
-	*jiff =  (mpy_l_X_l_ll(sec, SEC_CONVERSION) +
-		  (mpy_l_X_l_ll(nsec, NSEC_CONVERSION) >> 
-		   (NSEC_JIFFIE_SC - SEC_JIFFIE_SC))) >> SEC_JIFFIE_SC;
+	if (clock->clock_get == posix_clocks[CLOCK_MONOTONIC].clock_get)
+		return timespec_to_ktime(tp);
+
+	do_posix_gettime(clock, &now);
+	return mono + timespec_to_ktime(tp) - timespec_to_ktime(&now);
 }
 
 static void schedule_next_timer(struct k_itimer *timr)
 {
-	struct now_struct now;
-
 	/* Set up the timer for the next interval (if there is one) */
 	if (!timr->it_incr) 
 		return;
 
-	posix_get_now(&now);
-	do {
-		posix_bump_timer(timr);
-	}while (posix_time_before(&timr->it_timer, &now));
-
+	timr->it_overrun += hrtimer_forward(&timr->it_timer, ktime_get(),
+					    timr->it_incr);
 	timr->it_overrun_last = timr->it_overrun;
 	timr->it_overrun = -1;
 	++timr->it_requeue_pending;
-	add_timer(&timr->it_timer);
+	hrtimer_start(&timr->it_timer, timr->it_timer.expires);
 }
 
 /*
@@ -319,18 +300,19 @@ static void timer_notify_task(struct k_itimer *timr)
 
 /*
  * This function gets called when a POSIX.1b interval timer expires.  It
- * is used as a callback from the kernel internal timer.  The
- * run_timer_list code ALWAYS calls with interrutps on.
+ * is used as a callback from the hrtimer code, in interrupt context.
+ * Interval timers are requeued when the signal is delivered, not here.
  */
-static void posix_timer_fn(unsigned long __data)
+static int posix_timer_fn(struct hrtimer *timer)
 {
-	struct k_itimer *timr = (struct k_itimer *) __data;
+	struct k_itimer *timr = (struct k_itimer *) timer->data;
 	unsigned long flags;
 
 	spin_lock_irqsave(&timr->it_lock, flags);
- 	set_timer_inactive(timr);
 	timer_notify_task(timr);
 	unlock_timer(timr, flags);
+
+	return HRTIMER_NORESTART;
 }
 
 
@@ -482,11 +464,9 @@ sys_timer_create(clockid_t which_clock,
 	new_timer->it_clock = which_clock;
 	new_timer->it_incr = 0;
 	new_timer->it_overrun = -1;
-	init_timer(&new_timer->it_timer);
-	new_timer->it_timer.expires = 0;
+	hrtimer_init(&new_timer->it_timer);
 	new_timer->it_timer.data = (unsigned long) new_timer;
 	new_timer->it_timer.function = posix_timer_fn;
-	set_timer_inactive(new_timer);
 
 	/*
 	 * Once we set the process, it can be found so do it last...
@@ -577,36 +557,33 @@ static struct k_itimer * lock_timer(timer_t timer_id, unsigned long *flags)
 void inline
 do_timer_gettime(struct k_itimer *timr, struct itimerspec *cur_setting)
 {
-	unsigned long expires;
-	struct now_struct now;
-
-	do
-		expires = timr->it_timer.expires;
-	while ((volatile long) (timr->it_timer.expires) != expires);
-
-	posix_get_now(&now);
-
-	if (expires && (timr->it_sigev_notify & SIGEV_NONE) && !timr->it_incr &&
-			posix_time_before(&timr->it_timer, &now))
-		timr->it_timer.expires = expires = 0;
-	if (expires) {
-		if (timr->it_requeue_pending & REQUEUE_PENDING ||
-		    (timr->it_sigev_notify & SIGEV_NONE))
-			while (posix_time_before(&timr->it_timer, &now))
-				posix_bump_timer(timr);
-		else
-			if (!timer_pending(&timr->it_timer))
-				expires = 0;
-		if (expires)
-			expires -= now.jiffies;
-	}
-	jiffies_to_timespec(expires, &cur_setting->it_value);
-	jiffies_to_timespec(timr->it_incr, &cur_setting->it_interval);
+	ktime_t now, remaining;
 
-	if (cur_setting->it_value.tv_sec < 0) {
-		cur_setting->it_value.tv_nsec = 1;
-		cur_setting->it_value.tv_sec = 0;
-	}
+	memset(cur_setting, 0, sizeof(*cur_setting));
+	cur_setting->it_interval = ktime_to_timespec(timr->it_incr);
+
+	/* An expiry time of 0 means the timer is disarmed */
+	if (!timr->it_timer.expires)
+		return;
+
+	now = ktime_get();
+	if (timr->it_requeue_pending & REQUEUE_PENDING ||
+	    (timr->it_sigev_notify & SIGEV_NONE)) {
+		if (!timr->it_incr) {
+			if (timr->it_timer.expires <= now) {
+				timr->it_timer.expires = 0;
+				return;
+			}
+		} else
+			timr->it_overrun += hrtimer_forward(&timr->it_timer,
+							    now, timr->it_incr);
+	} else if (!hrtimer_active(&timr->it_timer))
+		return;
+
+	remaining = timr->it_timer.expires - now;
+	if (remaining <= 0)
+		remaining = 1;
+	cur_setting->it_value = ktime_to_timespec(remaining);
 }
 
 /* Get the time remaining on a POSIX.1b interval timer. */
@@ -656,93 +633,6 @@ sys_timer_getoverrun(timer_t timer_id)
 
 	return overrun;
 }
-/*
- * Adjust for absolute time
- *
- * If absolute time is given and it is not CLOCK_MONOTONIC, we need to
- * adjust for the offset between the timer clock (CLOCK_MONOTONIC) and
- * what ever clock he is using.
- *
- * If it is relative time, we need to add the current (CLOCK_MONOTONIC)
- * time to it to get the proper time for the timer.
- */
-static int adjust_abs_time(struct k_clock *clock, struct timespec *tp, 
-			   int abs, u64 *exp)
-{
-	struct timespec now;
-	struct timespec oc = *tp;
-	struct timespec wall_to_mono;
-	u64 jiffies_64_f;
-	int rtn =0;
-
-	if (abs) {
-		/*
-		 * The mask pick up the 4 basic clocks 
-		 */
-		if (!(clock - &posix_clocks[0]) & ~CLOCKS_MASK) {
-			jiffies_64_f = do_posix_clock_monotonic_gettime_parts(
-				&now,  &wall_to_mono);
-			/*
-			 * If we are doing a MONOTONIC clock
-			 */
-			if((clock - &posix_clocks[0]) & CLOCKS_MONO){
-				now.tv_sec += wall_to_mono.tv_sec;
-				now.tv_nsec += wall_to_mono.tv_nsec;
-			}
-		} else {
-			/*
-			 * Not one of the basic clocks
-			 */
-			do_posix_gettime(clock, &now);	
-			jiffies_64_f = get_jiffies_64();
-		}
-		/*
-		 * Take away now to get delta
-		 */
-		oc.tv_sec -= now.tv_sec;
-		oc.tv_nsec -= now.tv_nsec;
-		/*
-		 * Normalize...
-		 */
-		while ((oc.tv_nsec - NSEC_PER_SEC) >= 0) {
-			oc.tv_nsec -= NSEC_PER_SEC;
-			oc.tv_sec++;
-		}
-		while ((oc.tv_nsec) < 0) {
-			oc.tv_nsec += NSEC_PER_SEC;
-			oc.tv_sec--;
-		}
-	}else{
-		jiffies_64_f = get_jiffies_64();
-	}
-	/*
-	 * Check if the requested time is prior to now (if so set now)
-	 */
-	if (oc.tv_sec < 0)
-		oc.tv_sec = oc.tv_nsec = 0;
-	tstojiffie(&oc, clock->res, exp);
-
-	/*
-	 * Check if the requested time is more than the timer code
-	 * can handle (if so we error out but return the value too).
-	 */
-	if (*exp > ((u64)MAX_JIFFY_OFFSET))
-			/*
-			 * This is a considered response, not exactly in
-			 * line with the standard (in fact it is silent on
-			 * possible overflows).  We assume such a large 
-			 * value is ALMOST always a programming error and
-			 * try not to compound it by setting a really dumb
-			 * value.
-			 */
-			rtn = -EINVAL;
-	/*
-	 * return the actual jiffies expire time, full 64 bits
-	 */
-	*exp += jiffies_64_f;
-	return rtn;
-}
-
 /* Set a POSIX.1b interval timer. */
 /* timr->it_lock is taken. */
 static inline int
@@ -750,7 +640,7 @@ do_timer_settime(struct k_itimer *timr, int flags,
 		 struct itimerspec *new_setting, struct itimerspec *old_setting)
 {
 	struct k_clock *clock = &posix_clocks[timr->it_clock];
-	u64 expire_64;
+	ktime_t expires;
 
 	if (old_setting)
 		do_timer_gettime(timr, old_setting);
@@ -759,24 +649,13 @@ do_timer_settime(struct k_itimer *timr, int flags,
 	timr->it_incr = 0;
 	/*
 	 * careful here.  If smp we could be in the "fire" routine which will
-	 * be spinning as we hold the lock.  But this is ONLY an SMP issue.
+	 * be spinning as we hold the lock.  Since we have cleared the
+	 * interval stuff above, it should clear once we release the spin
+	 * lock.  So return with a "retry" exit status.
 	 */
-#ifdef CONFIG_SMP
-	if (timer_active(timr) && !del_timer(&timr->it_timer))
-		/*
-		 * It can only be active if on an other cpu.  Since
-		 * we have cleared the interval stuff above, it should
-		 * clear once we release the spin lock.  Of course once
-		 * we do that anything could happen, including the
-		 * complete melt down of the timer.  So return with
-		 * a "retry" exit status.
-		 */
+	if (hrtimer_try_to_cancel(&timr->it_timer) < 0)
 		return TIMER_RETRY;
 
-	set_timer_inactive(timr);
-#else
-	del_timer(&timr->it_timer);
-#endif
 	timr->it_requeue_pending = (timr->it_requeue_pending + 2) & 
 		~REQUEUE_PENDING;
 	timr->it_overrun_last = 0;
@@ -789,27 +668,22 @@ do_timer_settime(struct k_itimer *timr, int flags,
 		return 0;
 	}
 
-	if (adjust_abs_time(clock,
-			    &new_setting->it_value, flags & TIMER_ABSTIME, 
-			    &expire_64)) {
-		return -EINVAL;
-	}
-	timr->it_timer.expires = (unsigned long)expire_64;	
-	tstojiffie(&new_setting->it_interval, clock->res, &expire_64);
-	timr->it_incr = (unsigned long)expire_64;
+	expires = clock_to_mono(clock, &new_setting->it_value,
+				flags & TIMER_ABSTIME);
+	/* 0 would read back as disarmed, and is in the past anyway */
+	timr->it_timer.expires = expires ? expires : 1;
 
+	/* Intervals are rounded up to the resolution we can deliver. */
+	timr->it_incr = timespec_to_ktime(&new_setting->it_interval);
+	if (timr->it_incr && timr->it_incr < hrtimer_resolution())
+		timr->it_incr = hrtimer_resolution();
 
 	/*
-	 * For some reason the timer does not fire immediately if expires is
-	 * equal to jiffies, so the timer notify function is called directly.
+	 * Timers already in the past fire from the next timer event.
 	 * We do not even queue SIGEV_NONE timers!
 	 */
-	if (!(timr->it_sigev_notify & SIGEV_NONE)) {
-		if (timr->it_timer.expires == jiffies)
-			timer_notify_task(timr);
-		else
-			add_timer(&timr->it_timer);
-	}
+	if (!(timr->it_sigev_notify & SIGEV_NONE))
+		hrtimer_start(&timr->it_timer, timr->it_timer.expires);
 	return 0;
 }
 
@@ -861,20 +735,14 @@ retry:
 static inline int do_timer_delete(struct k_itimer *timer)
 {
 	timer->it_incr = 0;
-#ifdef CONFIG_SMP
-	if (timer_active(timer) && !del_timer(&timer->it_timer))
+	if (hrtimer_try_to_cancel(&timer->it_timer) < 0)
 		/*
-		 * It can only be active if on an other cpu.  Since
+		 * It can only be running if on an other cpu.  Since
 		 * we have cleared the interval stuff above, it should
-		 * clear once we release the spin lock.  Of course once
-		 * we do that anything could happen, including the
-		 * complete melt down of the timer.  So return with
+		 * clear once we release the spin lock.  So return with
 		 * a "retry" exit status.
 		 */
 		return TIMER_RETRY;
-#else
-	del_timer(&timer->it_timer);
-#endif
 	return 0;
 }
 
@@ -1064,6 +932,9 @@ sys_clock_getres(clockid_t which_clock, struct timespec __user *tp)
 
 	rtn_tp.tv_sec = 0;
 	rtn_tp.tv_nsec = posix_clocks[which_clock].res;
+	/* Timers and sleeps on the standard clocks are hrtimers */
+	if (which_clock == CLOCK_REALTIME || which_clock == CLOCK_MONOTONIC)
+		rtn_tp.tv_nsec = hrtimer_resolution();
 	if (tp && copy_to_user(tp, &rtn_tp, sizeof (rtn_tp)))
 		return -EFAULT;
 
@@ -1071,13 +942,6 @@ sys_clock_getres(clockid_t which_clock, struct timespec __user *tp)
 
 }
 
-static void nanosleep_wake_up(unsigned long __data)
-{
-	struct task_struct *p = (struct task_struct *) __data;
-
-	wake_up_process(p);
-}
-
 /*
  * The standard says that an absolute nanosleep call MUST wake up at
  * the requested time in spite of clock settings.  Here is what we do:
@@ -1139,70 +1003,48 @@ sys_clock_nanosleep(clockid_t which_clock, int flags,
 long
 do_clock_nanosleep(clockid_t which_clock, int flags, struct timespec *tsave)
 {
-	struct timespec t;
-	struct timer_list new_timer;
+	struct k_clock *clock = &posix_clocks[which_clock];
+	struct hrtimer timer;
 	DECLARE_WAITQUEUE(abs_wqueue, current);
-	u64 rq_time = (u64)0;
-	s64 left;
-	int abs;
+	ktime_t expires, left;
+	int abs, expired = 0;
 	struct restart_block *restart_block =
 	    &current_thread_info()->restart_block;
 
 	abs_wqueue.flags = 0;
-	init_timer(&new_timer);
-	new_timer.expires = 0;
-	new_timer.data = (unsigned long) current;
-	new_timer.function = nanosleep_wake_up;
+	hrtimer_init(&timer);
 	abs = flags & TIMER_ABSTIME;
 
 	if (restart_block->fn == clock_nanosleep_restart) {
 		/*
-		 * Interrupted by a non-delivered signal, pick up remaining
-		 * time and continue.  Remaining time is in arg2 & 3.
+		 * Interrupted by a non-delivered signal, pick up the
+		 * expiry time and continue.  It is in arg2 & 3.
 		 */
 		restart_block->fn = do_no_restart_syscall;
 
-		rq_time = restart_block->arg3;
-		rq_time = (rq_time << 32) + restart_block->arg2;
-		if (!rq_time)
-			return -EINTR;
-		left = rq_time - get_jiffies_64();
-		if (left <= (s64)0)
-			return 0;	/* Already passed */
-	}
+		expires = restart_block->arg3;
+		expires = (expires << 32) | restart_block->arg2;
+	} else
+		expires = clock_to_mono(clock, tsave, abs);
 
-	if (abs && (posix_clocks[which_clock].clock_get !=
+	if (abs && (clock->clock_get !=
 			    posix_clocks[CLOCK_MONOTONIC].clock_get))
 		add_wait_queue(&nanosleep_abs_wqueue, &abs_wqueue);
 
 	do {
-		t = *tsave;
-		if (abs || !rq_time) {
-			adjust_abs_time(&posix_clocks[which_clock], &t, abs,
-					&rq_time);
-			rq_time += (t.tv_sec || t.tv_nsec);
-		}
-
-		left = rq_time - get_jiffies_64();
-		if (left >= (s64)MAX_JIFFY_OFFSET)
-			left = (s64)MAX_JIFFY_OFFSET;
-		if (left < (s64)0)
-			break;
-
-		new_timer.expires = jiffies + left;
-		__set_current_state(TASK_INTERRUPTIBLE);
-		add_timer(&new_timer);
-
-		schedule();
-
-		del_timer_sync(&new_timer);
-		left = rq_time - get_jiffies_64();
-	} while (left > (s64)0 && !test_thread_flag(TIF_SIGPENDING));
+		/*
+		 * The clock may have been set while we slept.
+		 */
+		if (abs)
+			expires = clock_to_mono(clock, tsave, abs);
+		expired = hrtimer_sleep_until(&timer, expires);
+	} while (!expired && !signal_pending(current));
 
 	if (abs_wqueue.task_list.next)
 		finish_wait(&nanosleep_abs_wqueue, &abs_wqueue);
 
-	if (left > (s64)0) {
+	left = expires - ktime_get();
+	if (!expired && left > 0) {
 
 		/*
 		 * Always restart abs calls from scratch to pick up any
@@ -1211,13 +1053,10 @@ do_clock_nanosleep(clockid_t which_clock, int flags, struct timespec *tsave)
 		if (abs)
 			return -ERESTARTNOHAND;
 
-		left *= TICK_NSEC;
-		tsave->tv_sec = div_long_long_rem(left, 
-						  NSEC_PER_SEC, 
-						  &tsave->tv_nsec);
+		*tsave = ktime_to_timespec(left);
 		/*
-		 * Restart works by saving the time remaing in 
-		 * arg2 & 3 (it is 64-bits of jiffies).  The other
+		 * Restart works by saving the CLOCK_MONOTONIC expiry time
+		 * in arg2 & 3 (it is 64-bits of nanoseconds).  The other
 		 * info we need is the clock_id (saved in arg0). 
 		 * The sys_call interface needs the users 
 		 * timespec return address which _it_ saves in arg1.
@@ -1229,8 +1068,8 @@ do_clock_nanosleep(clockid_t which_clock, int flags, struct timespec *tsave)
 		/*
 		 * Caller sets arg1
 		 */
-		restart_block->arg2 = rq_time & 0xffffffffLL;
-		restart_block->arg3 = rq_time >> 32;
+		restart_block->arg2 = (u64)expires & 0xffffffffLL;
+		restart_block->arg3 = (u64)expires >> 32;
 
 		return -ERESTART_RESTARTBLOCK;
 	}
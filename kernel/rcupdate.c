@@ -44,6 +44,8 @@
 #include <linux/notifier.h>
 #include <linux/rcupdate.h>
 #include <linux/cpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 /* Definition for rcupdate control block. */
 struct rcu_ctrlblk rcu_ctrlblk = 
@@ -55,6 +57,39 @@ DEFINE_PER_CPU(struct rcu_data, rcu_data) = { 0L };
 static DEFINE_PER_CPU(struct tasklet_struct, rcu_tasklet) = {NULL};
 #define RCU_tasklet(cpu) (per_cpu(rcu_tasklet, cpu))
 
+/*
+ * Callbacks left over after rcu_batch_limit of them have been invoked
+ * from the tasklet are handed to this per-cpu thread, so that a huge
+ * batch does not hog softirq context.
+ */
+static DEFINE_PER_CPU(struct task_struct *, krcud);
+
+static int rcu_batch_limit = 16;
+
+static int __init rcu_batch_limit_setup(char *str)
+{
+	get_option(&str, &rcu_batch_limit);
+	if (rcu_batch_limit < 1)
+		rcu_batch_limit = 1;
+	return 1;
+}
+
+__setup("rcu_batch_limit=", rcu_batch_limit_setup);
+
+/*
+ * Quiescent states are reported to a group of cpus first, and only
+ * the last cpu of each group takes rcu_ctrlblk.mutex.  On big boxes
+ * this keeps the end of a grace period from being one long convoy on
+ * a single lock.
+ */
+#define RCU_GROUP_SHIFT		3
+#define RCU_GROUP(cpu)		((cpu) >> RCU_GROUP_SHIFT)
+#define RCU_NR_GROUPS		(RCU_GROUP(NR_CPUS - 1) + 1)
+
+static struct rcu_group {
+	atomic_t	pending;	/* cpus yet to pass this batch */
+} ____cacheline_aligned_in_smp rcu_groups[RCU_NR_GROUPS];
+
 /**
  * call_rcu - Queue an RCU update request.
  * @head: structure to be used for queueing the RCU updates.
@@ -76,24 +111,45 @@ void call_rcu(struct rcu_head *head, void (*func)(void *arg), void *arg)
 	local_irq_save(flags);
 	cpu = smp_processor_id();
 	list_add_tail(&head->list, &RCU_nxtlist(cpu));
+	per_cpu(rcu_data, cpu).qlen++;
+#ifdef CONFIG_NO_IDLE_HZ
+	/* Queued from an interrupt: we need our tick back to process it */
+	if (unlikely(cpu_isset(cpu, nohz_cpu_mask)))
+		wake_idle_cpu(cpu);
+#endif
 	local_irq_restore(flags);
 }
 
 /*
- * Invoke the completed RCU callbacks. They are expected to be in
- * a per-cpu list.
+ * Invoke up to rcu_batch_limit completed RCU callbacks from the per-cpu
+ * done list, or all of them if @limit is 0.  Called with bottom halves
+ * disabled, from the tasklet or from krcud.  Returns nonzero if there
+ * are callbacks left.
  */
-static void rcu_do_batch(struct list_head *list)
+static int rcu_do_batch(int cpu, int limit)
 {
+	struct rcu_data *rdp = &per_cpu(rcu_data, cpu);
+	struct list_head *list = &rdp->donelist;
 	struct list_head *entry;
 	struct rcu_head *head;
+	int count = 0;
 
 	while (!list_empty(list)) {
 		entry = list->next;
 		list_del(entry);
 		head = list_entry(entry, struct rcu_head, list);
 		head->func(head->arg);
+		if (++count == limit)
+			break;
 	}
+
+	rdp->donelen -= count;
+	rdp->nr_invoked += count;
+	local_irq_disable();
+	rdp->qlen -= count;
+	local_irq_enable();
+
+	return !list_empty(list);
 }
 
 /*
@@ -103,14 +159,62 @@ static void rcu_do_batch(struct list_head *list)
  */
 static void rcu_start_batch(long newbatch)
 {
+	cpumask_t mask = cpu_online_map;
+	int cpu, group;
+
 	if (rcu_batch_before(rcu_ctrlblk.maxbatch, newbatch)) {
 		rcu_ctrlblk.maxbatch = newbatch;
 	}
 	if (rcu_batch_before(rcu_ctrlblk.maxbatch, rcu_ctrlblk.curbatch) ||
-	    !cpus_empty(rcu_ctrlblk.rcu_cpu_mask)) {
+	    rcu_ctrlblk.groups_pending) {
 		return;
 	}
-	rcu_ctrlblk.rcu_cpu_mask = cpu_online_map;
+#ifdef CONFIG_NO_IDLE_HZ
+	/*
+	 * Tickless idle cpus are in an extended quiescent state and
+	 * would hold up the batch until their next wakeup.  They check
+	 * for a batch in progress after entering nohz_cpu_mask, and leave
+	 * it in irq_enter() before any interrupt handler runs.
+	 */
+	{
+		cpumask_t active = nohz_cpu_mask;
+
+		cpus_complement(active);
+		cpus_and(mask, mask, active);
+	}
+#endif
+	/*
+	 * Count the cpus of each group before any of them can see its
+	 * bit in the mask and report a quiescent state.
+	 */
+	for (group = 0; group < RCU_NR_GROUPS; group++)
+		atomic_set(&rcu_groups[group].pending, 0);
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		if (!cpu_isset(cpu, mask))
+			continue;
+		if (atomic_read(&rcu_groups[RCU_GROUP(cpu)].pending) == 0)
+			rcu_ctrlblk.groups_pending++;
+		atomic_inc(&rcu_groups[RCU_GROUP(cpu)].pending);
+	}
+	rcu_ctrlblk.batch_start = jiffies;
+	smp_wmb();
+	rcu_ctrlblk.rcu_cpu_mask = mask;
+}
+
+/*
+ * The current batch is over.  Caller must hold the rcu_ctrlblk lock.
+ */
+static void rcu_end_batch(void)
+{
+	unsigned long len = jiffies - rcu_ctrlblk.batch_start;
+
+	rcu_ctrlblk.nr_batches++;
+	rcu_ctrlblk.batch_jiffies += len;
+	if (len > rcu_ctrlblk.batch_max)
+		rcu_ctrlblk.batch_max = len;
+
+	rcu_ctrlblk.curbatch++;
+	rcu_start_batch(rcu_ctrlblk.maxbatch);
 }
 
 /*
@@ -137,19 +241,18 @@ static void rcu_check_quiescent_state(void)
 	if (RCU_qsctr(cpu) == RCU_last_qsctr(cpu))
 		return;
 
-	spin_lock(&rcu_ctrlblk.mutex);
-	if (!cpu_isset(cpu, rcu_ctrlblk.rcu_cpu_mask))
-		goto out_unlock;
-
+	/*
+	 * Only this cpu clears its bit, and the batch can't end (and a
+	 * new one set the mask) until it has.
+	 */
 	cpu_clear(cpu, rcu_ctrlblk.rcu_cpu_mask);
 	RCU_last_qsctr(cpu) = RCU_QSCTR_INVALID;
-	if (!cpus_empty(rcu_ctrlblk.rcu_cpu_mask))
-		goto out_unlock;
-
-	rcu_ctrlblk.curbatch++;
-	rcu_start_batch(rcu_ctrlblk.maxbatch);
+	if (!atomic_dec_and_test(&rcu_groups[RCU_GROUP(cpu)].pending))
+		return;
 
-out_unlock:
+	spin_lock(&rcu_ctrlblk.mutex);
+	if (!--rcu_ctrlblk.groups_pending)
+		rcu_end_batch();
 	spin_unlock(&rcu_ctrlblk.mutex);
 }
 
@@ -160,11 +263,19 @@ out_unlock:
 static void rcu_process_callbacks(unsigned long unused)
 {
 	int cpu = smp_processor_id();
-	LIST_HEAD(list);
+	struct rcu_data *rdp = &per_cpu(rcu_data, cpu);
+	struct list_head *entry;
+	unsigned long count = 0;
 
 	if (!list_empty(&RCU_curlist(cpu)) &&
 	    rcu_batch_after(rcu_ctrlblk.curbatch, RCU_batch(cpu))) {
-		list_splice(&RCU_curlist(cpu), &list);
+		list_for_each(entry, &RCU_curlist(cpu))
+			count++;
+		if (count > rdp->batch_max)
+			rdp->batch_max = count;
+		rdp->donelen += count;
+		/* Behind whatever krcud has yet to do */
+		list_splice(&RCU_curlist(cpu), RCU_donelist(cpu).prev);
 		INIT_LIST_HEAD(&RCU_curlist(cpu));
 	}
 
@@ -185,8 +296,16 @@ static void rcu_process_callbacks(unsigned long unused)
 		local_irq_enable();
 	}
 	rcu_check_quiescent_state();
-	if (!list_empty(&list))
-		rcu_do_batch(&list);
+
+	if (list_empty(&RCU_donelist(cpu)))
+		return;
+	if (!per_cpu(krcud, cpu)) {
+		/* Early boot, nobody to hand over to */
+		rcu_do_batch(cpu, 0);
+		return;
+	}
+	if (rcu_do_batch(cpu, rcu_batch_limit))
+		wake_up_process(per_cpu(krcud, cpu));
 }
 
 void rcu_check_callbacks(int cpu, int user)
@@ -204,6 +323,7 @@ static void __devinit rcu_online_cpu(int cpu)
 	tasklet_init(&RCU_tasklet(cpu), rcu_process_callbacks, 0UL);
 	INIT_LIST_HEAD(&RCU_nxtlist(cpu));
 	INIT_LIST_HEAD(&RCU_curlist(cpu));
+	INIT_LIST_HEAD(&RCU_donelist(cpu));
 }
 
 static int __devinit rcu_cpu_notify(struct notifier_block *self, 
@@ -240,6 +360,145 @@ void __init rcu_init(void)
 }
 
 
+static int krcud(void *__bind_cpu)
+{
+	int cpu = (int) (long) __bind_cpu;
+
+	daemonize("krcud/%d", cpu);
+	current->flags |= PF_IOTHREAD;
+
+	/* Migrate to the right CPU */
+	set_cpus_allowed(current, cpumask_of_cpu(cpu));
+	BUG_ON(smp_processor_id() != cpu);
+
+	__set_current_state(TASK_INTERRUPTIBLE);
+	mb();
+
+	__get_cpu_var(krcud) = current;
+
+	for (;;) {
+		if (list_empty(&RCU_donelist(cpu)))
+			schedule();
+
+		__set_current_state(TASK_RUNNING);
+
+		/*
+		 * Callbacks expect to run in softirq context, and this
+		 * also keeps the tasklet off the list meanwhile.
+		 */
+		for (;;) {
+			struct rcu_data *rdp = &per_cpu(rcu_data, cpu);
+			unsigned long invoked;
+			int more;
+
+			local_bh_disable();
+			invoked = rdp->nr_invoked;
+			more = rcu_do_batch(cpu, rcu_batch_limit);
+			rdp->nr_offloaded += rdp->nr_invoked - invoked;
+			local_bh_enable();
+			if (!more)
+				break;
+			cond_resched();
+		}
+
+		__set_current_state(TASK_INTERRUPTIBLE);
+	}
+}
+
+static int __devinit krcud_cpu_callback(struct notifier_block *nfb,
+					unsigned long action, void *hcpu)
+{
+	int hotcpu = (unsigned long)hcpu;
+
+	if (action == CPU_ONLINE) {
+		if (kernel_thread(krcud, hcpu, CLONE_KERNEL) < 0) {
+			printk("krcud for %i failed\n", hotcpu);
+			return NOTIFY_BAD;
+		}
+
+		while (!per_cpu(krcud, hotcpu))
+			yield();
+	}
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __devinitdata krcud_nb = {
+	.notifier_call	= krcud_cpu_callback,
+};
+
+static int __init spawn_krcud(void)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++)
+		if (cpu_online(cpu))
+			krcud_cpu_callback(&krcud_nb, CPU_ONLINE,
+					   (void *)(long)cpu);
+	register_cpu_notifier(&krcud_nb);
+	return 0;
+}
+
+__initcall(spawn_krcud);
+
+#ifdef CONFIG_PROC_FS
+/*
+ * Grace periods are in jiffies.  The backlog of a cpu is what has
+ * been queued and not invoked yet; "done" is the part of it whose
+ * grace period is over.
+ */
+static int proc_rcu_show(struct seq_file *m, void *v)
+{
+	struct rcu_data *rdp;
+	unsigned long avg = 0;
+	int cpu;
+
+	if (rcu_ctrlblk.nr_batches)
+		avg = rcu_ctrlblk.batch_jiffies / rcu_ctrlblk.nr_batches;
+	seq_printf(m, "batches: %lu  curbatch: %ld  maxbatch: %ld\n",
+		   rcu_ctrlblk.nr_batches, rcu_ctrlblk.curbatch,
+		   rcu_ctrlblk.maxbatch);
+	seq_printf(m, "grace period: avg %lu max %lu (jiffies)\n",
+		   avg, rcu_ctrlblk.batch_max);
+	seq_printf(m, "batch limit: %d\n", rcu_batch_limit);
+	seq_printf(m, "CPU %10s %10s %12s %12s %10s\n",
+		   "backlog", "done", "invoked", "offloaded", "max_batch");
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		if (!cpu_online(cpu))
+			continue;
+		rdp = &per_cpu(rcu_data, cpu);
+		seq_printf(m, "%3d %10ld %10ld %12lu %12lu %10lu\n", cpu,
+			   rdp->qlen, rdp->donelen, rdp->nr_invoked,
+			   rdp->nr_offloaded, rdp->batch_max);
+	}
+	return 0;
+}
+
+static int proc_rcu_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, proc_rcu_show, NULL);
+}
+
+static struct file_operations proc_rcu_operations = {
+	.open		= proc_rcu_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init proc_rcu_init(void)
+{
+	struct proc_dir_entry *e;
+
+	e = create_proc_entry("rcu", 0, NULL);
+	if (e)
+		e->proc_fops = &proc_rcu_operations;
+
+	return 0;
+}
+
+__initcall(proc_rcu_init);
+#endif
+
 /* Because of FASTCALL declaration of complete, we use this wrapper */
 static void wakeme_after_rcu(void *completion)
 {
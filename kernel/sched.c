@@ -34,6 +34,7 @@
 #include <linux/blkdev.h>
 #include <linux/delay.h>
 #include <linux/timer.h>
+#include <linux/workqueue.h>
 #include <linux/rcupdate.h>
 #include <linux/cpu.h>
 #include <linux/percpu.h>
@@ -356,16 +357,23 @@ static int effective_prio(task_t *p)
 {
 	int bonus, prio;
 
-	if (rt_task(p))
-		return p->prio;
-
-	bonus = CURRENT_BONUS(p) - MAX_BONUS / 2;
+	if (p->policy != SCHED_NORMAL)
+		prio = MAX_USER_RT_PRIO-1 - p->rt_priority;
+	else {
+		bonus = CURRENT_BONUS(p) - MAX_BONUS / 2;
 
-	prio = p->static_prio - bonus;
-	if (prio < MAX_RT_PRIO)
-		prio = MAX_RT_PRIO;
-	if (prio > MAX_PRIO-1)
-		prio = MAX_PRIO-1;
+		prio = p->static_prio - bonus;
+		if (prio < MAX_RT_PRIO)
+			prio = MAX_RT_PRIO;
+		if (prio > MAX_PRIO-1)
+			prio = MAX_PRIO-1;
+	}
+	/*
+	 * A task holding a PI futex runs at least at the priority
+	 * of its best waiter:
+	 */
+	if (p->pi_prio < prio)
+		prio = p->pi_prio;
 	return prio;
 }
 
@@ -701,7 +709,7 @@ void wake_up_forked_process(task_t * p)
 	p->prio = effective_prio(p);
 	set_task_cpu(p, smp_processor_id());
 
-	if (unlikely(!current->array))
+	if (unlikely(!current->array) || unlikely(current->pi_prio != MAX_PRIO))
 		__activate_task(p, rq);
 	else {
 		p->prio = current->prio;
@@ -1318,6 +1326,18 @@ static void rebalance_tick(runqueue_t *this_rq, int idle)
 		spin_lock(&this_rq->lock);
 		load_balance(this_rq, idle, cpu_to_node_mask(this_cpu));
 		spin_unlock(&this_rq->lock);
+#ifdef CONFIG_NO_IDLE_HZ
+		/*
+		 * Tickless idle cpus don't rebalance_tick(), so ask one
+		 * of them to come and pull some of our load.
+		 */
+		if (this_rq->nr_running > 1) {
+			int cpu = any_online_cpu(nohz_cpu_mask);
+
+			if (cpu < NR_CPUS)
+				wake_idle_cpu(cpu);
+		}
+#endif
 	}
 }
 #else
@@ -1333,6 +1353,22 @@ DEFINE_PER_CPU(struct kernel_stat, kstat) = { { 0 } };
 
 EXPORT_PER_CPU_SYMBOL(kstat);
 
+#ifdef CONFIG_NO_IDLE_HZ
+/*
+ * Charge the ticks an idle cpu slept through with its tick stopped,
+ * as scheduler_tick() would have.
+ */
+void account_idle_ticks(unsigned long ticks)
+{
+	struct cpu_usage_stat *cpustat = &kstat_this_cpu.cpustat;
+
+	if (atomic_read(&this_rq()->nr_iowait) > 0)
+		cpustat->iowait += ticks;
+	else
+		cpustat->idle += ticks;
+}
+#endif
+
 /*
  * We place interactive tasks back into the active array, if possible.
  *
@@ -1490,6 +1526,13 @@ asmlinkage void schedule(void)
 		}
 	}
 
+	/*
+	 * A workqueue worker about to block may have to hand its pool
+	 * over to another worker.  Do it before we take the runqueue lock.
+	 */
+	if (unlikely(current->flags & PF_WQ_WORKER))
+		wq_worker_sleeping(current);
+
 need_resched:
 	preempt_disable();
 	prev = current;
@@ -1601,6 +1644,9 @@ switch_tasks:
 	preempt_enable_no_resched();
 	if (test_thread_flag(TIF_NEED_RESCHED))
 		goto need_resched;
+
+	if (unlikely(current->flags & PF_WQ_WORKER))
+		wq_worker_waking_up(current);
 }
 
 EXPORT_SYMBOL(schedule);
@@ -1894,6 +1940,47 @@ out_unlock:
 
 EXPORT_SYMBOL(set_user_nice);
 
+/**
+ * set_task_pi_prio - set the priority inherited through PI futexes.
+ * @p: the task holding the futexes.
+ * @prio: the best waiter's priority, or MAX_PRIO to drop the boost.
+ *
+ * The boost is folded into p->prio by effective_prio(), so it survives
+ * the usual sleep_avg recalculations until it is dropped again.
+ */
+void set_task_pi_prio(task_t *p, int prio)
+{
+	unsigned long flags;
+	prio_array_t *array;
+	runqueue_t *rq;
+	int oldprio;
+
+	rq = task_rq_lock(p, &flags);
+	if (p->pi_prio == prio)
+		goto out_unlock;
+
+	array = p->array;
+	if (array)
+		dequeue_task(p, array);
+	p->pi_prio = prio;
+	oldprio = p->prio;
+	p->prio = effective_prio(p);
+	if (array) {
+		enqueue_task(p, array);
+		/*
+		 * Same rules as setscheduler(): reschedule if the running
+		 * task got weaker, or if somebody else now beats it.
+		 */
+		if (rq->curr == p) {
+			if (p->prio > oldprio)
+				resched_task(rq->curr);
+		} else if (p->prio < rq->curr->prio)
+			resched_task(rq->curr);
+	}
+out_unlock:
+	task_rq_unlock(rq, &flags);
+}
+
 #ifndef __alpha__
 
 /*
@@ -1973,6 +2060,21 @@ int idle_cpu(int cpu)
 
 EXPORT_SYMBOL_GPL(idle_cpu);
 
+#ifdef CONFIG_NO_IDLE_HZ
+/**
+ * wake_idle_cpu - kick a cpu out of its idle loop
+ * @cpu: the processor in question.
+ *
+ * The cpu goes through schedule(), which idle-balances, and restarts
+ * its tick if it was stopped.  Used when a tickless cpu is given a
+ * timer or an RCU callback, and when busy cpus want help.
+ */
+void wake_idle_cpu(int cpu)
+{
+	resched_task(cpu_rq(cpu)->idle);
+}
+#endif
+
 /**
  * find_process_by_pid - find a process with a matching PID value.
  * @pid: the pid in question.
@@ -2061,6 +2163,8 @@ static int setscheduler(pid_t pid, int policy, struct sched_param __user *param)
 		p->prio = MAX_USER_RT_PRIO-1 - p->rt_priority;
 	else
 		p->prio = p->static_prio;
+	if (p->pi_prio < p->prio)
+		p->prio = p->pi_prio;
 	if (array) {
 		__activate_task(p, task_rq(p));
 		/*
@@ -14,6 +14,10 @@
 #include <linux/notifier.h>
 #include <linux/percpu.h>
 #include <linux/cpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <asm/uaccess.h>
+#include <asm/div64.h>
 
 /*
    - No shared variables, all the data are CPU local.
@@ -38,10 +42,92 @@ irq_cpustat_t irq_stat[NR_CPUS] ____cacheline_aligned;
 EXPORT_SYMBOL(irq_stat);
 #endif
 
-static struct softirq_action softirq_vec[32] __cacheline_aligned_in_smp;
+static struct softirq_action softirq_vec[NR_SOFTIRQS] __cacheline_aligned_in_smp;
+
+static const char *softirq_to_name[NR_SOFTIRQS] = {
+	"HI", "TIMER", "NET_TX", "NET_RX", "SCSI", "TASKLET"
+};
 
 static DEFINE_PER_CPU(struct task_struct *, ksoftirqd);
 
+/* Per-cpu, per-vector accounting, see /proc/softirqs */
+struct softirq_stat {
+	unsigned long		count;
+	unsigned long long	time;		/* ns, from sched_clock() */
+};
+
+static DEFINE_PER_CPU(struct softirq_stat, softirq_stats[NR_SOFTIRQS]);
+
+/*
+ * With the "softirq_threads" boot option every vector is run by a
+ * thread of its own on each cpu, softirq-<vector>/<cpu>, which can be
+ * given any scheduling policy and priority from userspace.  Raising a
+ * softirq then only wakes the thread, so e.g. a network flood competes
+ * with applications on the scheduler's terms.  "softirq_threads=<n>"
+ * starts them SCHED_FIFO at priority n.
+ *
+ * softirq_thread_pending holds the vectors handed to the threads; it
+ * is only changed by the local cpu with interrupts disabled.
+ */
+static int softirq_threaded;
+static int softirq_thread_rtprio;
+
+static DEFINE_PER_CPU(struct task_struct *, softirq_threads[NR_SOFTIRQS]);
+static DEFINE_PER_CPU(__u32, softirq_thread_pending);
+static DEFINE_PER_CPU(int, softirq_threads_ready);
+
+static int __init softirq_threads_setup(char *str)
+{
+	softirq_threaded = 1;
+	if (*str == '=')
+		softirq_thread_rtprio = simple_strtol(str + 1, NULL, 0);
+	if (softirq_thread_rtprio < 0 ||
+	    softirq_thread_rtprio > MAX_USER_RT_PRIO - 1)
+		softirq_thread_rtprio = 0;
+	return 1;
+}
+
+__setup("softirq_threads", softirq_threads_setup);
+
+static inline void run_softirq_action(struct softirq_action *h)
+{
+	struct softirq_stat *st = __get_cpu_var(softirq_stats) +
+				  (h - softirq_vec);
+	unsigned long long start = sched_clock();
+
+	h->action(h);
+
+	st->time += sched_clock() - start;
+	st->count++;
+}
+
+/*
+ * Hand the pending softirqs over to their threads, if we have them.
+ * Interrupts must be disabled.
+ */
+static int softirq_hand_off(void)
+{
+	struct task_struct *tsk;
+	__u32 pending;
+	int nr;
+
+	if (!__get_cpu_var(softirq_threads_ready))
+		return 0;
+
+	pending = local_softirq_pending();
+	local_softirq_pending() = 0;
+	__get_cpu_var(softirq_thread_pending) |= pending;
+
+	for (nr = 0; pending; nr++, pending >>= 1) {
+		if (!(pending & 1))
+			continue;
+		tsk = __get_cpu_var(softirq_threads)[nr];
+		if (tsk->state != TASK_RUNNING)
+			wake_up_process(tsk);
+	}
+	return 1;
+}
+
 /*
  * we cannot loop indefinitely here to avoid userspace starvation,
  * but we also don't want to introduce a worst case 1/HZ latency
@@ -81,6 +167,9 @@ asmlinkage void do_softirq(void)
 
 	pending = local_softirq_pending();
 
+	if (pending && softirq_hand_off())
+		pending = 0;
+
 	if (pending) {
 		struct softirq_action *h;
 
@@ -95,7 +184,7 @@ restart:
 
 		do {
 			if (pending & 1)
-				h->action(h);
+				run_softirq_action(h);
 			h++;
 			pending >>= 1;
 		} while (pending);
@@ -142,7 +231,7 @@ inline void raise_softirq_irqoff(unsigned int nr)
 	 * Otherwise we wake up ksoftirqd to make sure we
 	 * schedule the softirq soon.
 	 */
-	if (!in_interrupt())
+	if (!in_interrupt() && !softirq_hand_off())
 		wakeup_softirqd();
 }
 
@@ -366,6 +455,72 @@ static int ksoftirqd(void * __bind_cpu)
 	}
 }
 
+extern asmlinkage long sys_sched_setscheduler(pid_t pid, int policy,
+					      struct sched_param __user *param);
+
+/* Thread of vector (long)__data % NR_SOFTIRQS on cpu __data / NR_SOFTIRQS */
+static int softirq_thread(void *__data)
+{
+	int cpu = (int) (long) __data / NR_SOFTIRQS;
+	int nr = (int) (long) __data % NR_SOFTIRQS;
+	__u32 mask = 1 << nr;
+	struct sched_param param = { .sched_priority = softirq_thread_rtprio };
+
+	daemonize("softirq-%s/%d", softirq_to_name[nr], cpu);
+	current->flags |= PF_IOTHREAD;
+
+	if (param.sched_priority) {
+		set_fs(KERNEL_DS);
+		sys_sched_setscheduler(0, SCHED_FIFO, &param);
+	}
+
+	/* Migrate to the right CPU */
+	set_cpus_allowed(current, cpumask_of_cpu(cpu));
+	BUG_ON(smp_processor_id() != cpu);
+
+	__set_current_state(TASK_INTERRUPTIBLE);
+	mb();
+
+	__get_cpu_var(softirq_threads)[nr] = current;
+
+	for (;;) {
+		if (!(__get_cpu_var(softirq_thread_pending) & mask))
+			schedule();
+
+		__set_current_state(TASK_RUNNING);
+
+		while (__get_cpu_var(softirq_thread_pending) & mask) {
+			local_irq_disable();
+			__get_cpu_var(softirq_thread_pending) &= ~mask;
+			local_irq_enable();
+
+			local_bh_disable();
+			run_softirq_action(softirq_vec + nr);
+			local_bh_enable();
+			cond_resched();
+		}
+
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+}
+
+static int __devinit spawn_softirq_threads(int cpu)
+{
+	int nr;
+
+	for (nr = 0; nr < NR_SOFTIRQS; nr++) {
+		if (kernel_thread(softirq_thread,
+				  (void *)(long)(cpu * NR_SOFTIRQS + nr),
+				  CLONE_KERNEL) < 0)
+			return -1;
+
+		while (!per_cpu(softirq_threads, cpu)[nr])
+			yield();
+	}
+	per_cpu(softirq_threads_ready, cpu) = 1;
+	return 0;
+}
+
 static int __devinit cpu_callback(struct notifier_block *nfb,
 				  unsigned long action,
 				  void *hcpu)
@@ -380,6 +535,10 @@ static int __devinit cpu_callback(struct notifier_block *nfb,
 
 		while (!per_cpu(ksoftirqd, hotcpu))
 			yield();
+
+		/* Softirqs are run inline until all threads are up */
+		if (softirq_threaded && spawn_softirq_threads(hotcpu) < 0)
+			printk("softirq threads for %i failed\n", hotcpu);
  	}
 	return NOTIFY_OK;
 }
@@ -394,3 +553,58 @@ __init int spawn_ksoftirqd(void)
 	register_cpu_notifier(&cpu_nfb);
 	return 0;
 }
+
+#ifdef CONFIG_PROC_FS
+/* Times are in microseconds. */
+static int proc_softirqs_show(struct seq_file *m, void *v)
+{
+	struct softirq_stat *st;
+	unsigned long long time;
+	int cpu, nr;
+
+	seq_printf(m, "%10s", "");
+	for (cpu = 0; cpu < NR_CPUS; cpu++)
+		if (cpu_online(cpu))
+			seq_printf(m, " %10s%-3d %12s", "CPU", cpu, "usecs");
+	seq_putc(m, '\n');
+
+	for (nr = 0; nr < NR_SOFTIRQS; nr++) {
+		seq_printf(m, "%9s:", softirq_to_name[nr]);
+		for (cpu = 0; cpu < NR_CPUS; cpu++) {
+			if (!cpu_online(cpu))
+				continue;
+			st = per_cpu(softirq_stats, cpu) + nr;
+			time = st->time;
+			do_div(time, 1000);
+			seq_printf(m, " %13lu %12llu", st->count, time);
+		}
+		seq_putc(m, '\n');
+	}
+	return 0;
+}
+
+static int proc_softirqs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, proc_softirqs_show, NULL);
+}
+
+static struct file_operations proc_softirqs_operations = {
+	.open		= proc_softirqs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init proc_softirqs_init(void)
+{
+	struct proc_dir_entry *e;
+
+	e = create_proc_entry("softirqs", 0, NULL);
+	if (e)
+		e->proc_fops = &proc_softirqs_operations;
+
+	return 0;
+}
+
+__initcall(proc_softirqs_init);
+#endif
@@ -31,6 +31,7 @@
 #include <linux/time.h>
 #include <linux/jiffies.h>
 #include <linux/cpu.h>
+#include <linux/hrtimer.h>
 
 #include <asm/uaccess.h>
 #include <asm/div64.h>
@@ -203,6 +204,11 @@ repeat:
 	if (old_base && (new_base != old_base))
 		spin_unlock(&old_base->lock);
 	spin_unlock(&new_base->lock);
+#ifdef CONFIG_NO_IDLE_HZ
+	/* Added from an interrupt which woke us from a tickless idle */
+	if (unlikely(cpu_isset(smp_processor_id(), nohz_cpu_mask)))
+		wake_idle_cpu(smp_processor_id());
+#endif
 	spin_unlock_irqrestore(&timer->lock, flags);
 
 	return ret;
@@ -230,6 +236,11 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	internal_add_timer(base, timer);
 	timer->base = base;
 	spin_unlock_irqrestore(&base->lock, flags);
+#ifdef CONFIG_NO_IDLE_HZ
+	/* The cpu must reprogram its tick for the new timer. */
+	if (unlikely(cpu_isset(cpu, nohz_cpu_mask)))
+		wake_idle_cpu(cpu);
+#endif
 }
 
 /***
@@ -431,6 +442,80 @@ repeat:
 	spin_unlock_irq(&base->lock);
 }
 
+#ifdef CONFIG_NO_IDLE_HZ
+/**
+ * next_timer_interrupt - the jiffy the next timer on this cpu is due
+ *
+ * Called with interrupts off by an idle cpu that wants to stop its
+ * tick.  The wheel is only searched up to the first non-empty list:
+ * the result may be too early, never too late.
+ */
+unsigned long next_timer_interrupt(void)
+{
+	tvec_base_t *base = &__get_cpu_var(tvec_bases);
+	struct list_head *head;
+	struct timer_list *timer;
+	unsigned long expires;
+	tvec_t *varray[4];
+	int i, idx, start;
+
+	spin_lock(&base->lock);
+	expires = base->timer_jiffies + (LONG_MAX >> 1);
+
+	/*
+	 * tv1 lists hold timers which all expire at the same jiffy,
+	 * or are already overdue (in the current list).
+	 */
+	start = base->timer_jiffies & TVR_MASK;
+	idx = start;
+	do {
+		head = base->tv1.vec + idx;
+		if (!list_empty(head)) {
+			list_for_each_entry(timer, head, entry)
+				if (time_before(timer->expires, expires))
+					expires = timer->expires;
+			/*
+			 * Past the wrap, timers cascading from tv2 at the
+			 * next round may be due first.
+			 */
+			if (idx >= start)
+				goto out;
+			break;
+		}
+		idx = (idx + 1) & TVR_MASK;
+	} while (idx != start);
+
+	/*
+	 * The first non-empty list of each outer vector holds the
+	 * earliest timers of that vector, which are cascaded before
+	 * they are due.  Take the earliest of them all.  The list at
+	 * the current index may have been cascaded already and refilled
+	 * with timers a full round away, so always look past it.
+	 */
+	varray[0] = &base->tv2;
+	varray[1] = &base->tv3;
+	varray[2] = &base->tv4;
+	varray[3] = &base->tv5;
+	for (i = 0; i < 4; i++) {
+		start = (base->timer_jiffies >> (TVR_BITS + i * TVN_BITS)) &
+			TVN_MASK;
+		idx = start;
+		do {
+			head = varray[i]->vec + idx;
+			list_for_each_entry(timer, head, entry)
+				if (time_before(timer->expires, expires))
+					expires = timer->expires;
+			if (!list_empty(head) && idx != start)
+				break;
+			idx = (idx + 1) & TVN_MASK;
+		} while (idx != start);
+	}
+out:
+	spin_unlock(&base->lock);
+	return expires;
+}
+#endif
+
 /******************************************************************/
 
 /*
@@ -747,6 +832,7 @@ void update_process_times(int user_tick)
 	int cpu = smp_processor_id(), system = user_tick ^ 1;
 
 	update_one_process(p, user_tick, system, cpu);
+	hrtimer_run_queues();
 	run_local_timers();
 	scheduler_tick(user_tick, system);
 }
@@ -1060,37 +1146,9 @@ asmlinkage long sys_gettid(void)
 	return current->pid;
 }
 
-static long nanosleep_restart(struct restart_block *restart)
-{
-	unsigned long expire = restart->arg0, now = jiffies;
-	struct timespec *rmtp = (struct timespec *) restart->arg1;
-	long ret;
-
-	/* Did it expire while we handled signals? */
-	if (!time_after(expire, now))
-		return 0;
-
-	current->state = TASK_INTERRUPTIBLE;
-	expire = schedule_timeout(expire - now);
-
-	ret = 0;
-	if (expire) {
-		struct timespec t;
-		jiffies_to_timespec(expire, &t);
-
-		ret = -ERESTART_RESTARTBLOCK;
-		if (rmtp && copy_to_user(rmtp, &t, sizeof(t)))
-			ret = -EFAULT;
-		/* The 'restart' block is already filled in */
-	}
-	return ret;
-}
-
 asmlinkage long sys_nanosleep(struct timespec *rqtp, struct timespec *rmtp)
 {
 	struct timespec t;
-	unsigned long expire;
-	long ret;
 
 	if (copy_from_user(&t, rqtp, sizeof(t)))
 		return -EFAULT;
@@ -1098,24 +1156,7 @@ asmlinkage long sys_nanosleep(struct timespec *rqtp, struct timespec *rmtp)
 	if ((t.tv_nsec >= 1000000000L) || (t.tv_nsec < 0) || (t.tv_sec < 0))
 		return -EINVAL;
 
-	expire = timespec_to_jiffies(&t) + (t.tv_sec || t.tv_nsec);
-	current->state = TASK_INTERRUPTIBLE;
-	expire = schedule_timeout(expire);
-
-	ret = 0;
-	if (expire) {
-		struct restart_block *restart;
-		jiffies_to_timespec(expire, &t);
-		if (rmtp && copy_to_user(rmtp, &t, sizeof(t)))
-			return -EFAULT;
-
-		restart = &current_thread_info()->restart_block;
-		restart->fn = nanosleep_restart;
-		restart->arg0 = jiffies + expire;
-		restart->arg1 = (unsigned long) rmtp;
-		ret = -ERESTART_RESTARTBLOCK;
-	}
-	return ret;
+	return hrtimer_nanosleep(&t, rmtp);
 }
 
 /*
@@ -1252,6 +1293,7 @@ void __init init_timers(void)
 				(void *)(long)smp_processor_id());
 	register_cpu_notifier(&timers_nb);
 	open_softirq(TIMER_SOFTIRQ, run_timer_softirq, NULL);
+	hrtimers_init();
 }
 
 #ifdef CONFIG_TIME_INTERPOLATION
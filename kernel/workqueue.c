@@ -25,9 +25,85 @@
 #include <linux/completion.h>
 #include <linux/workqueue.h>
 #include <linux/slab.h>
+#include <linux/cpu.h>
+#include <linux/notifier.h>
 
 /*
- * The per-CPU workqueue.
+ * A pool of worker threads.  There is one for each cpu, whose workers
+ * are bound to it, and one unbound pool.
+ *
+ * nr_running counts the workers of a cpu pool which are executing a
+ * work and not blocked.  While it is nonzero nobody else is woken: works
+ * of all workqueues queued on the cpu are taken in turn by the same
+ * worker.  When it drops to zero with work pending, schedule() wakes an
+ * idle worker, which first makes sure that there is another idle
+ * worker to hand over to in turn.  Workers of the unbound pool are
+ * never counted, so each work is handed to its own worker and only
+ * max_active throttles them.
+ *
+ * Everything but nr_running is protected by the pool lock.
+ */
+struct worker_pool {
+	spinlock_t lock;
+	int cpu;			/* -1 for the unbound pool */
+
+	struct list_head worklist;	/* works of all workqueues */
+	atomic_t nr_running;
+
+	int nr_workers;
+	int nr_idle;
+	struct list_head idle_list;	/* idle workers, most recent first */
+	struct list_head busy_list;	/* workers executing a work */
+	int managing;			/* a worker is being created */
+	int next_id;
+
+	struct timer_list mayday_timer;	/* calls the rescuers in */
+} ____cacheline_aligned_in_smp;
+
+#define WORKER_RUNNING		0x01	/* counted in pool->nr_running */
+#define WORKER_SLEEPING		0x02	/* blocked while running */
+
+struct worker {
+	struct list_head entry;		/* on idle_list or busy_list */
+	struct worker_pool *pool;
+	task_t *task;
+	int id;
+	unsigned int flags;		/* only changed by the worker itself */
+
+	struct work_struct *current_work;
+	struct cpu_workqueue_struct *current_cwq;
+	struct list_head scheduled;	/* works to run after current_work */
+
+	struct completion *started;
+};
+
+/*
+ * Idle workers beyond the first two exit after this long if there are
+ * more than a quarter as many of them as busy ones.
+ */
+#define IDLE_WORKER_TIMEOUT	(300 * HZ)
+#define MAX_IDLE_WORKERS_RATIO	4
+
+/*
+ * While a new worker is being created, the rescuers of the workqueues
+ * with works waiting are called in after MAYDAY_INITIAL_TIMEOUT and
+ * then every MAYDAY_INTERVAL.  A failed creation is retried after
+ * CREATE_COOLDOWN.
+ */
+#define MAYDAY_INITIAL_TIMEOUT	(HZ / 100 >= 2 ? HZ / 100 : 2)
+#define MAYDAY_INTERVAL		(HZ / 10)
+#define CREATE_COOLDOWN		HZ
+
+static struct worker_pool cpu_pools[NR_CPUS];
+static struct worker_pool unbound_pool;
+
+/*
+ * The per-CPU part of a workqueue.  Its works are run by the pool of
+ * the cpu, or by the unbound pool for WQ_UNBOUND workqueues, which only
+ * use the first of these.  Everything is protected by the pool lock.
+ *
+ * At most max_active works are handed to the pool, the others wait on
+ * delayed_works.
  *
  * The sequence counters are for flush_scheduled_work().  It wants to wait
  * until until all currently-scheduled works are completed, but it doesn't
@@ -37,18 +113,17 @@
  */
 struct cpu_workqueue_struct {
 
-	spinlock_t lock;
+	struct worker_pool *pool;
 
 	long remove_sequence;	/* Least-recently added (next to run) */
 	long insert_sequence;	/* Next to add */
 
-	struct list_head worklist;
-	wait_queue_head_t more_work;
+	int nr_active;
+	int max_active;
+	struct list_head delayed_works;
 	wait_queue_head_t work_done;
 
 	struct workqueue_struct *wq;
-	task_t *thread;
-	struct completion exit;
 
 } ____cacheline_aligned;
 
@@ -57,9 +132,78 @@ struct cpu_workqueue_struct {
  * per-CPU workqueues:
  */
 struct workqueue_struct {
+	unsigned int flags;
+	const char *name;
+
+	/* WQ_MEM_RECLAIM only, mayday_mask under wq_mayday_lock */
+	struct worker *rescuer;
+	cpumask_t mayday_mask;		/* cwqs asking for the rescuer */
+	struct completion *rescuer_exit;
+
 	struct cpu_workqueue_struct cpu_wq[NR_CPUS];
 };
 
+static spinlock_t wq_mayday_lock = SPIN_LOCK_UNLOCKED;
+
+static inline struct cpu_workqueue_struct *
+get_cwq(struct workqueue_struct *wq, int cpu)
+{
+	if (wq->flags & WQ_UNBOUND)
+		return wq->cpu_wq;
+	return wq->cpu_wq + cpu;
+}
+
+static inline int need_more_worker(struct worker_pool *pool)
+{
+	return !list_empty(&pool->worklist) &&
+		!atomic_read(&pool->nr_running);
+}
+
+static inline int keep_working(struct worker_pool *pool)
+{
+	return !list_empty(&pool->worklist) &&
+		atomic_read(&pool->nr_running) <= 1;
+}
+
+static inline int too_many_workers(struct worker_pool *pool)
+{
+	int nr_busy = pool->nr_workers - pool->nr_idle;
+
+	return pool->nr_idle > 2 &&
+		(pool->nr_idle - 2) * MAX_IDLE_WORKERS_RATIO >= nr_busy;
+}
+
+/* Wake up the most recently idle worker, if any. Called with pool lock. */
+static void wake_up_worker(struct worker_pool *pool)
+{
+	struct worker *worker;
+
+	if (list_empty(&pool->idle_list))
+		return;
+	worker = list_entry(pool->idle_list.next, struct worker, entry);
+	wake_up_process(worker->task);
+}
+
+/*
+ * Hand a work over to the pool, or park it if the workqueue has
+ * max_active works in flight already.  Called with the pool lock.
+ */
+static void insert_work(struct cpu_workqueue_struct *cwq,
+			struct work_struct *work)
+{
+	struct worker_pool *pool = cwq->pool;
+
+	cwq->insert_sequence++;
+	if (cwq->nr_active >= cwq->max_active) {
+		list_add_tail(&work->entry, &cwq->delayed_works);
+		return;
+	}
+	cwq->nr_active++;
+	list_add_tail(&work->entry, &pool->worklist);
+	if (need_more_worker(pool))
+		wake_up_worker(pool);
+}
+
 /*
  * Queue work on a workqueue. Return non-zero if it was successfully
  * added.
@@ -71,17 +215,15 @@ int queue_work(struct workqueue_struct *wq, struct work_struct *work)
 {
 	unsigned long flags;
 	int ret = 0, cpu = get_cpu();
-	struct cpu_workqueue_struct *cwq = wq->cpu_wq + cpu;
+	struct cpu_workqueue_struct *cwq = get_cwq(wq, cpu);
 
 	if (!test_and_set_bit(0, &work->pending)) {
 		BUG_ON(!list_empty(&work->entry));
 		work->wq_data = cwq;
 
-		spin_lock_irqsave(&cwq->lock, flags);
-		list_add_tail(&work->entry, &cwq->worklist);
-		cwq->insert_sequence++;
-		wake_up(&cwq->more_work);
-		spin_unlock_irqrestore(&cwq->lock, flags);
+		spin_lock_irqsave(&cwq->pool->lock, flags);
+		insert_work(cwq, work);
+		spin_unlock_irqrestore(&cwq->pool->lock, flags);
 		ret = 1;
 	}
 	put_cpu();
@@ -98,11 +240,9 @@ static void delayed_work_timer_fn(unsigned long __data)
 	 * Do the wakeup within the spinlock, so that flushing
 	 * can be done in a guaranteed way.
 	 */
-	spin_lock_irqsave(&cwq->lock, flags);
-	list_add_tail(&work->entry, &cwq->worklist);
-	cwq->insert_sequence++;
-	wake_up(&cwq->more_work);
-	spin_unlock_irqrestore(&cwq->lock, flags);
+	spin_lock_irqsave(&cwq->pool->lock, flags);
+	insert_work(cwq, work);
+	spin_unlock_irqrestore(&cwq->pool->lock, flags);
 }
 
 int queue_delayed_work(struct workqueue_struct *wq,
@@ -110,7 +250,7 @@ int queue_delayed_work(struct workqueue_struct *wq,
 {
 	int ret = 0, cpu = get_cpu();
 	struct timer_list *timer = &work->timer;
-	struct cpu_workqueue_struct *cwq = wq->cpu_wq + cpu;
+	struct cpu_workqueue_struct *cwq = get_cwq(wq, cpu);
 
 	if (!test_and_set_bit(0, &work->pending)) {
 		BUG_ON(timer_pending(timer));
@@ -127,58 +267,252 @@ int queue_delayed_work(struct workqueue_struct *wq,
 	return ret;
 }
 
-static inline void run_workqueue(struct cpu_workqueue_struct *cwq)
+/*
+ * schedule() hooks.  They run in the context of the worker itself, so
+ * worker->flags needs no locking.  The pool lock is only taken when the
+ * last running worker of the pool blocks, which orders it against
+ * insert_work() seeing nr_running nonzero and not waking anybody.
+ */
+void wq_worker_sleeping(task_t *task)
+{
+	struct worker *worker = task->wq_worker;
+	struct worker_pool *pool = worker->pool;
+	unsigned long flags;
+
+	if (task->state == TASK_RUNNING ||
+	    (preempt_count() & PREEMPT_ACTIVE) ||
+	    !(worker->flags & WORKER_RUNNING))
+		return;
+
+	worker->flags |= WORKER_SLEEPING;
+	if (atomic_dec_and_test(&pool->nr_running)) {
+		spin_lock_irqsave(&pool->lock, flags);
+		if (need_more_worker(pool))
+			wake_up_worker(pool);
+		spin_unlock_irqrestore(&pool->lock, flags);
+	}
+}
+
+void wq_worker_waking_up(task_t *task)
+{
+	struct worker *worker = task->wq_worker;
+
+	if (worker->flags & WORKER_SLEEPING) {
+		worker->flags &= ~WORKER_SLEEPING;
+		atomic_inc(&worker->pool->nr_running);
+	}
+}
+
+static int worker_thread(void *__worker);
+
+/*
+ * Start a new worker for @pool and wait until it has gone idle.
+ * Called without the pool lock, in process context.
+ */
+static int create_worker(struct worker_pool *pool)
 {
+	struct completion started;
+	struct worker *worker;
 	unsigned long flags;
+	int ret;
 
-	/*
-	 * Keep taking off work from the queue until
-	 * done.
-	 */
-	spin_lock_irqsave(&cwq->lock, flags);
-	while (!list_empty(&cwq->worklist)) {
-		struct work_struct *work = list_entry(cwq->worklist.next,
-						struct work_struct, entry);
-		void (*f) (void *) = work->func;
-		void *data = work->data;
-
-		list_del_init(cwq->worklist.next);
-		spin_unlock_irqrestore(&cwq->lock, flags);
-
-		BUG_ON(work->wq_data != cwq);
-		clear_bit(0, &work->pending);
-		f(data);
-
-		spin_lock_irqsave(&cwq->lock, flags);
-		cwq->remove_sequence++;
-		wake_up(&cwq->work_done);
+	worker = kmalloc(sizeof(*worker), GFP_KERNEL);
+	if (!worker)
+		return -ENOMEM;
+	memset(worker, 0, sizeof(*worker));
+	INIT_LIST_HEAD(&worker->entry);
+	INIT_LIST_HEAD(&worker->scheduled);
+	worker->pool = pool;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	worker->id = pool->next_id++;
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	init_completion(&started);
+	worker->started = &started;
+	ret = kernel_thread(worker_thread, worker, CLONE_FS | CLONE_FILES);
+	if (ret < 0) {
+		kfree(worker);
+		return ret;
 	}
-	spin_unlock_irqrestore(&cwq->lock, flags);
+	wait_for_completion(&started);
+	return 0;
 }
 
-typedef struct startup_s {
-	struct cpu_workqueue_struct *cwq;
-	struct completion done;
-	const char *name;
-} startup_t;
+/*
+ * Ask the rescuer of the work's workqueue, if it has one, to run the
+ * works it has waiting on the pool.  Called with the pool lock.
+ */
+static void send_mayday(struct work_struct *work)
+{
+	struct cpu_workqueue_struct *cwq = work->wq_data;
+	struct workqueue_struct *wq = cwq->wq;
+
+	if (!wq->rescuer)
+		return;
+
+	spin_lock(&wq_mayday_lock);
+	cpu_set(cwq - wq->cpu_wq, wq->mayday_mask);
+	spin_unlock(&wq_mayday_lock);
+	wake_up_process(wq->rescuer->task);
+}
+
+static void pool_mayday_timeout(unsigned long __pool)
+{
+	struct worker_pool *pool = (struct worker_pool *)__pool;
+	struct work_struct *work;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	if (need_more_worker(pool) && !pool->nr_idle)
+		list_for_each_entry(work, &pool->worklist, entry)
+			send_mayday(work);
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	mod_timer(&pool->mayday_timer, jiffies + MAYDAY_INTERVAL);
+}
+
+/*
+ * Make sure that there is an idle worker to take over when we block.
+ * Called and returns with the pool lock held, which may be dropped.
+ * Returns nonzero if it did so, in which case the caller must recheck.
+ *
+ * Creating a worker may wait on memory reclaim, which may wait on the
+ * very works we are starting a worker for: the mayday timer hands them
+ * to the rescuers meanwhile.
+ */
+static int manage_workers(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	if (pool->managing)
+		return 0;
+	pool->managing = 1;
+	spin_unlock_irq(&pool->lock);
+
+	mod_timer(&pool->mayday_timer, jiffies + MAYDAY_INITIAL_TIMEOUT);
+	while (create_worker(pool) < 0) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_timeout(CREATE_COOLDOWN);
+		if (!need_more_worker(pool))
+			break;
+	}
+	del_timer_sync(&pool->mayday_timer);
+
+	spin_lock_irq(&pool->lock);
+	pool->managing = 0;
+	return 1;
+}
+
+static struct worker *find_worker_executing_work(struct worker_pool *pool,
+						 struct work_struct *work)
+{
+	struct worker *worker;
+
+	list_for_each_entry(worker, &pool->busy_list, entry)
+		if (worker->current_work == work)
+			return worker;
+	return NULL;
+}
+
+/* The work is done, let the next delayed one at the pool. */
+static void cwq_work_done(struct cpu_workqueue_struct *cwq)
+{
+	struct work_struct *work;
+
+	cwq->remove_sequence++;
+	cwq->nr_active--;
+	if (!list_empty(&cwq->delayed_works)) {
+		work = list_entry(cwq->delayed_works.next,
+				  struct work_struct, entry);
+		list_move_tail(&work->entry, &cwq->pool->worklist);
+		cwq->nr_active++;
+	}
+	wake_up(&cwq->work_done);
+}
+
+/*
+ * Run one work, with the pool lock dropped meanwhile.  A work is never
+ * run by two workers of a pool at once: if it is requeued while it
+ * runs, the new instance is left to the worker running the old one.
+ */
+static void process_one_work(struct worker *worker, struct work_struct *work)
+{
+	struct worker_pool *pool = worker->pool;
+	struct cpu_workqueue_struct *cwq = work->wq_data;
+	struct worker *collision;
+	void (*f) (void *) = work->func;
+	void *data = work->data;
+
+	collision = find_worker_executing_work(pool, work);
+	if (collision) {
+		list_move_tail(&work->entry, &collision->scheduled);
+		return;
+	}
+
+	list_del_init(&work->entry);
+	worker->current_work = work;
+	worker->current_cwq = cwq;
+	list_add(&worker->entry, &pool->busy_list);
+
+	/* Nobody throttles the unbound pool, spread the work out. */
+	if (pool->cpu < 0 && !list_empty(&pool->worklist))
+		wake_up_worker(pool);
+
+	spin_unlock_irq(&pool->lock);
+
+	BUG_ON(cwq->pool != pool);
+	clear_bit(0, &work->pending);
+	f(data);
+
+	spin_lock_irq(&pool->lock);
+	list_del_init(&worker->entry);
+	worker->current_work = NULL;
+	worker->current_cwq = NULL;
+	cwq_work_done(cwq);
+}
+
+static void process_scheduled_works(struct worker *worker)
+{
+	while (!list_empty(&worker->scheduled))
+		process_one_work(worker, list_entry(worker->scheduled.next,
+						    struct work_struct, entry));
+}
+
+static void worker_enter_idle(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	list_add(&worker->entry, &pool->idle_list);
+	pool->nr_idle++;
+}
 
-static int worker_thread(void *__startup)
+static void worker_leave_idle(struct worker *worker)
 {
-	startup_t *startup = __startup;
-	struct cpu_workqueue_struct *cwq = startup->cwq;
-	int cpu = cwq - cwq->wq->cpu_wq;
-	DECLARE_WAITQUEUE(wait, current);
+	struct worker_pool *pool = worker->pool;
+
+	list_del_init(&worker->entry);
+	pool->nr_idle--;
+}
+
+static int worker_thread(void *__worker)
+{
+	struct worker *worker = __worker;
+	struct worker_pool *pool = worker->pool;
 	struct k_sigaction sa;
+	long timeout;
 
-	daemonize("%s/%d", startup->name, cpu);
+	if (pool->cpu < 0)
+		daemonize("kworker/u:%d", worker->id);
+	else
+		daemonize("kworker/%d:%d", pool->cpu, worker->id);
 	allow_signal(SIGCHLD);
 	current->flags |= PF_IOTHREAD;
-	cwq->thread = current;
+	worker->task = current;
 
 	set_user_nice(current, -10);
-	set_cpus_allowed(current, cpumask_of_cpu(cpu));
-
-	complete(&startup->done);
+	if (pool->cpu >= 0)
+		set_cpus_allowed(current, cpumask_of_cpu(pool->cpu));
 
 	/* Install a handler so SIGCLD is delivered */
 	sa.sa.sa_handler = SIG_IGN;
@@ -186,20 +520,44 @@ static int worker_thread(void *__startup)
 	siginitset(&sa.sa.sa_mask, sigmask(SIGCHLD));
 	do_sigaction(SIGCHLD, &sa, (struct k_sigaction *)0);
 
-	for (;;) {
-		set_task_state(current, TASK_INTERRUPTIBLE);
+	current->wq_worker = worker;
+	current->flags |= PF_WQ_WORKER;
 
-		add_wait_queue(&cwq->more_work, &wait);
-		if (!cwq->thread)
-			break;
-		if (list_empty(&cwq->worklist))
-			schedule();
-		else
-			set_task_state(current, TASK_RUNNING);
-		remove_wait_queue(&cwq->more_work, &wait);
+	spin_lock_irq(&pool->lock);
+	pool->nr_workers++;
+	complete(worker->started);
+	worker->started = NULL;
+	goto sleep;
 
-		if (!list_empty(&cwq->worklist))
-			run_workqueue(cwq);
+	for (;;) {
+		worker_leave_idle(worker);
+recheck:
+		if (!need_more_worker(pool))
+			goto sleep;
+		/* Somebody has to be there when we block */
+		if (!pool->nr_idle && manage_workers(worker))
+			goto recheck;
+
+		if (pool->cpu >= 0) {
+			worker->flags |= WORKER_RUNNING;
+			atomic_inc(&pool->nr_running);
+		}
+		do {
+			process_one_work(worker,
+					 list_entry(pool->worklist.next,
+						    struct work_struct, entry));
+			process_scheduled_works(worker);
+		} while (keep_working(pool));
+		if (worker->flags & WORKER_RUNNING) {
+			worker->flags &= ~WORKER_RUNNING;
+			atomic_dec(&pool->nr_running);
+		}
+sleep:
+		worker_enter_idle(worker);
+		__set_current_state(TASK_INTERRUPTIBLE);
+		spin_unlock_irq(&pool->lock);
+
+		timeout = schedule_timeout(IDLE_WORKER_TIMEOUT);
 
 		if (signal_pending(current)) {
 			while (waitpid(-1, NULL, __WALL|WNOHANG) > 0)
@@ -208,13 +566,101 @@ static int worker_thread(void *__startup)
 			/* zap all other signals */
 			flush_signals(current);
 		}
+
+		spin_lock_irq(&pool->lock);
+		if (!timeout && !need_more_worker(pool) &&
+		    too_many_workers(pool))
+			break;
 	}
-	remove_wait_queue(&cwq->more_work, &wait);
-	complete(&cwq->exit);
 
+	worker_leave_idle(worker);
+	pool->nr_workers--;
+	spin_unlock_irq(&pool->lock);
+
+	current->flags &= ~PF_WQ_WORKER;
+	current->wq_worker = NULL;
+	kfree(worker);
 	return 0;
 }
 
+/*
+ * Run the works @cwq has waiting on its pool, including the delayed
+ * ones they let in as they complete.
+ */
+static void rescue_cwq(struct worker *rescuer, struct cpu_workqueue_struct *cwq)
+{
+	struct worker_pool *pool = cwq->pool;
+	struct work_struct *work, *n;
+	cpumask_t all = CPU_MASK_ALL;
+
+	rescuer->pool = pool;
+	if (pool->cpu >= 0)
+		set_cpus_allowed(current, cpumask_of_cpu(pool->cpu));
+
+	spin_lock_irq(&pool->lock);
+	for (;;) {
+		list_for_each_entry_safe(work, n, &pool->worklist, entry)
+			if (work->wq_data == cwq)
+				list_move_tail(&work->entry, &rescuer->scheduled);
+		if (list_empty(&rescuer->scheduled))
+			break;
+		process_scheduled_works(rescuer);
+	}
+	/* the pool may have workers to spare again for the rest */
+	if (need_more_worker(pool))
+		wake_up_worker(pool);
+	spin_unlock_irq(&pool->lock);
+
+	if (pool->cpu >= 0)
+		set_cpus_allowed(current, all);
+}
+
+/*
+ * The rescuer of a WQ_MEM_RECLAIM workqueue.  It sleeps until a pool
+ * which can't get a new worker sends it a mayday, and then runs the
+ * works of its own workqueue there.  It never counts in nr_running.
+ */
+static int rescuer_thread(void *__wq)
+{
+	struct workqueue_struct *wq = __wq;
+	struct worker *rescuer = wq->rescuer;
+	int cpu;
+
+	daemonize("%s", wq->name);
+	current->flags |= PF_IOTHREAD;
+	rescuer->task = current;
+	set_user_nice(current, -10);
+
+	current->wq_worker = rescuer;
+	current->flags |= PF_WQ_WORKER;
+	complete(rescuer->started);
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+
+		spin_lock_irq(&wq_mayday_lock);
+		cpu = first_cpu(wq->mayday_mask);
+		if (cpu < NR_CPUS)
+			cpu_clear(cpu, wq->mayday_mask);
+		spin_unlock_irq(&wq_mayday_lock);
+
+		if (cpu >= NR_CPUS) {
+			if (wq->rescuer_exit)
+				break;
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+		rescue_cwq(rescuer, wq->cpu_wq + cpu);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	current->flags &= ~PF_WQ_WORKER;
+	current->wq_worker = NULL;
+	kfree(rescuer);
+	complete_and_exit(wq->rescuer_exit, 0);
+}
+
 /*
  * flush_workqueue - ensure that any scheduled work has run to completion.
  *
@@ -240,104 +686,104 @@ void flush_workqueue(struct workqueue_struct *wq)
 		DEFINE_WAIT(wait);
 		long sequence_needed;
 
-		if (!cpu_online(cpu))
+		if (wq->flags & WQ_UNBOUND) {
+			if (cpu)
+				break;
+		} else if (!cpu_online(cpu))
 			continue;
 		cwq = wq->cpu_wq + cpu;
 
-		spin_lock_irq(&cwq->lock);
+		spin_lock_irq(&cwq->pool->lock);
 		sequence_needed = cwq->insert_sequence;
 
 		while (sequence_needed - cwq->remove_sequence > 0) {
 			prepare_to_wait(&cwq->work_done, &wait,
 					TASK_UNINTERRUPTIBLE);
-			spin_unlock_irq(&cwq->lock);
+			spin_unlock_irq(&cwq->pool->lock);
 			schedule();
-			spin_lock_irq(&cwq->lock);
+			spin_lock_irq(&cwq->pool->lock);
 		}
 		finish_wait(&cwq->work_done, &wait);
-		spin_unlock_irq(&cwq->lock);
-	}
-}
-
-static int create_workqueue_thread(struct workqueue_struct *wq,
-				   const char *name,
-				   int cpu)
-{
-	startup_t startup;
-	struct cpu_workqueue_struct *cwq = wq->cpu_wq + cpu;
-	int ret;
-
-	spin_lock_init(&cwq->lock);
-	cwq->wq = wq;
-	cwq->thread = NULL;
-	cwq->insert_sequence = 0;
-	cwq->remove_sequence = 0;
-	INIT_LIST_HEAD(&cwq->worklist);
-	init_waitqueue_head(&cwq->more_work);
-	init_waitqueue_head(&cwq->work_done);
-	init_completion(&cwq->exit);
-
-	init_completion(&startup.done);
-	startup.cwq = cwq;
-	startup.name = name;
-	ret = kernel_thread(worker_thread, &startup, CLONE_FS | CLONE_FILES);
-	if (ret >= 0) {
-		wait_for_completion(&startup.done);
-		BUG_ON(!cwq->thread);
+		spin_unlock_irq(&cwq->pool->lock);
 	}
-	return ret;
 }
 
-struct workqueue_struct *create_workqueue(const char *name)
+/*
+ * Workers are shared, so creating a workqueue only sets up its
+ * per-cpu accounting, and the rescuer of a WQ_MEM_RECLAIM one.
+ */
+struct workqueue_struct *alloc_workqueue(const char *name,
+					 unsigned int flags, int max_active)
 {
-	int cpu, destroy = 0;
+	struct cpu_workqueue_struct *cwq;
 	struct workqueue_struct *wq;
+	struct completion started;
+	struct worker *rescuer;
+	int cpu;
 
-	BUG_ON(strlen(name) > 10);
+	if (!max_active)
+		max_active = WQ_DFL_ACTIVE;
+	BUG_ON(max_active < 0 || max_active > WQ_MAX_ACTIVE);
 
 	wq = kmalloc(sizeof(*wq), GFP_KERNEL);
 	if (!wq)
 		return NULL;
+	wq->flags = flags;
+	wq->name = name;
+	wq->rescuer = NULL;
+	cpus_clear(wq->mayday_mask);
+	wq->rescuer_exit = NULL;
 
 	for (cpu = 0; cpu < NR_CPUS; cpu++) {
-		if (!cpu_online(cpu))
-			continue;
-		if (create_workqueue_thread(wq, name, cpu) < 0)
-			destroy = 1;
+		cwq = wq->cpu_wq + cpu;
+		if (flags & WQ_UNBOUND)
+			cwq->pool = &unbound_pool;
+		else
+			cwq->pool = cpu_pools + cpu;
+		cwq->wq = wq;
+		cwq->insert_sequence = 0;
+		cwq->remove_sequence = 0;
+		cwq->nr_active = 0;
+		cwq->max_active = max_active;
+		INIT_LIST_HEAD(&cwq->delayed_works);
+		init_waitqueue_head(&cwq->work_done);
 	}
-	/*
-	 * Was there any error during startup? If yes then clean up:
-	 */
-	if (destroy) {
-		destroy_workqueue(wq);
-		wq = NULL;
+
+	if (flags & WQ_MEM_RECLAIM) {
+		rescuer = kmalloc(sizeof(*rescuer), GFP_KERNEL);
+		if (!rescuer)
+			goto fail;
+		memset(rescuer, 0, sizeof(*rescuer));
+		INIT_LIST_HEAD(&rescuer->entry);
+		INIT_LIST_HEAD(&rescuer->scheduled);
+		rescuer->id = -1;
+		wq->rescuer = rescuer;
+
+		init_completion(&started);
+		rescuer->started = &started;
+		if (kernel_thread(rescuer_thread, wq, CLONE_FS | CLONE_FILES) < 0) {
+			kfree(rescuer);
+			goto fail;
+		}
+		wait_for_completion(&started);
+		rescuer->started = NULL;
 	}
 	return wq;
-}
-
-static void cleanup_workqueue_thread(struct workqueue_struct *wq, int cpu)
-{
-	struct cpu_workqueue_struct *cwq;
-
-	cwq = wq->cpu_wq + cpu;
-	if (cwq->thread) {
-		/* Tell thread to exit and wait for it. */
-		cwq->thread = NULL;
-		wake_up(&cwq->more_work);
 
-		wait_for_completion(&cwq->exit);
-	}
+fail:
+	kfree(wq);
+	return NULL;
 }
 
 void destroy_workqueue(struct workqueue_struct *wq)
 {
-	int cpu;
+	DECLARE_COMPLETION(exited);
 
 	flush_workqueue(wq);
-
-	for (cpu = 0; cpu < NR_CPUS; cpu++) {
-		if (cpu_online(cpu))
-			cleanup_workqueue_thread(wq, cpu);
+	if (wq->rescuer) {
+		wq->rescuer_exit = &exited;
+		wake_up_process(wq->rescuer->task);
+		wait_for_completion(&exited);
 	}
 	kfree(wq);
 }
@@ -361,28 +807,67 @@ void flush_scheduled_work(void)
 
 int current_is_keventd(void)
 {
-	struct cpu_workqueue_struct *cwq;
-	int cpu;
+	struct worker *worker = current->wq_worker;
 
 	BUG_ON(!keventd_wq);
 
-	for (cpu = 0; cpu < NR_CPUS; cpu++) {
-		if (!cpu_online(cpu))
-			continue;
-		cwq = keventd_wq->cpu_wq + cpu;
-		if (current == cwq->thread)
-			return 1;
+	return (current->flags & PF_WQ_WORKER) && worker->current_cwq &&
+		worker->current_cwq->wq == keventd_wq;
+}
+
+static void init_worker_pool(struct worker_pool *pool, int cpu)
+{
+	spin_lock_init(&pool->lock);
+	pool->cpu = cpu;
+	INIT_LIST_HEAD(&pool->worklist);
+	atomic_set(&pool->nr_running, 0);
+	INIT_LIST_HEAD(&pool->idle_list);
+	INIT_LIST_HEAD(&pool->busy_list);
+
+	init_timer(&pool->mayday_timer);
+	pool->mayday_timer.function = pool_mayday_timeout;
+	pool->mayday_timer.data = (unsigned long)pool;
+}
+
+static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
+					    unsigned long action,
+					    void *hcpu)
+{
+	int hotcpu = (unsigned long)hcpu;
+
+	if (action == CPU_ONLINE && !cpu_pools[hotcpu].nr_workers) {
+		if (create_worker(cpu_pools + hotcpu) < 0) {
+			printk("workqueue: no worker for cpu %i\n", hotcpu);
+			return NOTIFY_BAD;
+		}
 	}
-	return 0;
+	return NOTIFY_OK;
 }
 
-void init_workqueues(void)
+static struct notifier_block __devinitdata workqueue_cpu_nb = {
+	.notifier_call	= workqueue_cpu_callback,
+};
+
+void __init init_workqueues(void)
 {
+	int cpu;
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++)
+		init_worker_pool(cpu_pools + cpu, cpu);
+	init_worker_pool(&unbound_pool, -1);
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++)
+		if (cpu_online(cpu))
+			workqueue_cpu_callback(&workqueue_cpu_nb, CPU_ONLINE,
+					       (void *)(long)cpu);
+	register_cpu_notifier(&workqueue_cpu_nb);
+	BUG_ON(create_worker(&unbound_pool) < 0);
+
 	keventd_wq = create_workqueue("events");
 	BUG_ON(!keventd_wq);
 }
 
-EXPORT_SYMBOL_GPL(create_workqueue);
+EXPORT_SYMBOL_GPL(alloc_workqueue);
 EXPORT_SYMBOL_GPL(queue_work);
 EXPORT_SYMBOL_GPL(queue_delayed_work);
 EXPORT_SYMBOL_GPL(flush_workqueue);
@@ -391,4 +876,3 @@ EXPORT_SYMBOL_GPL(destroy_workqueue);
 EXPORT_SYMBOL(schedule_work);
 EXPORT_SYMBOL(schedule_delayed_work);
 EXPORT_SYMBOL(flush_scheduled_work);
-
@@ -117,6 +117,8 @@ rpc_create_client(struct rpc_xprt *xprt, char *servname,
 	atomic_set(&clnt->cl_users, 0);
 
 	clnt->cl_xprt     = xprt;
+	clnt->cl_xprts[0] = xprt;
+	clnt->cl_nxprts   = 1;
 	clnt->cl_procinfo = version->procs;
 	clnt->cl_maxproc  = version->nrprocs;
 	clnt->cl_server   = servname;
@@ -200,6 +202,8 @@ rpc_shutdown_client(struct rpc_clnt *clnt)
 int
 rpc_destroy_client(struct rpc_clnt *clnt)
 {
+	unsigned int i;
+
 	dprintk("RPC: destroying %s client for %s\n",
 			clnt->cl_protname, clnt->cl_server);
 
@@ -210,6 +214,8 @@ rpc_destroy_client(struct rpc_clnt *clnt)
 	if (clnt->cl_pathname[0])
 		rpc_rmdir(clnt->cl_pathname);
 	if (clnt->cl_xprt) {
+		for (i = 1; i < clnt->cl_nxprts; i++)
+			xprt_destroy(clnt->cl_xprts[i]);
 		xprt_destroy(clnt->cl_xprt);
 		clnt->cl_xprt = NULL;
 	}
@@ -377,16 +383,48 @@ rpc_call_setup(struct rpc_task *task, struct rpc_message *msg, int flags)
 void
 rpc_setbufsize(struct rpc_clnt *clnt, unsigned int sndsize, unsigned int rcvsize)
 {
-	struct rpc_xprt *xprt = clnt->cl_xprt;
+	struct rpc_xprt *xprt;
+	unsigned int i;
+
+	for (i = 0; i < clnt->cl_nxprts; i++) {
+		xprt = clnt->cl_xprts[i];
+		xprt->sndsize = 0;
+		if (sndsize)
+			xprt->sndsize = sndsize + RPC_SLACK_SPACE;
+		xprt->rcvsize = 0;
+		if (rcvsize)
+			xprt->rcvsize = rcvsize + RPC_SLACK_SPACE;
+		if (xprt_connected(xprt))
+			xprt_sock_setbufsize(xprt);
+	}
+}
 
-	xprt->sndsize = 0;
-	if (sndsize)
-		xprt->sndsize = sndsize + RPC_SLACK_SPACE;
-	xprt->rcvsize = 0;
-	if (rcvsize)
-		xprt->rcvsize = rcvsize + RPC_SLACK_SPACE;
-	if (xprt_connected(xprt))
-		xprt_sock_setbufsize(xprt);
+/*
+ * Talk to the server over n transports instead of one.  The new ones
+ * are clones of cl_xprt, each with its own socket, request slots and
+ * congestion window; xprt_reserve spreads requests over them.
+ * Must be called before the client is put to use.
+ */
+int
+rpc_set_nconnect(struct rpc_clnt *clnt, unsigned int n)
+{
+	struct rpc_xprt *xprt = clnt->cl_xprt;
+	struct rpc_xprt *new;
+
+	if (n > RPC_MAXXPRTS)
+		n = RPC_MAXXPRTS;
+	while (clnt->cl_nxprts < n) {
+		new = xprt_create_proto(xprt->prot, &xprt->addr,
+					&xprt->timeout);
+		if (!new)
+			return -ENOMEM;
+		new->sndsize = xprt->sndsize;
+		new->rcvsize = xprt->rcvsize;
+		clnt->cl_xprts[clnt->cl_nxprts++] = new;
+	}
+	dprintk("RPC: %s client for %s uses %u transports\n",
+			clnt->cl_protname, clnt->cl_server, clnt->cl_nxprts);
+	return 0;
 }
 
 /*
@@ -581,7 +619,7 @@ static void
 call_bind(struct rpc_task *task)
 {
 	struct rpc_clnt	*clnt = task->tk_client;
-	struct rpc_xprt *xprt = clnt->cl_xprt;
+	struct rpc_xprt *xprt = task->tk_xprt;
 
 	dprintk("RPC: %4d call_bind xprt %p %s connected\n", task->tk_pid,
 			xprt, (xprt_connected(xprt) ? "is" : "is not"));
@@ -601,12 +639,10 @@ call_bind(struct rpc_task *task)
 static void
 call_connect(struct rpc_task *task)
 {
-	struct rpc_clnt *clnt = task->tk_client;
-
 	dprintk("RPC: %4d call_connect status %d\n",
 				task->tk_pid, task->tk_status);
 
-	if (xprt_connected(clnt->cl_xprt)) {
+	if (xprt_connected(task->tk_xprt)) {
 		task->tk_action = call_transmit;
 		return;
 	}
@@ -881,7 +917,7 @@ static u32 *
 call_header(struct rpc_task *task)
 {
 	struct rpc_clnt *clnt = task->tk_client;
-	struct rpc_xprt *xprt = clnt->cl_xprt;
+	struct rpc_xprt *xprt = task->tk_xprt;
 	struct rpc_rqst	*req = task->tk_rqstp;
 	u32		*p = req->rq_svec[0].iov_base;
 
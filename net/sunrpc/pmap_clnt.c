@@ -129,6 +129,7 @@ static void
 pmap_getport_done(struct rpc_task *task)
 {
 	struct rpc_clnt	*clnt = task->tk_client;
+	unsigned int	i;
 
 	dprintk("RPC: %4d pmap_getport_done(status %d, port %d)\n",
 			task->tk_pid, task->tk_status, clnt->cl_port);
@@ -142,7 +143,8 @@ pmap_getport_done(struct rpc_task *task)
 	} else {
 		/* byte-swap port number first */
 		clnt->cl_port = htons(clnt->cl_port);
-		clnt->cl_xprt->addr.sin_port = clnt->cl_port;
+		for (i = 0; i < clnt->cl_nxprts; i++)
+			clnt->cl_xprts[i]->addr.sin_port = clnt->cl_port;
 	}
 	spin_lock(&pmap_lock);
 	clnt->cl_binding = 0;
@@ -731,8 +731,10 @@ rpc_init_task(struct rpc_task *task, struct rpc_clnt *clnt,
 	list_add(&task->tk_task, &all_tasks);
 	spin_unlock(&rpc_sched_lock);
 
-	if (clnt)
+	if (clnt) {
 		atomic_inc(&clnt->cl_users);
+		task->tk_xprt = clnt->cl_xprt;
+	}
 
 #ifdef RPC_DEBUG
 	task->tk_magic = 0xf00baa;
@@ -52,6 +52,7 @@ EXPORT_SYMBOL(rpc_clnt_sigunmask);
 EXPORT_SYMBOL(rpc_delay);
 EXPORT_SYMBOL(rpc_restart_call);
 EXPORT_SYMBOL(rpc_setbufsize);
+EXPORT_SYMBOL(rpc_set_nconnect);
 EXPORT_SYMBOL(rpc_unlink);
 EXPORT_SYMBOL(rpc_wake_up);
 EXPORT_SYMBOL(rpc_queue_upcall);
@@ -73,6 +74,7 @@ EXPORT_SYMBOL(put_rpccred);
 
 /* RPC server stuff */
 EXPORT_SYMBOL(svc_create);
+EXPORT_SYMBOL(svc_create_pooled);
 EXPORT_SYMBOL(svc_create_thread);
 EXPORT_SYMBOL(svc_exit_thread);
 EXPORT_SYMBOL(svc_destroy);
@@ -82,6 +84,9 @@ EXPORT_SYMBOL(svc_recv);
 EXPORT_SYMBOL(svc_wake_up);
 EXPORT_SYMBOL(svc_makesock);
 EXPORT_SYMBOL(svc_reserve);
+EXPORT_SYMBOL(svc_max_payload);
+EXPORT_SYMBOL(svc_pool_map_set_mode);
+EXPORT_SYMBOL(svc_pool_map_get_mode);
 
 /* RPC statistics */
 #ifdef CONFIG_PROC_FS
@@ -151,6 +156,7 @@ init_sunrpc(void)
 #endif
 #ifdef CONFIG_PROC_FS
 	rpc_proc_init();
+	xprt_proc_init();
 #endif
 	cache_register(&auth_domain_cache);
 	cache_register(&ip_map_cache);
@@ -169,6 +175,7 @@ cleanup_sunrpc(void)
 	rpc_unregister_sysctl();
 #endif
 #ifdef CONFIG_PROC_FS
+	xprt_proc_exit();
 	rpc_proc_exit();
 #endif
 }
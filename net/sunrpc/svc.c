@@ -14,6 +14,8 @@
 #include <linux/in.h>
 #include <linux/unistd.h>
 #include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
 
 #include <linux/sunrpc/types.h>
 #include <linux/sunrpc/xdr.h>
@@ -24,15 +26,219 @@
 #define RPCDBG_FACILITY	RPCDBG_SVCDSP
 #define RPC_PARANOIA 1
 
+/*
+ * Mapping of cpus to thread pools, shared by all services.
+ *
+ * In SVC_POOL_PERCPU mode each online cpu gets a pool, in
+ * SVC_POOL_PERNODE mode each NUMA node with cpus does, and in
+ * SVC_POOL_GLOBAL mode there is a single pool as before.  Threads are
+ * bound to the cpus of their pool.  The map is built when the first
+ * service is created and the mode can only be changed while no
+ * service is running.
+ */
+enum {
+	SVC_POOL_AUTO = -1,	/* choose one of the others */
+	SVC_POOL_GLOBAL,	/* no mapping, just a single global pool */
+	SVC_POOL_PERCPU,	/* one pool per cpu */
+	SVC_POOL_PERNODE	/* one pool per numa node */
+};
+
+static const char *svc_pool_mode_names[] = {
+	[SVC_POOL_GLOBAL]	= "global",
+	[SVC_POOL_PERCPU]	= "percpu",
+	[SVC_POOL_PERNODE]	= "pernode",
+};
+
+static struct svc_pool_map {
+	int count;			/* # of services using the map */
+	int mode;			/* requested mode, maybe SVC_POOL_AUTO */
+	int cur_mode;			/* mode of the current map */
+	unsigned int npools;
+	unsigned int to_pool[NR_CPUS];	/* cpu -> pool */
+	cpumask_t pool_mask[NR_CPUS];	/* pool -> cpus */
+} svc_pool_map = {
+	.mode = SVC_POOL_AUTO,
+};
+static DECLARE_MUTEX(svc_pool_map_sem);
+
+static int
+svc_pool_map_choose_mode(void)
+{
+	if (numnodes > 1)
+		return SVC_POOL_PERNODE;
+	if (num_online_cpus() > 1)
+		return SVC_POOL_PERCPU;
+	return SVC_POOL_GLOBAL;
+}
+
+static unsigned int
+svc_pool_map_init_percpu(struct svc_pool_map *m)
+{
+	unsigned int pidx = 0;
+	int cpu;
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		if (!cpu_online(cpu))
+			continue;
+		m->to_pool[cpu] = pidx;
+		m->pool_mask[pidx] = cpumask_of_cpu(cpu);
+		pidx++;
+	}
+	return pidx;
+}
+
+static unsigned int
+svc_pool_map_init_pernode(struct svc_pool_map *m)
+{
+	unsigned int pidx = 0;
+	cpumask_t mask;
+	int node, cpu;
+
+	for (node = 0; node < numnodes && pidx < NR_CPUS; node++) {
+		mask = node_to_cpumask(node);
+		cpus_and(mask, mask, cpu_online_map);
+		if (cpus_empty(mask))
+			continue;
+		for (cpu = 0; cpu < NR_CPUS; cpu++)
+			if (cpu_isset(cpu, mask))
+				m->to_pool[cpu] = pidx;
+		m->pool_mask[pidx] = mask;
+		pidx++;
+	}
+	return pidx;
+}
+
+/*
+ * Take a reference to the pool map, building it for the first
+ * service.  Returns the number of pools.  Cpus that come online
+ * later are served by pool 0.
+ */
+static unsigned int
+svc_pool_map_get(void)
+{
+	struct svc_pool_map *m = &svc_pool_map;
+	unsigned int npools = 0;
+
+	down(&svc_pool_map_sem);
+
+	if (m->count++) {
+		up(&svc_pool_map_sem);
+		return m->npools;
+	}
+
+	memset(m->to_pool, 0, sizeof(m->to_pool));
+	m->cur_mode = m->mode;
+	if (m->cur_mode == SVC_POOL_AUTO)
+		m->cur_mode = svc_pool_map_choose_mode();
+
+	switch (m->cur_mode) {
+	case SVC_POOL_PERCPU:
+		npools = svc_pool_map_init_percpu(m);
+		break;
+	case SVC_POOL_PERNODE:
+		npools = svc_pool_map_init_pernode(m);
+		break;
+	}
+	if (npools < 2) {
+		/* default, or one cpu/node: a single global pool */
+		m->cur_mode = SVC_POOL_GLOBAL;
+		npools = 1;
+	}
+	m->npools = npools;
+
+	up(&svc_pool_map_sem);
+	return m->npools;
+}
+
+static void
+svc_pool_map_put(void)
+{
+	down(&svc_pool_map_sem);
+	svc_pool_map.count--;
+	up(&svc_pool_map_sem);
+}
+
+/*
+ * Set the pool mode by name ("auto", "global", "percpu" or "pernode")
+ * for services started from now on.  Fails with -EBUSY while any
+ * service is running.
+ */
+int
+svc_pool_map_set_mode(const char *name)
+{
+	int mode, err = 0;
+
+	if (!strcmp(name, "auto"))
+		mode = SVC_POOL_AUTO;
+	else {
+		for (mode = 0; mode <= SVC_POOL_PERNODE; mode++)
+			if (!strcmp(name, svc_pool_mode_names[mode]))
+				break;
+		if (mode > SVC_POOL_PERNODE)
+			return -EINVAL;
+	}
+
+	down(&svc_pool_map_sem);
+	if (svc_pool_map.count)
+		err = -EBUSY;
+	else
+		svc_pool_map.mode = mode;
+	up(&svc_pool_map_sem);
+	return err;
+}
+
+/*
+ * Name of the mode in use, or of the one that will be used by the
+ * next service started.
+ */
+const char *
+svc_pool_map_get_mode(void)
+{
+	struct svc_pool_map *m = &svc_pool_map;
+
+	if (m->count)
+		return svc_pool_mode_names[m->cur_mode];
+	if (m->mode == SVC_POOL_AUTO)
+		return "auto";
+	return svc_pool_mode_names[m->mode];
+}
+
+/*
+ * Find the pool to queue work for, on behalf of the given cpu.
+ * Pools without threads are skipped, so that a service running
+ * fewer threads than there are pools still serves every cpu.
+ */
+struct svc_pool *
+svc_pool_for_cpu(struct svc_serv *serv, int cpu)
+{
+	unsigned int pidx = 0;
+	unsigned int i;
+
+	if (serv->sv_nrpools <= 1)
+		return &serv->sv_pools[0];
+
+	pidx = svc_pool_map.to_pool[cpu];
+	if (pidx >= serv->sv_nrpools)
+		pidx = 0;
+	for (i = 0; i < serv->sv_nrpools; i++) {
+		if (serv->sv_pools[pidx].sp_nrthreads)
+			break;
+		if (++pidx == serv->sv_nrpools)
+			pidx = 0;
+	}
+	return &serv->sv_pools[pidx];
+}
+
 /*
  * Create an RPC service
  */
-struct svc_serv *
-svc_create(struct svc_program *prog, unsigned int bufsize)
+static struct svc_serv *
+__svc_create(struct svc_program *prog, unsigned int bufsize, int pooled)
 {
 	struct svc_serv	*serv;
 	int vers;
 	unsigned int xdrsize;
+	unsigned int i;
 
 	if (!(serv = (struct svc_serv *) kmalloc(sizeof(*serv), GFP_KERNEL)))
 		return NULL;
@@ -52,12 +258,31 @@ svc_create(struct svc_program *prog, unsigned int bufsize)
 				xdrsize = prog->pg_vers[vers]->vs_xdrsize;
 		}
 	serv->sv_xdrsize   = xdrsize;
-	INIT_LIST_HEAD(&serv->sv_threads);
-	INIT_LIST_HEAD(&serv->sv_sockets);
 	INIT_LIST_HEAD(&serv->sv_tempsocks);
 	INIT_LIST_HEAD(&serv->sv_permsocks);
 	spin_lock_init(&serv->sv_lock);
 
+	serv->sv_pooled = pooled;
+	serv->sv_nrpools = pooled ? svc_pool_map_get() : 1;
+	serv->sv_pools = kmalloc(serv->sv_nrpools * sizeof(struct svc_pool),
+				 GFP_KERNEL);
+	if (!serv->sv_pools) {
+		if (pooled)
+			svc_pool_map_put();
+		kfree(serv);
+		return NULL;
+	}
+	memset(serv->sv_pools, 0, serv->sv_nrpools * sizeof(struct svc_pool));
+	for (i = 0; i < serv->sv_nrpools; i++) {
+		struct svc_pool *pool = &serv->sv_pools[i];
+
+		pool->sp_id = i;
+		INIT_LIST_HEAD(&pool->sp_threads);
+		INIT_LIST_HEAD(&pool->sp_sockets);
+		INIT_LIST_HEAD(&pool->sp_pages);
+		spin_lock_init(&pool->sp_lock);
+	}
+
 	serv->sv_name      = prog->pg_name;
 
 	/* Remove any stale portmap registrations */
@@ -66,6 +291,22 @@ svc_create(struct svc_program *prog, unsigned int bufsize)
 	return serv;
 }
 
+struct svc_serv *
+svc_create(struct svc_program *prog, unsigned int bufsize)
+{
+	return __svc_create(prog, bufsize, 0);
+}
+
+/*
+ * Create an RPC service with a thread pool per cpu or per node,
+ * see svc_pool_map.  For services that run many threads.
+ */
+struct svc_serv *
+svc_create_pooled(struct svc_program *prog, unsigned int bufsize)
+{
+	return __svc_create(prog, bufsize, 1);
+}
+
 /*
  * Destroy an RPC service
  */
@@ -73,6 +314,8 @@ void
 svc_destroy(struct svc_serv *serv)
 {
 	struct svc_sock	*svsk;
+	struct page	*page;
+	unsigned int	i;
 
 	dprintk("RPC: svc_destroy(%s, %d)\n",
 				serv->sv_program->pg_name,
@@ -103,22 +346,34 @@ svc_destroy(struct svc_serv *serv)
 
 	/* Unregister service with the portmapper */
 	svc_register(serv, 0, 0);
+
+	for (i = 0; i < serv->sv_nrpools; i++) {
+		struct svc_pool *pool = &serv->sv_pools[i];
+
+		while (!list_empty(&pool->sp_pages)) {
+			page = list_entry(pool->sp_pages.next, struct page, lru);
+			list_del(&page->lru);
+			put_page(page);
+		}
+		pool->sp_nrpages = 0;
+	}
+	kfree(serv->sv_pools);
+	if (serv->sv_pooled)
+		svc_pool_map_put();
 	kfree(serv);
 }
 
 /*
  * Allocate an RPC server's buffer space.
- * We allocate pages and place them in rq_argpages.
+ * We allocate pages and place them in rq_argpages.  Only the pages an
+ * idle thread keeps are allocated here; svc_recv tops the buffer up
+ * once it has a socket to read from.
  */
 static int
-svc_init_buffer(struct svc_rqst *rqstp, unsigned int size)
+svc_init_buffer(struct svc_rqst *rqstp, int pages)
 {
-	int pages;
 	int arghi;
 	
-	if (size > RPCSVC_MAXPAYLOAD)
-		size = RPCSVC_MAXPAYLOAD;
-	pages = 2 + (size+ PAGE_SIZE -1) / PAGE_SIZE;
 	rqstp->rq_argused = 0;
 	rqstp->rq_resused = 0;
 	arghi = 0;
@@ -151,6 +406,36 @@ svc_release_buffer(struct svc_rqst *rqstp)
 	rqstp->rq_argused = 0;
 }
 
+/*
+ * Pick the pool with the fewest threads for a new thread.
+ */
+static struct svc_pool *
+svc_pool_next(struct svc_serv *serv)
+{
+	struct svc_pool *pool = &serv->sv_pools[0];
+	unsigned int i;
+
+	for (i = 1; i < serv->sv_nrpools; i++)
+		if (serv->sv_pools[i].sp_nrthreads < pool->sp_nrthreads)
+			pool = &serv->sv_pools[i];
+	return pool;
+}
+
+/*
+ * Bind a new server thread to the cpus of its pool, then run it.
+ */
+static int
+svc_thread_start(void *arg)
+{
+	struct svc_rqst *rqstp = arg;
+
+	if (rqstp->rq_server->sv_nrpools > 1)
+		set_cpus_allowed(current,
+			svc_pool_map.pool_mask[rqstp->rq_pool->sp_id]);
+	rqstp->rq_threadfn(rqstp);
+	return 0;
+}
+
 /*
  * Create a server thread
  */
@@ -158,6 +443,7 @@ int
 svc_create_thread(svc_thread_fn func, struct svc_serv *serv)
 {
 	struct svc_rqst	*rqstp;
+	struct svc_pool	*pool;
 	int		error = -ENOMEM;
 
 	rqstp = kmalloc(sizeof(*rqstp), GFP_KERNEL);
@@ -169,12 +455,20 @@ svc_create_thread(svc_thread_fn func, struct svc_serv *serv)
 
 	if (!(rqstp->rq_argp = (u32 *) kmalloc(serv->sv_xdrsize, GFP_KERNEL))
 	 || !(rqstp->rq_resp = (u32 *) kmalloc(serv->sv_xdrsize, GFP_KERNEL))
-	 || !svc_init_buffer(rqstp, serv->sv_bufsz))
+	 || !svc_init_buffer(rqstp, RPCSVC_IDLEPAGES))
 		goto out_thread;
 
 	serv->sv_nrthreads++;
 	rqstp->rq_server = serv;
-	error = kernel_thread((int (*)(void *)) func, rqstp, 0);
+	rqstp->rq_threadfn = func;
+
+	pool = svc_pool_next(serv);
+	spin_lock_bh(&pool->sp_lock);
+	pool->sp_nrthreads++;
+	spin_unlock_bh(&pool->sp_lock);
+	rqstp->rq_pool = pool;
+
+	error = kernel_thread(svc_thread_start, rqstp, 0);
 	if (error < 0)
 		goto out_thread;
 	svc_sock_update_bufs(serv);
@@ -194,6 +488,13 @@ void
 svc_exit_thread(struct svc_rqst *rqstp)
 {
 	struct svc_serv	*serv = rqstp->rq_server;
+	struct svc_pool	*pool = rqstp->rq_pool;
+
+	if (pool) {
+		spin_lock_bh(&pool->sp_lock);
+		pool->sp_nrthreads--;
+		spin_unlock_bh(&pool->sp_lock);
+	}
 
 	svc_release_buffer(rqstp);
 	if (rqstp->rq_resp)
@@ -474,3 +775,19 @@ err_bad:
 	svc_putu32(resv, rpc_stat);
 	goto sendit;
 }
+
+/*
+ * Return the largest payload (READ or WRITE data) that can go in a
+ * single request or reply on the transport this request came in on.
+ */
+u32
+svc_max_payload(const struct svc_rqst *rqstp)
+{
+	u32 max = RPCSVC_MAXPAYLOAD_TCP;
+
+	if (rqstp->rq_prot == IPPROTO_UDP)
+		max = RPCSVC_MAXPAYLOAD_UDP;
+	if (rqstp->rq_server->sv_bufsz < max)
+		max = rqstp->rq_server->sv_bufsz;
+	return max;
+}
@@ -46,7 +46,13 @@
 
 /* SMP locking strategy:
  *
- * 	svc_serv->sv_lock protects most stuff for that service.
+ *	svc_pool->sp_lock protects most of the fields of that pool:
+ *	its idle threads and ready sockets, and the sk_pool of sockets
+ *	queued on it.
+ *	svc_serv->sv_lock protects sv_tempsocks, sv_permsocks, sv_tmpcnt
+ *	and the sk_deferred lists.
+ *	sk_inuse and sk_reserved are atomic.  A socket holds one reference
+ *	to itself while it is on the sv_*socks lists.
  *
  *	Some flags can be set to certain values at any time
  *	providing that certain rules are followed:
@@ -63,6 +69,13 @@
 
 #define RPCDBG_FACILITY	RPCDBG_SVCSOCK
 
+/*
+ * Most send buffer a TCP connection asks for, see svc_tcp_recvfrom().
+ * Small payloads never reach it; with 1MB ones it keeps a few hundred
+ * threads from claiming a few hundred megabytes per connection.
+ */
+#define SVC_TCP_SNDBUF_MAX	(8*1024*1024u)
+
 
 static struct svc_sock *svc_setup_socket(struct svc_serv *, struct socket *,
 					 int *errp, int pmap_reg);
@@ -75,22 +88,22 @@ static int svc_deferred_recv(struct svc_rqst *rqstp);
 static struct cache_deferred_req *svc_defer(struct cache_req *req);
 
 /*
- * Queue up an idle server thread.  Must have serv->sv_lock held.
+ * Queue up an idle server thread.  Must have pool->sp_lock held.
  * Note: this is really a stack rather than a queue, so that we only
  * use as many different threads as we need, and the rest don't polute
  * the cache.
  */
 static inline void
-svc_serv_enqueue(struct svc_serv *serv, struct svc_rqst *rqstp)
+svc_thread_enqueue(struct svc_pool *pool, struct svc_rqst *rqstp)
 {
-	list_add(&rqstp->rq_list, &serv->sv_threads);
+	list_add(&rqstp->rq_list, &pool->sp_threads);
 }
 
 /*
- * Dequeue an nfsd thread.  Must have serv->sv_lock held.
+ * Dequeue an nfsd thread.  Must have pool->sp_lock held.
  */
 static inline void
-svc_serv_dequeue(struct svc_serv *serv, struct svc_rqst *rqstp)
+svc_thread_dequeue(struct svc_pool *pool, struct svc_rqst *rqstp)
 {
 	list_del(&rqstp->rq_list);
 }
@@ -132,16 +145,37 @@ svc_sock_wspace(struct svc_sock *svsk)
 	return wspace;
 }
 
+/*
+ * Buffer space one request on this socket may need.  A UDP request or
+ * reply cannot be larger than a datagram, so services with large TCP
+ * payloads don't get to size (and reserve) their UDP sockets for them.
+ */
+static inline unsigned int
+svc_sock_bufsz(struct svc_sock *svsk)
+{
+	unsigned int bufsz = svsk->sk_server->sv_bufsz;
+
+	if (svsk->sk_sock->type == SOCK_DGRAM &&
+	    bufsz > RPCSVC_MAXPAYLOAD_UDP + PAGE_SIZE)
+		bufsz = RPCSVC_MAXPAYLOAD_UDP + PAGE_SIZE;
+	return bufsz;
+}
+
 /*
  * Queue up a socket with data pending. If there are idle nfsd
  * processes, wake 'em up.
  *
+ * The socket goes to the pool of the cpu we are running on, which for
+ * the data_ready callbacks is the cpu that received the data.
  */
 static void
 svc_sock_enqueue(struct svc_sock *svsk)
 {
 	struct svc_serv	*serv = svsk->sk_server;
+	struct svc_pool *pool;
 	struct svc_rqst	*rqstp;
+	unsigned int	bufsz = svc_sock_bufsz(svsk);
+	int cpu;
 
 	if (!(svsk->sk_flags &
 	      ( (1<<SK_CONN)|(1<<SK_DATA)|(1<<SK_CLOSE)|(1<<SK_DEFERRED)) ))
@@ -149,10 +183,14 @@ svc_sock_enqueue(struct svc_sock *svsk)
 	if (test_bit(SK_DEAD, &svsk->sk_flags))
 		return;
 
-	spin_lock_bh(&serv->sv_lock);
+	cpu = get_cpu();
+	pool = svc_pool_for_cpu(serv, cpu);
+	put_cpu();
 
-	if (!list_empty(&serv->sv_threads) && 
-	    !list_empty(&serv->sv_sockets))
+	spin_lock_bh(&pool->sp_lock);
+
+	if (!list_empty(&pool->sp_threads) &&
+	    !list_empty(&pool->sp_sockets))
 		printk(KERN_ERR
 			"svc_sock_enqueue: threads and sockets both waiting??\n");
 
@@ -162,73 +200,80 @@ svc_sock_enqueue(struct svc_sock *svsk)
 		goto out_unlock;
 	}
 
-	if (test_bit(SK_BUSY, &svsk->sk_flags)) {
+	/* Mark socket as busy. It will remain in this state until the
+	 * server has processed all pending data and put the socket back
+	 * on the idle list.  We update SK_BUSY atomically because
+	 * it also guards against trying to enqueue the svc_sock twice
+	 * from pools on different cpus.
+	 */
+	if (test_and_set_bit(SK_BUSY, &svsk->sk_flags)) {
 		/* Don't enqueue socket while daemon is receiving */
 		dprintk("svc: socket %p busy, not enqueued\n", svsk->sk_sk);
 		goto out_unlock;
 	}
+	BUG_ON(svsk->sk_pool != NULL);
+	svsk->sk_pool = pool;
 
 	set_bit(SOCK_NOSPACE, &svsk->sk_sock->flags);
-	if (((svsk->sk_reserved + serv->sv_bufsz)*2
+	if (((atomic_read(&svsk->sk_reserved) + bufsz)*2
 	     > svc_sock_wspace(svsk))
 	    && !test_bit(SK_CLOSE, &svsk->sk_flags)
 	    && !test_bit(SK_CONN, &svsk->sk_flags)) {
 		/* Don't enqueue while not enough space for reply */
 		dprintk("svc: socket %p  no space, %d*2 > %ld, not enqueued\n",
-			svsk->sk_sk, svsk->sk_reserved+serv->sv_bufsz,
+			svsk->sk_sk, atomic_read(&svsk->sk_reserved)+bufsz,
 			svc_sock_wspace(svsk));
+		svsk->sk_pool = NULL;
+		clear_bit(SK_BUSY, &svsk->sk_flags);
 		goto out_unlock;
 	}
 	clear_bit(SOCK_NOSPACE, &svsk->sk_sock->flags);
 
-	/* Mark socket as busy. It will remain in this state until the
-	 * server has processed all pending data and put the socket back
-	 * on the idle list.
-	 */
-	set_bit(SK_BUSY, &svsk->sk_flags);
-
-	if (!list_empty(&serv->sv_threads)) {
-		rqstp = list_entry(serv->sv_threads.next,
+	pool->sp_packets++;
+	if (!list_empty(&pool->sp_threads)) {
+		rqstp = list_entry(pool->sp_threads.next,
 				   struct svc_rqst,
 				   rq_list);
 		dprintk("svc: socket %p served by daemon %p\n",
 			svsk->sk_sk, rqstp);
-		svc_serv_dequeue(serv, rqstp);
+		svc_thread_dequeue(pool, rqstp);
 		if (rqstp->rq_sock)
 			printk(KERN_ERR 
 				"svc_sock_enqueue: server %p, rq_sock=%p!\n",
 				rqstp, rqstp->rq_sock);
 		rqstp->rq_sock = svsk;
-		svsk->sk_inuse++;
-		rqstp->rq_reserved = serv->sv_bufsz;
-		svsk->sk_reserved += rqstp->rq_reserved;
+		atomic_inc(&svsk->sk_inuse);
+		rqstp->rq_reserved = bufsz;
+		atomic_add(rqstp->rq_reserved, &svsk->sk_reserved);
+		pool->sp_threads_woken++;
 		wake_up(&rqstp->rq_wait);
 	} else {
 		dprintk("svc: socket %p put into queue\n", svsk->sk_sk);
-		list_add_tail(&svsk->sk_ready, &serv->sv_sockets);
+		list_add_tail(&svsk->sk_ready, &pool->sp_sockets);
+		pool->sp_queued++;
 	}
 
 out_unlock:
-	spin_unlock_bh(&serv->sv_lock);
+	spin_unlock_bh(&pool->sp_lock);
 }
 
 /*
- * Dequeue the first socket.  Must be called with the serv->sv_lock held.
+ * Dequeue the first socket.  Must be called with the pool->sp_lock held.
  */
 static inline struct svc_sock *
-svc_sock_dequeue(struct svc_serv *serv)
+svc_sock_dequeue(struct svc_pool *pool)
 {
 	struct svc_sock	*svsk;
 
-	if (list_empty(&serv->sv_sockets))
+	if (list_empty(&pool->sp_sockets))
 		return NULL;
 
-	svsk = list_entry(serv->sv_sockets.next,
+	svsk = list_entry(pool->sp_sockets.next,
 			  struct svc_sock, sk_ready);
 	list_del_init(&svsk->sk_ready);
 
 	dprintk("svc: socket %p dequeued, inuse=%d\n",
-		svsk->sk_sk, svsk->sk_inuse);
+		svsk->sk_sk, atomic_read(&svsk->sk_inuse));
 
 	return svsk;
 }
@@ -242,6 +287,7 @@ svc_sock_dequeue(struct svc_serv *serv)
 static inline void
 svc_sock_received(struct svc_sock *svsk)
 {
+	svsk->sk_pool = NULL;
 	clear_bit(SK_BUSY, &svsk->sk_flags);
 	svc_sock_enqueue(svsk);
 }
@@ -263,10 +309,8 @@ void svc_reserve(struct svc_rqst *rqstp, int space)
 
 	if (space < rqstp->rq_reserved) {
 		struct svc_sock *svsk = rqstp->rq_sock;
-		spin_lock_bh(&svsk->sk_server->sv_lock);
-		svsk->sk_reserved -= (rqstp->rq_reserved - space);
+		atomic_sub((rqstp->rq_reserved - space), &svsk->sk_reserved);
 		rqstp->rq_reserved = space;
-		spin_unlock_bh(&svsk->sk_server->sv_lock);
 
 		svc_sock_enqueue(svsk);
 	}
@@ -278,17 +322,12 @@ void svc_reserve(struct svc_rqst *rqstp, int space)
 static inline void
 svc_sock_put(struct svc_sock *svsk)
 {
-	struct svc_serv *serv = svsk->sk_server;
-
-	spin_lock_bh(&serv->sv_lock);
-	if (!--(svsk->sk_inuse) && test_bit(SK_DEAD, &svsk->sk_flags)) {
-		spin_unlock_bh(&serv->sv_lock);
+	if (atomic_dec_and_test(&svsk->sk_inuse) &&
+	    test_bit(SK_DEAD, &svsk->sk_flags)) {
 		dprintk("svc: releasing dead socket\n");
 		sock_release(svsk->sk_sock);
 		kfree(svsk);
 	}
-	else
-		spin_unlock_bh(&serv->sv_lock);
 }
 
 static void
@@ -321,26 +360,34 @@ svc_sock_release(struct svc_rqst *rqstp)
 }
 
 /*
- * External function to wake up a server waiting for data
+ * External function to wake up a server waiting for data.
+ * This really only makes sense for services like lockd
+ * which have exactly one thread anyway.
  */
 void
 svc_wake_up(struct svc_serv *serv)
 {
 	struct svc_rqst	*rqstp;
-
-	spin_lock_bh(&serv->sv_lock);
-	if (!list_empty(&serv->sv_threads)) {
-		rqstp = list_entry(serv->sv_threads.next,
-				   struct svc_rqst,
-				   rq_list);
-		dprintk("svc: daemon %p woken up.\n", rqstp);
-		/*
-		svc_serv_dequeue(serv, rqstp);
-		rqstp->rq_sock = NULL;
-		 */
-		wake_up(&rqstp->rq_wait);
+	struct svc_pool *pool;
+	unsigned int i;
+
+	for (i = 0; i < serv->sv_nrpools; i++) {
+		pool = &serv->sv_pools[i];
+
+		spin_lock_bh(&pool->sp_lock);
+		if (!list_empty(&pool->sp_threads)) {
+			rqstp = list_entry(pool->sp_threads.next,
+					   struct svc_rqst,
+					   rq_list);
+			dprintk("svc: daemon %p woken up.\n", rqstp);
+			/*
+			svc_thread_dequeue(pool, rqstp);
+			rqstp->rq_sock = NULL;
+			 */
+			wake_up(&rqstp->rq_wait);
+		}
+		spin_unlock_bh(&pool->sp_lock);
 	}
-	spin_unlock_bh(&serv->sv_lock);
 }
 
 /*
@@ -574,8 +621,8 @@ svc_udp_recvfrom(struct svc_rqst *rqstp)
 	     * for one reply per thread.
 	     */
 	    svc_sock_setbufsize(svsk->sk_sock,
-				(serv->sv_nrthreads+3) * serv->sv_bufsz,
-				(serv->sv_nrthreads+3) * serv->sv_bufsz);
+				(serv->sv_nrthreads+3) * svc_sock_bufsz(svsk),
+				(serv->sv_nrthreads+3) * svc_sock_bufsz(svsk));
 
 	if ((rqstp->rq_deferred = svc_deferred_dequeue(svsk))) {
 		svc_sock_received(svsk);
@@ -676,8 +723,8 @@ svc_udp_init(struct svc_sock *svsk)
 	 * svc_udp_recvfrom will re-adjust if necessary
 	 */
 	svc_sock_setbufsize(svsk->sk_sock,
-			    3 * svsk->sk_server->sv_bufsz,
-			    3 * svsk->sk_server->sv_bufsz);
+			    3 * svc_sock_bufsz(svsk),
+			    3 * svc_sock_bufsz(svsk));
 
 	set_bit(SK_DATA, &svsk->sk_flags); /* might have come in before data_ready set up */
 	set_bit(SK_CHNGBUF, &svsk->sk_flags);
@@ -844,7 +891,7 @@ svc_tcp_accept(struct svc_sock *svsk)
 						  struct svc_sock,
 						  sk_list);
 			set_bit(SK_CLOSE, &svsk->sk_flags);
-			svsk->sk_inuse ++;
+			atomic_inc(&svsk->sk_inuse);
 		}
 		spin_unlock_bh(&serv->sv_lock);
 
@@ -874,7 +921,7 @@ svc_tcp_recvfrom(struct svc_rqst *rqstp)
 	struct svc_sock	*svsk = rqstp->rq_sock;
 	struct svc_serv	*serv = svsk->sk_server;
 	int		len;
-	struct iovec vec[RPCSVC_MAXPAGES];
+	struct iovec *vec = rqstp->rq_vec;
 	int pnum, vlen;
 
 	dprintk("svc: tcp_recv %p data %d conn %d close %d\n",
@@ -898,17 +945,26 @@ svc_tcp_recvfrom(struct svc_rqst *rqstp)
 		return 0;
 	}
 
-	if (test_and_clear_bit(SK_CHNGBUF, &svsk->sk_flags))
+	if (test_and_clear_bit(SK_CHNGBUF, &svsk->sk_flags)) {
 		/* sndbuf needs to have room for one request
 		 * per thread, otherwise we can stall even when the
-		 * network isn't a bottleneck.
+		 * network isn't a bottleneck.  Up to
+		 * SVC_TCP_SNDBUF_MAX, and never less than the
+		 * three requests a new connection starts with.
 		 * rcvbuf just needs to be able to hold a few requests.
 		 * Normally they will be removed from the queue 
 		 * as soon a a complete request arrives.
 		 */
+		unsigned int nreqs = serv->sv_nrthreads + 3;
+
+		if (nreqs > SVC_TCP_SNDBUF_MAX / serv->sv_bufsz)
+			nreqs = SVC_TCP_SNDBUF_MAX / serv->sv_bufsz;
+		if (nreqs < 3)
+			nreqs = 3;
 		svc_sock_setbufsize(svsk->sk_sock,
-				    (serv->sv_nrthreads+3) * serv->sv_bufsz,
+				    nreqs * serv->sv_bufsz,
 				    3 * serv->sv_bufsz);
+	}
 
 	clear_bit(SK_DATA, &svsk->sk_flags);
 
@@ -1117,37 +1173,57 @@ svc_sock_update_bufs(struct svc_serv *serv)
 }
 
 /*
- * Receive the next request on any socket.
+ * An idle thread gives all but RPCSVC_IDLEPAGES of its pages to the
+ * pool, so that a few hundred mostly idle nfsd threads don't each sit
+ * on a megabyte.  Called with sp_lock held.
  */
-int
-svc_recv(struct svc_serv *serv, struct svc_rqst *rqstp, long timeout)
+static void
+svc_pool_put_pages(struct svc_pool *pool, struct svc_rqst *rqstp)
 {
-	struct svc_sock		*svsk =NULL;
-	int			len;
-	int 			pages;
-	struct xdr_buf		*arg;
-	DECLARE_WAITQUEUE(wait, current);
-
-	dprintk("svc: server %p waiting for data (to = %ld)\n",
-		rqstp, timeout);
-
-	if (rqstp->rq_sock)
-		printk(KERN_ERR 
-			"svc_recv: service %p, socket not NULL!\n",
-			 rqstp);
-	if (waitqueue_active(&rqstp->rq_wait))
-		printk(KERN_ERR 
-			"svc_recv: service %p, wait queue active!\n",
-			 rqstp);
+	struct page *p;
+
+	while (rqstp->rq_arghi > RPCSVC_IDLEPAGES) {
+		p = rqstp->rq_argpages[--rqstp->rq_arghi];
+		if (pool->sp_nrpages < RPCSVC_POOL_REQS * RPCSVC_MAXPAGES) {
+			list_add(&p->lru, &pool->sp_pages);
+			pool->sp_nrpages++;
+		} else
+			put_page(p);
+	}
+}
 
-	/* Initialize the buffers */
-	/* first reclaim pages that were moved to response list */
-	svc_pushback_allpages(rqstp);
+/*
+ * Make sure the thread has enough pages to receive a request from
+ * svsk and build the reply, preferring pages other threads of the
+ * pool have given back, and point rq_arg at them.
+ */
+static void
+svc_fill_buffer(struct svc_rqst *rqstp, struct svc_sock *svsk)
+{
+	struct svc_pool		*pool = rqstp->rq_pool;
+	struct xdr_buf		*arg;
+	struct page		*p;
+	int			pages;
+
+	pages = 2 + (svc_sock_bufsz(svsk) + PAGE_SIZE -1) / PAGE_SIZE;
+	if (pages > RPCSVC_MAXPAGES)
+		pages = RPCSVC_MAXPAGES;
+
+	if (rqstp->rq_arghi < pages && pool->sp_nrpages) {
+		spin_lock_bh(&pool->sp_lock);
+		while (rqstp->rq_arghi < pages &&
+		       !list_empty(&pool->sp_pages)) {
+			p = list_entry(pool->sp_pages.next, struct page, lru);
+			list_del(&p->lru);
+			pool->sp_nrpages--;
+			rqstp->rq_argpages[rqstp->rq_arghi++] = p;
+		}
+		spin_unlock_bh(&pool->sp_lock);
+	}
 
 	/* now allocate needed pages.  If we get a failure, sleep briefly */
-	pages = 2 + (serv->sv_bufsz + PAGE_SIZE -1) / PAGE_SIZE;
 	while (rqstp->rq_arghi < pages) {
-		struct page *p = alloc_page(GFP_KERNEL);
+		p = alloc_page(GFP_KERNEL);
 		if (!p) {
 			set_current_state(TASK_UNINTERRUPTIBLE);
 			schedule_timeout(HZ/2);
@@ -1167,36 +1243,79 @@ svc_recv(struct svc_serv *serv, struct svc_rqst *rqstp, long timeout)
 	arg->page_len = (pages-2)*PAGE_SIZE;
 	arg->len = (pages-1)*PAGE_SIZE;
 	arg->tail[0].iov_len = 0;
-	
+}
+
+/*
+ * Receive the next request on any socket.
+ */
+int
+svc_recv(struct svc_serv *serv, struct svc_rqst *rqstp, long timeout)
+{
+	struct svc_sock		*svsk =NULL;
+	struct svc_pool		*pool = rqstp->rq_pool;
+	int			len;
+	DECLARE_WAITQUEUE(wait, current);
+
+	dprintk("svc: server %p waiting for data (to = %ld)\n",
+		rqstp, timeout);
+
+	if (rqstp->rq_sock)
+		printk(KERN_ERR 
+			"svc_recv: service %p, socket not NULL!\n",
+			 rqstp);
+	if (waitqueue_active(&rqstp->rq_wait))
+		printk(KERN_ERR 
+			"svc_recv: service %p, wait queue active!\n",
+			 rqstp);
+
+	/* Initialize the buffers */
+	/* first reclaim pages that were moved to response list */
+	svc_pushback_allpages(rqstp);
+
 	if (signalled())
 		return -EINTR;
 
-	spin_lock_bh(&serv->sv_lock);
-	if (!list_empty(&serv->sv_tempsocks)) {
-		svsk = list_entry(serv->sv_tempsocks.next,
-				  struct svc_sock, sk_list);
-		/* apparently the "standard" is that clients close
-		 * idle connections after 5 minutes, servers after
-		 * 6 minutes
-		 *   http://www.connectathon.org/talks96/nfstcp.pdf 
-		 */
-		if (get_seconds() - svsk->sk_lastrecv < 6*60
-		    || test_bit(SK_BUSY, &svsk->sk_flags))
-			svsk = NULL;
+	/*
+	 * Look for an idle temporary socket to close.  The oldest one is
+	 * at the head of sv_tempsocks; checking at most once a second
+	 * keeps the threads of all pools off sv_lock most of the time.
+	 */
+	if (!list_empty(&serv->sv_tempsocks) &&
+	    serv->sv_tempcheck != get_seconds()) {
+		serv->sv_tempcheck = get_seconds();
+		spin_lock_bh(&serv->sv_lock);
+		if (!list_empty(&serv->sv_tempsocks)) {
+			svsk = list_entry(serv->sv_tempsocks.next,
+					  struct svc_sock, sk_list);
+			/* apparently the "standard" is that clients close
+			 * idle connections after 5 minutes, servers after
+			 * 6 minutes
+			 *   http://www.connectathon.org/talks96/nfstcp.pdf 
+			 */
+			if (get_seconds() - svsk->sk_lastrecv < 6*60
+			    || test_and_set_bit(SK_BUSY, &svsk->sk_flags))
+				svsk = NULL;
+		}
+		if (svsk) {
+			set_bit(SK_CLOSE, &svsk->sk_flags);
+			rqstp->rq_sock = svsk;
+			atomic_inc(&svsk->sk_inuse);
+		}
+		spin_unlock_bh(&serv->sv_lock);
 	}
+
+	spin_lock_bh(&pool->sp_lock);
 	if (svsk) {
-		set_bit(SK_BUSY, &svsk->sk_flags);
-		set_bit(SK_CLOSE, &svsk->sk_flags);
+		/* closing an idle temporary socket */
+	} else if ((svsk = svc_sock_dequeue(pool)) != NULL) {
 		rqstp->rq_sock = svsk;
-		svsk->sk_inuse++;
-	} else if ((svsk = svc_sock_dequeue(serv)) != NULL) {
-		rqstp->rq_sock = svsk;
-		svsk->sk_inuse++;
-		rqstp->rq_reserved = serv->sv_bufsz;	
-		svsk->sk_reserved += rqstp->rq_reserved;
+		atomic_inc(&svsk->sk_inuse);
+		rqstp->rq_reserved = svc_sock_bufsz(svsk);
+		atomic_add(rqstp->rq_reserved, &svsk->sk_reserved);
 	} else {
 		/* No data pending. Go to sleep */
-		svc_serv_enqueue(serv, rqstp);
+		svc_pool_put_pages(pool, rqstp);
+		svc_thread_enqueue(pool, rqstp);
 
 		/*
 		 * We have to be able to interrupt this wait
@@ -1204,27 +1323,29 @@ svc_recv(struct svc_serv *serv, struct svc_rqst *rqstp, long timeout)
 		 */
 		set_current_state(TASK_INTERRUPTIBLE);
 		add_wait_queue(&rqstp->rq_wait, &wait);
-		spin_unlock_bh(&serv->sv_lock);
+		spin_unlock_bh(&pool->sp_lock);
 
 		schedule_timeout(timeout);
 
 		if (current->flags & PF_FREEZE)
 			refrigerator(PF_IOTHREAD);
 
-		spin_lock_bh(&serv->sv_lock);
+		spin_lock_bh(&pool->sp_lock);
 		remove_wait_queue(&rqstp->rq_wait, &wait);
 
 		if (!(svsk = rqstp->rq_sock)) {
-			svc_serv_dequeue(serv, rqstp);
-			spin_unlock_bh(&serv->sv_lock);
+			svc_thread_dequeue(pool, rqstp);
+			spin_unlock_bh(&pool->sp_lock);
 			dprintk("svc: server %p, no data yet\n", rqstp);
 			return signalled()? -EINTR : -EAGAIN;
 		}
 	}
-	spin_unlock_bh(&serv->sv_lock);
+	spin_unlock_bh(&pool->sp_lock);
+
+	svc_fill_buffer(rqstp, svsk);
 
 	dprintk("svc: server %p, socket %p, inuse=%d\n",
-		 rqstp, svsk, svsk->sk_inuse);
+		 rqstp, svsk, atomic_read(&svsk->sk_inuse));
 	len = svsk->sk_recvfrom(rqstp);
 	dprintk("svc: got len=%d\n", len);
 
@@ -1233,14 +1354,17 @@ svc_recv(struct svc_serv *serv, struct svc_rqst *rqstp, long timeout)
 		svc_sock_release(rqstp);
 		return -EAGAIN;
 	}
-	svsk->sk_lastrecv = get_seconds();
-	if (test_bit(SK_TEMP, &svsk->sk_flags)) {
-		/* push active sockets to end of list */
+	if (test_bit(SK_TEMP, &svsk->sk_flags) &&
+	    svsk->sk_lastrecv != get_seconds()) {
+		/* push active sockets to end of list; the list is only
+		 * ordered to the second, so once a second will do */
+		svsk->sk_lastrecv = get_seconds();
 		spin_lock_bh(&serv->sv_lock);
 		if (!list_empty(&svsk->sk_list))
 			list_move_tail(&svsk->sk_list, &serv->sv_tempsocks);
 		spin_unlock_bh(&serv->sv_lock);
 	}
+	svsk->sk_lastrecv = get_seconds();
 
 	rqstp->rq_secure  = ntohs(rqstp->rq_addr.sin_port) < 1024;
 	rqstp->rq_chandle.defer = svc_defer;
@@ -1338,6 +1462,7 @@ svc_setup_socket(struct svc_serv *serv, struct socket *sock,
 	svsk->sk_owspace = inet->sk_write_space;
 	svsk->sk_server = serv;
 	svsk->sk_lastrecv = get_seconds();
+	atomic_set(&svsk->sk_inuse, 1);	/* for the sv_*socks list */
 	INIT_LIST_HEAD(&svsk->sk_deferred);
 	INIT_LIST_HEAD(&svsk->sk_ready);
 	sema_init(&svsk->sk_sem, 1);
@@ -1437,20 +1562,21 @@ svc_delete_socket(struct svc_sock *svsk)
 	spin_lock_bh(&serv->sv_lock);
 
 	list_del_init(&svsk->sk_list);
-	list_del_init(&svsk->sk_ready);
-	if (!test_and_set_bit(SK_DEAD, &svsk->sk_flags))
+	/*
+	 * We don't take the socket off the ready list of its pool: it
+	 * is only still queued when called from svc_destroy, which is
+	 * about to free the pools anyway.
+	 */
+	if (!test_and_set_bit(SK_DEAD, &svsk->sk_flags)) {
 		if (test_bit(SK_TEMP, &svsk->sk_flags))
 			serv->sv_tmpcnt--;
-
-	if (!svsk->sk_inuse) {
 		spin_unlock_bh(&serv->sv_lock);
-		sock_release(svsk->sk_sock);
-		kfree(svsk);
-	} else {
+		/* drop the reference of the sv_*socks list */
+		if (atomic_read(&svsk->sk_inuse) > 1)
+			dprintk(KERN_NOTICE "svc: server socket destroy delayed\n");
+		svc_sock_put(svsk);
+	} else
 		spin_unlock_bh(&serv->sv_lock);
-		dprintk(KERN_NOTICE "svc: server socket destroy delayed\n");
-		/* svsk->sk_server = NULL; */
-	}
 }
 
 /*
@@ -1519,10 +1645,8 @@ svc_defer(struct cache_req *req)
 		dr->argslen = rqstp->rq_arg.len >> 2;
 		memcpy(dr->args, rqstp->rq_arg.head[0].iov_base-skip, dr->argslen<<2);
 	}
-	spin_lock(&rqstp->rq_server->sv_lock);
-	rqstp->rq_sock->sk_inuse++;
+	atomic_inc(&rqstp->rq_sock->sk_inuse);
 	dr->svsk = rqstp->rq_sock;
-	spin_unlock(&rqstp->rq_server->sv_lock);
 
 	dr->handle.revisit = svc_revisit;
 	return &dr->handle;
@@ -58,7 +58,10 @@
 #include <linux/tcp.h>
 #include <linux/unistd.h>
 #include <linux/sunrpc/clnt.h>
+#include <linux/sunrpc/stats.h>
 #include <linux/file.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 #include <net/sock.h>
 #include <net/checksum.h>
@@ -76,6 +79,12 @@
 
 #define XPRT_MAX_BACKOFF	(8)
 
+/*
+ * All transports, for /proc/net/rpc/xprt
+ */
+static LIST_HEAD(all_xprts);
+static spinlock_t all_xprts_lock = SPIN_LOCK_UNLOCKED;
+
 /*
  * Local functions
  */
@@ -450,6 +459,7 @@ xprt_connect(struct rpc_task *task)
 	}
 	xprt_bind_socket(xprt, sock);
 	xprt_sock_setbufsize(xprt);
+	xprt->stat_connects++;
 
 	if (!xprt->stream)
 		goto out_write;
@@ -610,6 +620,7 @@ xprt_complete_rqst(struct rpc_xprt *xprt, struct rpc_rqst *req, int copied)
 #endif
 
 	dprintk("RPC: %4d has input (%d bytes)\n", task->tk_pid, copied);
+	xprt->stat_recvs++;
 	req->rq_received = copied;
 	list_del_init(&req->rq_list);
 
@@ -1222,6 +1233,7 @@ xprt_transmit(struct rpc_task *task)
 	dprintk("RPC: %4d xmit complete\n", task->tk_pid);
 	/* Set the task's receive timeout value */
 	spin_lock_bh(&xprt->sock_lock);
+	xprt->stat_sends++;
 	if (!xprt->nocong) {
 		int timer = task->tk_msg.rpc_proc->p_timer;
 		task->tk_timeout = rpc_calc_rto(&clnt->cl_rtt, timer);
@@ -1241,13 +1253,50 @@ xprt_transmit(struct rpc_task *task)
 	spin_unlock_bh(&xprt->sock_lock);
 }
 
+/*
+ * Pick the transport for a new request of a client with several of
+ * them: the one with the most free request slots, with congested
+ * transports last.  The search starts at a different transport each
+ * time so that equally loaded ones take turns.  The slot counts are
+ * read without locking; a wrong guess only costs a wait on that
+ * transport's backlog.
+ */
+static struct rpc_xprt *
+xprt_select(struct rpc_clnt *clnt)
+{
+	struct rpc_xprt	*xprt, *best = NULL;
+	unsigned int	i, start, load, bestload = 0;
+
+	if (clnt->cl_nxprts <= 1)
+		return clnt->cl_xprt;
+
+	start = clnt->cl_xprtnext++;
+	for (i = 0; i < clnt->cl_nxprts; i++) {
+		xprt = clnt->cl_xprts[(start + i) % clnt->cl_nxprts];
+		if (xprt->shutdown)
+			continue;
+		load = xprt->inuse;
+		if (!xprt->nocong && RPCXPRT_CONGESTED(xprt))
+			load += RPC_MAXREQS;
+		if (!best || load < bestload) {
+			best = xprt;
+			bestload = load;
+		}
+	}
+	return best ? best : clnt->cl_xprt;
+}
+
 /*
  * Reserve an RPC call slot.
  */
 void
 xprt_reserve(struct rpc_task *task)
 {
-	struct rpc_xprt	*xprt = task->tk_xprt;
+	struct rpc_xprt	*xprt;
+
+	if (!task->tk_rqstp)
+		task->tk_xprt = xprt_select(task->tk_client);
+	xprt = task->tk_xprt;
 
 	task->tk_status = -EIO;
 	if (!xprt->shutdown) {
@@ -1270,10 +1319,12 @@ do_xprt_reserve(struct rpc_task *task)
 		xprt->free = req->rq_next;
 		req->rq_next = NULL;
 		task->tk_rqstp = req;
+		xprt->inuse++;
 		xprt_request_init(task, xprt);
 		return;
 	}
 	dprintk("RPC:      waiting for request slot\n");
+	xprt->stat_backlog++;
 	task->tk_status = -EAGAIN;
 	task->tk_timeout = 0;
 	rpc_sleep_on(&xprt->backlog, task, NULL, NULL);
@@ -1342,6 +1393,7 @@ xprt_release(struct rpc_task *task)
 	spin_lock(&xprt->xprt_lock);
 	req->rq_next = xprt->free;
 	xprt->free   = req;
+	xprt->inuse--;
 
 	xprt_clear_backlog(xprt);
 	spin_unlock(&xprt->xprt_lock);
@@ -1425,6 +1477,10 @@ xprt_setup(int proto, struct sockaddr_in *ap, struct rpc_timeout *to)
 	/* Check whether we want to use a reserved port */
 	xprt->resvport = capable(CAP_NET_BIND_SERVICE) ? 1 : 0;
 
+	spin_lock(&all_xprts_lock);
+	list_add_tail(&xprt->all_xprts, &all_xprts);
+	spin_unlock(&all_xprts_lock);
+
 	dprintk("RPC:      created transport %p\n", xprt);
 	
 	return xprt;
@@ -1605,7 +1661,117 @@ xprt_destroy(struct rpc_xprt *xprt)
 	dprintk("RPC:      destroying transport %p\n", xprt);
 	xprt_shutdown(xprt);
 	xprt_close(xprt);
+	spin_lock(&all_xprts_lock);
+	list_del(&xprt->all_xprts);
+	spin_unlock(&all_xprts_lock);
 	kfree(xprt);
 
 	return 0;
 }
+
+#ifdef CONFIG_PROC_FS
+/*
+ * /proc/net/rpc/xprt: one line per client transport, so that the
+ * connections of a multi-transport client can be told apart.
+ */
+static void *
+xprt_seq_start(struct seq_file *m, loff_t *pos)
+{
+	struct list_head *p;
+	loff_t n = *pos;
+
+	spin_lock(&all_xprts_lock);
+	if (!n--)
+		return SEQ_START_TOKEN;
+	list_for_each(p, &all_xprts)
+		if (!n--)
+			return list_entry(p, struct rpc_xprt, all_xprts);
+	return NULL;
+}
+
+static void *
+xprt_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	struct list_head *p;
+
+	++*pos;
+	if (v == SEQ_START_TOKEN)
+		p = all_xprts.next;
+	else
+		p = ((struct rpc_xprt *)v)->all_xprts.next;
+	if (p == &all_xprts)
+		return NULL;
+	return list_entry(p, struct rpc_xprt, all_xprts);
+}
+
+static void
+xprt_seq_stop(struct seq_file *m, void *v)
+{
+	spin_unlock(&all_xprts_lock);
+}
+
+static int
+xprt_seq_show(struct seq_file *m, void *v)
+{
+	struct rpc_xprt *xprt = v;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(m, "# addr port proto connected inuse cong cwnd"
+			    " connects sends recvs backlog\n");
+		return 0;
+	}
+	seq_printf(m, "%u.%u.%u.%u %u %s %d %u %lu %lu %lu %lu %lu %lu\n",
+			NIPQUAD(xprt->addr.sin_addr.s_addr),
+			ntohs(xprt->addr.sin_port),
+			xprt->stream ? "tcp" : "udp",
+			xprt_connected(xprt) ? 1 : 0,
+			xprt->inuse,
+			xprt->cong, xprt->cwnd,
+			xprt->stat_connects,
+			xprt->stat_sends,
+			xprt->stat_recvs,
+			xprt->stat_backlog);
+	return 0;
+}
+
+static struct seq_operations xprt_seq_ops = {
+	.start	= xprt_seq_start,
+	.next	= xprt_seq_next,
+	.stop	= xprt_seq_stop,
+	.show	= xprt_seq_show,
+};
+
+static int
+xprt_seq_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &xprt_seq_ops);
+}
+
+static struct file_operations xprt_proc_fops = {
+	.open		= xprt_seq_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+int
+xprt_proc_init(void)
+{
+	struct proc_dir_entry *p;
+
+	if (!proc_net_rpc)
+		return -ENOENT;
+	p = create_proc_entry("xprt", S_IRUGO, proc_net_rpc);
+	if (!p)
+		return -ENOMEM;
+	p->proc_fops = &xprt_proc_fops;
+	return 0;
+}
+
+void
+xprt_proc_exit(void)
+{
+	if (proc_net_rpc)
+		remove_proc_entry("xprt", proc_net_rpc);
+}
+#endif /* CONFIG_PROC_FS */